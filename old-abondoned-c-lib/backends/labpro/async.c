@@ -0,0 +1,397 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/async.h"
+#include "backends/labpro/labpro-internal.h"
+#include "backends/labpro/transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NDEBUG
+#define DEBUG
+#endif
+
+/* An IN transfer is not resubmitted after this many consecutive errors. This is
+ * the same limit the synchronous read loop used to have.
+ */
+#define LABPRO_ASYNC_MAX_ERRORS 5
+
+/* Drop a reference, and free the engine and its transfers with the last
+ * one. Returns whether it did. libusb allows freeing a transfer from its
+ * own callback.
+ */
+static bool LabPro_async_release(LabPro_Async_Engine* engine) {
+    if (atomic_fetch_sub(&engine->references, 1) != 1)
+        return false;
+    
+    for (int i = 0; i < engine->num_in_transfers; ++i)
+        libusb_free_transfer(engine->in_transfers[i]);
+    libusb_free_transfer(engine->out_transfer);
+    free(engine);
+    return true;
+}
+
+/* An IN transfer that isn't resubmitted gives up its reference. */
+static void LabPro_async_retire_in(LabPro_Async_Engine* engine) {
+    --engine->in_flight;
+    LabPro_async_release(engine);
+}
+
+static void LabPro_async_in_callback(struct libusb_transfer* transfer) {
+    LabPro_Async_Engine* engine = (LabPro_Async_Engine*)transfer->user_data;
+    
+    switch (transfer->status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+            engine->num_in_errors = 0;
+            // Once stopped, on_packet_data may already have been freed.
+            if (transfer->actual_length > 0 && engine->running) {
+                ++engine->packets_in;
+                engine->bytes_in += transfer->actual_length;
+                if (engine->on_packet != NULL)
+                    engine->on_packet(engine->on_packet_data, transfer->buffer, transfer->actual_length);
+            }
+            break;
+        
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            // IN transfers are submitted without a timeout, but just in case.
+            break;
+        
+        case LIBUSB_TRANSFER_CANCELLED:
+            LabPro_async_retire_in(engine);
+            return;
+        
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            engine->device_gone = true;
+            LabPro_async_retire_in(engine);
+            return;
+        
+        default:
+            ++engine->in_errors;
+            ++engine->num_in_errors;
+            printf("[liblabpro ERR] Error reading from USB: transfer status %d\n", (int)transfer->status);
+            if (engine->num_in_errors > LABPRO_ASYNC_MAX_ERRORS) {
+                printf("[liblabpro ERR] LabPro_async_in_callback: error limit reached; not resubmitting.\n");
+                LabPro_async_retire_in(engine);
+                return;
+            }
+            break;
+    }
+    
+    if (!engine->running) {
+        LabPro_async_retire_in(engine);
+        return;
+    }
+    
+    int status = libusb_submit_transfer(transfer);
+    if (status != LIBUSB_SUCCESS) {
+        if (status == LIBUSB_ERROR_NO_DEVICE)
+            engine->device_gone = true;
+        else
+            printf("[liblabpro ERR] Unable to resubmit IN transfer: %s\n", libusb_strerror(status));
+        LabPro_async_retire_in(engine);
+    }
+}
+
+static void LabPro_async_out_callback(struct libusb_transfer* transfer) {
+    LabPro_Async_Engine* engine = (LabPro_Async_Engine*)transfer->user_data;
+    
+    engine->out_transferred = transfer->actual_length;
+    switch (transfer->status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+            engine->out_status = LIBUSB_SUCCESS;
+            break;
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            engine->out_status = LIBUSB_ERROR_TIMEOUT;
+            break;
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            engine->device_gone = true;
+            engine->out_status = LIBUSB_ERROR_NO_DEVICE;
+            break;
+        case LIBUSB_TRANSFER_STALL:
+            engine->out_status = LIBUSB_ERROR_PIPE;
+            break;
+        case LIBUSB_TRANSFER_OVERFLOW:
+            engine->out_status = LIBUSB_ERROR_OVERFLOW;
+            break;
+        case LIBUSB_TRANSFER_CANCELLED:
+            engine->out_status = LIBUSB_ERROR_INTERRUPTED;
+            break;
+        default:
+            engine->out_status = LIBUSB_ERROR_IO;
+            break;
+    }
+    engine->out_completed = true;
+    LabPro_async_release(engine);
+}
+
+/* Fill in IN transfer number index and submit it. */
+static int LabPro_async_submit_in(LabPro_Async_Engine* engine, int index) {
+    libusb_fill_bulk_transfer(
+        engine->in_transfers[index],
+        engine->device_handle,
+        engine->in_endpt_addr,
+        engine->in_buffers[index],
+        LABPRO_PACKET_SIZE,
+        LabPro_async_in_callback,
+        engine,
+        0 // No timeout; the transfer simply stays queued until the LabPro sends something.
+    );
+    
+    // Counted before submitting, as the callback may run on another thread before libusb_submit_transfer() returns.
+    ++engine->in_flight;
+    ++engine->references;
+    int status = libusb_submit_transfer(engine->in_transfers[index]);
+    if (status != LIBUSB_SUCCESS) {
+        printf("[liblabpro ERR] Unable to submit IN transfer: %s\n", libusb_strerror(status));
+        --engine->in_flight;
+        --engine->references;
+        return status;
+    }
+    return LIBUSB_SUCCESS;
+}
+
+int LabPro_async_start(
+    LabPro_Async_Engine** engine,
+    libusb_context* usb_link,
+    libusb_device_handle* device_handle,
+    unsigned char in_endpt_addr,
+    unsigned char out_endpt_addr,
+    int num_in_transfers,
+    LabPro_Packet_Callback on_packet,
+    void* on_packet_data
+) {
+    *engine = NULL;
+    if (num_in_transfers < 1 || num_in_transfers > LABPRO_ASYNC_MAX_IN_TRANSFERS)
+        return LIBUSB_ERROR_INVALID_PARAM;
+    
+    LabPro_Async_Engine* new_engine = calloc(1, sizeof(LabPro_Async_Engine));
+    if (new_engine == NULL)
+        return LIBUSB_ERROR_NO_MEM;
+    
+    new_engine->usb_link = usb_link;
+    new_engine->device_handle = device_handle;
+    new_engine->in_endpt_addr = in_endpt_addr;
+    new_engine->out_endpt_addr = out_endpt_addr;
+    new_engine->on_packet = on_packet;
+    new_engine->on_packet_data = on_packet_data;
+    new_engine->references = 1;
+    new_engine->out_completed = true;
+    
+    new_engine->out_transfer = libusb_alloc_transfer(0);
+    if (new_engine->out_transfer == NULL) {
+        LabPro_async_stop(new_engine);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    
+    for (int i = 0; i < num_in_transfers; ++i) {
+        new_engine->in_transfers[i] = libusb_alloc_transfer(0);
+        if (new_engine->in_transfers[i] == NULL) {
+            LabPro_async_stop(new_engine);
+            return LIBUSB_ERROR_NO_MEM;
+        }
+        ++new_engine->num_in_transfers;
+    }
+    
+    new_engine->running = true;
+    for (int i = 0; i < num_in_transfers; ++i) {
+        int status = LabPro_async_submit_in(new_engine, i);
+        if (status != LIBUSB_SUCCESS) {
+            LabPro_async_stop(new_engine);
+            return status;
+        }
+    }
+
+#ifdef DEBUG
+    printf("[liblabpro DBG] Queued %d IN transfers on endpoint %x.\n", num_in_transfers, (unsigned int)in_endpt_addr);
+#endif
+    *engine = new_engine;
+    return LIBUSB_SUCCESS;
+}
+
+int LabPro_async_add_in_transfers(LabPro_Async_Engine* engine, int num_in_transfers) {
+    if (num_in_transfers > LABPRO_ASYNC_MAX_IN_TRANSFERS)
+        num_in_transfers = LABPRO_ASYNC_MAX_IN_TRANSFERS;
+    
+    while (engine->num_in_transfers < num_in_transfers) {
+        int index = engine->num_in_transfers;
+        engine->in_transfers[index] = libusb_alloc_transfer(0);
+        if (engine->in_transfers[index] == NULL)
+            return LIBUSB_ERROR_NO_MEM;
+        
+        // Counted first so that LabPro_async_stop() frees it even if submitting fails.
+        ++engine->num_in_transfers;
+        int status = LabPro_async_submit_in(engine, index);
+        if (status != LIBUSB_SUCCESS)
+            return status;
+    }
+
+#ifdef DEBUG
+    printf("[liblabpro DBG] %d IN transfers queued on endpoint %x.\n", engine->num_in_transfers, (unsigned int)engine->in_endpt_addr);
+#endif
+    return LIBUSB_SUCCESS;
+}
+
+int LabPro_async_stop(LabPro_Async_Engine* engine) {
+    engine->running = false;
+    
+    for (int i = 0; i < engine->num_in_transfers; ++i) {
+        if (engine->in_transfers[i] != NULL)
+            libusb_cancel_transfer(engine->in_transfers[i]);
+    }
+    if (!engine->out_completed)
+        libusb_cancel_transfer(engine->out_transfer);
+    
+    // Cancelled transfers still have to be handed back through their callbacks.
+    unsigned long long deadline = LabPro_time_usec() + LABPRO_ASYNC_STOP_TIMEOUT_MS * 1000ULL;
+    while ((engine->in_flight > 0 || !engine->out_completed) && LabPro_time_usec() < deadline) {
+        struct timeval tv = {0, 10000};
+        libusb_handle_events_timeout(engine->usb_link, &tv);
+    }
+    
+    int pending = engine->in_flight + !engine->out_completed;
+    if (LabPro_async_release(engine))
+        return LIBUSB_SUCCESS;
+    
+    printf("[liblabpro WARN] LabPro_async_stop: %d transfers not handed back after %d ms; the engine is freed with the last of them.\n",
+        pending, LABPRO_ASYNC_STOP_TIMEOUT_MS);
+    return LIBUSB_ERROR_TIMEOUT;
+}
+
+int LabPro_async_write(LabPro_Async_Engine* engine, const unsigned char* data, int length, unsigned int timeout, int* transferred) {
+    *transferred = 0;
+    if (engine->device_gone)
+        return LIBUSB_ERROR_NO_DEVICE;
+    if (length > LABPRO_PACKET_SIZE)
+        return LIBUSB_ERROR_INVALID_PARAM;
+    if (!engine->out_completed)
+        return LIBUSB_ERROR_BUSY;
+    
+    // In the engine rather than on the stack, in case libusb keeps the transfer after we give up on it.
+    memcpy(engine->out_buffer, data, length);
+    
+    libusb_fill_bulk_transfer(
+        engine->out_transfer,
+        engine->device_handle,
+        engine->out_endpt_addr,
+        engine->out_buffer,
+        length,
+        LabPro_async_out_callback,
+        engine,
+        timeout
+    );
+    engine->out_completed = false;
+    engine->out_status = LIBUSB_SUCCESS;
+    engine->out_transferred = 0;
+    
+    ++engine->references;
+    int status = libusb_submit_transfer(engine->out_transfer);
+    if (status != LIBUSB_SUCCESS) {
+        if (status == LIBUSB_ERROR_NO_DEVICE)
+            engine->device_gone = true;
+        engine->out_completed = true;
+        --engine->references;
+        ++engine->out_errors;
+        return status;
+    }
+    
+    // Returns as soon as any event has been handled, on this thread or another.
+    struct timeval tv = {0, 100000};
+    while (!engine->out_completed) {
+        status = libusb_handle_events_timeout_completed(engine->usb_link, &tv, NULL);
+        if (status != LIBUSB_SUCCESS && status != LIBUSB_ERROR_INTERRUPTED) {
+            // Give libusb a moment to hand the transfer back; if it doesn't,
+            // the next write reports LIBUSB_ERROR_BUSY until it has.
+            libusb_cancel_transfer(engine->out_transfer);
+            unsigned long long deadline = LabPro_time_usec() + LABPRO_ASYNC_STOP_TIMEOUT_MS * 1000ULL;
+            while (!engine->out_completed && LabPro_time_usec() < deadline)
+                libusb_handle_events_timeout_completed(engine->usb_link, &tv, NULL);
+            ++engine->out_errors;
+            return status;
+        }
+    }
+    
+    *transferred = engine->out_transferred;
+    if (engine->out_status == LIBUSB_SUCCESS) {
+        ++engine->packets_out;
+        engine->bytes_out += engine->out_transferred;
+    }
+    else
+        ++engine->out_errors;
+    
+    return engine->out_status;
+}
+
+int LabPro_async_handle_events(LabPro_Async_Engine* engine, unsigned int timeout_ms) {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    
+    int status = libusb_handle_events_timeout_completed(engine->usb_link, &tv, NULL);
+    if (status == LIBUSB_ERROR_INTERRUPTED)
+        return LIBUSB_SUCCESS;
+    if (engine->device_gone)
+        return LIBUSB_ERROR_NO_DEVICE;
+    return status;
+}
+
+static int LabPro_async_transport_write(void* transport_data, const unsigned char* data, int length, unsigned int timeout, int* transferred) {
+    return LabPro_async_write((LabPro_Async_Engine*)transport_data, data, length, timeout, transferred);
+}
+
+static int LabPro_async_transport_handle_events(void* transport_data, unsigned int timeout_ms) {
+    return LabPro_async_handle_events((LabPro_Async_Engine*)transport_data, timeout_ms);
+}
+
+static int LabPro_async_transport_status(void* transport_data) {
+    LabPro_Async_Engine* engine = (LabPro_Async_Engine*)transport_data;
+    
+    if (engine->in_flight > 0)
+        return LIBUSB_SUCCESS;
+    return engine->device_gone ? LIBUSB_ERROR_NO_DEVICE : LIBUSB_ERROR_IO;
+}
+
+static unsigned long long LabPro_async_transport_in_errors(void* transport_data) {
+    return ((LabPro_Async_Engine*)transport_data)->in_errors;
+}
+
+static void LabPro_async_transport_close(void* transport_data) {
+    libusb_device_handle* device_handle = ((LabPro_Async_Engine*)transport_data)->device_handle;
+    
+    // libusb may not be given a handle back while it still has transfers on it.
+    if (LabPro_async_stop((LabPro_Async_Engine*)transport_data) != LIBUSB_SUCCESS) {
+        printf("[liblabpro WARN] Leaving the device handle open, as transfers are still pending on it.\n");
+        return;
+    }
+    libusb_release_interface(device_handle, 0);
+    libusb_close(device_handle);
+}
+
+const LabPro_Transport LabPro_async_transport = {
+    "libusb",
+    LabPro_async_transport_write,
+    LabPro_async_transport_handle_events,
+    LabPro_async_transport_status,
+    LabPro_async_transport_in_errors,
+    LabPro_async_transport_close
+};
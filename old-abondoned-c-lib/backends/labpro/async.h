@@ -0,0 +1,208 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Async Asynchronous USB transfer engine
+ * 
+ * The LabPro only ever sends data in 64-byte bulk packets. Instead of asking
+ * libusb for one packet at a time with libusb_bulk_transfer() (which leaves the
+ * bus idle between packets), the engine keeps several IN transfers submitted at
+ * all times and resubmits each one from its completion callback. Incoming packets
+ * are handed to a callback as soon as they complete.
+ * 
+ * Nothing here blocks on its own; the transfers only make progress while some
+ * thread is handling libusb events, e.g. through LabPro_async_handle_events().
+ * 
+ * The engine is allocated on its own, apart from the LabPro, and the packet
+ * buffers are inside it. If libusb hasn't handed every transfer back by the
+ * time the engine is stopped, the engine is freed by the last callback
+ * instead, so a late callback never writes into freed memory.
+ */
+
+#pragma once
+#include <libusb-1.0/libusb.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/** \brief Size of a LabPro USB packet, in bytes.
+ * \ingroup LabPro-Async
+ */
+#define LABPRO_PACKET_SIZE 64
+
+/** \brief Maximum number of IN transfers that can be queued at once.
+ * \ingroup LabPro-Async
+ */
+#define LABPRO_ASYNC_MAX_IN_TRANSFERS 16
+
+/** \brief Number of IN transfers queued when a LabPro is opened.
+ * \ingroup LabPro-Async
+ */
+#define LABPRO_ASYNC_DEFAULT_IN_TRANSFERS 4
+
+/** \brief Longest LabPro_async_stop() waits for cancelled transfers, in milliseconds.
+ * \ingroup LabPro-Async
+ */
+#define LABPRO_ASYNC_STOP_TIMEOUT_MS 1000
+
+/** \brief Called for every IN packet that completes successfully.
+ * This runs from inside libusb's event handling, so it must not block.
+ * \ingroup LabPro-Async
+ */
+typedef void (*LabPro_Packet_Callback)(void* user_data, const unsigned char* packet, int length);
+
+/** \brief State of the asynchronous transfer engine for one LabPro.
+ * 
+ * The callbacks run on whichever thread handles libusb events, while the
+ * application reads the flags and counters, so those are atomic.
+ * 
+ * \ingroup LabPro-Async
+ */
+typedef struct {
+    libusb_context* usb_link;
+    libusb_device_handle* device_handle;
+    unsigned char in_endpt_addr;
+    unsigned char out_endpt_addr;
+    
+    /** \brief How many IN transfers are kept queued. */
+    int num_in_transfers;
+    struct libusb_transfer* in_transfers[LABPRO_ASYNC_MAX_IN_TRANSFERS];
+    unsigned char in_buffers[LABPRO_ASYNC_MAX_IN_TRANSFERS][LABPRO_PACKET_SIZE];
+    
+    /** \brief How many IN transfers are currently submitted to libusb. */
+    _Atomic int in_flight;
+    
+    /** \brief One for the owner and one for every transfer submitted to
+     * libusb. Whoever drops the last one frees the engine.
+     */
+    _Atomic int references;
+    
+    /** \brief Whether the IN transfers should be resubmitted when they complete. */
+    atomic_bool running;
+    
+    /** \brief Set once libusb reports that the device has gone away. */
+    atomic_bool device_gone;
+    
+    /** \brief Consecutive failed IN transfers. Reset on every successful packet. */
+    _Atomic int num_in_errors;
+    
+    struct libusb_transfer* out_transfer;
+    unsigned char out_buffer[LABPRO_PACKET_SIZE];
+    
+    /** \brief Cleared when the OUT transfer is submitted, set by its callback. */
+    atomic_bool out_completed;
+    _Atomic int out_status;
+    _Atomic int out_transferred;
+    
+    LabPro_Packet_Callback on_packet;
+    void* on_packet_data;
+    
+    /** \brief Counters, mostly useful for debugging throughput problems. */
+    _Atomic unsigned long long packets_in;
+    _Atomic unsigned long long bytes_in;
+    _Atomic unsigned long long packets_out;
+    _Atomic unsigned long long bytes_out;
+    _Atomic unsigned long long in_errors;
+    _Atomic unsigned long long out_errors;
+} LabPro_Async_Engine;
+
+/** \brief Allocate an engine and its transfers, and queue the IN transfers.
+ * 
+ * \param engine Receives the engine, or NULL on failure
+ * \param usb_link The libusb context the device handle belongs to
+ * \param device_handle Open device handle with interface 0 claimed
+ * \param in_endpt_addr Bulk IN endpoint
+ * \param out_endpt_addr Bulk OUT endpoint
+ * \param num_in_transfers Number of IN transfers to keep queued (1 to LABPRO_ASYNC_MAX_IN_TRANSFERS)
+ * \param on_packet Callback for completed IN packets
+ * \param on_packet_data Passed to on_packet
+ * \return LIBUSB_SUCCESS or one of the \ref LabPro_USB_Errors errorcodes.
+ * 
+ * \ingroup LabPro-Async
+ */
+int LabPro_async_start(
+    LabPro_Async_Engine** engine,
+    libusb_context* usb_link,
+    libusb_device_handle* device_handle,
+    unsigned char in_endpt_addr,
+    unsigned char out_endpt_addr,
+    int num_in_transfers,
+    LabPro_Packet_Callback on_packet,
+    void* on_packet_data
+);
+
+/** \brief Queue more IN transfers on a running engine.
+ * 
+ * Useful before a long burst of data, so the host controller always has
+ * somewhere to put the next packet. The number of transfers is never reduced;
+ * asking for fewer than are already queued does nothing.
+ * 
+ * \param engine A started engine
+ * \param num_in_transfers Total number of IN transfers to keep queued (up to LABPRO_ASYNC_MAX_IN_TRANSFERS)
+ * \return LIBUSB_SUCCESS or one of the \ref LabPro_USB_Errors errorcodes.
+ *         Transfers queued before an error stay queued.
+ * 
+ * \ingroup LabPro-Async
+ */
+int LabPro_async_add_in_transfers(LabPro_Async_Engine* engine, int num_in_transfers);
+
+/** \brief Cancel all pending transfers, wait for them to be reaped, and free the engine.
+ * 
+ * Waits at most LABPRO_ASYNC_STOP_TIMEOUT_MS. Transfers libusb still hasn't
+ * handed back by then keep the engine alive, and the last of them frees it.
+ * 
+ * \return LIBUSB_SUCCESS if the engine has been freed, or LIBUSB_ERROR_TIMEOUT
+ *         if transfers are still submitted, in which case the device handle
+ *         must not be closed.
+ * 
+ * \ingroup LabPro-Async
+ */
+int LabPro_async_stop(LabPro_Async_Engine* engine);
+
+/** \brief Write up to one packet to the OUT endpoint.
+ * 
+ * Submits the OUT transfer and handles events until it has completed, so IN
+ * packets that arrive in the meantime are still delivered.
+ * 
+ * \param engine The engine to write with
+ * \param data Bytes to send
+ * \param length Number of bytes (at most LABPRO_PACKET_SIZE)
+ * \param timeout Transfer timeout in milliseconds
+ * \param transferred Number of bytes actually sent
+ * \return LIBUSB_SUCCESS or one of the \ref LabPro_USB_Errors errorcodes;
+ *         LIBUSB_ERROR_BUSY if a previous OUT transfer that failed still
+ *         hasn't been handed back by libusb.
+ * 
+ * \ingroup LabPro-Async
+ */
+int LabPro_async_write(LabPro_Async_Engine* engine, const unsigned char* data, int length, unsigned int timeout, int* transferred);
+
+/** \brief Handle libusb events for up to timeout_ms milliseconds.
+ * 
+ * Returns early if an event was handled, so callers waiting on data should call
+ * this in a loop and check their own condition.
+ * 
+ * \return LIBUSB_SUCCESS or one of the \ref LabPro_USB_Errors errorcodes.
+ * 
+ * \ingroup LabPro-Async
+ */
+int LabPro_async_handle_events(LabPro_Async_Engine* engine, unsigned int timeout_ms);
@@ -0,0 +1,101 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/binary.h"
+#include "backends/labpro/labpro-internal.h"
+
+void LabPro_binary_decode_samples(const unsigned char* data, size_t num_samples, int adc_bits, uint16_t* samples) {
+    int shift = 16 - adc_bits;
+    
+    // Simple enough for the compiler to vectorize.
+    for (size_t i = 0; i < num_samples; ++i)
+        samples[i] = (uint16_t)(((unsigned int)data[2 * i] << 8 | data[2 * i + 1]) >> shift);
+}
+
+int LabPro_binary_decode_records(const unsigned char* data, size_t num_packets, int records_per_packet, int num_channels, int adc_bits, uint16_t* samples, uint32_t* times) {
+    int retval = LABPRO_OK;
+    size_t record_index = 0;
+    int used_length = 2 * num_channels + 4;
+    
+    for (size_t i = 0; i < num_packets; ++i) {
+        const unsigned char* packet = data + i * LABPRO_PACKET_SIZE;
+        
+        for (int j = 0; j < records_per_packet; ++j, ++record_index) {
+            const unsigned char* record = packet + j * LABPRO_BINARY_RECORD_SIZE;
+            LabPro_binary_decode_samples(record, num_channels, adc_bits, samples + record_index * num_channels);
+            
+            const unsigned char* time = record + 2 * num_channels;
+            if (times != NULL)
+                times[record_index] = (uint32_t)time[0] << 24 | (uint32_t)time[1] << 16 | (uint32_t)time[2] << 8 | time[3];
+            
+            for (int k = used_length; k < LABPRO_BINARY_RECORD_SIZE; ++k) {
+                if (record[k] != 0)
+                    retval = LABPRO_ERR_BAD_BINARY;
+            }
+        }
+        
+        for (int k = records_per_packet * LABPRO_BINARY_RECORD_SIZE; k < LABPRO_PACKET_SIZE; ++k) {
+            if (packet[k] != 0)
+                retval = LABPRO_ERR_BAD_BINARY;
+        }
+    }
+    return retval;
+}
+
+int LabPro_binary_packet_records(const unsigned char* packet, int records_per_packet) {
+    int num_records = 1;
+    for (; num_records < records_per_packet; ++num_records) {
+        const unsigned char* record = packet + num_records * LABPRO_BINARY_RECORD_SIZE;
+        bool empty = true;
+        for (int k = 0; k < LABPRO_BINARY_RECORD_SIZE && empty; ++k)
+            empty = record[k] == 0;
+        if (empty)
+            break;
+    }
+    return num_records;
+}
+
+bool LabPro_binary_volts_scale(int operation, int adc_bits, float* offset, float* scale) {
+    float steps = (float)(1 << adc_bits);
+    
+    switch (operation) {
+        case LABPRO_CHANOP_VOLTAGE10V:
+            *offset = -10.0f;
+            *scale = 20.0f / steps;
+            return true;
+        
+        case LABPRO_CHANOP_VOLTAGE_ZERO_TO_FIVE:
+            *offset = 0.0f;
+            *scale = 5.0f / steps;
+            return true;
+        
+        default:
+            // Auto-ID sensors pick their own range, and the rest don't measure volts at all.
+            return false;
+    }
+}
+
+void LabPro_binary_to_volts(const uint16_t* samples, size_t count, size_t stride, float offset, float scale, float* volts) {
+    for (size_t i = 0; i < count; ++i)
+        volts[i] = offset + scale * samples[i * stride];
+}
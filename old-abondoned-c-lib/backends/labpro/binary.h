@@ -0,0 +1,149 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Binary Binary data decoding
+ * 
+ * Decoders for the LabPro's binary data format, which is requested with
+ * command 4 as {4,0,-1} or {4,0,-1,X} (see LabPro_set_binary_mode()). Binary
+ * data takes two bytes per sample instead of the thirteen an ASCII number
+ * needs, but only the active analog and motion channels support it, and the
+ * samples are the raw ADC output: calibration equations and derivatives are
+ * ignored.
+ * 
+ * Each sample is a big-endian 16-bit word holding the ADC output left
+ * justified, i.e. a LabPro's 12-bit reading is in the top 12 bits and a
+ * CBL2's 10-bit reading in the top 10. Over USB there is no checksum and no
+ * CR, so the host has to know how many bytes to expect.
+ * 
+ * Non-realtime data comes back as N samples for one channel per "g", padded
+ * with zeros to a multiple of 64 bytes. Realtime data comes back as 16-byte
+ * records, one per sample point: a word for every active channel, lowest
+ * channel first, then the big-endian 32-bit time counter, then zeros. Each
+ * 64-byte packet carries X records (1 to 4, one by default) and is padded with
+ * zeros after the last one.
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief ADC resolution of a LabPro, in bits.
+ * \ingroup LabPro-Binary
+ */
+#define LABPRO_ADC_BITS 12
+
+/** \brief ADC resolution of a CBL2, in bits.
+ * \ingroup LabPro-Binary
+ */
+#define LABPRO_CBL2_ADC_BITS 10
+
+/** \brief Size of one realtime record in bytes.
+ * \ingroup LabPro-Binary
+ */
+#define LABPRO_BINARY_RECORD_SIZE 16
+
+/** \brief Most records the LabPro packs into one packet.
+ * \ingroup LabPro-Binary
+ */
+#define LABPRO_BINARY_MAX_RECORDS_PER_PACKET 4
+
+/** \brief Most channels that fit into one realtime record along with the time counter.
+ * \ingroup LabPro-Binary
+ */
+#define LABPRO_BINARY_MAX_CHANNELS ((LABPRO_BINARY_RECORD_SIZE - 4) / 2)
+
+/** \brief Decode big-endian samples into raw ADC readings.
+ * 
+ * \param data Two bytes per sample
+ * \param num_samples Number of samples
+ * \param adc_bits LABPRO_ADC_BITS or LABPRO_CBL2_ADC_BITS; the readings are
+ *        shifted right to drop the zero fill.
+ * \param samples Receives num_samples readings, from 0 to 2^adc_bits - 1
+ * 
+ * \ingroup LabPro-Binary
+ */
+void LabPro_binary_decode_samples(const unsigned char* data, size_t num_samples, int adc_bits, uint16_t* samples);
+
+/** \brief Decode the realtime records in whole 64-byte packets.
+ * 
+ * \param data The packets
+ * \param num_packets Number of packets in data
+ * \param records_per_packet X from the binary mode command, 1 to 4
+ * \param num_channels Number of active channels, 1 to LABPRO_BINARY_MAX_CHANNELS
+ * \param adc_bits As for LabPro_binary_decode_samples()
+ * \param samples Receives num_channels readings per record, interleaved like the records
+ * \param times Receives the time counter of each record; may be NULL.
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_BINARY if a byte that should be padding
+ *         isn't zero, which means the data isn't laid out the way the
+ *         arguments say. Everything is decoded either way.
+ * 
+ * \ingroup LabPro-Binary
+ */
+int LabPro_binary_decode_records(const unsigned char* data, size_t num_packets, int records_per_packet, int num_channels, int adc_bits, uint16_t* samples, uint32_t* times);
+
+/** \brief Count the realtime records in a 64-byte packet.
+ * 
+ * A packet holds at least one record, and the slots after the last one are
+ * zero. A record after the first can't be all zeros, as its time counter is
+ * later than the first one's, so the records are the first slot and every
+ * slot up to the first that is all zeros.
+ * 
+ * \param packet The packet
+ * \param records_per_packet X from the binary mode command, 1 to 4
+ * \return The number of records, 1 to records_per_packet
+ * 
+ * \ingroup LabPro-Binary
+ */
+int LabPro_binary_packet_records(const unsigned char* packet, int records_per_packet);
+
+/** \brief Find out how raw readings map to volts for an analog channel operation.
+ * 
+ * volts = offset + scale * reading. The mapping assumes the ADC spans the
+ * whole nominal range of the operation; it is not calibrated.
+ * 
+ * \param operation The LabPro_Analog_Chan_Operations value the channel was set
+ *        up with using command 1
+ * \param adc_bits As for LabPro_binary_decode_samples()
+ * \param offset Volts at a reading of zero
+ * \param scale Volts per ADC step
+ * \return false if the operation doesn't measure a voltage, e.g. resistance.
+ * 
+ * \ingroup LabPro-Binary
+ */
+bool LabPro_binary_volts_scale(int operation, int adc_bits, float* offset, float* scale);
+
+/** \brief Convert raw readings to volts using a mapping from LabPro_binary_volts_scale().
+ * 
+ * \param samples Raw readings
+ * \param count Number of readings
+ * \param stride Distance between the readings of one channel, e.g. the number
+ *        of channels when converting one channel of interleaved records.
+ * \param offset As from LabPro_binary_volts_scale()
+ * \param scale As from LabPro_binary_volts_scale()
+ * \param volts Receives count values, packed
+ * 
+ * \ingroup LabPro-Binary
+ */
+void LabPro_binary_to_volts(const uint16_t* samples, size_t count, size_t stride, float offset, float scale, float* volts);
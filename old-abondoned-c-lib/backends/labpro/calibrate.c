@@ -0,0 +1,217 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/calibrate.h"
+#include "backends/labpro/cpu.h"
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LABPRO_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* The vector kernels do the same multiplies and adds in the same order as
+ * these, without fused multiply-adds, so every path gives the same bits.
+ */
+static void LabPro_calibrate_linear_scalar(double k0, double k1, const double* inputs, double* outputs, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        outputs[i] = k0 + k1 * inputs[i];
+}
+
+static void LabPro_calibrate_quadratic_scalar(double k0, double k1, double k2, const double* inputs, double* outputs, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        outputs[i] = k0 + inputs[i] * (k1 + inputs[i] * k2);
+}
+
+#ifdef LABPRO_HAVE_X86_SIMD
+
+__attribute__((target("sse4.2")))
+static void LabPro_calibrate_linear_sse42(double k0, double k1, const double* inputs, double* outputs, size_t count) {
+    __m128d vk0 = _mm_set1_pd(k0);
+    __m128d vk1 = _mm_set1_pd(k1);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128d x0 = _mm_loadu_pd(inputs + i);
+        __m128d x1 = _mm_loadu_pd(inputs + i + 2);
+        _mm_storeu_pd(outputs + i, _mm_add_pd(vk0, _mm_mul_pd(vk1, x0)));
+        _mm_storeu_pd(outputs + i + 2, _mm_add_pd(vk0, _mm_mul_pd(vk1, x1)));
+    }
+    LabPro_calibrate_linear_scalar(k0, k1, inputs + i, outputs + i, count - i);
+}
+
+__attribute__((target("sse4.2")))
+static void LabPro_calibrate_quadratic_sse42(double k0, double k1, double k2, const double* inputs, double* outputs, size_t count) {
+    __m128d vk0 = _mm_set1_pd(k0);
+    __m128d vk1 = _mm_set1_pd(k1);
+    __m128d vk2 = _mm_set1_pd(k2);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128d x0 = _mm_loadu_pd(inputs + i);
+        __m128d x1 = _mm_loadu_pd(inputs + i + 2);
+        __m128d y0 = _mm_add_pd(vk1, _mm_mul_pd(x0, vk2));
+        __m128d y1 = _mm_add_pd(vk1, _mm_mul_pd(x1, vk2));
+        _mm_storeu_pd(outputs + i, _mm_add_pd(vk0, _mm_mul_pd(x0, y0)));
+        _mm_storeu_pd(outputs + i + 2, _mm_add_pd(vk0, _mm_mul_pd(x1, y1)));
+    }
+    LabPro_calibrate_quadratic_scalar(k0, k1, k2, inputs + i, outputs + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void LabPro_calibrate_linear_avx2(double k0, double k1, const double* inputs, double* outputs, size_t count) {
+    __m256d vk0 = _mm256_set1_pd(k0);
+    __m256d vk1 = _mm256_set1_pd(k1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256d x0 = _mm256_loadu_pd(inputs + i);
+        __m256d x1 = _mm256_loadu_pd(inputs + i + 4);
+        _mm256_storeu_pd(outputs + i, _mm256_add_pd(vk0, _mm256_mul_pd(vk1, x0)));
+        _mm256_storeu_pd(outputs + i + 4, _mm256_add_pd(vk0, _mm256_mul_pd(vk1, x1)));
+    }
+    LabPro_calibrate_linear_scalar(k0, k1, inputs + i, outputs + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void LabPro_calibrate_quadratic_avx2(double k0, double k1, double k2, const double* inputs, double* outputs, size_t count) {
+    __m256d vk0 = _mm256_set1_pd(k0);
+    __m256d vk1 = _mm256_set1_pd(k1);
+    __m256d vk2 = _mm256_set1_pd(k2);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256d x0 = _mm256_loadu_pd(inputs + i);
+        __m256d x1 = _mm256_loadu_pd(inputs + i + 4);
+        __m256d y0 = _mm256_add_pd(vk1, _mm256_mul_pd(x0, vk2));
+        __m256d y1 = _mm256_add_pd(vk1, _mm256_mul_pd(x1, vk2));
+        _mm256_storeu_pd(outputs + i, _mm256_add_pd(vk0, _mm256_mul_pd(x0, y0)));
+        _mm256_storeu_pd(outputs + i + 4, _mm256_add_pd(vk0, _mm256_mul_pd(x1, y1)));
+    }
+    LabPro_calibrate_quadratic_scalar(k0, k1, k2, inputs + i, outputs + i, count - i);
+}
+
+#endif // LABPRO_HAVE_X86_SIMD
+
+static void LabPro_calibrate_linear(double k0, double k1, const double* inputs, double* outputs, size_t count) {
+#ifdef LABPRO_HAVE_X86_SIMD
+    switch (LabPro_simd_level()) {
+        case LABPRO_SIMD_AVX2:
+            LabPro_calibrate_linear_avx2(k0, k1, inputs, outputs, count);
+            return;
+        case LABPRO_SIMD_SSE42:
+            LabPro_calibrate_linear_sse42(k0, k1, inputs, outputs, count);
+            return;
+        default:
+            break;
+    }
+#endif
+    LabPro_calibrate_linear_scalar(k0, k1, inputs, outputs, count);
+}
+
+static void LabPro_calibrate_quadratic(double k0, double k1, double k2, const double* inputs, double* outputs, size_t count) {
+#ifdef LABPRO_HAVE_X86_SIMD
+    switch (LabPro_simd_level()) {
+        case LABPRO_SIMD_AVX2:
+            LabPro_calibrate_quadratic_avx2(k0, k1, k2, inputs, outputs, count);
+            return;
+        case LABPRO_SIMD_SSE42:
+            LabPro_calibrate_quadratic_sse42(k0, k1, k2, inputs, outputs, count);
+            return;
+        default:
+            break;
+    }
+#endif
+    LabPro_calibrate_quadratic_scalar(k0, k1, k2, inputs, outputs, count);
+}
+
+int LabPro_calibrate(int equation_type, const LabPro_Sensor_Calibration_Page* page, const double* inputs, double* outputs, size_t count) {
+    double k0 = page->k0;
+    double k1 = page->k1;
+    double k2 = page->k2;
+    
+    switch (equation_type) {
+        case LABPRO_EQN_POLYNOMIAL:
+            // Nearly every sensor is linear, with k2 = 0.
+            if (k2 == 0)
+                LabPro_calibrate_linear(k0, k1, inputs, outputs, count);
+            else
+                LabPro_calibrate_quadratic(k0, k1, k2, inputs, outputs, count);
+            break;
+        case LABPRO_EQN_MIXED_POLYNOMIAL:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k2 / inputs[i] + k0 + k1 * inputs[i];
+            break;
+        case LABPRO_EQN_POWER:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 * pow(inputs[i], k1);
+            break;
+        case LABPRO_EQN_MODIFIED_POWER: {
+            // k1^x = e^(x ln k1), which saves a log per value.
+            double ln_k1 = log(k1);
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 * exp(inputs[i] * ln_k1);
+            break;
+        }
+        case LABPRO_EQN_LOGARITHMIC:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 + k1 * log(inputs[i]);
+            break;
+        case LABPRO_EQN_MODIFIED_LOGARITHMIC:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 + k1 * log(1 / inputs[i]);
+            break;
+        case LABPRO_EQN_EXPONENTIAL:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 * exp(k1 * inputs[i]);
+            break;
+        case LABPRO_EQN_MODIFIED_EXPONENTIAL:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 * exp(k1 / inputs[i]);
+            break;
+        case LABPRO_EQN_GEOMETRIC:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 * pow(inputs[i], k1 * inputs[i]);
+            break;
+        case LABPRO_EQN_MODIFIED_GEOMETRIC:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = k0 * pow(inputs[i], k1 / inputs[i]);
+            break;
+        case LABPRO_EQN_RECIPROCAL_LOG:
+            for (size_t i = 0; i < count; ++i)
+                outputs[i] = 1 / (k0 + k1 * log(k2 * inputs[i]));
+            break;
+        case LABPRO_EQN_STEINHART_HART:
+            for (size_t i = 0; i < count; ++i) {
+                double ln_r = log(1000 * inputs[i]);
+                outputs[i] = 1 / (k0 + ln_r * (k1 + ln_r * ln_r * k2));
+            }
+            break;
+        default:
+            return LABPRO_ERR_BAD_EQUATION;
+    }
+    return LABPRO_OK;
+}
+
+int LabPro_calibrate_sensor(const LabPro_Analog_Sensor* sensor, const double* inputs, double* outputs, size_t count) {
+    if (sensor->active_cal_idx >= sizeof(sensor->calibrations) / sizeof(sensor->calibrations[0]))
+        return LABPRO_ERR_BAD_EQUATION;
+    
+    return LabPro_calibrate(sensor->equation_type, &sensor->calibrations[sensor->active_cal_idx], inputs, outputs, count);
+}
@@ -0,0 +1,100 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Calibrate Calibration
+ * 
+ * Converts raw voltages to calibrated values on the host, using the same
+ * conversion equations that sensors store in their calibration pages. This
+ * is for data collected as raw voltages, and for converting a stored
+ * collection again after a sensor has been recalibrated.
+ * 
+ * Whole arrays are converted at once. The polynomial equations, which are
+ * what nearly all sensors use, run on the vector units as chosen by
+ * \ref LabPro-CPU and give exactly the same results as the plain C path. The
+ * other equations are plain loops around the math library.
+ * 
+ * In the formulas below, x is the input and k0, k1 and k2 come from the
+ * calibration page. The types are numbered as in Command 4 of the LabPro
+ * Technical Manual. A calibration page holds three coefficients, so the two
+ * polynomial types are limited to what three coefficients can express.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include "core.h"
+#include <stddef.h>
+
+/** \brief Conversion equation types, as stored in LabPro_Analog_Sensor.equation_type
+ * \ingroup LabPro-Calibrate
+ */
+enum LabPro_Equation_Types {
+    /** \brief Polynomial: k0 + k1 * x + k2 * x^2 */
+    LABPRO_EQN_POLYNOMIAL = 1,
+    /** \brief Mixed polynomial with one negative power: k2 / x + k0 + k1 * x */
+    LABPRO_EQN_MIXED_POLYNOMIAL = 2,
+    /** \brief k0 * x^k1 */
+    LABPRO_EQN_POWER = 3,
+    /** \brief k0 * k1^x */
+    LABPRO_EQN_MODIFIED_POWER = 4,
+    /** \brief k0 + k1 * ln(x) */
+    LABPRO_EQN_LOGARITHMIC = 5,
+    /** \brief k0 + k1 * ln(1 / x) */
+    LABPRO_EQN_MODIFIED_LOGARITHMIC = 6,
+    /** \brief k0 * e^(k1 * x) */
+    LABPRO_EQN_EXPONENTIAL = 7,
+    /** \brief k0 * e^(k1 / x) */
+    LABPRO_EQN_MODIFIED_EXPONENTIAL = 8,
+    /** \brief k0 * x^(k1 * x) */
+    LABPRO_EQN_GEOMETRIC = 9,
+    /** \brief k0 * x^(k1 / x) */
+    LABPRO_EQN_MODIFIED_GEOMETRIC = 10,
+    /** \brief 1 / (k0 + k1 * ln(k2 * x)) */
+    LABPRO_EQN_RECIPROCAL_LOG = 11,
+    /** \brief Steinhart-Hart, for thermistors: 1 / (k0 + k1 * ln(1000 * x) + k2 * ln(1000 * x)^3),
+     * with x the thermistor's resistance in kilohms and the result in kelvins.
+     */
+    LABPRO_EQN_STEINHART_HART = 12
+};
+
+/** \brief Convert an array with a calibration page.
+ * 
+ * \param equation_type One of the \ref LabPro_Equation_Types
+ * \param page The coefficients
+ * \param inputs count raw values, usually voltages
+ * \param outputs Receives count calibrated values; may be the same array as inputs.
+ * \param count Number of values
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_EQUATION if the equation type is unknown.
+ * 
+ * \ingroup LabPro-Calibrate
+ */
+int LabPro_calibrate(int equation_type, const LabPro_Sensor_Calibration_Page* page, const double* inputs, double* outputs, size_t count);
+
+/** \brief Convert an array with a sensor's equation and active calibration page.
+ * 
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_EQUATION if the sensor's equation type
+ *         is unknown or its active page is out of range.
+ * 
+ * \ingroup LabPro-Calibrate
+ */
+int LabPro_calibrate_sensor(const LabPro_Analog_Sensor* sensor, const double* inputs, double* outputs, size_t count);
@@ -0,0 +1,375 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/capture.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(LabPro_Capture_Header) <= LABPRO_CAPTURE_HEADER_SIZE, "The capture header doesn't fit into its page.");
+_Static_assert(sizeof(LabPro_Capture_Chunk_Header) % sizeof(double) == 0, "Chunk columns have to stay aligned.");
+
+static const char LabPro_capture_magic[4] = {'L', 'P', 'C', 'F'};
+static const char LabPro_capture_chunk_magic[4] = {'L', 'P', 'C', 'K'};
+
+static uint32_t LabPro_crc32_table[256];
+static pthread_once_t LabPro_crc32_once = PTHREAD_ONCE_INIT;
+
+static void LabPro_crc32_init_table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        LabPro_crc32_table[i] = crc;
+    }
+}
+
+uint32_t LabPro_crc32(uint32_t crc, const void* data, size_t length) {
+    pthread_once(&LabPro_crc32_once, LabPro_crc32_init_table);
+    
+    const unsigned char* bytes = (const unsigned char*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i)
+        crc = LabPro_crc32_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* Copy a string into a fixed-size field, always NULL-terminated and zero-padded. */
+static void LabPro_capture_copy_string(char* field, size_t size, const char* string) {
+    memset(field, 0, size);
+    if (string != NULL)
+        strncpy(field, string, size - 1);
+}
+
+void LabPro_capture_describe_channel(LabPro_Capture_Channel* channel, const LabPro_Data_Session* session, const LabPro_Analog_Sensor* sensor) {
+    memset(channel, 0, sizeof(LabPro_Capture_Channel));
+    
+    channel->channel = session->channel;
+    channel->analog_op = session->analog_op;
+    channel->sonic_op = session->sonic_op;
+    channel->postproc = session->postproc;
+    channel->sampling_mode = session->sampling_mode;
+    channel->use_conversion_eqn = session->use_conversion_eqn;
+    channel->use_sonic_temp_compensation = session->use_sonic_temp_compensation;
+    LabPro_capture_copy_string(channel->onboard_conversion_equation, LABPRO_CAPTURE_MAX_EQUATION, session->onboard_conversion_equation);
+    LabPro_capture_copy_string(channel->sonic_temp_compensation_equation, LABPRO_CAPTURE_MAX_EQUATION, session->sonic_temp_compensation_equation);
+    
+    if (sensor == NULL)
+        return;
+    
+    channel->has_sensor = 1;
+    channel->sensor_id = sensor->id;
+    channel->serial_number = sensor->serial_number;
+    memcpy(channel->name_long, sensor->name_long, sizeof(channel->name_long));
+    memcpy(channel->name_short, sensor->name_short, sizeof(channel->name_short));
+    channel->is_smart = sensor->is_smart;
+    
+    int page = sensor->active_cal_idx < 3 ? sensor->active_cal_idx : 0;
+    channel->active_cal_idx = page;
+    channel->k0 = sensor->calibrations[page].k0;
+    channel->k1 = sensor->calibrations[page].k1;
+    channel->k2 = sensor->calibrations[page].k2;
+    memcpy(channel->units, sensor->calibrations[page].units, sizeof(sensor->calibrations[page].units));
+}
+
+/* Write all of buffer at offset, or fail. */
+static bool LabPro_capture_pwrite(int fd, const void* buffer, size_t length, off_t offset) {
+    const unsigned char* bytes = (const unsigned char*)buffer;
+    while (length > 0) {
+        ssize_t written = pwrite(fd, bytes, length, offset);
+        if (written < 0)
+            return false;
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+/* Column c of a chunk, where column 0 is the time. */
+static double* LabPro_capture_column(unsigned char* chunk, uint32_t chunk_points, int column) {
+    return (double*)(chunk + sizeof(LabPro_Capture_Chunk_Header)) + (size_t)column * chunk_points;
+}
+
+int LabPro_capture_create(LabPro_Capture_Writer* writer, const char* path, const LabPro_Capture_Channel* channels, int num_channels, double sample_time, uint32_t chunk_points, bool sync) {
+    writer->fd = -1;
+    writer->chunk = NULL;
+    if (num_channels < 1 || num_channels > LABPRO_CAPTURE_MAX_CHANNELS)
+        return LABPRO_ERR_BAD_CHANNEL;
+    if (chunk_points == 0)
+        chunk_points = LABPRO_CAPTURE_DEFAULT_CHUNK_POINTS;
+    
+    LabPro_Capture_Header* header = &writer->header;
+    memset(header, 0, sizeof(LabPro_Capture_Header));
+    memcpy(header->magic, LabPro_capture_magic, 4);
+    header->version = LABPRO_CAPTURE_VERSION;
+    header->sample_time = sample_time;
+    header->created = (int64_t)time(NULL);
+    header->num_channels = num_channels;
+    header->chunk_points = chunk_points;
+    memcpy(header->channels, channels, num_channels * sizeof(LabPro_Capture_Channel));
+    
+    // A whole number of pages, so that every chunk starts on a page.
+    uint64_t used = sizeof(LabPro_Capture_Chunk_Header) + (uint64_t)chunk_points * (num_channels + 1) * sizeof(double);
+    header->chunk_size = (used + LABPRO_CAPTURE_HEADER_SIZE - 1) / LABPRO_CAPTURE_HEADER_SIZE * LABPRO_CAPTURE_HEADER_SIZE;
+    header->crc = LabPro_crc32(0, header, offsetof(LabPro_Capture_Header, crc));
+    
+    writer->chunk = calloc(1, header->chunk_size);
+    if (writer->chunk == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        printf("[liblabpro ERR] Unable to create capture file %s.\n", path);
+        free(writer->chunk);
+        writer->chunk = NULL;
+        return LABPRO_ERR_CAPTURE_IO;
+    }
+    
+    unsigned char page[LABPRO_CAPTURE_HEADER_SIZE] = {0};
+    memcpy(page, header, sizeof(LabPro_Capture_Header));
+    writer->chunk_fill = 0;
+    writer->num_chunks = 0;
+    writer->sync = sync;
+    writer->failed = !LabPro_capture_pwrite(writer->fd, page, sizeof(page), 0);
+    if (writer->failed) {
+        printf("[liblabpro ERR] Unable to write the header of capture file %s.\n", path);
+        LabPro_capture_close(writer);
+        return LABPRO_ERR_CAPTURE_IO;
+    }
+    return LABPRO_OK;
+}
+
+static int LabPro_capture_write_chunk(LabPro_Capture_Writer* writer) {
+    if (writer->failed)
+        return LABPRO_ERR_CAPTURE_IO;
+    if (writer->chunk_fill == 0)
+        return LABPRO_OK;
+    
+    const LabPro_Capture_Header* header = &writer->header;
+    LabPro_Capture_Chunk_Header chunk_header = {{0}, writer->num_chunks, writer->chunk_fill, 0, 0};
+    for (uint32_t column = 0; column <= header->num_channels; ++column)
+        chunk_header.crc = LabPro_crc32(chunk_header.crc, LabPro_capture_column(writer->chunk, header->chunk_points, column), writer->chunk_fill * sizeof(double));
+    memcpy(chunk_header.magic, LabPro_capture_chunk_magic, 4);
+    
+    // The points go first and the header last, so a reader never counts a chunk that is still being written.
+    off_t offset = LABPRO_CAPTURE_HEADER_SIZE + (off_t)writer->num_chunks * header->chunk_size;
+    size_t header_size = sizeof(LabPro_Capture_Chunk_Header);
+    writer->failed = !LabPro_capture_pwrite(writer->fd, writer->chunk + header_size, header->chunk_size - header_size, offset + header_size);
+    if (!writer->failed && writer->sync)
+        writer->failed = fdatasync(writer->fd) != 0;
+    if (!writer->failed)
+        writer->failed = !LabPro_capture_pwrite(writer->fd, &chunk_header, header_size, offset);
+    if (!writer->failed && writer->sync)
+        writer->failed = fdatasync(writer->fd) != 0;
+    
+    if (writer->failed) {
+        printf("[liblabpro ERR] Unable to write chunk %u of a capture file.\n", writer->num_chunks);
+        return LABPRO_ERR_CAPTURE_IO;
+    }
+    
+    ++writer->num_chunks;
+    writer->chunk_fill = 0;
+    memset(writer->chunk, 0, header->chunk_size);
+    return LABPRO_OK;
+}
+
+int LabPro_capture_append(LabPro_Capture_Writer* writer, const double* times, const double* values, size_t count) {
+    const LabPro_Capture_Header* header = &writer->header;
+    uint32_t num_channels = header->num_channels;
+    
+    size_t done = 0;
+    while (done < count) {
+        if (writer->failed)
+            return LABPRO_ERR_CAPTURE_IO;
+        
+        size_t run = header->chunk_points - writer->chunk_fill;
+        if (run > count - done)
+            run = count - done;
+        
+        memcpy(LabPro_capture_column(writer->chunk, header->chunk_points, 0) + writer->chunk_fill, times + done, run * sizeof(double));
+        for (uint32_t channel = 0; channel < num_channels; ++channel) {
+            double* column = LabPro_capture_column(writer->chunk, header->chunk_points, channel + 1) + writer->chunk_fill;
+            const double* source = values + done * num_channels + channel;
+            for (size_t i = 0; i < run; ++i)
+                column[i] = source[i * num_channels];
+        }
+        writer->chunk_fill += run;
+        done += run;
+        
+        if (writer->chunk_fill == header->chunk_points) {
+            int retval = LabPro_capture_write_chunk(writer);
+            if (retval != LABPRO_OK)
+                return retval;
+        }
+    }
+    return LABPRO_OK;
+}
+
+int LabPro_capture_flush(LabPro_Capture_Writer* writer) {
+    return LabPro_capture_write_chunk(writer);
+}
+
+int LabPro_capture_close(LabPro_Capture_Writer* writer) {
+    int retval = LABPRO_OK;
+    if (writer->fd >= 0) {
+        retval = LabPro_capture_write_chunk(writer);
+        if (close(writer->fd) != 0)
+            retval = LABPRO_ERR_CAPTURE_IO;
+        writer->fd = -1;
+    }
+    free(writer->chunk);
+    writer->chunk = NULL;
+    return retval;
+}
+
+/* Count the complete chunks that have appeared since the last look. */
+static void LabPro_capture_scan(LabPro_Capture_Reader* reader) {
+    const LabPro_Capture_Header* header = reader->header;
+    while (true) {
+        size_t offset = LABPRO_CAPTURE_HEADER_SIZE + (size_t)reader->num_chunks * header->chunk_size;
+        if (offset + header->chunk_size > reader->map_size)
+            break;
+        
+        const LabPro_Capture_Chunk_Header* chunk_header = (const LabPro_Capture_Chunk_Header*)(reader->map + offset);
+        if (memcmp(chunk_header->magic, LabPro_capture_chunk_magic, 4) != 0)
+            break;
+        
+        ++reader->num_chunks;
+        reader->num_points += chunk_header->num_points;
+    }
+}
+
+/* Map the whole file as it is now. */
+static int LabPro_capture_map(LabPro_Capture_Reader* reader) {
+    struct stat info;
+    if (fstat(reader->fd, &info) != 0)
+        return LABPRO_ERR_CAPTURE_IO;
+    // An empty file can't be mapped; it may just not have its header yet.
+    if ((size_t)info.st_size == reader->map_size || info.st_size == 0)
+        return LABPRO_OK;
+    
+    if (reader->map != NULL)
+        munmap((void*)reader->map, reader->map_size);
+    reader->map = NULL;
+    reader->header = NULL;
+    reader->map_size = 0;
+    
+    void* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED)
+        return LABPRO_ERR_CAPTURE_IO;
+    
+    reader->map = (const unsigned char*)map;
+    reader->map_size = info.st_size;
+    reader->header = (const LabPro_Capture_Header*)map;
+    return LABPRO_OK;
+}
+
+int LabPro_capture_open(LabPro_Capture_Reader* reader, const char* path) {
+    memset(reader, 0, sizeof(LabPro_Capture_Reader));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        printf("[liblabpro ERR] Unable to open capture file %s.\n", path);
+        return LABPRO_ERR_CAPTURE_IO;
+    }
+    
+    int retval = LabPro_capture_map(reader);
+    if (retval == LABPRO_OK && reader->map_size < LABPRO_CAPTURE_HEADER_SIZE)
+        retval = LABPRO_ERR_BAD_CAPTURE;
+    
+    if (retval == LABPRO_OK) {
+        const LabPro_Capture_Header* header = reader->header;
+        if (memcmp(header->magic, LabPro_capture_magic, 4) != 0
+                || header->version != LABPRO_CAPTURE_VERSION
+                || header->crc != LabPro_crc32(0, header, offsetof(LabPro_Capture_Header, crc))
+                || header->num_channels < 1 || header->num_channels > LABPRO_CAPTURE_MAX_CHANNELS
+                || header->chunk_size < sizeof(LabPro_Capture_Chunk_Header) + (uint64_t)header->chunk_points * (header->num_channels + 1) * sizeof(double)) {
+            printf("[liblabpro ERR] %s is not a capture file this version of liblabpro can read.\n", path);
+            retval = LABPRO_ERR_BAD_CAPTURE;
+        }
+    }
+    
+    if (retval != LABPRO_OK) {
+        LabPro_capture_close_reader(reader);
+        return retval;
+    }
+    
+    LabPro_capture_scan(reader);
+    return LABPRO_OK;
+}
+
+int LabPro_capture_refresh(LabPro_Capture_Reader* reader) {
+    int retval = LabPro_capture_map(reader);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    LabPro_capture_scan(reader);
+    return LABPRO_OK;
+}
+
+int LabPro_capture_chunk(LabPro_Capture_Reader* reader, uint32_t index, LabPro_Capture_Chunk* chunk) {
+    if (index >= reader->num_chunks)
+        return LABPRO_ERR_BAD_CAPTURE;
+    
+    const LabPro_Capture_Header* header = reader->header;
+    unsigned char* base = (unsigned char*)reader->map + LABPRO_CAPTURE_HEADER_SIZE + (size_t)index * header->chunk_size;
+    const LabPro_Capture_Chunk_Header* chunk_header = (const LabPro_Capture_Chunk_Header*)base;
+    if (chunk_header->num_points > header->chunk_points)
+        return LABPRO_ERR_BAD_CAPTURE;
+    
+    chunk->num_points = chunk_header->num_points;
+    chunk->times = LabPro_capture_column(base, header->chunk_points, 0);
+    for (uint32_t channel = 0; channel < header->num_channels; ++channel)
+        chunk->values[channel] = LabPro_capture_column(base, header->chunk_points, channel + 1);
+    
+    // Chunks are checked in order, and those before num_verified aren't checked again.
+    if (index >= reader->num_verified) {
+        uint32_t crc = 0;
+        for (uint32_t column = 0; column <= header->num_channels; ++column)
+            crc = LabPro_crc32(crc, LabPro_capture_column(base, header->chunk_points, column), chunk_header->num_points * sizeof(double));
+        if (chunk_header->sequence != index || crc != chunk_header->crc) {
+            printf("[liblabpro ERR] Chunk %u of a capture file is damaged.\n", index);
+            return LABPRO_ERR_BAD_CAPTURE;
+        }
+        if (index == reader->num_verified)
+            ++reader->num_verified;
+    }
+    return LABPRO_OK;
+}
+
+void LabPro_capture_close_reader(LabPro_Capture_Reader* reader) {
+    if (reader->map != NULL)
+        munmap((void*)reader->map, reader->map_size);
+    if (reader->fd >= 0)
+        close(reader->fd);
+    reader->map = NULL;
+    reader->header = NULL;
+    reader->map_size = 0;
+    reader->fd = -1;
+}
@@ -0,0 +1,305 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Capture Capture files
+ * 
+ * An append-only file format for long collections, written as the samples
+ * arrive so that neither RAM nor a crash limits how much is kept. The file is
+ * laid out so that a reader can mmap it and use the samples in place.
+ * 
+ * File format (all integers and floats little-endian, as on the host):
+ * 
+ *     header:  LABPRO_CAPTURE_HEADER_SIZE bytes, see LabPro_Capture_Header
+ *     chunks:  one after another, each LabPro_Capture_Header.chunk_size bytes
+ * 
+ *     chunk:   LabPro_Capture_Chunk_Header, then chunk_points times (doubles),
+ *              then chunk_points values (doubles) for each channel in turn
+ * 
+ * Every chunk takes the same space, a whole number of pages, so chunk i always starts at
+ * LABPRO_CAPTURE_HEADER_SIZE + i * chunk_size, and its columns start at fixed
+ * offsets within it. A chunk may hold fewer than chunk_points points if it
+ * was flushed early; the rest of its space is zero. The columns are in the
+ * same order as the channels in the header.
+ * 
+ * Each chunk header carries a CRC-32 of the chunk's points and is written
+ * after them, so a reader looking at a file that is still being written
+ * only counts a chunk once it is complete. If the writer crashes, only the
+ * points that hadn't been flushed yet are lost.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include "core.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief Capture format version written by this library.
+ * \ingroup LabPro-Capture
+ */
+#define LABPRO_CAPTURE_VERSION 1
+
+/** \brief Size of the file header, in bytes. A page, so that chunks stay page-aligned.
+ * \ingroup LabPro-Capture
+ */
+#define LABPRO_CAPTURE_HEADER_SIZE 4096
+
+/** \brief Most channels a capture file can hold.
+ * \ingroup LabPro-Capture
+ */
+#define LABPRO_CAPTURE_MAX_CHANNELS 8
+
+/** \brief Points per chunk used unless LabPro_capture_create() is told otherwise.
+ * \ingroup LabPro-Capture
+ */
+#define LABPRO_CAPTURE_DEFAULT_CHUNK_POINTS 4096
+
+/** \brief Longest equation string kept in the header, including the NULL byte.
+ * \ingroup LabPro-Capture
+ */
+#define LABPRO_CAPTURE_MAX_EQUATION 64
+
+/** \brief How one channel was collected, as stored in the file header
+ * \ingroup LabPro-Capture
+ */
+typedef struct {
+    /* From LabPro_Data_Session */
+    int32_t channel;
+    int32_t analog_op;
+    int32_t sonic_op;
+    int32_t postproc;
+    int32_t sampling_mode;
+    uint8_t use_conversion_eqn;
+    uint8_t use_sonic_temp_compensation;
+    uint8_t has_sensor;
+    uint8_t reserved;
+    char onboard_conversion_equation[LABPRO_CAPTURE_MAX_EQUATION];
+    char sonic_temp_compensation_equation[LABPRO_CAPTURE_MAX_EQUATION];
+    
+    /* From LabPro_Analog_Sensor, if has_sensor is set */
+    int32_t sensor_id;
+    uint32_t serial_number;
+    char name_long[20];
+    char name_short[12];
+    uint8_t is_smart;
+    uint8_t active_cal_idx;
+    uint8_t reserved2[2];
+    float k0;
+    float k1;
+    float k2;
+    char units[8];
+} LabPro_Capture_Channel;
+
+/** \brief The file header
+ * \ingroup LabPro-Capture
+ */
+typedef struct {
+    /** \brief "LPCF" */
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+    
+    /** \brief Seconds between samples, or 0 if not known. */
+    double sample_time;
+    
+    /** \brief Wall-clock time the capture was created, in seconds since the epoch. */
+    int64_t created;
+    
+    uint32_t num_channels;
+    uint32_t chunk_points;
+    
+    /** \brief Bytes taken by each chunk, header included. */
+    uint64_t chunk_size;
+    
+    LabPro_Capture_Channel channels[LABPRO_CAPTURE_MAX_CHANNELS];
+    
+    /** \brief CRC-32 of everything above. */
+    uint32_t crc;
+} LabPro_Capture_Header;
+
+/** \brief The start of each chunk
+ * \ingroup LabPro-Capture
+ */
+typedef struct {
+    /** \brief "LPCK" once the chunk is complete, zero before. */
+    char magic[4];
+    
+    /** \brief Position of the chunk in the file, starting at zero. */
+    uint32_t sequence;
+    
+    /** \brief Points in the chunk, up to chunk_points. */
+    uint32_t num_points;
+    
+    /** \brief CRC-32 of the chunk's columns, num_points values each. */
+    uint32_t crc;
+    
+    uint64_t reserved;
+} LabPro_Capture_Chunk_Header;
+
+/** \brief A capture file being written
+ * \ingroup LabPro-Capture
+ */
+typedef struct {
+    int fd;
+    LabPro_Capture_Header header;
+    
+    /** \brief The chunk being filled, laid out exactly as in the file. */
+    unsigned char* chunk;
+    uint32_t chunk_fill;
+    
+    /** \brief Chunks written to the file so far. */
+    uint32_t num_chunks;
+    
+    /** \brief Make every chunk durable with fdatasync() before going on. */
+    bool sync;
+    
+    /** \brief Set after a write to the file fails; nothing more is written. */
+    bool failed;
+} LabPro_Capture_Writer;
+
+/** \brief One chunk of a capture file, pointing into the mapped file
+ * \ingroup LabPro-Capture
+ */
+typedef struct {
+    uint32_t num_points;
+    const double* times;
+    const double* values[LABPRO_CAPTURE_MAX_CHANNELS];
+} LabPro_Capture_Chunk;
+
+/** \brief A capture file open for reading
+ * \ingroup LabPro-Capture
+ */
+typedef struct {
+    int fd;
+    const unsigned char* map;
+    size_t map_size;
+    const LabPro_Capture_Header* header;
+    
+    /** \brief Complete chunks found so far. */
+    uint32_t num_chunks;
+    
+    /** \brief Points in those chunks. */
+    unsigned long long num_points;
+    
+    /** \brief Chunks whose checksum has been checked; they aren't checked again. */
+    uint32_t num_verified;
+} LabPro_Capture_Reader;
+
+/** \brief Describe a channel for the header of a new capture.
+ * 
+ * \param channel Filled in
+ * \param session How the channel is set up
+ * \param sensor The sensor connected to it, or NULL
+ * 
+ * \ingroup LabPro-Capture
+ */
+void LabPro_capture_describe_channel(LabPro_Capture_Channel* channel, const LabPro_Data_Session* session, const LabPro_Analog_Sensor* sensor);
+
+/** \brief Create a capture file and write its header.
+ * 
+ * \param writer The writer to set up
+ * \param path File to create; overwritten if it exists.
+ * \param channels The channels, from LabPro_capture_describe_channel()
+ * \param num_channels Number of channels, 1 to LABPRO_CAPTURE_MAX_CHANNELS
+ * \param sample_time Seconds between samples, or 0
+ * \param chunk_points Points per chunk, or 0 for LABPRO_CAPTURE_DEFAULT_CHUNK_POINTS
+ * \param sync Whether to wait for each chunk to reach the disk
+ * \return LABPRO_OK, LABPRO_ERR_BAD_CHANNEL, LABPRO_ERR_NO_MEM, or LABPRO_ERR_CAPTURE_IO
+ * 
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_create(LabPro_Capture_Writer* writer, const char* path, const LabPro_Capture_Channel* channels, int num_channels, double sample_time, uint32_t chunk_points, bool sync);
+
+/** \brief Append samples that are interleaved by channel.
+ * 
+ * Each full chunk is written to the file right away.
+ * 
+ * \param writer The writer
+ * \param times count times
+ * \param values count rows with one value per channel
+ * \param count Number of rows
+ * \return LABPRO_OK or LABPRO_ERR_CAPTURE_IO
+ * 
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_append(LabPro_Capture_Writer* writer, const double* times, const double* values, size_t count);
+
+/** \brief Write out the chunk being filled, even though it isn't full.
+ * 
+ * The next point starts a new chunk, so flushing often wastes space.
+ * 
+ * \return LABPRO_OK or LABPRO_ERR_CAPTURE_IO
+ * 
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_flush(LabPro_Capture_Writer* writer);
+
+/** \brief Flush, close the file, and free the writer.
+ * \return LABPRO_OK, or LABPRO_ERR_CAPTURE_IO if part of the capture was lost.
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_close(LabPro_Capture_Writer* writer);
+
+/** \brief Open a capture file for reading, even one that is still being written.
+ * 
+ * \return LABPRO_OK, LABPRO_ERR_CAPTURE_IO, or LABPRO_ERR_BAD_CAPTURE if the
+ *         header is damaged or from an unknown version.
+ * 
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_open(LabPro_Capture_Reader* reader, const char* path);
+
+/** \brief Pick up chunks that have been written since the file was opened or last refreshed.
+ * 
+ * The file may be mapped again, which invalidates all pointers obtained from
+ * the reader before.
+ * 
+ * \return LABPRO_OK or LABPRO_ERR_CAPTURE_IO
+ * 
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_refresh(LabPro_Capture_Reader* reader);
+
+/** \brief Get one chunk, without copying.
+ * 
+ * \param reader The reader
+ * \param index Chunk number, below reader->num_chunks
+ * \param chunk Set to point into the mapped file
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_CAPTURE if there is no such chunk or
+ *         its checksum doesn't match.
+ * 
+ * \ingroup LabPro-Capture
+ */
+int LabPro_capture_chunk(LabPro_Capture_Reader* reader, uint32_t index, LabPro_Capture_Chunk* chunk);
+
+/** \brief Unmap and close a capture file.
+ * \ingroup LabPro-Capture
+ */
+void LabPro_capture_close_reader(LabPro_Capture_Reader* reader);
+
+/** \brief CRC-32 (the one used by zlib and PNG) of some bytes.
+ * \param crc 0, or the result for the bytes before these
+ * \ingroup LabPro-Capture
+ */
+uint32_t LabPro_crc32(uint32_t crc, const void* data, size_t length);
@@ -0,0 +1,278 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/clocksync.h"
+#include <math.h>
+#include <stdlib.h>
+
+double LabPro_clock_host_now(void) {
+    return LabPro_time_usec() / 1e6;
+}
+
+void LabPro_clock_init(LabPro_Clock* clock, double start_host_time) {
+    clock->start_host_time = start_host_time;
+    clock->offset = start_host_time;
+    clock->rate = 1;
+    clock->observations = 0;
+    clock->first_point = 0;
+    clock->num_points = 0;
+    clock->last_bucket = 0;
+}
+
+static LabPro_Clock_Point* LabPro_clock_point(LabPro_Clock* clock, size_t index) {
+    return &clock->points[(clock->first_point + index) % LABPRO_CLOCK_MAX_POINTS];
+}
+
+/* Fit the rate to the points, then put the line under all of them. The
+ * newest bucket is left out of the rate: it has seen the fewest samples, so
+ * its quickest one is likely slower than the others', which would tilt the line.
+ */
+static void LabPro_clock_fit(LabPro_Clock* clock) {
+    size_t num_fitted = clock->num_points - 1;
+    if (num_fitted >= 2) {
+        // Relative to the first point and to a rate of one, to keep the sums accurate.
+        const LabPro_Clock_Point* origin = LabPro_clock_point(clock, 0);
+        double sum_x = 0;
+        double sum_y = 0;
+        for (size_t i = 0; i < num_fitted; ++i) {
+            const LabPro_Clock_Point* point = LabPro_clock_point(clock, i);
+            double x = point->device_time - origin->device_time;
+            sum_x += x;
+            sum_y += point->host_time - origin->host_time - x;
+        }
+        double mean_x = sum_x / num_fitted;
+        double mean_y = sum_y / num_fitted;
+        
+        double sxx = 0;
+        double sxy = 0;
+        for (size_t i = 0; i < num_fitted; ++i) {
+            const LabPro_Clock_Point* point = LabPro_clock_point(clock, i);
+            double x = point->device_time - origin->device_time;
+            double y = point->host_time - origin->host_time - x;
+            sxx += (x - mean_x) * (x - mean_x);
+            sxy += (x - mean_x) * (y - mean_y);
+        }
+        
+        if (sxx > 0) {
+            double drift = sxy / sxx;
+            if (drift > LABPRO_CLOCK_MAX_DRIFT)
+                drift = LABPRO_CLOCK_MAX_DRIFT;
+            if (drift < -LABPRO_CLOCK_MAX_DRIFT)
+                drift = -LABPRO_CLOCK_MAX_DRIFT;
+            clock->rate = 1 + drift;
+        }
+    }
+    
+    double offset = INFINITY;
+    for (size_t i = 0; i < clock->num_points; ++i) {
+        const LabPro_Clock_Point* point = LabPro_clock_point(clock, i);
+        double candidate = point->host_time - clock->rate * point->device_time;
+        if (candidate < offset)
+            offset = candidate;
+    }
+    clock->offset = offset > clock->start_host_time ? offset : clock->start_host_time;
+}
+
+void LabPro_clock_observe(LabPro_Clock* clock, double device_time, double host_time) {
+    ++clock->observations;
+    long long bucket = (long long)floor(device_time / LABPRO_CLOCK_BUCKET_SECONDS);
+    
+    if (clock->num_points == 0 || bucket > clock->last_bucket) {
+        if (clock->num_points == LABPRO_CLOCK_MAX_POINTS) {
+            clock->first_point = (clock->first_point + 1) % LABPRO_CLOCK_MAX_POINTS;
+            --clock->num_points;
+        }
+        LabPro_Clock_Point* point = LabPro_clock_point(clock, clock->num_points++);
+        point->device_time = device_time;
+        point->host_time = host_time;
+        clock->last_bucket = bucket;
+        LabPro_clock_fit(clock);
+        return;
+    }
+    if (bucket < clock->last_bucket)
+        return; // Streams don't go backwards; nothing to learn.
+    
+    // A quicker sample in the newest bucket replaces its point, and can only lower the line.
+    LabPro_Clock_Point* point = LabPro_clock_point(clock, clock->num_points - 1);
+    double candidate = host_time - clock->rate * device_time;
+    if (candidate < point->host_time - clock->rate * point->device_time) {
+        point->device_time = device_time;
+        point->host_time = host_time;
+        if (candidate < clock->offset)
+            clock->offset = candidate > clock->start_host_time ? candidate : clock->start_host_time;
+    }
+}
+
+double LabPro_clock_to_host(const LabPro_Clock* clock, double device_time) {
+    return clock->offset + clock->rate * device_time;
+}
+
+int LabPro_sync_init(LabPro_Sync* sync, LabPro_Realtime_Stream* const* streams, int num_streams, size_t buffer_capacity, double max_delay) {
+    sync->num_sources = 0;
+    sync->buffer_capacity = buffer_capacity > 0 ? buffer_capacity : LABPRO_SYNC_DEFAULT_BUFFER;
+    sync->max_delay = max_delay >= 0 ? max_delay : LABPRO_SYNC_DEFAULT_MAX_DELAY;
+    sync->heap_size = 0;
+    sync->sources = calloc(num_streams > 0 ? num_streams : 1, sizeof(LabPro_Sync_Source));
+    sync->heap = malloc((num_streams > 0 ? num_streams : 1) * sizeof(int));
+    if (sync->sources == NULL || sync->heap == NULL) {
+        LabPro_sync_free(sync);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    for (int i = 0; i < num_streams; ++i) {
+        LabPro_Sync_Source* source = &sync->sources[i];
+        source->buffer = malloc(sync->buffer_capacity * sizeof(LabPro_Synced_Sample));
+        if (source->buffer == NULL) {
+            LabPro_sync_free(sync);
+            return LABPRO_ERR_NO_MEM;
+        }
+        ++sync->num_sources;
+        
+        source->stream = streams[i];
+        LabPro_clock_init(&source->clock, streams[i]->start_host_time);
+        source->first = 0;
+        source->count = 0;
+        source->latest_time = -INFINITY;
+    }
+    return LABPRO_OK;
+}
+
+/* Move whatever the stream has into the source's buffer, aligned. */
+static void LabPro_sync_take(LabPro_Sync* sync, int index) {
+    LabPro_Sync_Source* source = &sync->sources[index];
+    double sample_time = source->stream->config.sample_time;
+    LabPro_Sample batch[LABPRO_SYNC_BATCH];
+    
+    while (source->count < sync->buffer_capacity) {
+        size_t room = sync->buffer_capacity - source->count;
+        if (room > LABPRO_SYNC_BATCH)
+            room = LABPRO_SYNC_BATCH;
+        size_t num_samples = LabPro_realtime_poll(source->stream, batch, room);
+        
+        for (size_t i = 0; i < num_samples; ++i) {
+            double device_time = batch[i].sequence * sample_time;
+            LabPro_clock_observe(&source->clock, device_time, batch[i].host_time);
+            
+            // The fit moves a little as points come in; the stream's own samples stay in order.
+            double time = LabPro_clock_to_host(&source->clock, device_time);
+            if (time < source->latest_time)
+                time = source->latest_time;
+            source->latest_time = time;
+            
+            LabPro_Synced_Sample* entry = &source->buffer[(source->first + source->count) % sync->buffer_capacity];
+            ++source->count;
+            entry->source = index;
+            entry->time = time;
+            entry->sample = batch[i];
+        }
+        if (num_samples < room)
+            break;
+    }
+}
+
+static double LabPro_sync_head_time(const LabPro_Sync* sync, int index) {
+    const LabPro_Sync_Source* source = &sync->sources[index];
+    return source->buffer[source->first].time;
+}
+
+static void LabPro_sync_sift_down(LabPro_Sync* sync, int position) {
+    for (;;) {
+        int smallest = position;
+        int left = 2 * position + 1;
+        int right = left + 1;
+        if (left < sync->heap_size && LabPro_sync_head_time(sync, sync->heap[left]) < LabPro_sync_head_time(sync, sync->heap[smallest]))
+            smallest = left;
+        if (right < sync->heap_size && LabPro_sync_head_time(sync, sync->heap[right]) < LabPro_sync_head_time(sync, sync->heap[smallest]))
+            smallest = right;
+        if (smallest == position)
+            return;
+        
+        int swap = sync->heap[position];
+        sync->heap[position] = sync->heap[smallest];
+        sync->heap[smallest] = swap;
+        position = smallest;
+    }
+}
+
+static size_t LabPro_sync_merge(LabPro_Sync* sync, LabPro_Synced_Sample* samples, size_t max_samples, bool flush) {
+    sync->heap_size = 0;
+    for (int i = 0; i < sync->num_sources; ++i) {
+        LabPro_sync_take(sync, i);
+        if (sync->sources[i].count > 0)
+            sync->heap[sync->heap_size++] = i;
+    }
+    for (int i = sync->heap_size / 2 - 1; i >= 0; --i)
+        LabPro_sync_sift_down(sync, i);
+    
+    // A sample is due once every stream with nothing buffered has already
+    // gone past it, or once it is so old that anything older would have arrived.
+    double idle = INFINITY;
+    for (int i = 0; i < sync->num_sources; ++i) {
+        if (sync->sources[i].count == 0 && sync->sources[i].latest_time < idle)
+            idle = sync->sources[i].latest_time;
+    }
+    double horizon = LabPro_clock_host_now() - sync->max_delay;
+    double limit = flush ? INFINITY : fmax(idle, horizon);
+    
+    size_t num_samples = 0;
+    while (num_samples < max_samples && sync->heap_size > 0) {
+        LabPro_Sync_Source* source = &sync->sources[sync->heap[0]];
+        LabPro_Synced_Sample* entry = &source->buffer[source->first];
+        if (entry->time > limit)
+            break;
+        
+        samples[num_samples++] = *entry;
+        source->first = (source->first + 1) % sync->buffer_capacity;
+        if (--source->count == 0) {
+            sync->heap[0] = sync->heap[--sync->heap_size];
+            if (!flush && source->latest_time < idle) {
+                idle = source->latest_time;
+                limit = fmax(idle, horizon);
+            }
+        }
+        if (sync->heap_size > 0)
+            LabPro_sync_sift_down(sync, 0);
+    }
+    return num_samples;
+}
+
+size_t LabPro_sync_poll(LabPro_Sync* sync, LabPro_Synced_Sample* samples, size_t max_samples) {
+    return LabPro_sync_merge(sync, samples, max_samples, false);
+}
+
+size_t LabPro_sync_flush(LabPro_Sync* sync, LabPro_Synced_Sample* samples, size_t max_samples) {
+    return LabPro_sync_merge(sync, samples, max_samples, true);
+}
+
+void LabPro_sync_free(LabPro_Sync* sync) {
+    if (sync->sources != NULL) {
+        for (int i = 0; i < sync->num_sources; ++i)
+            free(sync->sources[i].buffer);
+    }
+    free(sync->sources);
+    free(sync->heap);
+    sync->sources = NULL;
+    sync->heap = NULL;
+    sync->num_sources = 0;
+    sync->heap_size = 0;
+}
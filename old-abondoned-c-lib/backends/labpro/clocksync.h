@@ -0,0 +1,228 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Clock-Sync Clock synchronization
+ * 
+ * Puts the samples of several LabPros collecting at once on one timeline,
+ * the host's clock as read by LabPro_time_usec(), and merges their realtime
+ * streams into a single stream in time order.
+ * 
+ * Each LabPro keeps time with a crystal of its own, so its sample times
+ * start from whenever it got the command to collect and run a little fast
+ * or slow. For each stream a LabPro_Clock fits
+ * 
+ *     host time = offset + rate * device time
+ * 
+ * where the device time of a sample is its sequence number times the
+ * sample time. Every sample is stamped with the host time it was decoded
+ * (LabPro_Sample.host_time), which is its real host time plus however long
+ * it spent in the LabPro, on USB and waiting to be read. That delay is never
+ * negative, so the samples that got through fastest tell the most: the
+ * quickest sample of every LABPRO_CLOCK_BUCKET_SECONDS of device time is
+ * kept, the rate is fitted to those by least squares, and the offset is
+ * lowered until the line passes under all of them. The host time the start
+ * command was sent (LabPro_Realtime_Stream.start_host_time) bounds the
+ * offset from below, as the LabPro can't have started collecting before it.
+ * The least delay a sample ever has can't be told apart from the offset, but
+ * it is about the same for every LabPro, so it doesn't matter when lining
+ * them up with each other.
+ * 
+ * LabPro_sync_poll() pulls what each stream has, maps it onto host time and
+ * does a k-way merge with a small heap over the streams. A sample is only
+ * handed out once every other stream has caught up with it, or once it is
+ * LabPro_Sync.max_delay old, so that a stream whose samples arrive later
+ * than the others' can't put them out of order.
+ */
+
+#pragma once
+#include "backends/labpro/realtime.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Device time covered by each point the clock fit uses, in seconds.
+ * \ingroup LabPro-Clock-Sync
+ */
+#define LABPRO_CLOCK_BUCKET_SECONDS 1.0
+
+/** \brief Points the clock fit uses at most; older ones are forgotten, so
+ * the fit follows the drift as the crystals warm up.
+ * \ingroup LabPro-Clock-Sync
+ */
+#define LABPRO_CLOCK_MAX_POINTS 300
+
+/** \brief Largest difference in rate from the host's clock believed, as a
+ * fraction. LabPro crystals are far better than this; a fit beyond it is
+ * down to too few points.
+ * \ingroup LabPro-Clock-Sync
+ */
+#define LABPRO_CLOCK_MAX_DRIFT 1e-3
+
+/** \brief Samples buffered for each stream unless LabPro_sync_init() is told otherwise.
+ * \ingroup LabPro-Clock-Sync
+ */
+#define LABPRO_SYNC_DEFAULT_BUFFER 4096
+
+/** \brief Age in seconds at which a sample is handed out even if another
+ * stream hasn't caught up with it, unless LabPro_sync_init() is told otherwise.
+ * \ingroup LabPro-Clock-Sync
+ */
+#define LABPRO_SYNC_DEFAULT_MAX_DELAY 0.25
+
+/** \brief Samples LabPro_sync_poll() takes from a stream at once.
+ * \ingroup LabPro-Clock-Sync
+ */
+#define LABPRO_SYNC_BATCH 64
+
+/** \brief A device time and the host time it was seen at
+ * \ingroup LabPro-Clock-Sync
+ */
+typedef struct {
+    double device_time;
+    double host_time;
+} LabPro_Clock_Point;
+
+/** \brief The mapping from one LabPro's clock to the host's
+ * \ingroup LabPro-Clock-Sync
+ */
+typedef struct {
+    /** \brief Lower bound on offset, from the start command. */
+    double start_host_time;
+    
+    /** \brief Host time of device time zero. */
+    double offset;
+    
+    /** \brief Host seconds per device second. rate - 1 is the LabPro's drift. */
+    double rate;
+    
+    /** \brief Device times seen so far. */
+    unsigned long long observations;
+    
+    /** \brief The quickest point of each bucket, oldest first, in a ring. */
+    LabPro_Clock_Point points[LABPRO_CLOCK_MAX_POINTS];
+    size_t first_point;
+    size_t num_points;
+    long long last_bucket;
+} LabPro_Clock;
+
+/** \brief A merged sample
+ * \ingroup LabPro-Clock-Sync
+ */
+typedef struct {
+    /** \brief Position of the sample's stream in the array given to LabPro_sync_init(). */
+    int source;
+    
+    /** \brief When the sample was taken, in host seconds. */
+    double time;
+    
+    LabPro_Sample sample;
+} LabPro_Synced_Sample;
+
+/** \brief One stream being merged
+ * \ingroup LabPro-Clock-Sync
+ */
+typedef struct {
+    LabPro_Realtime_Stream* stream;
+    LabPro_Clock clock;
+    
+    /** \brief Samples taken from the stream but not handed out yet, in a ring. */
+    LabPro_Synced_Sample* buffer;
+    size_t first;
+    size_t count;
+    
+    /** \brief Aligned time of the newest sample taken from the stream, or -INFINITY. */
+    double latest_time;
+} LabPro_Sync_Source;
+
+/** \brief Several streams being merged
+ * \ingroup LabPro-Clock-Sync
+ */
+typedef struct {
+    LabPro_Sync_Source* sources;
+    int num_sources;
+    size_t buffer_capacity;
+    double max_delay;
+    
+    /** \brief Sources with buffered samples, as a min-heap on the time of
+     * their oldest one. Only used inside LabPro_sync_poll().
+     */
+    int* heap;
+    int heap_size;
+} LabPro_Sync;
+
+/** \brief LabPro_time_usec() in seconds.
+ * \ingroup LabPro-Clock-Sync
+ */
+double LabPro_clock_host_now(void);
+
+/** \brief Start a clock with no points. Until it has some, device time zero
+ * is taken to be start_host_time.
+ * \ingroup LabPro-Clock-Sync
+ */
+void LabPro_clock_init(LabPro_Clock* clock, double start_host_time);
+
+/** \brief Refine the clock with a sample that was seen on the host at host_time.
+ * \ingroup LabPro-Clock-Sync
+ */
+void LabPro_clock_observe(LabPro_Clock* clock, double device_time, double host_time);
+
+/** \brief Map a device time to host time with the clock as it is now.
+ * \ingroup LabPro-Clock-Sync
+ */
+double LabPro_clock_to_host(const LabPro_Clock* clock, double device_time);
+
+/** \brief Set up merging of running realtime streams.
+ * 
+ * \param sync The merge to set up
+ * \param streams The streams, which must outlive the merge. Nothing else may
+ *        poll them while it is in use.
+ * \param num_streams Number of streams
+ * \param buffer_capacity Samples to buffer for each stream, or 0 for
+ *        LABPRO_SYNC_DEFAULT_BUFFER. A stream whose buffer is full is left
+ *        alone until the others catch up, so its own queue fills instead.
+ * \param max_delay Seconds after which a sample is handed out even if
+ *        another stream has nothing as new yet, or a negative number for
+ *        LABPRO_SYNC_DEFAULT_MAX_DELAY. It should be more than the longest
+ *        a sample takes to arrive.
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-Clock-Sync
+ */
+int LabPro_sync_init(LabPro_Sync* sync, LabPro_Realtime_Stream* const* streams, int num_streams, size_t buffer_capacity, double max_delay);
+
+/** \brief Take what the streams have and hand out the samples that are due, oldest first.
+ * \return The number of samples put into samples
+ * \ingroup LabPro-Clock-Sync
+ */
+size_t LabPro_sync_poll(LabPro_Sync* sync, LabPro_Synced_Sample* samples, size_t max_samples);
+
+/** \brief Like LabPro_sync_poll(), but without waiting for any stream to
+ * catch up, e.g. right before the streams are stopped.
+ * \ingroup LabPro-Clock-Sync
+ */
+size_t LabPro_sync_flush(LabPro_Sync* sync, LabPro_Synced_Sample* samples, size_t max_samples);
+
+/** \brief Free the merge's buffers. The streams are left as they are.
+ * \ingroup LabPro-Clock-Sync
+ */
+void LabPro_sync_free(LabPro_Sync* sync);
@@ -0,0 +1,322 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/compress.h"
+#include "backends/labpro/labpro-internal.h"
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Multiples beyond this can't be told apart once converted to a double. */
+#define LABPRO_COMPRESS_MAX_MULTIPLE (1LL << 52)
+
+/* offset + multiple * quantum, rounded once so that every compiler and CPU
+ * gets the same bits whether or not it would have fused the operations itself.
+ */
+static double LabPro_compress_value(double offset, int64_t multiple, double quantum) {
+    return fma((double)multiple, quantum, offset);
+}
+
+static size_t LabPro_varint_put(unsigned char* out, uint64_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+static size_t LabPro_varint_size(uint64_t value) {
+    size_t length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++length;
+    }
+    return length;
+}
+
+/* Read a varint, or return false if it runs past end or is too long. */
+static bool LabPro_varint_get(const unsigned char** cursor, const unsigned char* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*cursor == end)
+            return false;
+        unsigned char byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t LabPro_zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t LabPro_unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint64_t LabPro_double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double LabPro_bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+size_t LabPro_compress_bound(size_t count) {
+    // Codec, count, offset, quantum, first multiple and bit width, then at worst 9 bytes per value.
+    return 1 + 10 + 16 + 10 + 1 + 9 * count;
+}
+
+static int LabPro_bit_width(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+/* Turn every value into its multiple of quantum, or return false if one
+ * doesn't come back bit for bit.
+ */
+static bool LabPro_compress_quantize(const double* values, size_t count, double offset, double quantum, int64_t* multiples) {
+    if (!(quantum > 0) || !isfinite(quantum) || !isfinite(offset))
+        return false;
+    
+    for (size_t i = 0; i < count; ++i) {
+        double multiple = nearbyint((values[i] - offset) / quantum);
+        if (!(fabs(multiple) < LABPRO_COMPRESS_MAX_MULTIPLE))
+            return false;
+        multiples[i] = (int64_t)multiple;
+        if (LabPro_double_bits(LabPro_compress_value(offset, multiples[i], quantum)) != LabPro_double_bits(values[i]))
+            return false;
+    }
+    return true;
+}
+
+static size_t LabPro_compress_xor(const double* values, size_t count, unsigned char* out) {
+    size_t length = 0;
+    uint64_t previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t bits = LabPro_double_bits(values[i]);
+        if (i == 0) {
+            memcpy(out, &bits, sizeof(bits));
+            length = sizeof(bits);
+            previous = bits;
+            continue;
+        }
+        
+        uint64_t difference = bits ^ previous;
+        previous = bits;
+        if (difference == 0) {
+            out[length++] = 0;
+            continue;
+        }
+        
+        int trailing = __builtin_ctzll(difference) / 8;
+        int significant = 8 - __builtin_clzll(difference) / 8 - trailing;
+        out[length++] = (unsigned char)(significant << 4 | trailing);
+        difference >>= 8 * trailing;
+        for (int j = 0; j < significant; ++j, difference >>= 8)
+            out[length++] = (unsigned char)difference;
+    }
+    return length;
+}
+
+size_t LabPro_compress_block(const double* values, size_t count, double offset, double quantum, unsigned char* out) {
+    if (count > LABPRO_COMPRESS_MAX_BLOCK)
+        count = LABPRO_COMPRESS_MAX_BLOCK;
+    
+    int64_t multiples[LABPRO_COMPRESS_MAX_BLOCK];
+    if (!LabPro_compress_quantize(values, count, offset, quantum, multiples)) {
+        out[0] = LABPRO_CODEC_XOR;
+        size_t length = 1 + LabPro_varint_put(out + 1, count);
+        return length + LabPro_compress_xor(values, count, out + length);
+    }
+    
+    // Evenly spaced values cost nothing as second differences, noisy ones less as first differences.
+    uint64_t first_order = 0;
+    uint64_t second_order = 0;
+    for (size_t i = 1; i < count; ++i) {
+        int64_t delta = multiples[i] - multiples[i - 1];
+        first_order |= LabPro_zigzag(delta);
+        if (i > 1)
+            second_order |= LabPro_zigzag(delta - (multiples[i - 1] - multiples[i - 2]));
+    }
+    enum LabPro_Codec codec = LabPro_bit_width(second_order) < LabPro_bit_width(first_order) ? LABPRO_CODEC_DELTA2 : LABPRO_CODEC_DELTA;
+    int width = LabPro_bit_width(codec == LABPRO_CODEC_DELTA2 ? second_order : first_order);
+    
+    out[0] = codec;
+    size_t length = 1 + LabPro_varint_put(out + 1, count);
+    memcpy(out + length, &offset, sizeof(double));
+    memcpy(out + length + sizeof(double), &quantum, sizeof(double));
+    length += 2 * sizeof(double);
+    if (count == 0)
+        return length;
+    
+    length += LabPro_varint_put(out + length, LabPro_zigzag(multiples[0]));
+    size_t first_packed = 1;
+    if (codec == LABPRO_CODEC_DELTA2) {
+        // The second differences only start with the third value.
+        length += LabPro_varint_put(out + length, LabPro_zigzag(multiples[1] - multiples[0]));
+        first_packed = 2;
+    }
+    out[length++] = (unsigned char)width;
+    
+    // Pack the differences width bits each, lowest bit first.
+    unsigned __int128 pending = 0;
+    int pending_bits = 0;
+    for (size_t i = first_packed; i < count; ++i) {
+        int64_t delta = multiples[i] - multiples[i - 1];
+        int64_t encoded = codec == LABPRO_CODEC_DELTA2 ? delta - (multiples[i - 1] - multiples[i - 2]) : delta;
+        pending |= (unsigned __int128)LabPro_zigzag(encoded) << pending_bits;
+        pending_bits += width;
+        while (pending_bits >= 8) {
+            out[length++] = (unsigned char)pending;
+            pending >>= 8;
+            pending_bits -= 8;
+        }
+    }
+    if (pending_bits > 0)
+        out[length++] = (unsigned char)pending;
+    return length;
+}
+
+int LabPro_compress_block_count(const unsigned char* data, size_t length, size_t* count) {
+    const unsigned char* cursor = data + 1;
+    uint64_t value;
+    if (length < 1 || data[0] > LABPRO_CODEC_DELTA2 || !LabPro_varint_get(&cursor, data + length, &value) || value > LABPRO_COMPRESS_MAX_BLOCK)
+        return LABPRO_ERR_BAD_BLOCK;
+    
+    *count = (size_t)value;
+    return LABPRO_OK;
+}
+
+int LabPro_decompress_block(const unsigned char* data, size_t length, double* values, size_t max_values, size_t* count, size_t* used) {
+    *count = 0;
+    *used = 0;
+    
+    size_t num_values;
+    int retval = LabPro_compress_block_count(data, length, &num_values);
+    if (retval != LABPRO_OK)
+        return retval;
+    if (num_values > max_values)
+        return LABPRO_ERR_LIST_TOO_LONG;
+    
+    const unsigned char* end = data + length;
+    const unsigned char* cursor = data + 1 + LabPro_varint_size(num_values);
+    enum LabPro_Codec codec = (enum LabPro_Codec)data[0];
+    
+    if (codec == LABPRO_CODEC_XOR) {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < num_values; ++i) {
+            if (i == 0) {
+                if (end - cursor < (ptrdiff_t)sizeof(bits))
+                    return LABPRO_ERR_BAD_BLOCK;
+                memcpy(&bits, cursor, sizeof(bits));
+                cursor += sizeof(bits);
+            }
+            else {
+                if (cursor == end)
+                    return LABPRO_ERR_BAD_BLOCK;
+                int significant = *cursor >> 4;
+                int trailing = *cursor & 0x0F;
+                ++cursor;
+                if (significant + trailing > 8 || (significant == 0 && trailing > 0) || end - cursor < significant)
+                    return LABPRO_ERR_BAD_BLOCK;
+                
+                uint64_t difference = 0;
+                for (int j = significant - 1; j >= 0; --j)
+                    difference = difference << 8 | cursor[j];
+                cursor += significant;
+                bits ^= difference << (8 * trailing);
+            }
+            values[i] = LabPro_bits_double(bits);
+        }
+    }
+    else {
+        double offset, quantum;
+        if (end - cursor < (ptrdiff_t)(2 * sizeof(double)))
+            return LABPRO_ERR_BAD_BLOCK;
+        memcpy(&offset, cursor, sizeof(double));
+        memcpy(&quantum, cursor + sizeof(double), sizeof(double));
+        cursor += 2 * sizeof(double);
+        
+        if (num_values > 0) {
+            uint64_t encoded;
+            uint64_t first_delta = 0;
+            size_t first_packed = 1;
+            if (!LabPro_varint_get(&cursor, end, &encoded))
+                return LABPRO_ERR_BAD_BLOCK;
+            if (codec == LABPRO_CODEC_DELTA2 && num_values > 1) {
+                if (!LabPro_varint_get(&cursor, end, &first_delta))
+                    return LABPRO_ERR_BAD_BLOCK;
+                first_packed = 2;
+            }
+            if (cursor == end || *cursor > 64)
+                return LABPRO_ERR_BAD_BLOCK;
+            
+            int width = *cursor++;
+            size_t packed_length = (num_values > first_packed ? (num_values - first_packed) * width + 7 : 0) / 8;
+            if ((size_t)(end - cursor) < packed_length)
+                return LABPRO_ERR_BAD_BLOCK;
+            
+            // Unsigned, so that a damaged block wraps around instead of overflowing.
+            uint64_t multiple = (uint64_t)LabPro_unzigzag(encoded);
+            uint64_t delta = (uint64_t)LabPro_unzigzag(first_delta);
+            uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+            unsigned __int128 pending = 0;
+            int pending_bits = 0;
+            values[0] = LabPro_compress_value(offset, (int64_t)multiple, quantum);
+            if (first_packed == 2) {
+                multiple += delta;
+                values[1] = LabPro_compress_value(offset, (int64_t)multiple, quantum);
+            }
+            for (size_t i = first_packed; i < num_values; ++i) {
+                while (pending_bits < width) {
+                    pending |= (unsigned __int128)*cursor++ << pending_bits;
+                    pending_bits += 8;
+                }
+                encoded = (uint64_t)pending & mask;
+                pending >>= width;
+                pending_bits -= width;
+                
+                if (codec == LABPRO_CODEC_DELTA2)
+                    delta += (uint64_t)LabPro_unzigzag(encoded);
+                else
+                    delta = (uint64_t)LabPro_unzigzag(encoded);
+                multiple += delta;
+                values[i] = LabPro_compress_value(offset, (int64_t)multiple, quantum);
+            }
+        }
+    }
+    
+    *count = num_values;
+    *used = cursor - data;
+    return LABPRO_OK;
+}
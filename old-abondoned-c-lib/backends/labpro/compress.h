@@ -0,0 +1,122 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Compress Sample compression
+ * 
+ * A lossless codec for columns of samples, such as the columns of a
+ * \ref LabPro-Store or a \ref LabPro-Capture chunk. Data is compressed in
+ * independent blocks of up to LABPRO_COMPRESS_MAX_BLOCK values, so any block
+ * can be decoded without the ones before it.
+ * 
+ * A block is about the size of a store chunk, so decoding one to get at a
+ * single value stays cheap.
+ * 
+ * Values from the LabPro are almost always whole multiples of some step: the
+ * ADC's resolution for analog channels, the sample time for the time column.
+ * Given that step, a block is stored as the differences between successive
+ * multiples, or the differences between those differences, whichever needs
+ * fewer bits, packed with just as many bits as the largest of them needs. A
+ * slowly changing value then takes two or three bits per sample, and an evenly
+ * spaced time column nothing at all beyond the block's header. Blocks where
+ * some value isn't exactly offset + k * quantum, or where no quantum is given,
+ * are stored by XORing each value with the one before and dropping the zero
+ * bytes of the result instead.
+ * 
+ * Block format (doubles in host byte order, like capture files):
+ * 
+ *     codec (1 byte), count (varint)
+ *     LABPRO_CODEC_XOR:     first value (8 bytes), then per value: a control byte
+ *                           with the number of significant bytes of the XOR in the
+ *                           high nibble and of trailing zero bytes in the low
+ *                           nibble, then the significant bytes, lowest first
+ *     LABPRO_CODEC_DELTA,
+ *     LABPRO_CODEC_DELTA2:  offset (8 bytes), quantum (8 bytes), the first
+ *                           multiple (zigzag varint), for LABPRO_CODEC_DELTA2 the
+ *                           first difference (zigzag varint), the bit width w
+ *                           (1 byte), then the remaining differences of the first
+ *                           or second order as zigzag numbers of w bits each,
+ *                           packed lowest bit first
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief Most values in one block.
+ * \ingroup LabPro-Compress
+ */
+#define LABPRO_COMPRESS_MAX_BLOCK 4096
+
+/** \brief How a block is stored
+ * \ingroup LabPro-Compress
+ */
+enum LabPro_Codec {
+    /** \brief Each value XORed with the one before, zero bytes dropped. */
+    LABPRO_CODEC_XOR,
+    /** \brief Differences between successive multiples of the quantum. */
+    LABPRO_CODEC_DELTA,
+    /** \brief Differences between successive differences. */
+    LABPRO_CODEC_DELTA2
+};
+
+/** \brief Most bytes a block of count values can take.
+ * \ingroup LabPro-Compress
+ */
+size_t LabPro_compress_bound(size_t count);
+
+/** \brief Compress one block.
+ * 
+ * \param values The values
+ * \param count Number of values, up to LABPRO_COMPRESS_MAX_BLOCK
+ * \param offset, quantum The values are expected to be offset + k * quantum
+ *        for whole numbers k. Use a quantum of 0 if they aren't.
+ * \param out Receives the block; needs LabPro_compress_bound(count) bytes.
+ * \return Size of the block in bytes.
+ * 
+ * \ingroup LabPro-Compress
+ */
+size_t LabPro_compress_block(const double* values, size_t count, double offset, double quantum, unsigned char* out);
+
+/** \brief Get the number of values in a block without decoding it.
+ * 
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_BLOCK if data doesn't start with a block.
+ * 
+ * \ingroup LabPro-Compress
+ */
+int LabPro_compress_block_count(const unsigned char* data, size_t length, size_t* count);
+
+/** \brief Decompress one block.
+ * 
+ * \param data Start of the block
+ * \param length Bytes available from data on; may extend past the block.
+ * \param values Receives the values
+ * \param max_values Room in values
+ * \param count Set to the number of values
+ * \param used Set to the size of the block, so the next one starts at data + used.
+ * \return LABPRO_OK, LABPRO_ERR_BAD_BLOCK if the block is damaged or cut off,
+ *         or LABPRO_ERR_LIST_TOO_LONG if it has more than max_values values.
+ * 
+ * \ingroup LabPro-Compress
+ */
+int LabPro_decompress_block(const unsigned char* data, size_t length, double* values, size_t max_values, size_t* count, size_t* used);
@@ -0,0 +1,58 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/cpu.h"
+#include <stdatomic.h>
+
+// -1 until the level has been detected.
+static _Atomic int LabPro_current_simd_level = -1;
+
+enum LabPro_SIMD_Level LabPro_simd_detect() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return LABPRO_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return LABPRO_SIMD_SSE42;
+#endif
+    return LABPRO_SIMD_NONE;
+}
+
+enum LabPro_SIMD_Level LabPro_simd_level() {
+    int level = atomic_load_explicit(&LabPro_current_simd_level, memory_order_relaxed);
+    if (level < 0) {
+        // Racing threads all detect the same thing, so it doesn't matter who stores it.
+        level = LabPro_simd_detect();
+        atomic_store_explicit(&LabPro_current_simd_level, level, memory_order_relaxed);
+    }
+    return (enum LabPro_SIMD_Level)level;
+}
+
+enum LabPro_SIMD_Level LabPro_set_simd_level(enum LabPro_SIMD_Level level) {
+    enum LabPro_SIMD_Level supported = LabPro_simd_detect();
+    if (level > supported)
+        level = supported;
+    
+    atomic_store_explicit(&LabPro_current_simd_level, level, memory_order_relaxed);
+    return level;
+}
@@ -0,0 +1,67 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-CPU CPU feature detection
+ * 
+ * Picks which vectorized code paths liblabpro uses. The level is detected
+ * from the CPU the first time it is needed, and can be lowered afterwards,
+ * e.g. to compare the vectorized and scalar paths in benchmarks. On
+ * compilers or architectures without the x86 intrinsics, the level is always
+ * LABPRO_SIMD_NONE.
+ */
+
+#pragma once
+
+/** \brief Instruction set extensions liblabpro knows how to use
+ * \ingroup LabPro-CPU
+ */
+enum LabPro_SIMD_Level {
+    /** \brief Plain C only. */
+    LABPRO_SIMD_NONE,
+    
+    /** \brief SSE up to SSE4.2, including SSSE3's byte shuffles and POPCNT. */
+    LABPRO_SIMD_SSE42,
+    
+    /** \brief AVX2, which doubles the vector width of the SSE4.2 paths. */
+    LABPRO_SIMD_AVX2
+};
+
+/** \brief The best level the CPU running this process supports.
+ * \ingroup LabPro-CPU
+ */
+enum LabPro_SIMD_Level LabPro_simd_detect();
+
+/** \brief The level currently in use. Defaults to LabPro_simd_detect().
+ * \ingroup LabPro-CPU
+ */
+enum LabPro_SIMD_Level LabPro_simd_level();
+
+/** \brief Change the level in use.
+ * 
+ * \param level Requested level; lowered to what the CPU supports.
+ * \return The level actually in use from now on.
+ * 
+ * \ingroup LabPro-CPU
+ */
+enum LabPro_SIMD_Level LabPro_set_simd_level(enum LabPro_SIMD_Level level);
@@ -0,0 +1,290 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/decimate.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+void LabPro_decimate_init(LabPro_Decimator* decimator) {
+    memset(decimator, 0, sizeof(LabPro_Decimator));
+}
+
+void LabPro_decimate_free(LabPro_Decimator* decimator) {
+    for (int level = 0; level < LABPRO_DECIMATE_MAX_LEVELS; ++level)
+        free(decimator->buckets[level]);
+    LabPro_decimate_init(decimator);
+}
+
+/* Adds the samples of from, which all come after those of into, to into. */
+static void LabPro_decimate_merge(LabPro_Decimate_Bucket* into, const LabPro_Decimate_Bucket* from) {
+    if (from->count == 0)
+        return;
+    if (into->count == 0) {
+        *into = *from;
+        return;
+    }
+    
+    into->last_time = from->last_time;
+    into->last_value = from->last_value;
+    if (from->min < into->min) {
+        into->min = from->min;
+        into->min_time = from->min_time;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+        into->max_time = from->max_time;
+    }
+    into->sum_time += from->sum_time;
+    into->sum_value += from->sum_value;
+    into->count += from->count;
+}
+
+static int LabPro_decimate_reserve(LabPro_Decimator* decimator, int level) {
+    if (decimator->num_buckets[level] < decimator->capacity[level])
+        return LABPRO_OK;
+    
+    size_t capacity = decimator->capacity[level] ? decimator->capacity[level] * 2 : 64;
+    LabPro_Decimate_Bucket* buckets = realloc(decimator->buckets[level], capacity * sizeof(LabPro_Decimate_Bucket));
+    if (buckets == NULL)
+        return LABPRO_ERR_NO_MEM;
+    decimator->buckets[level] = buckets;
+    decimator->capacity[level] = capacity;
+    return LABPRO_OK;
+}
+
+static int LabPro_decimate_append_one(LabPro_Decimator* decimator, double time, double value) {
+    // Make room on every level this sample completes a bucket on first, so
+    // that running out of memory leaves nothing half done.
+    for (int level = 0; level < LABPRO_DECIMATE_MAX_LEVELS && decimator->open_parts[level] == LABPRO_DECIMATE_FANOUT - 1; ++level) {
+        if (LabPro_decimate_reserve(decimator, level) != LABPRO_OK)
+            return LABPRO_ERR_NO_MEM;
+    }
+    
+    LabPro_Decimate_Bucket sample = {
+        time, value, time, value, time, value, time, value, time, value, 1
+    };
+    LabPro_decimate_merge(&decimator->open[0], &sample);
+    decimator->open_parts[0]++;
+    decimator->num_samples++;
+    
+    for (int level = 0; level < LABPRO_DECIMATE_MAX_LEVELS && decimator->open_parts[level] == LABPRO_DECIMATE_FANOUT; ++level) {
+        decimator->buckets[level][decimator->num_buckets[level]++] = decimator->open[level];
+        if (level + 1 < LABPRO_DECIMATE_MAX_LEVELS) {
+            LabPro_decimate_merge(&decimator->open[level + 1], &decimator->open[level]);
+            decimator->open_parts[level + 1]++;
+        }
+        memset(&decimator->open[level], 0, sizeof(LabPro_Decimate_Bucket));
+        decimator->open_parts[level] = 0;
+    }
+    return LABPRO_OK;
+}
+
+int LabPro_decimate_append(LabPro_Decimator* decimator, const double* times, const double* values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int retval = LabPro_decimate_append_one(decimator, times[i], values[i]);
+        if (retval != LABPRO_OK)
+            return retval;
+    }
+    return LABPRO_OK;
+}
+
+/* The buckets of one level that overlap the plot, followed by a bucket for
+ * the samples that no complete bucket of that level holds yet.
+ */
+typedef struct {
+    const LabPro_Decimate_Bucket* buckets;
+    size_t num_buckets;
+    LabPro_Decimate_Bucket tail;
+    size_t first;
+    size_t end;
+    
+    double start;
+    double width;
+    size_t pixels;
+} LabPro_Decimate_View;
+
+static const LabPro_Decimate_Bucket* LabPro_decimate_view_get(const LabPro_Decimate_View* view, size_t index) {
+    return index < view->num_buckets ? &view->buckets[index] : &view->tail;
+}
+
+static void LabPro_decimate_view_init(LabPro_Decimate_View* view, const LabPro_Decimator* decimator, int level, double start, double end, size_t pixels) {
+    view->buckets = decimator->buckets[level];
+    view->num_buckets = decimator->num_buckets[level];
+    view->start = start;
+    view->width = end - start;
+    view->pixels = pixels;
+    
+    // The open buckets of the levels below hold later samples than the one on this level.
+    memset(&view->tail, 0, sizeof(LabPro_Decimate_Bucket));
+    for (int below = level; below >= 0; --below)
+        LabPro_decimate_merge(&view->tail, &decimator->open[below]);
+    
+    // First bucket ending at or after start
+    size_t low = 0, high = view->num_buckets;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (view->buckets[middle].last_time < start)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    view->first = low;
+    
+    // First bucket starting after end
+    high = view->num_buckets;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (view->buckets[middle].first_time <= end)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    view->end = low;
+    
+    if (view->end == view->num_buckets && view->tail.count > 0 && view->tail.first_time <= end && view->tail.last_time >= start)
+        view->end++;
+}
+
+static size_t LabPro_decimate_view_column(const LabPro_Decimate_View* view, const LabPro_Decimate_Bucket* bucket) {
+    if (!(view->width > 0))
+        return 0;
+    
+    double position = ((bucket->first_time + bucket->last_time) / 2 - view->start) / view->width * view->pixels;
+    if (position < 0)
+        return 0;
+    if (position >= view->pixels)
+        return view->pixels - 1;
+    return (size_t)position;
+}
+
+/* Gathers the buckets from *index on that fall in the same pixel column.
+ * Returns false if there are none left.
+ */
+static bool LabPro_decimate_view_next(const LabPro_Decimate_View* view, size_t* index, LabPro_Decimate_Bucket* column, size_t* column_first, size_t* column_end) {
+    if (*index >= view->end)
+        return false;
+    
+    const LabPro_Decimate_Bucket* bucket = LabPro_decimate_view_get(view, *index);
+    size_t pixel = LabPro_decimate_view_column(view, bucket);
+    *column = *bucket;
+    *column_first = (*index)++;
+    while (*index < view->end) {
+        bucket = LabPro_decimate_view_get(view, *index);
+        if (LabPro_decimate_view_column(view, bucket) != pixel)
+            break;
+        LabPro_decimate_merge(column, bucket);
+        ++*index;
+    }
+    *column_end = *index;
+    return true;
+}
+
+/* Picks the coarsest level with at least as many buckets in the plot as pixels, or the finest. */
+static void LabPro_decimate_choose(LabPro_Decimate_View* view, const LabPro_Decimator* decimator, double start, double end, size_t pixels) {
+    for (int level = LABPRO_DECIMATE_MAX_LEVELS - 1; level >= 0; --level) {
+        LabPro_decimate_view_init(view, decimator, level, start, end, pixels);
+        if (view->end > view->first && view->end - view->first >= pixels)
+            return;
+    }
+}
+
+size_t LabPro_decimate_minmax(const LabPro_Decimator* decimator, double start, double end, size_t pixels, LabPro_Decimate_Bucket* columns) {
+    if (pixels == 0)
+        return 0;
+    
+    LabPro_Decimate_View view;
+    LabPro_decimate_choose(&view, decimator, start, end, pixels);
+    
+    size_t count = 0;
+    size_t index = view.first;
+    size_t column_first, column_end;
+    while (LabPro_decimate_view_next(&view, &index, &columns[count], &column_first, &column_end))
+        ++count;
+    return count;
+}
+
+static double LabPro_decimate_area(const LabPro_Plot_Point* a, double time, double value, double c_time, double c_value) {
+    return fabs((a->time - c_time) * (value - a->value) - (a->time - time) * (c_value - a->value));
+}
+
+size_t LabPro_decimate_lttb(const LabPro_Decimator* decimator, double start, double end, size_t pixels, LabPro_Plot_Point* points) {
+    if (pixels == 0)
+        return 0;
+    
+    LabPro_Decimate_View view;
+    LabPro_decimate_choose(&view, decimator, start, end, pixels);
+    
+    size_t index = view.first;
+    LabPro_Decimate_Bucket current, next;
+    size_t current_first, current_end, next_first, next_end;
+    if (!LabPro_decimate_view_next(&view, &index, &current, &current_first, &current_end))
+        return 0;
+    
+    points[0].time = current.first_time;
+    points[0].value = current.first_value;
+    size_t count = 1;
+    
+    if (!LabPro_decimate_view_next(&view, &index, &next, &next_first, &next_end)) {
+        if (pixels > 1 && current.count > 1) {
+            points[1].time = current.last_time;
+            points[1].value = current.last_value;
+            count = 2;
+        }
+        return count;
+    }
+    
+    while (true) {
+        current = next;
+        current_first = next_first;
+        current_end = next_end;
+        if (!LabPro_decimate_view_next(&view, &index, &next, &next_first, &next_end)) {
+            points[count].time = current.last_time;
+            points[count].value = current.last_value;
+            return count + 1;
+        }
+        
+        // The candidates are the extremes of each bucket in the column.
+        const LabPro_Plot_Point* a = &points[count - 1];
+        double c_time = next.sum_time / next.count;
+        double c_value = next.sum_value / next.count;
+        double best_area = -1;
+        for (size_t i = current_first; i < current_end; ++i) {
+            const LabPro_Decimate_Bucket* bucket = LabPro_decimate_view_get(&view, i);
+            double area = LabPro_decimate_area(a, bucket->min_time, bucket->min, c_time, c_value);
+            if (area > best_area) {
+                best_area = area;
+                points[count].time = bucket->min_time;
+                points[count].value = bucket->min;
+            }
+            area = LabPro_decimate_area(a, bucket->max_time, bucket->max, c_time, c_value);
+            if (area > best_area) {
+                best_area = area;
+                points[count].time = bucket->max_time;
+                points[count].value = bucket->max;
+            }
+        }
+        ++count;
+    }
+}
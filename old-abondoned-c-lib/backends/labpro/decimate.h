@@ -0,0 +1,164 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Decimate Decimation for plotting
+ * 
+ * Keeps a summary of a channel at several resolutions, so that a plot of any
+ * part of a long collection can be drawn from about as many points as it has
+ * pixels, however many samples that part holds. This is done on the host;
+ * the LabPro's own data reduction (command 10) throws the samples away.
+ * 
+ * The samples are grouped into buckets of LABPRO_DECIMATE_FANOUT, those into
+ * buckets of LABPRO_DECIMATE_FANOUT buckets, and so on. Each bucket keeps
+ * its first, last, smallest and largest values with their times, which is
+ * all a line plot needs to look exactly like one drawn from every sample,
+ * plus its average. Buckets are added as the samples arrive, with a constant
+ * amount of work per sample on average. The summary takes about 6 bytes per
+ * sample.
+ * 
+ * A plot is then drawn from the coarsest level that still has a bucket or
+ * more per pixel:
+ * 
+ * - LabPro_decimate_minmax() merges them into one bucket per pixel column,
+ *   to draw as a vertical line from min to max (joined by first and last).
+ * - LabPro_decimate_lttb() picks one point per column with
+ *   Largest-Triangle-Three-Buckets, choosing among the buckets' smallest and
+ *   largest values (MinMaxLTTB), for a line plot with one point per pixel.
+ * 
+ * Either takes time proportional to the number of pixels. When even the
+ * finest level has fewer buckets than pixels in a range, there are fewer
+ * than LABPRO_DECIMATE_FANOUT samples per pixel and the samples themselves
+ * are best drawn instead.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <stddef.h>
+
+/** \brief Samples in a bucket of the finest level, and buckets in a bucket of the levels above.
+ * \ingroup LabPro-Decimate
+ */
+#define LABPRO_DECIMATE_FANOUT 16
+
+/** \brief Levels kept. The coarsest has buckets of 16^8 samples, about 4 billion.
+ * \ingroup LabPro-Decimate
+ */
+#define LABPRO_DECIMATE_MAX_LEVELS 8
+
+/** \brief Summary of a run of samples
+ * \ingroup LabPro-Decimate
+ */
+typedef struct {
+    double first_time;
+    double first_value;
+    double last_time;
+    double last_value;
+    double min_time;
+    double min;
+    double max_time;
+    double max;
+    
+    /** \brief Sums of the times and values, for their averages. */
+    double sum_time;
+    double sum_value;
+    
+    /** \brief Samples in the run. */
+    unsigned long long count;
+} LabPro_Decimate_Bucket;
+
+/** \brief A point picked for plotting
+ * \ingroup LabPro-Decimate
+ */
+typedef struct {
+    double time;
+    double value;
+} LabPro_Plot_Point;
+
+/** \brief The summary of one channel
+ * \ingroup LabPro-Decimate
+ */
+typedef struct {
+    /** \brief Complete buckets of each level, oldest first. */
+    LabPro_Decimate_Bucket* buckets[LABPRO_DECIMATE_MAX_LEVELS];
+    size_t num_buckets[LABPRO_DECIMATE_MAX_LEVELS];
+    size_t capacity[LABPRO_DECIMATE_MAX_LEVELS];
+    
+    /** \brief The bucket being filled on each level, and what it has been filled with
+     * so far: samples on the finest level, complete buckets of the level below on the others.
+     */
+    LabPro_Decimate_Bucket open[LABPRO_DECIMATE_MAX_LEVELS];
+    int open_parts[LABPRO_DECIMATE_MAX_LEVELS];
+    
+    unsigned long long num_samples;
+} LabPro_Decimator;
+
+/** \brief Set up an empty summary.
+ * \ingroup LabPro-Decimate
+ */
+void LabPro_decimate_init(LabPro_Decimator* decimator);
+
+/** \brief Free a summary's buckets.
+ * \ingroup LabPro-Decimate
+ */
+void LabPro_decimate_free(LabPro_Decimator* decimator);
+
+/** \brief Add samples.
+ * 
+ * \param decimator The summary
+ * \param times count times, no earlier than those added before
+ * \param values count values, not NAN
+ * \param count Number of samples
+ * \return LABPRO_OK, or LABPRO_ERR_NO_MEM. Samples before the one that
+ *         couldn't be added stay added.
+ * 
+ * \ingroup LabPro-Decimate
+ */
+int LabPro_decimate_append(LabPro_Decimator* decimator, const double* times, const double* values, size_t count);
+
+/** \brief Get one bucket per pixel column.
+ * 
+ * \param decimator The summary
+ * \param start, end Times at the left and right edges of the plot
+ * \param pixels Number of pixel columns
+ * \param columns Receives up to pixels buckets, one for each column that has
+ *        samples, left to right. Buckets that straddle an edge of the plot
+ *        are counted in full.
+ * \return Number of buckets written.
+ * 
+ * \ingroup LabPro-Decimate
+ */
+size_t LabPro_decimate_minmax(const LabPro_Decimator* decimator, double start, double end, size_t pixels, LabPro_Decimate_Bucket* columns);
+
+/** \brief Pick one point per pixel column.
+ * 
+ * The first and last points are the first and last samples of the columns
+ * at the edges. Every column in between gets its smallest or largest value,
+ * whichever makes the largest triangle with the point picked for the column
+ * before and the average of the column after.
+ * 
+ * \return Number of points written, up to pixels.
+ * 
+ * \ingroup LabPro-Decimate
+ */
+size_t LabPro_decimate_lttb(const LabPro_Decimator* decimator, double start, double end, size_t pixels, LabPro_Plot_Point* points);
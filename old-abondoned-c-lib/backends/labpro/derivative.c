@@ -0,0 +1,286 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/derivative.h"
+#include "backends/labpro/cpu.h"
+#include <math.h>
+#include <stdbool.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LABPRO_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Fits a parabola to n points and evaluates its derivatives at point `at`.
+ * Times are taken relative to that point and scaled by the window's spread,
+ * so that the normal equations stay well conditioned whatever the units.
+ * Drops to a straight line if the times don't allow a parabola, and gives
+ * NAN if they don't allow that either.
+ */
+static void LabPro_deriv_fit(const double* times, const double* values, int n, int at, double* first, double* second) {
+    double t0 = times[at];
+    double x0 = values[at];
+    double scale = fmax(fabs(times[0] - t0), fabs(times[n - 1] - t0));
+    
+    double s0 = n, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+    double r0 = 0, r1 = 0, r2 = 0;
+    if (scale > 0) {
+        for (int i = 0; i < n; ++i) {
+            double u = (times[i] - t0) / scale;
+            double y = values[i] - x0;
+            double u2 = u * u;
+            s1 += u;
+            s2 += u2;
+            s3 += u2 * u;
+            s4 += u2 * u2;
+            r0 += y;
+            r1 += y * u;
+            r2 += y * u2;
+        }
+    }
+    
+    double slope = NAN;
+    double curvature = NAN;
+    double det = s0 * (s2 * s4 - s3 * s3) - s1 * (s1 * s4 - s3 * s2) + s2 * (s1 * s3 - s2 * s2);
+    if (n >= 3 && det != 0) {
+        double b1 = s0 * (r1 * s4 - s3 * r2) - r0 * (s1 * s4 - s3 * s2) + s2 * (s1 * r2 - r1 * s2);
+        double b2 = s0 * (s2 * r2 - r1 * s3) - s1 * (s1 * r2 - r1 * s2) + r0 * (s1 * s3 - s2 * s2);
+        slope = b1 / det / scale;
+        curvature = 2 * b2 / det / (scale * scale);
+    }
+    else {
+        double det1 = s0 * s2 - s1 * s1;
+        if (n >= 2 && det1 != 0) {
+            slope = (s0 * r1 - s1 * r0) / det1 / scale;
+            curvature = 0;
+        }
+    }
+    
+    if (first)
+        *first = slope;
+    if (second)
+        *second = curvature;
+}
+
+static int LabPro_deriv_clamp_window(int window) {
+    if (window < 3)
+        window = 3;
+    if (window > LABPRO_DERIV_MAX_WINDOW)
+        window = LABPRO_DERIV_MAX_WINDOW;
+    return window | 1;
+}
+
+int LabPro_deriv_init(LabPro_Deriv_Filter* filter, int window) {
+    filter->window = LabPro_deriv_clamp_window(window);
+    filter->received = 0;
+    filter->emitted = 0;
+    return filter->window;
+}
+
+/* Copies the points in the filter to t and x, oldest first. */
+static int LabPro_deriv_gather(const LabPro_Deriv_Filter* filter, double* t, double* x) {
+    int window = filter->window;
+    if (filter->received < (unsigned long long)window) {
+        for (int i = 0; i < (int)filter->received; ++i) {
+            t[i] = filter->times[i];
+            x[i] = filter->values[i];
+        }
+        return (int)filter->received;
+    }
+    
+    int start = (int)(filter->received % window);
+    for (int i = 0; i < window; ++i) {
+        int slot = start + i < window ? start + i : start + i - window;
+        t[i] = filter->times[slot];
+        x[i] = filter->values[slot];
+    }
+    return window;
+}
+
+size_t LabPro_deriv_push(LabPro_Deriv_Filter* filter, double time, double value, double* first, double* second) {
+    int window = filter->window;
+    int half = window / 2;
+    int slot = (int)(filter->received % window);
+    filter->times[slot] = time;
+    filter->values[slot] = value;
+    filter->received++;
+    
+    if (filter->received < (unsigned long long)window)
+        return 0;
+    
+    double t[LABPRO_DERIV_MAX_WINDOW];
+    double x[LABPRO_DERIV_MAX_WINDOW];
+    LabPro_deriv_gather(filter, t, x);
+    
+    // The first full window also covers the points before its middle.
+    int from = filter->received == (unsigned long long)window ? 0 : half;
+    for (int p = from; p <= half; ++p)
+        LabPro_deriv_fit(t, x, window, p, first ? first + p - from : NULL, second ? second + p - from : NULL);
+    
+    filter->emitted += half - from + 1;
+    return half - from + 1;
+}
+
+size_t LabPro_deriv_finish(LabPro_Deriv_Filter* filter, double* first, double* second) {
+    double t[LABPRO_DERIV_MAX_WINDOW];
+    double x[LABPRO_DERIV_MAX_WINDOW];
+    int n = LabPro_deriv_gather(filter, t, x);
+    int remaining = (int)(filter->received - filter->emitted);
+    
+    for (int i = 0; i < remaining; ++i)
+        LabPro_deriv_fit(t, x, n, n - remaining + i, first ? first + i : NULL, second ? second + i : NULL);
+    
+    filter->emitted = filter->received;
+    return remaining;
+}
+
+/* On evenly spaced points, the fit in the middle of the data is a fixed
+ * weighted sum of the window's values. The vector kernels add up the same
+ * products in the same order as the plain one, so all give the same bits.
+ */
+static void LabPro_deriv_convolve_scalar(const double* values, size_t count, const double* weights, int window, double* out) {
+    for (size_t i = 0; i < count; ++i) {
+        double sum = 0;
+        for (int j = 0; j < window; ++j)
+            sum = sum + weights[j] * values[i + j];
+        out[i] = sum;
+    }
+}
+
+#ifdef LABPRO_HAVE_X86_SIMD
+
+__attribute__((target("sse4.2")))
+static void LabPro_deriv_convolve_sse42(const double* values, size_t count, const double* weights, int window, double* out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128d sum0 = _mm_setzero_pd();
+        __m128d sum1 = _mm_setzero_pd();
+        for (int j = 0; j < window; ++j) {
+            __m128d w = _mm_set1_pd(weights[j]);
+            sum0 = _mm_add_pd(sum0, _mm_mul_pd(w, _mm_loadu_pd(values + i + j)));
+            sum1 = _mm_add_pd(sum1, _mm_mul_pd(w, _mm_loadu_pd(values + i + j + 2)));
+        }
+        _mm_storeu_pd(out + i, sum0);
+        _mm_storeu_pd(out + i + 2, sum1);
+    }
+    LabPro_deriv_convolve_scalar(values + i, count - i, weights, window, out + i);
+}
+
+__attribute__((target("avx2")))
+static void LabPro_deriv_convolve_avx2(const double* values, size_t count, const double* weights, int window, double* out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256d sum0 = _mm256_setzero_pd();
+        __m256d sum1 = _mm256_setzero_pd();
+        for (int j = 0; j < window; ++j) {
+            __m256d w = _mm256_set1_pd(weights[j]);
+            sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(w, _mm256_loadu_pd(values + i + j)));
+            sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(w, _mm256_loadu_pd(values + i + j + 4)));
+        }
+        _mm256_storeu_pd(out + i, sum0);
+        _mm256_storeu_pd(out + i + 4, sum1);
+    }
+    LabPro_deriv_convolve_scalar(values + i, count - i, weights, window, out + i);
+}
+
+#endif // LABPRO_HAVE_X86_SIMD
+
+static void LabPro_deriv_convolve(const double* values, size_t count, const double* weights, int window, double* out) {
+#ifdef LABPRO_HAVE_X86_SIMD
+    switch (LabPro_simd_level()) {
+        case LABPRO_SIMD_AVX2:
+            LabPro_deriv_convolve_avx2(values, count, weights, window, out);
+            return;
+        case LABPRO_SIMD_SSE42:
+            LabPro_deriv_convolve_sse42(values, count, weights, window, out);
+            return;
+        default:
+            break;
+    }
+#endif
+    LabPro_deriv_convolve_scalar(values, count, weights, window, out);
+}
+
+// Relative deviation from the average spacing up to which points count as evenly spaced.
+#define LABPRO_DERIV_EVEN_TOLERANCE 1e-9
+
+static bool LabPro_deriv_evenly_spaced(const double* times, size_t count, double* spacing) {
+    double dt = (times[count - 1] - times[0]) / (count - 1);
+    if (!(dt > 0))
+        return false;
+    
+    for (size_t i = 0; i + 1 < count; ++i) {
+        if (fabs(times[i + 1] - times[i] - dt) > LABPRO_DERIV_EVEN_TOLERANCE * dt)
+            return false;
+    }
+    *spacing = dt;
+    return true;
+}
+
+void LabPro_derivatives(const double* times, const double* values, size_t count, int window, double* first, double* second) {
+    window = LabPro_deriv_clamp_window(window);
+    int half = window / 2;
+    
+    double dt;
+    if (count < (size_t)window || !LabPro_deriv_evenly_spaced(times, count, &dt)) {
+        int n = count < (size_t)window ? (int)count : window;
+        for (size_t i = 0; i < count; ++i) {
+            size_t low = i < (size_t)half ? 0 : i - half;
+            if (low > count - n)
+                low = count - n;
+            LabPro_deriv_fit(times + low, values + low, n, (int)(i - low), first ? first + i : NULL, second ? second + i : NULL);
+        }
+        return;
+    }
+    
+    // Ends: the window is moved inwards, as above.
+    for (int i = 0; i < half; ++i) {
+        LabPro_deriv_fit(times, values, window, i, first ? first + i : NULL, second ? second + i : NULL);
+        size_t end = count - half + i;
+        LabPro_deriv_fit(times + count - window, values + count - window, window, half + 1 + i,
+                         first ? first + end : NULL, second ? second + end : NULL);
+    }
+    
+    // Middle: with offsets k = -half..half, the parabola's slope is
+    // sum(k x) / (sum(k^2) dt), and its curvature
+    // 2 sum((n k^2 - sum(k^2)) x) / ((n sum(k^4) - sum(k^2)^2) dt^2).
+    double k2_sum = 0, k4_sum = 0;
+    for (int k = -half; k <= half; ++k) {
+        k2_sum += (double)k * k;
+        k4_sum += (double)k * k * k * k;
+    }
+    
+    double weights[LABPRO_DERIV_MAX_WINDOW];
+    size_t middle = count - 2 * half;
+    if (first) {
+        for (int k = -half; k <= half; ++k)
+            weights[k + half] = k / (k2_sum * dt);
+        LabPro_deriv_convolve(values, middle, weights, window, first + half);
+    }
+    if (second) {
+        double denominator = (window * k4_sum - k2_sum * k2_sum) * dt * dt;
+        for (int k = -half; k <= half; ++k)
+            weights[k + half] = 2 * (window * (double)k * k - k2_sum) / denominator;
+        LabPro_deriv_convolve(values, middle, weights, window, second + half);
+    }
+}
@@ -0,0 +1,131 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Derivative Derivatives
+ * 
+ * Works out first and second time derivatives on the host, e.g. velocity and
+ * acceleration. The LabPro only does this itself outside realtime mode and
+ * only for analog channels (see LabPro_Data_Session.postproc), and it is
+ * better not to make it do so even then.
+ * 
+ * At each point, a parabola is fitted by least squares to the window of
+ * points around it, and its slope and curvature there are the derivatives.
+ * Wider windows smooth out more noise. With a window of 3 on evenly spaced
+ * points, this is the usual central difference. Near the ends of the data,
+ * where there aren't enough points on one side, the window is moved inwards.
+ * 
+ * A LabPro_Deriv_Filter does this for samples as they arrive, with the same
+ * amount of work for every sample, so the derivatives of a realtime stream
+ * can be kept up to date. Each point's derivatives come out once the points
+ * after it in its window have arrived, i.e. window / 2 samples late.
+ * LabPro_derivatives() does a whole array at once, with vector code when the
+ * points are evenly spaced. Both give the same results, apart from rounding.
+ */
+
+#pragma once
+#include <stddef.h>
+
+/** \brief Widest window that can be used.
+ * \ingroup LabPro-Derivative
+ */
+#define LABPRO_DERIV_MAX_WINDOW 31
+
+/** \brief A reasonable window for most data.
+ * \ingroup LabPro-Derivative
+ */
+#define LABPRO_DERIV_DEFAULT_WINDOW 7
+
+/** \brief Works out derivatives for samples as they arrive
+ * \ingroup LabPro-Derivative
+ */
+typedef struct {
+    /** \brief Points fitted for each point, odd. */
+    int window;
+    
+    /** \brief The last window points, times and values, oldest first from received % window. */
+    double times[LABPRO_DERIV_MAX_WINDOW];
+    double values[LABPRO_DERIV_MAX_WINDOW];
+    
+    /** \brief Points pushed so far. */
+    unsigned long long received;
+    
+    /** \brief Points whose derivatives have been handed out so far. The next
+     * ones handed out are for the point with this index.
+     */
+    unsigned long long emitted;
+} LabPro_Deriv_Filter;
+
+/** \brief Set up a filter, or start it over.
+ * 
+ * \param filter The filter
+ * \param window Points to fit for each point; made odd, and kept between 3
+ *        and LABPRO_DERIV_MAX_WINDOW.
+ * \return The window actually used.
+ * 
+ * \ingroup LabPro-Derivative
+ */
+int LabPro_deriv_init(LabPro_Deriv_Filter* filter, int window);
+
+/** \brief Add a sample, and get the derivatives that became ready.
+ * 
+ * Usually one point becomes ready, the one window / 2 samples back. None do
+ * until the window has filled for the first time; then the first window / 2 + 1
+ * do at once.
+ * 
+ * \param filter The filter
+ * \param time, value The sample
+ * \param first Receives first derivatives, or NULL; needs room for window / 2 + 1.
+ * \param second Receives second derivatives, or NULL; same size.
+ * \return Number of points whose derivatives were written, starting at the
+ *         point filter->emitted had before the call.
+ * 
+ * \ingroup LabPro-Derivative
+ */
+size_t LabPro_deriv_push(LabPro_Deriv_Filter* filter, double time, double value, double* first, double* second);
+
+/** \brief Get the derivatives of the last points, once no more samples are coming.
+ * 
+ * \param filter The filter
+ * \param first Receives first derivatives, or NULL; needs room for window - 1.
+ * \param second Receives second derivatives, or NULL; same size.
+ * \return Number of points whose derivatives were written.
+ * 
+ * \ingroup LabPro-Derivative
+ */
+size_t LabPro_deriv_finish(LabPro_Deriv_Filter* filter, double* first, double* second);
+
+/** \brief Work out the derivatives of a whole array.
+ * 
+ * \param times count times, increasing
+ * \param values count values
+ * \param count Number of points
+ * \param window As for LabPro_deriv_init()
+ * \param first Receives count first derivatives, or NULL
+ * \param second Receives count second derivatives, or NULL
+ * 
+ * Points whose window has no spread in time get NAN.
+ * 
+ * \ingroup LabPro-Derivative
+ */
+void LabPro_derivatives(const double* times, const double* values, size_t count, int window, double* first, double* second);
@@ -0,0 +1,167 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/eventloop.h"
+#include <stdlib.h>
+
+static bool LabPro_event_loop_is_usb(const LabPro* labpro) {
+    return labpro->transport == &LabPro_async_transport;
+}
+
+/* Drop the source at index; the last one takes its place. Called with the mutex held. */
+static void LabPro_event_loop_drop(LabPro_Event_Loop* loop, size_t index) {
+    if (LabPro_event_loop_is_usb(loop->sources[index].labpro))
+        atomic_fetch_sub_explicit(&loop->num_usb, 1, memory_order_relaxed);
+    else
+        atomic_fetch_sub_explicit(&loop->num_polled, 1, memory_order_relaxed);
+    
+    loop->sources[index] = loop->sources[loop->num_sources - 1];
+    --loop->num_sources;
+}
+
+/* One pass over every source: let the transports that aren't libusb deliver
+ * what is due, then hand each LabPro's new data to its callback.
+ */
+static void LabPro_event_loop_service(LabPro_Event_Loop* loop) {
+    pthread_mutex_lock(&loop->mutex);
+    for (size_t i = 0; i < loop->num_sources; ++i) {
+        LabPro_Event_Source* source = &loop->sources[i];
+        LabPro* labpro = source->labpro;
+        
+        if (!LabPro_event_loop_is_usb(labpro))
+            labpro->transport->handle_events(labpro->transport_data, 0);
+        
+        if (source->callback(source->user_data) != LABPRO_OK) {
+            LabPro_event_loop_drop(loop, i);
+            --i;
+        }
+    }
+    pthread_mutex_unlock(&loop->mutex);
+}
+
+static void* LabPro_event_loop_thread(void* data) {
+    LabPro_Event_Loop* loop = (LabPro_Event_Loop*)data;
+    
+    while (!atomic_load_explicit(&loop->stop, memory_order_acquire)) {
+        unsigned long long started = LabPro_time_usec();
+        LabPro_event_loop_service(loop);
+        atomic_fetch_add_explicit(&loop->busy_usec, LabPro_time_usec() - started, memory_order_relaxed);
+        atomic_fetch_add_explicit(&loop->passes, 1, memory_order_relaxed);
+        
+        // Wait for the next transfer to complete on any of the real LabPros,
+        // but not past when the others may have something due.
+        unsigned int wait_ms = LABPRO_EVENT_LOOP_POLL_MS;
+        if (atomic_load_explicit(&loop->num_polled, memory_order_relaxed) > 0)
+            wait_ms = LABPRO_EVENT_LOOP_SIM_POLL_MS;
+        
+        if (atomic_load_explicit(&loop->num_usb, memory_order_relaxed) > 0) {
+            struct timeval tv = {wait_ms / 1000, (wait_ms % 1000) * 1000};
+            libusb_handle_events_timeout_completed(loop->usb_link, &tv, NULL);
+        }
+        else
+            LabPro_sleep_usec(wait_ms * 1000);
+    }
+    return NULL;
+}
+
+int LabPro_event_loop_start(LabPro_Context* context, LabPro_Event_Loop** loop) {
+    *loop = NULL;
+    LabPro_Event_Loop* new_loop = calloc(1, sizeof(LabPro_Event_Loop));
+    if (new_loop == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    new_loop->usb_link = (*context).usb_link;
+    atomic_init(&new_loop->stop, false);
+    atomic_init(&new_loop->num_polled, 0);
+    atomic_init(&new_loop->num_usb, 0);
+    atomic_init(&new_loop->passes, 0);
+    atomic_init(&new_loop->busy_usec, 0);
+    pthread_mutex_init(&new_loop->mutex, NULL);
+    
+    if (pthread_create(&new_loop->thread, NULL, LabPro_event_loop_thread, new_loop) != 0) {
+        pthread_mutex_destroy(&new_loop->mutex);
+        free(new_loop);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    *loop = new_loop;
+    return LABPRO_OK;
+}
+
+int LabPro_event_loop_add(LabPro_Event_Loop* loop, LabPro* labpro, LabPro_Event_Callback callback, void* user_data) {
+    int retval = LABPRO_OK;
+    pthread_mutex_lock(&loop->mutex);
+    
+    if (loop->num_sources == loop->capacity) {
+        size_t capacity = loop->capacity > 0 ? loop->capacity * 2 : 4;
+        LabPro_Event_Source* sources = realloc(loop->sources, capacity * sizeof(LabPro_Event_Source));
+        if (sources == NULL)
+            retval = LABPRO_ERR_NO_MEM;
+        else {
+            loop->sources = sources;
+            loop->capacity = capacity;
+        }
+    }
+    
+    if (retval == LABPRO_OK) {
+        LabPro_Event_Source* source = &loop->sources[loop->num_sources++];
+        source->labpro = labpro;
+        source->callback = callback;
+        source->user_data = user_data;
+        
+        if (LabPro_event_loop_is_usb(labpro))
+            atomic_fetch_add_explicit(&loop->num_usb, 1, memory_order_relaxed);
+        else
+            atomic_fetch_add_explicit(&loop->num_polled, 1, memory_order_relaxed);
+    }
+    
+    pthread_mutex_unlock(&loop->mutex);
+    return retval;
+}
+
+void LabPro_event_loop_remove(LabPro_Event_Loop* loop, LabPro* labpro) {
+    pthread_mutex_lock(&loop->mutex);
+    for (size_t i = 0; i < loop->num_sources; ++i) {
+        if (loop->sources[i].labpro == labpro) {
+            LabPro_event_loop_drop(loop, i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&loop->mutex);
+}
+
+void LabPro_event_loop_stats(LabPro_Event_Loop* loop, LabPro_Event_Loop_Stats* stats) {
+    stats->sources = atomic_load_explicit(&loop->num_usb, memory_order_relaxed)
+        + atomic_load_explicit(&loop->num_polled, memory_order_relaxed);
+    stats->passes = atomic_load_explicit(&loop->passes, memory_order_relaxed);
+    stats->busy_usec = atomic_load_explicit(&loop->busy_usec, memory_order_relaxed);
+}
+
+void LabPro_event_loop_stop(LabPro_Event_Loop* loop) {
+    atomic_store_explicit(&loop->stop, true, memory_order_release);
+    pthread_join(loop->thread, NULL);
+    
+    pthread_mutex_destroy(&loop->mutex);
+    free(loop->sources);
+    free(loop);
+}
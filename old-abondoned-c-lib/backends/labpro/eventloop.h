@@ -0,0 +1,162 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Event-Loop Shared event loop
+ * 
+ * One thread that services any number of LabPros, instead of a thread per
+ * LabPro. Each pass it makes progress on every LabPro's transfers, then
+ * calls back whoever registered the LabPro to use what has arrived; a
+ * realtime stream started with LabPro_Realtime_Config.loop set is serviced
+ * this way.
+ * 
+ * All the real LabPros share the context's libusb context, so a single
+ * libusb_handle_events call completes the transfers of every one of them at
+ * once. Simulated and replayed LabPros are asked for what is due on every
+ * pass instead, so while any are registered the loop wakes up at least every
+ * LABPRO_EVENT_LOOP_SIM_POLL_MS.
+ * 
+ * A LabPro costs the loop one LabPro_Event_Source and its share of a pass,
+ * which is only the decoding of what it sent; there is no stack, no thread
+ * and no wakeup of its own. LabPro_event_loop_stats() reports the time spent
+ * servicing, so the cost per LabPro can be checked as more are added.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Longest the loop waits for USB events before checking whether it should stop, in milliseconds.
+ * \ingroup LabPro-Event-Loop
+ */
+#define LABPRO_EVENT_LOOP_POLL_MS 20
+
+/** \brief Longest the loop waits while simulated or replayed LabPros are registered, in milliseconds.
+ * \ingroup LabPro-Event-Loop
+ */
+#define LABPRO_EVENT_LOOP_SIM_POLL_MS 1
+
+/** \brief Called by the loop thread on every pass, after the LabPro's
+ * transfers have made progress. It must not wait for more data; reading with
+ * LabPro.timeout set to 0 never does. Returning anything but LABPRO_OK
+ * removes the LabPro from the loop.
+ * \ingroup LabPro-Event-Loop
+ */
+typedef int (*LabPro_Event_Callback)(void* user_data);
+
+/** \brief A LabPro registered with the loop
+ * \ingroup LabPro-Event-Loop
+ */
+typedef struct {
+    LabPro* labpro;
+    LabPro_Event_Callback callback;
+    void* user_data;
+} LabPro_Event_Source;
+
+/** \brief Counters kept by the loop
+ * \ingroup LabPro-Event-Loop
+ */
+typedef struct {
+    /** \brief LabPros registered right now. */
+    size_t sources;
+    
+    /** \brief Passes made so far. */
+    unsigned long long passes;
+    
+    /** \brief Microseconds spent making progress on transfers and in the
+     * callbacks, not counting the time spent waiting for events.
+     */
+    unsigned long long busy_usec;
+} LabPro_Event_Loop_Stats;
+
+/** \brief The loop and its thread
+ * \ingroup LabPro-Event-Loop
+ */
+typedef struct {
+    libusb_context* usb_link;
+    pthread_t thread;
+    
+    /** \brief Set by LabPro_event_loop_stop() to tell the thread to finish. */
+    atomic_bool stop;
+    
+    /** \brief Guards the sources. The thread holds it while servicing them,
+     * so a LabPro removed from the loop is never in use once removed.
+     */
+    pthread_mutex_t mutex;
+    LabPro_Event_Source* sources;
+    size_t num_sources;
+    size_t capacity;
+    
+    /** \brief Sources whose transport isn't libusb. */
+    _Atomic size_t num_polled;
+    
+    /** \brief Sources whose transport is libusb. */
+    _Atomic size_t num_usb;
+    
+    _Atomic unsigned long long passes;
+    _Atomic unsigned long long busy_usec;
+} LabPro_Event_Loop;
+
+/** \brief Start a loop with no LabPros yet.
+ * 
+ * \param context The context the LabPros to be registered were listed with
+ * \param loop Receives the loop
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-Event-Loop
+ */
+int LabPro_event_loop_start(LabPro_Context* context, LabPro_Event_Loop** loop);
+
+/** \brief Register a LabPro. Any thread but the loop's own.
+ * 
+ * From the next pass on, callback(user_data) is called on the loop thread
+ * until the LabPro is removed. Register each LabPro only once.
+ * 
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-Event-Loop
+ */
+int LabPro_event_loop_add(LabPro_Event_Loop* loop, LabPro* labpro, LabPro_Event_Callback callback, void* user_data);
+
+/** \brief Remove a LabPro. Any thread but the loop's own.
+ * 
+ * Once this returns, the LabPro's callback is neither running nor called
+ * again. Removing a LabPro that isn't registered, e.g. because its callback
+ * already failed, does nothing.
+ * 
+ * \ingroup LabPro-Event-Loop
+ */
+void LabPro_event_loop_remove(LabPro_Event_Loop* loop, LabPro* labpro);
+
+/** \brief Get the loop's counters. Any thread.
+ * \ingroup LabPro-Event-Loop
+ */
+void LabPro_event_loop_stats(LabPro_Event_Loop* loop, LabPro_Event_Loop_Stats* stats);
+
+/** \brief Stop the thread and free the loop. Remove every LabPro first.
+ * \ingroup LabPro-Event-Loop
+ */
+void LabPro_event_loop_stop(LabPro_Event_Loop* loop);
@@ -0,0 +1,224 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/fastmode.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef NDEBUG
+#define DEBUG
+#endif
+
+/* Collects the values of an ASCII data list into a capture. */
+static void LabPro_fastmode_on_values(void* user_data, int first_index, const double* values, int count) {
+    LabPro_FastMode_Capture* capture = (LabPro_FastMode_Capture*)user_data;
+    for (int i = 0; i < count && first_index + i < capture->capacity; ++i)
+        capture->values[first_index + i] = values[i];
+}
+
+static void LabPro_fastmode_on_list_end(void* user_data, int num_values, int status) {
+    LabPro_FastMode_Capture* capture = (LabPro_FastMode_Capture*)user_data;
+    (void)status;
+    capture->num_points = num_values < capture->capacity ? num_values : capture->capacity;
+}
+
+/* Keeps the elements of the status list that the capture needs. */
+static void LabPro_fastmode_on_status(void* user_data, int first_index, const double* values, int count) {
+    double* status = (double*)user_data;
+    for (int i = 0; i < count && first_index + i < 17; ++i)
+        status[first_index + i] = values[i];
+}
+
+void LabPro_fastmode_default_config(LabPro_FastMode_Config* config) {
+    config->channel = LABPRO_CHAN_ANALOG_1;
+    config->analog_op = LABPRO_CHANOP_VOLTAGE10V;
+    config->sample_time = LABPRO_FASTMODE_MIN_SAMPLE_TIME;
+    config->num_points = LABPRO_FASTMODE_MAX_POINTS;
+    config->binary = true;
+}
+
+int LabPro_fastmode_capture_init(LabPro_FastMode_Capture* capture, const LabPro_FastMode_Config* config) {
+    capture->raw = NULL;
+    capture->values = NULL;
+    capture->capacity = 0;
+    
+    if (config->channel < LABPRO_CHAN_ANALOG_1 || config->channel > LABPRO_CHAN_ANALOG_4)
+        return LABPRO_ERR_BAD_FASTMODE;
+    // Period, frequency and transition counting need the channel's own timing, which FastMode takes over.
+    if (config->analog_op == LABPRO_CHANOP_OFF
+            || (config->analog_op >= LABPRO_CHANOP_VOLTAGE10V_PERIOD && config->analog_op <= LABPRO_CHANOP_VOLTAGE10V_TRANSITIONS_COUNT))
+        return LABPRO_ERR_BAD_FASTMODE;
+    if (config->sample_time < LABPRO_FASTMODE_MIN_SAMPLE_TIME || config->sample_time > LABPRO_FASTMODE_MAX_SAMPLE_TIME)
+        return LABPRO_ERR_BAD_FASTMODE;
+    if (config->num_points < 1 || config->num_points > LABPRO_FASTMODE_MAX_POINTS)
+        return LABPRO_ERR_BAD_FASTMODE;
+    
+    capture->config = *config;
+    capture->values = malloc(config->num_points * sizeof(double));
+    if (config->binary)
+        capture->raw = malloc(config->num_points * sizeof(uint16_t));
+    if (capture->values == NULL || (config->binary && capture->raw == NULL)) {
+        LabPro_fastmode_capture_free(capture);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    capture->capacity = config->num_points;
+    capture->num_points = 0;
+    capture->sample_time = config->sample_time;
+    capture->sampling_usec = 0;
+    capture->transfer_usec = 0;
+    return LABPRO_OK;
+}
+
+void LabPro_fastmode_capture_free(LabPro_FastMode_Capture* capture) {
+    free(capture->raw);
+    free(capture->values);
+    capture->raw = NULL;
+    capture->values = NULL;
+    capture->capacity = 0;
+}
+
+/* Wait blind for the sampling to finish, then ask the LabPro how it went. */
+static int LabPro_fastmode_finish_sampling(LabPro* labpro, LabPro_FastMode_Capture* capture) {
+    const LabPro_FastMode_Config* config = &capture->config;
+    unsigned int sampling_ms = (unsigned int)(config->sample_time * config->num_points * 1000.0 + 0.5);
+    LabPro_sleep(sampling_ms + LABPRO_FASTMODE_MARGIN_MS);
+    
+    labpro->is_fastmode_running = false;
+    labpro->is_collecting_data = false;
+    
+    char command[16];
+    int transferred;
+    snprintf(command, sizeof(command), "s{%d}", LABPRO_SYS_STATUS);
+    int retval = LabPro_send_raw(labpro, command, &transferred);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    double status[17] = {0};
+    LabPro_Stream_Parser parser;
+    LabPro_stream_parser_init(&parser, LabPro_fastmode_on_status, NULL, status);
+    retval = LabPro_read_parsed(labpro, &parser);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    labpro->errorcode = (int)status[1];
+    labpro->system_status = (enum LabPro_System_Status)(int)status[13];
+    if (labpro->errorcode != 0 || labpro->system_status != LABPRO_SYSSTATUS_DONE) {
+        printf("[liblabpro ERR] FastMode collection failed: error %d, system status %d.\n", labpro->errorcode, (int)labpro->system_status);
+        return LABPRO_ERR_FASTMODE_FAILED;
+    }
+    
+    if (status[4] > 0)
+        capture->sample_time = status[4];
+    return LABPRO_OK;
+}
+
+/* Fetch the samples with one "g" into the capture's buffers. */
+static int LabPro_fastmode_fetch(LabPro* labpro, LabPro_FastMode_Capture* capture) {
+    int retval;
+    int transferred;
+    
+    if (capture->config.binary) {
+        retval = LabPro_set_binary_mode(labpro, 1);
+        if (retval != LABPRO_OK)
+            return retval;
+    }
+    
+    // The whole burst is requested at once, so keep as many packets queued as the engine allows.
+    if (labpro->transport == &LabPro_async_transport) {
+        int status = LabPro_async_add_in_transfers((LabPro_Async_Engine*)labpro->transport_data, LABPRO_ASYNC_MAX_IN_TRANSFERS);
+        if (status != LIBUSB_SUCCESS)
+            printf("[liblabpro WARN] Unable to queue more IN transfers for FastMode: %s\n", libusb_strerror(status));
+    }
+    
+    retval = LabPro_send_raw(labpro, "g", &transferred);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    if (!capture->config.binary) {
+        LabPro_Stream_Parser parser;
+        LabPro_stream_parser_init(&parser, LabPro_fastmode_on_values, LabPro_fastmode_on_list_end, capture);
+        return LabPro_read_parsed(labpro, &parser);
+    }
+    
+    size_t num_read;
+    retval = LabPro_read_binary(labpro, capture->raw, capture->capacity, &num_read);
+    capture->num_points = (int)num_read;
+    
+    float offset, scale;
+    if (LabPro_binary_volts_scale(capture->config.analog_op, LABPRO_ADC_BITS, &offset, &scale)) {
+        for (size_t i = 0; i < num_read; ++i)
+            capture->values[i] = offset + scale * capture->raw[i];
+    }
+    else {
+        for (size_t i = 0; i < num_read; ++i)
+            capture->values[i] = capture->raw[i];
+    }
+    return retval;
+}
+
+int LabPro_fastmode_run(LabPro* labpro, LabPro_FastMode_Capture* capture) {
+    if (!labpro->is_open)
+        return LABPRO_ERR_NOT_OPEN;
+    if (labpro->is_collecting_data)
+        return LABPRO_ERR_BUSY_COLLECT;
+    
+    const LabPro_FastMode_Config* config = &capture->config;
+    capture->num_points = 0;
+    capture->sampling_usec = 0;
+    capture->transfer_usec = 0;
+    
+    int retval = LabPro_reset(labpro, false);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    char command[96];
+    int transferred;
+    snprintf(command, sizeof(command), "s{%d,%d,%d}", LABPRO_CHANNEL_SETUP, config->channel, config->analog_op);
+    retval = LabPro_send_raw(labpro, command, &transferred);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    // {3,samptime,numpoints,trigtype,trigchan,trigthresh,prestore,extclock,rectime,filter,fastmode}
+    snprintf(command, sizeof(command), "s{%d,%g,%d,0,0,0,0,0,0,0,1}", LABPRO_DATACOLLECT_SETUP, config->sample_time, config->num_points);
+    unsigned long long start = LabPro_time_usec();
+    retval = LabPro_send_raw(labpro, command, &transferred);
+    if (retval != LABPRO_OK)
+        return retval;
+    labpro->is_fastmode_running = true;
+    labpro->is_collecting_data = true;
+    
+    retval = LabPro_fastmode_finish_sampling(labpro, capture);
+    unsigned long long sampled = LabPro_time_usec();
+    capture->sampling_usec = sampled - start;
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    retval = LabPro_fastmode_fetch(labpro, capture);
+    capture->transfer_usec = LabPro_time_usec() - sampled;
+    
+#ifdef DEBUG
+    printf("[liblabpro DBG] FastMode: %d points, %llu µs sampling, %llu µs transfer.\n", capture->num_points, capture->sampling_usec, capture->transfer_usec);
+#endif
+    return retval;
+}
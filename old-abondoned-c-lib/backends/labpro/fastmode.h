@@ -0,0 +1,154 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-FastMode FastMode capture
+ * 
+ * Runs a FastMode collection: one analog channel sampled every 20 to 200 µs
+ * into the LabPro's RAM, then fetched in one go. Everything the capture needs
+ * is allocated by LabPro_fastmode_capture_init(), sized from the number of
+ * points, so the same capture can be run again and again without allocating.
+ * 
+ * The LabPro aborts FastMode sampling as soon as any command reaches it, so
+ * the host can't poll while it runs. LabPro_fastmode_run() waits for as long
+ * as the sampling should take, plus LABPRO_FASTMODE_MARGIN_MS, before it
+ * talks to the LabPro again. The data is then requested in binary, which is
+ * about a third of the size of the ASCII list, and the IN transfers are topped
+ * up to LABPRO_ASYNC_MAX_IN_TRANSFERS so the burst is drained back to back.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** \brief Shortest time between FastMode samples, in seconds (50000 samples/s).
+ * \ingroup LabPro-FastMode
+ */
+#define LABPRO_FASTMODE_MIN_SAMPLE_TIME 0.00002
+
+/** \brief Longest time between FastMode samples, in seconds (5000 samples/s).
+ * \ingroup LabPro-FastMode
+ */
+#define LABPRO_FASTMODE_MAX_SAMPLE_TIME 0.0002
+
+/** \brief Most points a FastMode collection can hold.
+ * \ingroup LabPro-FastMode
+ */
+#define LABPRO_FASTMODE_MAX_POINTS 12000
+
+/** \brief Extra time given to the LabPro to finish sampling before it is sent anything, in milliseconds.
+ * \ingroup LabPro-FastMode
+ */
+#define LABPRO_FASTMODE_MARGIN_MS 50
+
+/** \brief How to run a FastMode collection
+ * \ingroup LabPro-FastMode
+ */
+typedef struct {
+    /** \brief Analog channel to sample, LABPRO_CHAN_ANALOG_1 to LABPRO_CHAN_ANALOG_4. */
+    int channel;
+    
+    /** \brief Channel operation sent with command 1, e.g. LABPRO_CHANOP_VOLTAGE10V. */
+    int analog_op;
+    
+    /** \brief Seconds between samples, LABPRO_FASTMODE_MIN_SAMPLE_TIME to LABPRO_FASTMODE_MAX_SAMPLE_TIME. */
+    double sample_time;
+    
+    /** \brief Points to collect, 1 to LABPRO_FASTMODE_MAX_POINTS. */
+    int num_points;
+    
+    /** \brief Fetch the data in binary instead of as an ASCII list. */
+    bool binary;
+} LabPro_FastMode_Config;
+
+/** \brief A FastMode collection and the buffers its data lands in
+ * \ingroup LabPro-FastMode
+ */
+typedef struct {
+    LabPro_FastMode_Config config;
+    
+    /** \brief Points the buffers have room for. */
+    int capacity;
+    
+    /** \brief Raw ADC readings, only filled in binary mode. */
+    uint16_t* raw;
+    
+    /** \brief The samples, in volts if the channel operation measures volts
+     * (see LabPro_binary_volts_scale()). In binary mode with any other
+     * operation, these are the raw readings.
+     */
+    double* values;
+    
+    /** \brief Points received by the last run. */
+    int num_points;
+    
+    /** \brief Seconds between samples as reported by the LabPro after the last run. */
+    double sample_time;
+    
+    /** \brief How long the last run spent waiting for the LabPro to sample, in microseconds. */
+    unsigned long long sampling_usec;
+    
+    /** \brief How long the last run spent fetching the data, in microseconds. */
+    unsigned long long transfer_usec;
+} LabPro_FastMode_Capture;
+
+/** \brief Fill in defaults: channel 1, ±10 V, 20 µs between samples, 12000 points, binary.
+ * \ingroup LabPro-FastMode
+ */
+void LabPro_fastmode_default_config(LabPro_FastMode_Config* config);
+
+/** \brief Check a configuration and allocate the buffers for it.
+ * 
+ * \param capture The capture to set up
+ * \param config How to run it; copied.
+ * \return LABPRO_OK, LABPRO_ERR_BAD_FASTMODE if the configuration isn't
+ *         something FastMode can do, or LABPRO_ERR_NO_MEM.
+ * 
+ * \ingroup LabPro-FastMode
+ */
+int LabPro_fastmode_capture_init(LabPro_FastMode_Capture* capture, const LabPro_FastMode_Config* config);
+
+/** \brief Free the buffers of a capture.
+ * \ingroup LabPro-FastMode
+ */
+void LabPro_fastmode_capture_free(LabPro_FastMode_Capture* capture);
+
+/** \brief Run a FastMode collection and fetch its data into the capture.
+ * 
+ * Resets the LabPro first, so any channel setup and collection are lost. The
+ * call blocks for the whole collection, and the LabPro must not be used from
+ * any other thread meanwhile. Afterwards the LabPro is left in binary mode if
+ * the capture is binary; reset it to go back to ASCII.
+ * 
+ * \param labpro The LabPro
+ * \param capture A capture set up with LabPro_fastmode_capture_init()
+ * \return LABPRO_OK, LABPRO_ERR_NOT_OPEN, LABPRO_ERR_BUSY_COLLECT if the
+ *         LabPro is already collecting data, LABPRO_ERR_FASTMODE_FAILED if
+ *         the LabPro reported an error (see labpro->errorcode) or hadn't
+ *         finished sampling, LABPRO_ERR_OVERRUN, LABPRO_ERR_BAD_LIST, or one of
+ *         the \ref LabPro_USB_Errors errorcodes.
+ * 
+ * \ingroup LabPro-FastMode
+ */
+int LabPro_fastmode_run(LabPro* labpro, LabPro_FastMode_Capture* capture);
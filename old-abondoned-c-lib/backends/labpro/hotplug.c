@@ -0,0 +1,213 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/hotplug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Runs inside libusb's event handling, so it only queues the event. */
+static int LabPro_hotplug_callback(libusb_context* usb_link, libusb_device* device, libusb_hotplug_event event, void* user_data) {
+    LabPro_Hotplug* hotplug = (LabPro_Hotplug*)user_data;
+    (void)usb_link;
+    
+    pthread_mutex_lock(&hotplug->mutex);
+    if (hotplug->num_pending == hotplug->pending_capacity) {
+        size_t capacity = hotplug->pending_capacity > 0 ? hotplug->pending_capacity * 2 : 8;
+        LabPro_Hotplug_Pending* pending = realloc(hotplug->pending, capacity * sizeof(LabPro_Hotplug_Pending));
+        if (pending == NULL) {
+            ++hotplug->missed;
+            pthread_mutex_unlock(&hotplug->mutex);
+            return 0;
+        }
+        hotplug->pending = pending;
+        hotplug->pending_capacity = capacity;
+    }
+    
+    LabPro_Hotplug_Pending* entry = &hotplug->pending[hotplug->num_pending++];
+    entry->device = libusb_ref_device(device);
+    entry->arrived = event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED;
+    pthread_mutex_unlock(&hotplug->mutex);
+    return 0; // Stay registered
+}
+
+static LabPro_Hotplug_Device* LabPro_hotplug_find(LabPro_Hotplug* hotplug, libusb_device* device) {
+    for (size_t i = 0; i < hotplug->num_devices; ++i) {
+        if (hotplug->devices[i].device == device)
+            return &hotplug->devices[i];
+    }
+    return NULL;
+}
+
+/* The unplugged LabPro last plugged in where the new device is, if there is one. */
+static LabPro_Hotplug_Device* LabPro_hotplug_find_lost(LabPro_Hotplug* hotplug, const LabPro_Hotplug_Device* where) {
+    for (size_t i = 0; i < hotplug->num_devices; ++i) {
+        LabPro_Hotplug_Device* known = &hotplug->devices[i];
+        if (known->device == NULL && known->bus == where->bus && known->num_ports == where->num_ports
+            && memcmp(known->ports, where->ports, where->num_ports) == 0)
+            return known;
+    }
+    return NULL;
+}
+
+static int LabPro_hotplug_arrived(LabPro_Hotplug* hotplug, libusb_device* device) {
+    if (LabPro_hotplug_find(hotplug, device) != NULL)
+        return LABPRO_OK;
+    
+    LabPro_Hotplug_Device where;
+    where.bus = libusb_get_bus_number(device);
+    where.num_ports = libusb_get_port_numbers(device, where.ports, LABPRO_HOTPLUG_MAX_PORTS);
+    if (where.num_ports < 0)
+        where.num_ports = 0;
+    
+    LabPro_Hotplug_Device* lost = LabPro_hotplug_find_lost(hotplug, &where);
+    if (lost != NULL) {
+        int status = LabPro_reopen_usb(lost->labpro, hotplug->context, device, (int)(lost - hotplug->devices));
+        if (!lost->labpro->is_open) {
+            printf("[liblabpro ERR] A LabPro was plugged back in but couldn't be opened again: error %d\n", status);
+            return LABPRO_OK;
+        }
+        if (status != LABPRO_OK)
+            printf("[liblabpro WARN] A LabPro was plugged back in, but its setup couldn't all be sent again: error %d\n", status);
+        
+        lost->device = libusb_ref_device(device);
+        hotplug->callback(hotplug->user_data, lost->labpro, LABPRO_HOTPLUG_RESUMED);
+        return LABPRO_OK;
+    }
+    
+    LabPro* labpro = LabPro_open_usb(hotplug->context, device, (int)hotplug->num_devices);
+    if (labpro == NULL)
+        return LABPRO_OK;
+    
+    if (hotplug->num_devices == hotplug->capacity) {
+        size_t capacity = hotplug->capacity > 0 ? hotplug->capacity * 2 : 4;
+        LabPro_Hotplug_Device* devices = realloc(hotplug->devices, capacity * sizeof(LabPro_Hotplug_Device));
+        if (devices == NULL) {
+            LabPro_close_labpro(labpro);
+            free(labpro);
+            return LABPRO_ERR_NO_MEM;
+        }
+        hotplug->devices = devices;
+        hotplug->capacity = capacity;
+    }
+    
+    LabPro_Hotplug_Device* added = &hotplug->devices[hotplug->num_devices++];
+    *added = where;
+    added->labpro = labpro;
+    added->device = libusb_ref_device(device);
+    hotplug->callback(hotplug->user_data, labpro, LABPRO_HOTPLUG_ADDED);
+    return LABPRO_OK;
+}
+
+static void LabPro_hotplug_left(LabPro_Hotplug* hotplug, libusb_device* device) {
+    LabPro_Hotplug_Device* known = LabPro_hotplug_find(hotplug, device);
+    if (known == NULL)
+        return;
+    
+    // Stopping a collection in the callback clears is_collecting_data.
+    known->labpro->collecting_when_lost = known->labpro->is_collecting_data;
+    hotplug->callback(hotplug->user_data, known->labpro, LABPRO_HOTPLUG_LOST);
+    LabPro_detach(known->labpro);
+    libusb_unref_device(known->device);
+    known->device = NULL;
+}
+
+int LabPro_hotplug_start(LabPro_Context* context, LabPro_Hotplug_Callback callback, void* user_data, LabPro_Hotplug** hotplug) {
+    *hotplug = NULL;
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    
+    LabPro_Hotplug* new_hotplug = calloc(1, sizeof(LabPro_Hotplug));
+    if (new_hotplug == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    new_hotplug->context = context;
+    new_hotplug->callback = callback;
+    new_hotplug->user_data = user_data;
+    pthread_mutex_init(&new_hotplug->mutex, NULL);
+    
+    int status = libusb_hotplug_register_callback(
+        (*context).usb_link,
+        LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+        LIBUSB_HOTPLUG_ENUMERATE,
+        0x08f7,
+        1,
+        LIBUSB_HOTPLUG_MATCH_ANY,
+        LabPro_hotplug_callback,
+        new_hotplug,
+        &new_hotplug->handle
+    );
+    if (status != LIBUSB_SUCCESS) {
+        printf("[liblabpro ERR] Unable to listen for LabPros being plugged in: %s\n", libusb_strerror(status));
+        pthread_mutex_destroy(&new_hotplug->mutex);
+        free(new_hotplug->pending);
+        free(new_hotplug);
+        return status;
+    }
+    
+    *hotplug = new_hotplug;
+    return LABPRO_OK;
+}
+
+int LabPro_hotplug_process(LabPro_Hotplug* hotplug) {
+    // Take the queue as it is, so that libusb isn't held up while LabPros are opened.
+    pthread_mutex_lock(&hotplug->mutex);
+    LabPro_Hotplug_Pending* pending = hotplug->pending;
+    size_t num_pending = hotplug->num_pending;
+    hotplug->pending = NULL;
+    hotplug->num_pending = 0;
+    hotplug->pending_capacity = 0;
+    pthread_mutex_unlock(&hotplug->mutex);
+    
+    int retval = LABPRO_OK;
+    for (size_t i = 0; i < num_pending; ++i) {
+        if (pending[i].arrived) {
+            int status = LabPro_hotplug_arrived(hotplug, pending[i].device);
+            if (status != LABPRO_OK)
+                retval = status;
+        }
+        else
+            LabPro_hotplug_left(hotplug, pending[i].device);
+        libusb_unref_device(pending[i].device);
+    }
+    free(pending);
+    return retval;
+}
+
+void LabPro_hotplug_stop(LabPro_Hotplug* hotplug) {
+    libusb_hotplug_deregister_callback((*hotplug->context).usb_link, hotplug->handle);
+    
+    for (size_t i = 0; i < hotplug->num_pending; ++i)
+        libusb_unref_device(hotplug->pending[i].device);
+    for (size_t i = 0; i < hotplug->num_devices; ++i) {
+        LabPro_close_labpro(hotplug->devices[i].labpro);
+        free(hotplug->devices[i].labpro);
+        if (hotplug->devices[i].device != NULL)
+            libusb_unref_device(hotplug->devices[i].device);
+    }
+    
+    pthread_mutex_destroy(&hotplug->mutex);
+    free(hotplug->pending);
+    free(hotplug->devices);
+    free(hotplug);
+}
@@ -0,0 +1,157 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Hotplug Hotplug
+ * 
+ * Opens LabPros as they are plugged in and notices when they are unplugged,
+ * from libusb's hotplug events rather than by scanning the bus with
+ * LabPro_list_labpros(). LabPros that are already plugged in when it starts
+ * are opened too.
+ * 
+ * An unplugged LabPro isn't freed. It waits to be plugged back into the same
+ * port, as after a cable bump or a hub reset, and is then opened again and
+ * sent its \ref LabPro-Journal, so the channel setup comes back by itself
+ * and the application's pointer to the LabPro stays good throughout. Data
+ * collection doesn't start again by itself.
+ * 
+ * libusb reports hotplug events while some thread is handling its events,
+ * e.g. a \ref LabPro-Event-Loop, and LabPros can't be opened from there. The
+ * events are only queued then; LabPro_hotplug_process() acts on them and
+ * calls the application back, on whichever thread calls it.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief Most hub ports between the computer and a LabPro that are told apart.
+ * USB allows no more than 7.
+ * \ingroup LabPro-Hotplug
+ */
+#define LABPRO_HOTPLUG_MAX_PORTS 7
+
+/** \brief What happened to a LabPro
+ * \ingroup LabPro-Hotplug
+ */
+enum LabPro_Hotplug_Events {
+    /** \brief A LabPro was plugged in for the first time, and has been opened. */
+    LABPRO_HOTPLUG_ADDED,
+    
+    /** \brief A LabPro was unplugged. Stop using it, e.g. stop its realtime
+     * stream, before returning; it is detached from its device right after.
+     */
+    LABPRO_HOTPLUG_LOST,
+    
+    /** \brief A LabPro that was unplugged is back in the same port, open,
+     * and its journal has been sent. It isn't collecting data; a collection
+     * or realtime stream has to be started again, unless LabPro::resume_collection
+     * is set and it was collecting when it was unplugged.
+     */
+    LABPRO_HOTPLUG_RESUMED
+};
+
+/** \brief Called by LabPro_hotplug_process() for each thing that happened.
+ * \ingroup LabPro-Hotplug
+ */
+typedef void (*LabPro_Hotplug_Callback)(void* user_data, LabPro* labpro, enum LabPro_Hotplug_Events event);
+
+/** \brief A hotplug event waiting for LabPro_hotplug_process()
+ * \ingroup LabPro-Hotplug
+ */
+typedef struct {
+    /** \brief Referenced until the event has been handled. */
+    libusb_device* device;
+    bool arrived;
+} LabPro_Hotplug_Pending;
+
+/** \brief A LabPro that has been plugged in
+ * \ingroup LabPro-Hotplug
+ */
+typedef struct {
+    LabPro* labpro;
+    
+    /** \brief The libusb device, referenced, or NULL while the LabPro is unplugged. */
+    libusb_device* device;
+    
+    /** \brief Where the LabPro is plugged in, to know it when it comes back. */
+    uint8_t bus;
+    uint8_t ports[LABPRO_HOTPLUG_MAX_PORTS];
+    int num_ports;
+} LabPro_Hotplug_Device;
+
+/** \brief Hotplug handling for one context
+ * \ingroup LabPro-Hotplug
+ */
+typedef struct {
+    LabPro_Context* context;
+    libusb_hotplug_callback_handle handle;
+    LabPro_Hotplug_Callback callback;
+    void* user_data;
+    
+    /** \brief Guards the pending events, which libusb adds from its event handling. */
+    pthread_mutex_t mutex;
+    LabPro_Hotplug_Pending* pending;
+    size_t num_pending;
+    size_t pending_capacity;
+    
+    /** \brief Events that couldn't be queued for lack of memory. */
+    unsigned long long missed;
+    
+    /* Only touched by LabPro_hotplug_process() and LabPro_hotplug_stop(). */
+    LabPro_Hotplug_Device* devices;
+    size_t num_devices;
+    size_t capacity;
+} LabPro_Hotplug;
+
+/** \brief Start listening for LabPros being plugged in and unplugged.
+ * 
+ * Events for the LabPros already plugged in are queued straight away.
+ * 
+ * \param context A pointer to the liblabpro context.
+ * \param callback Called by LabPro_hotplug_process()
+ * \param user_data Passed to callback
+ * \param hotplug Receives the hotplug handling
+ * \return LABPRO_OK, LABPRO_ERR_NO_MEM, LIBUSB_ERROR_NOT_SUPPORTED if libusb
+ *         has no hotplug support on this platform, or another libusb error.
+ * 
+ * \ingroup LabPro-Hotplug
+ */
+int LabPro_hotplug_start(LabPro_Context* context, LabPro_Hotplug_Callback callback, void* user_data, LabPro_Hotplug** hotplug);
+
+/** \brief Act on the events queued so far. Never from inside libusb's event handling.
+ * 
+ * \return LABPRO_OK, or LABPRO_ERR_NO_MEM if a LabPro that was plugged in
+ *         couldn't be kept track of. It is closed again then.
+ * 
+ * \ingroup LabPro-Hotplug
+ */
+int LabPro_hotplug_process(LabPro_Hotplug* hotplug);
+
+/** \brief Stop listening, and close and free every LabPro that was opened.
+ * \ingroup LabPro-Hotplug
+ */
+void LabPro_hotplug_stop(LabPro_Hotplug* hotplug);
@@ -0,0 +1,154 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/journal.h"
+#include "backends/labpro/labpro-internal.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+void LabPro_journal_init(LabPro_Journal* journal) {
+    journal->entries = NULL;
+    journal->num_entries = 0;
+    journal->capacity = 0;
+    journal->collection = NULL;
+}
+
+static void LabPro_journal_clear(LabPro_Journal* journal) {
+    for (size_t i = 0; i < journal->num_entries; ++i)
+        free(journal->entries[i].command);
+    journal->num_entries = 0;
+    free(journal->collection);
+    journal->collection = NULL;
+}
+
+void LabPro_journal_free(LabPro_Journal* journal) {
+    LabPro_journal_clear(journal);
+    free(journal->entries);
+    LabPro_journal_init(journal);
+}
+
+/* Whether sending the command again would bring back some of the LabPro's
+ * state. Command 3 isn't one of them: it also starts sampling, so it is kept
+ * apart. Neither is command 5, which only picks what the next Get returns and
+ * is always followed by one.
+ */
+static bool LabPro_journal_keeps(int number) {
+    switch (number) {
+        case LABPRO_CHANNEL_SETUP:
+        case LABPRO_CONVERSION_EQN_SETUP:
+        case LABPRO_SYS_SETUP:
+        case LABPRO_DIGITAL_DATA_CAPTURE:
+        case LABPRO_PORT_POWER_CTL:
+        case LABPRO_ANALOG_OUT_SETUP:
+        case LABPRO_LED_CTL:
+        case LABPRO_SOUND_CTL:
+        case LABPRO_DIGITAL_OUT_CTL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* A copy of the command without its trailing CRs, or NULL if out of memory. */
+static char* LabPro_journal_copy(const char* command) {
+    size_t length = strlen(command);
+    while (length > 0 && command[length - 1] == '\r')
+        --length;
+    char* copy = malloc(length + 1);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, command, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+int LabPro_journal_record(LabPro_Journal* journal, const char* command) {
+    const char* position = command;
+    while (isspace((unsigned char)*position))
+        ++position;
+    if (position[0] != 's' || position[1] != '{')
+        return LABPRO_OK;
+    
+    char* end;
+    long number = strtol(position + 2, &end, 10);
+    if (end == position + 2)
+        return LABPRO_OK;
+    if (number == LABPRO_RESET) {
+        LabPro_journal_clear(journal);
+        return LABPRO_OK;
+    }
+    if (number == LABPRO_DATACOLLECT_SETUP) {
+        char* collection = LabPro_journal_copy(command);
+        if (collection == NULL)
+            return LABPRO_ERR_NO_MEM;
+        free(journal->collection);
+        journal->collection = collection;
+        return LABPRO_OK;
+    }
+    if (!LabPro_journal_keeps((int)number))
+        return LABPRO_OK;
+    
+    // Commands 1 and 4 are kept per channel, and command 6 per setting.
+    long key = -1;
+    if ((number == LABPRO_CHANNEL_SETUP || number == LABPRO_CONVERSION_EQN_SETUP || number == LABPRO_SYS_SETUP) && *end == ',')
+        key = strtol(end + 1, NULL, 10);
+    
+    // Stopping sampling with {6,0} or {6,2} has nothing to bring back.
+    if (number == LABPRO_SYS_SETUP && (key == 0 || key == 2))
+        return LABPRO_OK;
+    
+    char* copy = LabPro_journal_copy(command);
+    if (copy == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    // The command replaces earlier ones of its kind. Setting up channel 0 sets up all of them.
+    size_t kept = 0;
+    for (size_t i = 0; i < journal->num_entries; ++i) {
+        LabPro_Journal_Entry* entry = &journal->entries[i];
+        bool replaced = entry->number == number
+            && (entry->key == key || (number == LABPRO_CHANNEL_SETUP && key == LABPRO_CHAN_ALL));
+        if (replaced)
+            free(entry->command);
+        else
+            journal->entries[kept++] = *entry;
+    }
+    journal->num_entries = kept;
+    
+    if (journal->num_entries == journal->capacity) {
+        size_t capacity = journal->capacity > 0 ? journal->capacity * 2 : 8;
+        LabPro_Journal_Entry* entries = realloc(journal->entries, capacity * sizeof(LabPro_Journal_Entry));
+        if (entries == NULL) {
+            free(copy);
+            return LABPRO_ERR_NO_MEM;
+        }
+        journal->entries = entries;
+        journal->capacity = capacity;
+    }
+    
+    LabPro_Journal_Entry* entry = &journal->entries[journal->num_entries++];
+    entry->command = copy;
+    entry->number = (int)number;
+    entry->key = (int)key;
+    return LABPRO_OK;
+}
@@ -0,0 +1,101 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Journal Setup journal
+ * 
+ * The commands that have put a LabPro in its current state, so that they can
+ * be sent again when the LabPro comes back after being unplugged (see
+ * \ref LabPro-Hotplug). The LabPro forgets its channel setup, data
+ * collection setup and so on when it loses power, but the session the
+ * application set up is still wanted.
+ * 
+ * Queries such as command 7 are not kept, nor is command 5, which only
+ * selects the data for the Get that follows it, nor stopping sampling with
+ * command 6. The data collection setup (command 3) is kept apart from the
+ * other commands, since sending it starts sampling; it is only sent again if
+ * the application asked for that (see LabPro::resume_collection). A reset
+ * (command 0) empties the journal.
+ * 
+ * Only the latest command of each kind is kept, with those of commands 1 and 4
+ * told apart by channel and those of command 6 by setting, so the journal
+ * stays small however long the LabPro is used. Setting up channel 0 replaces
+ * the setup of every channel. A command that replaces an earlier one moves to
+ * the end, since e.g. a calibration has to come after the channel setup it uses.
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief One kept command
+ * \ingroup LabPro-Journal
+ */
+typedef struct {
+    /** \brief As passed to LabPro_send_raw(), without the CR. */
+    char* command;
+    
+    /** \brief The command number, e.g. 1 for channel setup. */
+    int number;
+    
+    /** \brief What tells commands of the same number apart: the channel for
+     * commands 1 and 4, the setting (the first argument) for command 6,
+     * otherwise -1.
+     */
+    int key;
+} LabPro_Journal_Entry;
+
+/** \brief The commands kept for one LabPro, oldest first
+ * \ingroup LabPro-Journal
+ */
+typedef struct {
+    LabPro_Journal_Entry* entries;
+    size_t num_entries;
+    size_t capacity;
+    
+    /** \brief The latest command 3, or NULL. Not one of the entries, as
+     * sending it again starts sampling.
+     */
+    char* collection;
+} LabPro_Journal;
+
+/** \brief Set up an empty journal.
+ * \ingroup LabPro-Journal
+ */
+void LabPro_journal_init(LabPro_Journal* journal);
+
+/** \brief Free the journal's commands.
+ * \ingroup LabPro-Journal
+ */
+void LabPro_journal_free(LabPro_Journal* journal);
+
+/** \brief Keep a command that was sent, if it changes the LabPro's state.
+ * 
+ * \param journal The journal
+ * \param command The command, e.g. "s{1,1,2}". A trailing CR is ignored, and
+ *        anything that isn't an "s{...}" command is left out.
+ * \return LABPRO_OK, or LABPRO_ERR_NO_MEM. The journal is unchanged then.
+ * 
+ * \ingroup LabPro-Journal
+ */
+int LabPro_journal_record(LabPro_Journal* journal, const char* command);
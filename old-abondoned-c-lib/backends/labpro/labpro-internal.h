@@ -21,8 +21,24 @@
  * 
  */
 
+#pragma once
 #include <libusb-1.0/libusb.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include "backends/labpro/async.h"
+#include "backends/labpro/binary.h"
+#include "backends/labpro/compress.h"
+#include "backends/labpro/cpu.h"
+#include "backends/labpro/journal.h"
+#include "backends/labpro/listparse.h"
+#include "backends/labpro/pacing.h"
+#include "backends/labpro/ringbuffer.h"
+#include "backends/labpro/sim.h"
+#include "backends/labpro/spsc.h"
+#include "backends/labpro/streamparse.h"
+#include "backends/labpro/trace.h"
+#include "backends/labpro/transport.h"
 
 /** \file
  * \defgroup LabPro-Internal Functions used for the LabPro backend
@@ -178,7 +194,8 @@ enum LabPro_Sonic_Chan_Operations {
 /** \brief Post-processing performed on analog data.
  * As with data collection from sonic channels, please calculate the derivatives in your application
  * rather than making the LabPro compute them. The extra computations will raise the temperature of
- * the LabPro and make its readings less accurate.
+ * the LabPro and make its readings less accurate. \ref LabPro-Derivative can do it on the host,
+ * also in realtime mode and for sonic channels.
  * \ingroup LabPro-Internal
  */
 enum LabPro_Analog_PostProc {
@@ -218,6 +235,21 @@ enum LabPro_System_Status {
     LABPRO_SYSSTATUS_INIT       = 99
 };
 
+/** \brief How LabPro_read_raw() decides where a response ends
+ * \ingroup LabPro-Internal
+ */
+enum LabPro_Framing {
+    /** \brief Responses are ASCII lists terminated by a carriage return.
+     * Whatever follows the CR in the same 64-byte packet is padding and is thrown away.
+     * This is the default.
+     */
+    LABPRO_FRAMING_CR,
+    /** \brief Keep every byte and read until a short packet or a timeout.
+     * The LabPro pads every packet to 64 bytes, so this mostly ends in the timeout.
+     */
+    LABPRO_FRAMING_RAW
+};
+
 /** \brief Errors related to the "front-end"
  * These errors are specific to use of the LabPro and are positive integers.
  * For underlying errors arising from USB transfer errors, see LabPro_USB_Errors.
@@ -267,7 +299,48 @@ enum LabPro_Errors {
     LABPRO_ERR_POSTPROC_ON_REALTIME,
     
     /** \brief LabPro_parse_list() was called with an incorrectly-formatted list. */
-    LABPRO_ERR_BAD_LIST
+    LABPRO_ERR_BAD_LIST,
+    
+    /** \brief The receive buffer overflowed and overwrote data that was still being read. */
+    LABPRO_ERR_OVERRUN,
+    
+    /** \brief A trace file couldn't be created, read or written. */
+    LABPRO_ERR_TRACE_IO,
+    
+    /** \brief A trace file isn't in a format this version of liblabpro can replay. */
+    LABPRO_ERR_BAD_TRACE,
+    
+    /** \brief A list had more elements than the array it was being decoded into. */
+    LABPRO_ERR_LIST_TOO_LONG,
+    
+    /** \brief Binary data didn't have the layout that was expected, e.g. nonzero padding. */
+    LABPRO_ERR_BAD_BINARY,
+    
+    /** \brief A realtime stream's I/O thread has stopped, and no more samples will arrive. */
+    LABPRO_ERR_STREAM_STOPPED,
+    
+    /** \brief The settings aren't something FastMode can do: one analog channel,
+     * 20 to 200 µs between samples, at most 12000 points.
+     */
+    LABPRO_ERR_BAD_FASTMODE,
+    
+    /** \brief The LabPro reported an error after a FastMode collection, or hadn't finished it. */
+    LABPRO_ERR_FASTMODE_FAILED,
+    
+    /** \brief The channel doesn't exist or can't be used for this. */
+    LABPRO_ERR_BAD_CHANNEL,
+    
+    /** \brief A capture file couldn't be created, read or written. */
+    LABPRO_ERR_CAPTURE_IO,
+    
+    /** \brief A capture file is damaged or from an unknown version of the format. */
+    LABPRO_ERR_BAD_CAPTURE,
+    
+    /** \brief A compressed block is damaged or cut off. */
+    LABPRO_ERR_BAD_BLOCK,
+    
+    /** \brief The conversion equation type is unknown, or the calibration page doesn't exist. */
+    LABPRO_ERR_BAD_EQUATION
 };
 
 /** \brief Thin wrapper around libusb_context
@@ -275,6 +348,14 @@ enum LabPro_Errors {
  */
 typedef struct {
     libusb_context *usb_link;
+    
+    /** \brief Simulated LabPros that LabPro_list_labpros() returns along with the real ones. */
+    LabPro_Sim_Config* sim_configs;
+    int num_sim_devices;
+    
+    /** \brief Traces that LabPro_list_labpros() replays as LabPros, after the simulated ones. */
+    LabPro_Replay_Config* replay_configs;
+    int num_replays;
 } LabPro_Context;
 
 /** \brief Struct describing the LabPro firmware version */
@@ -331,6 +412,82 @@ typedef struct {
     /** \brief How long libusb waits before timing out on a transfer. Default is 5000. */
     unsigned int timeout;
     
+    /** \brief The libusb context the device was opened with. */
+    libusb_context* usb_link;
+    
+    /** \brief How long LabPro_list_labpros() took to open and set up this LabPro, in microseconds. */
+    unsigned long long open_usec;
+    
+    /** \brief How this LabPro is actually talked to; see \ref LabPro-Transport. For
+     * real LabPros, transport_data is the LabPro_Async_Engine that keeps IN
+     * transfers queued so the bus never sits idle.
+     */
+    const LabPro_Transport* transport;
+    void* transport_data;
+    
+    /** \brief Bytes received from the LabPro that have not been read yet. */
+    LabPro_Ring rx;
+    
+    /** \brief Ring position right after the latest packet shorter than 64 bytes,
+     * which ends a response. Set on whichever thread handles libusb events;
+     * being a position, it never needs clearing, and a short packet that
+     * arrives while a response is read can't be mistaken for that response's end.
+     */
+    _Atomic size_t rx_response_end;
+    
+    /** \brief Ring position up to which rx has already been searched for a CR. */
+    size_t rx_scan_pos;
+    
+    /** \brief Set by LabPro_set_binary_mode(). Binary data may contain CRs, so
+     * packets go into rx whole, and the padding after an ASCII response's CR
+     * is dropped when the response is read instead.
+     */
+    atomic_bool rx_whole_packets;
+    
+    /** \brief Padding after the response LabPro_read_view() returned, which
+     * LabPro_release_view() drops along with it.
+     */
+    size_t rx_padding;
+    
+    /** \brief How responses are split up. Defaults to LABPRO_FRAMING_CR. */
+    enum LabPro_Framing framing;
+    
+    /** \brief Realtime records per packet set by LabPro_set_binary_mode(), or 0 for ASCII data. */
+    int binary_records_per_packet;
+    
+    /** \brief Decides how long to wait between packets, and keeps track of time spent waiting. */
+    LabPro_Pacer pacer;
+    
+    /** \brief The commands sent so far that LabPro_replay_journal() sends again. */
+    LabPro_Journal journal;
+    
+    /** \brief Set while LabPro_replay_journal() runs, so that it doesn't record its own commands. */
+    bool replaying_journal;
+    
+    /** \brief Set once a read or write has found the LabPro unplugged; cleared when it comes back. */
+    bool unplugged;
+    
+    /** \brief Whether the latest data collection setup (command 3) is sent
+     * again when the LabPro comes back, if it was collecting data when it was
+     * unplugged. Off by default. Meant for collections the LabPro stores and
+     * that are fetched afterwards; a realtime stream has to be started again
+     * by the application, which sends its own command 3.
+     */
+    bool resume_collection;
+    
+    /** \brief Whether data was being collected when the LabPro was last
+     * unplugged. Set by \ref LabPro-Hotplug before LABPRO_HOTPLUG_LOST is reported.
+     */
+    bool collecting_when_lost;
+    
+    /** \brief Trace every packet is being recorded to, or NULL. See LabPro_start_trace(). */
+    LabPro_Trace_Writer* trace;
+    
+    /** \brief Guards trace. IN packets are recorded on the thread handling
+     * events and OUT packets on the one sending commands.
+     */
+    pthread_mutex_t trace_mutex;
+    
     /** \brief Current firmware version 
      * From the LabPro Technical Reference Manual, the format is X.MMmms
      * (Product Code.Major.Minor.Step)
@@ -367,15 +524,23 @@ typedef struct {
     
 } LabPro;
 
+/** \brief Most threads LabPro_list_labpros() opens LabPros on at once, counting the calling thread.
+ * \ingroup init_deinit
+ */
+#define LABPRO_LIST_MAX_THREADS 32
+
 /** \brief Struct acting as an array of LabPros
  * \ingroup init_deinit
  */
 typedef struct {
-    /** \brief Number of available LabPros. Max is 5. */
-    unsigned short num;
+    /** \brief Number of available LabPros. */
+    int num;
+    
+    /** \brief Number of LabPros labpros has room for. */
+    int capacity;
     
-    /** \brief Array of LabPro. */
-    LabPro *labpros[5];
+    /** \brief Array of LabPro. Free it with LabPro_free_list(). */
+    LabPro **labpros;
 } LabPro_List;
 
 /** \brief Struct representing a "data session"
@@ -426,7 +591,8 @@ typedef struct {
      * 
      * This should be LABPRO_POSTPROC_NONE if in realtime sampling mode
      * (Because only one point is stored at a time in realtime mode) or
-     * when the channel is not an analog channel.
+     * when the channel is not an analog channel. Use a LabPro_Deriv_Filter
+     * for those instead.
      */
     enum LabPro_Analog_PostProc postproc;
     
@@ -451,6 +617,10 @@ typedef struct {
     
     bool use_conversion_eqn;
     char* onboard_conversion_equation;
+    /** \brief Have the LabPro correct sonic distances for the air temperature.
+     * \ref LabPro-Sonic can do this on the host instead, from a temperature
+     * probe read in the same collection.
+     */
     bool use_sonic_temp_compensation;
     char* sonic_temp_compensation_equation;
 } LabPro_Data_Session;
@@ -465,25 +635,65 @@ typedef struct {
  */
 int LabPro_init(LabPro_Context* context);
 
-/** \brief De-initialize liblabpro.
+/** \brief De-initialize liblabpro. Close every LabPro first.
  * \ingroup init_deinit
  */
 void LabPro_exit(LabPro_Context* context);
 
+/** \brief Add a simulated LabPro to the context.
+ * 
+ * Every following call to LabPro_list_labpros() will return a new simulated
+ * LabPro for each one added, after the real ones. See \ref LabPro-Sim.
+ * 
+ * \param context A pointer to the liblabpro context.
+ * \param config How the simulated LabPro should behave; copied.
+ * \return LABPRO_OK, or LABPRO_ERR_NO_MEM.
+ * 
+ * \ingroup init_deinit
+ */
+int LabPro_sim_add(LabPro_Context* context, const LabPro_Sim_Config* config);
+
+/** \brief Add a recorded trace to be replayed as a LabPro.
+ * 
+ * Every following call to LabPro_list_labpros() will return a new LabPro
+ * replaying the trace from the start, after the real and simulated ones.
+ * See \ref LabPro-Trace.
+ * 
+ * \param context A pointer to the liblabpro context.
+ * \param path Trace file recorded with LabPro_start_trace()
+ * \param time_scale 1.0 to replay at the recorded pace, 0 to replay as fast as possible
+ * \return LABPRO_OK, or LABPRO_ERR_NO_MEM if the path is too long.
+ * 
+ * \ingroup init_deinit
+ */
+int LabPro_replay_add(LabPro_Context* context, const char* path, double time_scale);
+
 /** \brief Obtain a list connected LabPro devices.
  * 
  * This function attempts to open and claim the USB interface for each LabPro,
  * so the application should call LabPro_close_labpro() on each LabPro in the
  * LabPro_List that will not be used.
  * 
+ * The LabPros are opened side by side on up to LABPRO_LIST_MAX_THREADS
+ * threads, so this takes about as long as the slowest one rather than all of
+ * them together; LabPro.open_usec says how long each took. The list is in
+ * the same order either way: real LabPros in bus order, then simulated ones,
+ * then replays.
+ * 
  * \param context A pointer to the liblabpro context.
- * \return A struct containing a pointer to an array of up to
- *         5 LabPro devices and the number of found devices.
+ * \return A struct containing a pointer to an array of all the LabPro
+ *         devices found and the number of them. Free the array with
+ *         LabPro_free_list() once the LabPros are safely stored elsewhere.
  * 
  * \ingroup init_deinit
  */
 LabPro_List LabPro_list_labpros(LabPro_Context* context);
 
+/** \brief Free the array of a LabPro_List, but not the LabPros in it.
+ * \ingroup init_deinit
+ */
+void LabPro_free_list(LabPro_List* list);
+
 /** \brief Close the LabPro
  * 
  * Close a LabPro, releasing its USB interface and closing its libusb device handle.
@@ -542,24 +752,68 @@ int LabPro_check_data_session(LabPro_Data_Session* session, int** errors);
  */
 int LabPro_send_raw(LabPro* labpro, char* command, int* length_transferred);
 
+/** \brief Set the minimum delay between USB packets sent to the LabPro.
+ * 
+ * By default packets are sent back-to-back and the delay only grows when
+ * transfers start failing (see \ref LabPro-Pacing). If a particular LabPro
+ * needs some breathing room between packets regardless, set a floor here.
+ * Time spent waiting is recorded in labpro->pacer.total_wait_usec.
+ * 
+ * \param labpro The LabPro to configure
+ * \param floor_usec Minimum delay between packets, in microseconds
+ * 
+ * \ingroup internal
+ */
+void LabPro_set_pacing_floor(LabPro* labpro, unsigned int floor_usec);
+
+/** \brief Start recording every packet sent to and received from the LabPro.
+ * 
+ * Any trace already being recorded is stopped first. Recording stops when the
+ * LabPro is closed.
+ * 
+ * \param labpro The LabPro to trace
+ * \param path File to write the trace to; overwritten if it exists.
+ * \return LABPRO_OK, LABPRO_ERR_NO_MEM, or LABPRO_ERR_TRACE_IO
+ * 
+ * \ingroup internal
+ */
+int LabPro_start_trace(LabPro* labpro, const char* path);
+
+/** \brief Stop recording and close the trace file.
+ * \return LABPRO_OK, or LABPRO_ERR_TRACE_IO if part of the trace was lost.
+ * \ingroup internal
+ */
+int LabPro_stop_trace(LabPro* labpro);
+
 /** \brief Read raw bytes from the LabPro.
  * 
  * This is for internal or console purposes; you shouldn't need to use it.
- * It reads as many bytes as possible from the LabPro, then returns the
- * string. If there is trailing garbage due to the LabPro's response not
- * being a multiple of 64 bytes (the LabPro's USB packet size), it is NOT
- * stripped (see LabPro_trim_response() for that purpose). If this function
- * encounters six errors from libusb, it will assume that there is something
- * wrong and abort with an error code from LabPro_USB_Errors.
+ * The IN transfers are always queued by the asynchronous engine, so this
+ * just handles libusb events until a complete response has arrived.
  * 
- * Even if this function returns LABPRO_ERR_NO_MEM, some of the data
- * may have been transferred, because this function calls realloc() after
- * each 64-byte packet.
+ * With LABPRO_FRAMING_CR (the default), this returns as soon as a carriage
+ * return has been received. Only the first response, up to and including
+ * its CR, is returned; anything received after it stays buffered for the
+ * next call. The padding the LabPro puts after the CR to fill up the 64-byte
+ * packet is already gone, but the CR itself is NOT stripped (see
+ * LabPro_trim_response() for that purpose).
+ * 
+ * With LABPRO_FRAMING_RAW, this keeps reading until the LabPro sends a short
+ * packet and returns everything that has been received, including any
+ * trailing garbage.
+ * 
+ * If nothing completes the response within labpro->timeout milliseconds,
+ * whatever has been received so far is returned. If the engine gives up on
+ * the IN endpoint after repeated errors, this returns an error code from
+ * LabPro_USB_Errors.
+ * 
+ * The returned string is always NULL-terminated and must be freed by the caller.
+ * To avoid the copy and the allocation, use LabPro_read_view() instead.
  * 
  * \param labpro The LabPro to read from
  * \param string Pointer to char array that will hold the data
- * \param length The number of bytes that were read. This will always be a multiple of 64.
- *               Maybe useful if you're requesting binary sample data.
+ * \param length The number of bytes that were read. Maybe useful if you're
+ *               requesting binary sample data.
  * \return One of the \ref LabPro_Errors error codes, LABPRO_OK, or, if the
  *         return value is negative, it is one of the \ref LabPro_USB_Errors errorcodes.
  * 
@@ -567,6 +821,129 @@ int LabPro_send_raw(LabPro* labpro, char* command, int* length_transferred);
  */
 int LabPro_read_raw(LabPro* labpro, char** string, int* length);
 
+/** \brief Read a list response, decoding it while it arrives.
+ * 
+ * Each packet is fed to the parser as soon as it has been received, and
+ * consumed from the receive buffer right away, so a response of any length
+ * needs no more memory than a packet or two. The parser's callbacks are
+ * called from inside this function. Returns after the CR that ends the list;
+ * anything after it is left for the next read.
+ * 
+ * \param labpro The LabPro to read from
+ * \param parser A parser set up with LabPro_stream_parser_init(). A list that
+ *        was cut off by a timeout stays in the parser, so calling this again
+ *        picks up where it left off.
+ * \return LABPRO_OK, LABPRO_ERR_BAD_LIST if the list was malformed,
+ *         LABPRO_ERR_OVERRUN if part of it was overwritten in the receive buffer,
+ *         LABPRO_ERR_NOT_OPEN, or one of the \ref LabPro_USB_Errors errorcodes
+ *         (LIBUSB_ERROR_TIMEOUT if the list didn't end in time).
+ * 
+ * \ingroup internal
+ */
+int LabPro_read_parsed(LabPro* labpro, LabPro_Stream_Parser* parser);
+
+/** \brief Switch the data the LabPro returns to its binary format.
+ * 
+ * Sends {4,0,-1,X}. From then on, data requests return raw ADC readings as
+ * described in \ref LabPro-Binary; read them with LabPro_read_binary() and
+ * LabPro_read_binary_records(). Only analog and motion channels support
+ * binary data.
+ * 
+ * Binary data may contain any byte, including CR, so from then on packets
+ * are no longer cut at their first CR as they arrive. The binary reads count
+ * the bytes they need instead, and other responses are still ASCII and still
+ * end at their CR; the padding after it is dropped when they are read.
+ * LabPro_reset() switches back to ASCII data.
+ * 
+ * \param labpro The LabPro
+ * \param records_per_packet How many realtime records the LabPro packs into
+ *        each packet, 1 to 4. More records per packet allow faster realtime
+ *        sampling, but a late packet then leaves a bigger gap.
+ * \return LABPRO_OK, LABPRO_ERR_NOT_OPEN, or one of the \ref LabPro_USB_Errors errorcodes
+ * 
+ * \ingroup internal
+ */
+int LabPro_set_binary_mode(LabPro* labpro, int records_per_packet);
+
+/** \brief Read one binary non-realtime response, i.e. the answer to one "g".
+ * 
+ * Reads exactly num_samples samples and throws away the padding after them.
+ * The samples are decoded and consumed from the receive buffer as packets
+ * arrive, so num_samples isn't limited by the size of the buffer.
+ * 
+ * \param labpro The LabPro, in binary mode
+ * \param samples Receives num_samples raw readings (see LabPro_binary_decode_samples())
+ * \param num_samples How many samples the LabPro was asked for
+ * \param num_read Number of samples actually read, which is less than
+ *        num_samples only if there was an error.
+ * \return LABPRO_OK, LABPRO_ERR_OVERRUN, LABPRO_ERR_NOT_OPEN, or one of the
+ *         \ref LabPro_USB_Errors errorcodes (LIBUSB_ERROR_TIMEOUT if the data
+ *         stopped coming).
+ * 
+ * \ingroup internal
+ */
+int LabPro_read_binary(LabPro* labpro, uint16_t* samples, size_t num_samples, size_t* num_read);
+
+/** \brief Read the binary realtime records that have arrived.
+ * 
+ * Waits until at least one packet has arrived, then decodes as many whole
+ * packets as there are and as fit into max_records. Only the records a
+ * packet actually holds are returned, not its zero padding.
+ * 
+ * \param labpro The LabPro, in binary mode
+ * \param num_channels Number of active channels, which is the number of
+ *        readings in each record, 1 to LABPRO_BINARY_MAX_CHANNELS
+ * \param samples Receives num_channels readings per record, interleaved
+ * \param times Receives the time counter of each record; may be NULL.
+ * \param max_records Room in samples and times. Must be at least
+ *        labpro->binary_records_per_packet.
+ * \param num_records Number of records read
+ * \return LABPRO_OK, LABPRO_ERR_BAD_BINARY (also if num_channels is out of
+ *         range), LABPRO_ERR_LIST_TOO_LONG if max_records is less than one
+ *         packet's worth, LABPRO_ERR_OVERRUN, LABPRO_ERR_NOT_OPEN, or one of
+ *         the \ref LabPro_USB_Errors errorcodes
+ * 
+ * \ingroup internal
+ */
+int LabPro_read_binary_records(LabPro* labpro, int num_channels, uint16_t* samples, uint32_t* times, size_t max_records, size_t* num_records);
+
+/** \brief Wait for a response like LabPro_read_raw(), but without copying it.
+ * 
+ * The view points straight into the LabPro's receive ring buffer and is
+ * not NULL-terminated. It stays valid until it is passed to
+ * LabPro_release_view(), which must happen before the next read.
+ * 
+ * \param labpro The LabPro to read from
+ * \param view Filled with the response
+ * \return Same as LabPro_read_raw().
+ * 
+ * \ingroup internal
+ */
+int LabPro_read_view(LabPro* labpro, LabPro_Ring_View* view);
+
+/** \brief Give the bytes of a view from LabPro_read_view() back to the receive buffer.
+ * 
+ * \return LABPRO_OK, or LABPRO_ERR_OVERRUN if the buffer overflowed while the
+ *         view was held and some of its bytes were overwritten.
+ * 
+ * \ingroup internal
+ */
+int LabPro_release_view(LabPro* labpro, const LabPro_Ring_View* view);
+
+/** \brief Replace the LabPro's receive buffer.
+ * 
+ * Any unread data is thrown away. Only call this from the thread that handles
+ * the LabPro's USB events, while nothing is reading from it.
+ * 
+ * \param labpro The LabPro to configure
+ * \param capacity Buffer size in bytes; rounded up to a power of two
+ * \param policy What to do when the buffer is full
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM. On failure the old buffer is kept.
+ * 
+ * \ingroup internal
+ */
+int LabPro_set_rx_buffer(LabPro* labpro, size_t capacity, enum LabPro_Overflow_Policy policy);
+
 /** \brief Trim trailing junk that the LabPro sent
  * Since the LabPro always returns data in multiples of 64 bytes, the
  * last packet is likely to contain junk following the actual
@@ -582,13 +959,87 @@ int LabPro_trim_response(char* string);
 
 /** \brief Parse TI OS-style list into an array of strings.
  * The string should already have been cleaned with LabPro_trim_response().
- * The closing '}' character may be followed by garbage data, provided
- * the data doesn't include a ','.
+ * The closing '}' character may be followed by garbage data.
+ * 
+ * The list is split in place: the ',' and '}' characters in string are
+ * overwritten with NULL bytes and the elements point into string, so string
+ * must outlive argv_list. Only argv_list itself needs to be freed, not its
+ * elements. To get numbers out of a list, LabPro_parse_list_doubles() is
+ * much faster and does not need to modify or allocate anything.
  * 
  * \param string The string representation of the list
- * \param argv_list Pointer to array of strings
+ * \param argc_list Set to the number of elements
+ * \param argv_list Set to an array of pointers to the elements, or NULL on error
  * \return One of \ref LabPro_Errors.
  * 
  * \ingroup internal
  */
 int LabPro_parse_list(char* string, int* argc_list, char*** argv_list);
+
+
+/** \brief Sleep for the given number of milliseconds.
+ * \ingroup internal
+ */
+void LabPro_sleep(unsigned int milliseconds);
+
+/** \brief Sleep for the given number of microseconds.
+ * \ingroup internal
+ */
+void LabPro_sleep_usec(unsigned int microseconds);
+
+/** \brief Microseconds on a monotonic clock, for measuring intervals.
+ * \ingroup internal
+ */
+unsigned long long LabPro_time_usec();
+
+/** \brief Called when libusb reports that the LabPro has been unplugged.
+ * \ingroup internal
+ */
+void LabPro_handle_device_disconnect(LabPro* labpro);
+
+/** \brief Open a LabPro found on the bus, as LabPro_list_labpros() does.
+ * 
+ * \param context A pointer to the liblabpro context.
+ * \param device The LabPro's libusb device
+ * \param index Number the LabPro goes by in messages
+ * \return The LabPro, or NULL if it couldn't be opened. The reason has been printed.
+ * 
+ * \ingroup internal
+ */
+LabPro* LabPro_open_usb(LabPro_Context* context, libusb_device* device, int index);
+
+/** \brief Open a LabPro that was unplugged again, and restore its setup.
+ * 
+ * The LabPro keeps everything on the host side, such as its trace and
+ * pacing; what it had received but not read is thrown away. Its journal is
+ * then sent with LabPro_replay_journal().
+ * 
+ * \param labpro A LabPro taken off its old device with LabPro_detach()
+ * \param context A pointer to the liblabpro context.
+ * \param device The libusb device it is now
+ * \param index Number the LabPro goes by in messages
+ * \return LABPRO_OK, LABPRO_ERR_BUSY if the LabPro is still open, or an error
+ *         from opening the device or sending the journal.
+ * 
+ * \ingroup internal
+ */
+int LabPro_reopen_usb(LabPro* labpro, LabPro_Context* context, libusb_device* device, int index);
+
+/** \brief Send every command in the LabPro's \ref LabPro-Journal again, oldest first.
+ * 
+ * If LabPro::resume_collection and LabPro::collecting_when_lost are set, the
+ * latest command 3 follows, and the LabPro is collecting data again.
+ * 
+ * \return LABPRO_OK, or the first error from LabPro_send_raw().
+ * \ingroup internal
+ */
+int LabPro_replay_journal(LabPro* labpro);
+
+/** \brief Stop the LabPro's transfers and release its device, keeping everything else.
+ * 
+ * Afterwards the LabPro reports LABPRO_ERR_NOT_OPEN until LabPro_reopen_usb()
+ * or LabPro_close_labpro(). Nothing may be using it at the time.
+ * 
+ * \ingroup internal
+ */
+void LabPro_detach(LabPro* labpro);
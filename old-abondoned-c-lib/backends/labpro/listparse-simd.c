@@ -0,0 +1,225 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* Vectorized pieces of the list decoder.
+ * 
+ * The LabPro formats every number the same way, "+1.23450E+00": a sign, one
+ * digit, a point, five digits, 'E', a signed two-digit exponent. The kernels
+ * here check a whole element against that template with a few vector
+ * compares, then gather its eight digits with one byte shuffle and combine
+ * them pairwise with multiply-adds. Anything that doesn't fit the template
+ * exactly is left for LabPro_parse_number().
+ */
+
+#include "backends/labpro/listparse.h"
+#include "backends/labpro/cpu.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LABPRO_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Length of a fixed-format element, not counting the delimiter after it.
+#define LABPRO_FIXED_LENGTH 12
+
+static size_t LabPro_count_byte_scalar(const char* string, size_t length, char c) {
+    size_t count = 0;
+    const char* end = string + length;
+    for (const char* p = string; (p = memchr(p, c, end - p)) != NULL; ++p)
+        ++count;
+    return count;
+}
+
+#ifdef LABPRO_HAVE_X86_SIMD
+
+// Digit positions in the template: 1 and 3-7 (significand), 10-11 (exponent).
+#define LABPRO_FIXED_DIGIT_MASK 0x0CFA
+// Positions of the '.' and the 'E'.
+#define LABPRO_FIXED_LITERAL_MASK 0x0104
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t LabPro_count_byte_sse42(const char* string, size_t length, char c) {
+    size_t count = 0;
+    size_t i = 0;
+    __m128i needle = _mm_set1_epi8(c);
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(string + i));
+        count += _mm_popcnt_u32(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+    }
+    return count + LabPro_count_byte_scalar(string + i, length - i, c);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t LabPro_count_byte_avx2(const char* string, size_t length, char c) {
+    size_t count = 0;
+    size_t i = 0;
+    __m256i needle = _mm256_set1_epi8(c);
+    for (; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(string + i));
+        count += _mm_popcnt_u32((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+    }
+    return count + LabPro_count_byte_sse42(string + i, length - i, c);
+}
+
+/* The parts of the template that aren't digits. Signs and the delimiter
+ * are checked separately since each has two valid values.
+ */
+static bool LabPro_fixed_punctuation_ok(const char* p) {
+    return (p[0] == '+' || p[0] == '-')
+        && (p[9] == '+' || p[9] == '-')
+        && (p[12] == ',' || p[12] == '}');
+}
+
+static double LabPro_fixed_value(const char* p, int significand, int exponent) {
+    double value = LabPro_decimal_to_double(significand, (p[9] == '-' ? -exponent : exponent) - 5);
+    return p[0] == '-' ? -value : value;
+}
+
+/* Validate 16 bytes against the template and combine the digits into
+ * 16-bit lanes 0-3: the significand digits in pairs, then the exponent.
+ * Returns a mask of the checks that passed; the element is fixed-format
+ * if the mask is complete.
+ */
+__attribute__((target("sse4.2")))
+static inline int LabPro_fixed_check_sse42(__m128i chunk, __m128i* pairs) {
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i literals = _mm_setr_epi8(0, 0, '.', 0, 0, 0, 0, 0, 'E', 0, 0, 0, 0, 0, 0, 0);
+    const __m128i gather = _mm_setr_epi8(1, 3, 4, 5, 6, 7, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i weights = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+    
+    __m128i digits = _mm_sub_epi8(chunk, zero_char);
+    int digit_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(digits, nine), digits));
+    int literal_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, literals));
+    
+    *pairs = _mm_maddubs_epi16(_mm_shuffle_epi8(digits, gather), weights);
+    return (digit_mask & LABPRO_FIXED_DIGIT_MASK) | (literal_mask & LABPRO_FIXED_LITERAL_MASK);
+}
+
+__attribute__((target("sse4.2")))
+static size_t LabPro_decode_fixed_sse42(const char* p, const char* end, double* values, size_t max_values, const char** next) {
+    size_t count = 0;
+    *next = p;
+    
+    while (count < max_values && end - p >= 16) {
+        __m128i pairs;
+        int mask = LabPro_fixed_check_sse42(_mm_loadu_si128((const __m128i*)p), &pairs);
+        if (mask != (LABPRO_FIXED_DIGIT_MASK | LABPRO_FIXED_LITERAL_MASK) || !LabPro_fixed_punctuation_ok(p))
+            break;
+        
+        int significand = _mm_extract_epi16(pairs, 0) * 10000 + _mm_extract_epi16(pairs, 1) * 100 + _mm_extract_epi16(pairs, 2);
+        values[count++] = LabPro_fixed_value(p, significand, _mm_extract_epi16(pairs, 3));
+        
+        p += LABPRO_FIXED_LENGTH + 1;
+        *next = p;
+        if (p[-1] == '}')
+            break;
+    }
+    return count;
+}
+
+__attribute__((target("avx2")))
+static size_t LabPro_decode_fixed_avx2(const char* p, const char* end, double* values, size_t max_values, const char** next) {
+    const __m256i zero_char = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i literals = _mm256_setr_epi8(
+        0, 0, '.', 0, 0, 0, 0, 0, 'E', 0, 0, 0, 0, 0, 0, 0,
+        0, 0, '.', 0, 0, 0, 0, 0, 'E', 0, 0, 0, 0, 0, 0, 0
+    );
+    const __m256i gather = _mm256_setr_epi8(
+        1, 3, 4, 5, 6, 7, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1,
+        1, 3, 4, 5, 6, 7, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1
+    );
+    const __m256i weights = _mm256_setr_epi8(
+        10, 1, 10, 1, 10, 1, 10, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+        10, 1, 10, 1, 10, 1, 10, 1, 0, 0, 0, 0, 0, 0, 0, 0
+    );
+    const unsigned int complete = (LABPRO_FIXED_DIGIT_MASK | LABPRO_FIXED_LITERAL_MASK)
+        | ((LABPRO_FIXED_DIGIT_MASK | LABPRO_FIXED_LITERAL_MASK) << 16);
+    
+    size_t count = 0;
+    *next = p;
+    
+    // Two elements per iteration, one in each 128-bit lane, since elements are 13 bytes apart.
+    while (count + 2 <= max_values && end - p >= LABPRO_FIXED_LENGTH + 1 + 16) {
+        __m256i chunk = _mm256_loadu2_m128i((const __m128i*)(p + LABPRO_FIXED_LENGTH + 1), (const __m128i*)p);
+        __m256i digits = _mm256_sub_epi8(chunk, zero_char);
+        unsigned int digit_mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(digits, nine), digits));
+        unsigned int literal_mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, literals));
+        unsigned int mask = (digit_mask & ((LABPRO_FIXED_DIGIT_MASK << 16) | LABPRO_FIXED_DIGIT_MASK))
+            | (literal_mask & ((LABPRO_FIXED_LITERAL_MASK << 16) | LABPRO_FIXED_LITERAL_MASK));
+        
+        if (mask != complete || !LabPro_fixed_punctuation_ok(p) || p[LABPRO_FIXED_LENGTH] != ','
+            || !LabPro_fixed_punctuation_ok(p + LABPRO_FIXED_LENGTH + 1))
+            break;
+        
+        __m256i pairs = _mm256_maddubs_epi16(_mm256_shuffle_epi8(digits, gather), weights);
+        uint16_t lanes[16];
+        _mm256_storeu_si256((__m256i*)lanes, pairs);
+        
+        values[count++] = LabPro_fixed_value(p, lanes[0] * 10000 + lanes[1] * 100 + lanes[2], lanes[3]);
+        p += LABPRO_FIXED_LENGTH + 1;
+        values[count++] = LabPro_fixed_value(p, lanes[8] * 10000 + lanes[9] * 100 + lanes[10], lanes[11]);
+        p += LABPRO_FIXED_LENGTH + 1;
+        *next = p;
+        if (p[-1] == '}')
+            return count;
+    }
+    
+    // Finish off whatever is left one element at a time.
+    const char* sse_next;
+    count += LabPro_decode_fixed_sse42(p, end, values + count, max_values - count, &sse_next);
+    *next = sse_next;
+    return count;
+}
+
+#endif // LABPRO_HAVE_X86_SIMD
+
+size_t LabPro_count_byte(const char* string, size_t length, char c) {
+#ifdef LABPRO_HAVE_X86_SIMD
+    switch (LabPro_simd_level()) {
+        case LABPRO_SIMD_AVX2:
+            return LabPro_count_byte_avx2(string, length, c);
+        case LABPRO_SIMD_SSE42:
+            return LabPro_count_byte_sse42(string, length, c);
+        default:
+            break;
+    }
+#endif
+    return LabPro_count_byte_scalar(string, length, c);
+}
+
+LabPro_Fixed_Decoder LabPro_fixed_decoder() {
+#ifdef LABPRO_HAVE_X86_SIMD
+    switch (LabPro_simd_level()) {
+        case LABPRO_SIMD_AVX2:
+            return LabPro_decode_fixed_avx2;
+        case LABPRO_SIMD_SSE42:
+            return LabPro_decode_fixed_sse42;
+        default:
+            break;
+    }
+#endif
+    return NULL;
+}
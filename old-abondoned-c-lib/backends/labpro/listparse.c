@@ -0,0 +1,281 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/listparse.h"
+#include "backends/labpro/labpro-internal.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Every power of ten that a double holds exactly.
+static const double LabPro_exact_powers_of_ten[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Slow path for numbers the fast path can't do exactly. Working in long
+ * double keeps the intermediate roundings well below what survives the final
+ * conversion to double on x86, where long double has a 64-bit significand.
+ */
+static double LabPro_scale_by_power_of_ten(uint64_t significand, int exponent) {
+    // Anything past this is zero or infinity no matter what the significand was.
+    if (exponent > 400)
+        exponent = 400;
+    if (exponent < -400)
+        exponent = -400;
+    
+    long double value = (long double)significand;
+    long double power = 1.0L;
+    long double base = 10.0L;
+    for (int n = exponent >= 0 ? exponent : -exponent; n > 0; n >>= 1) {
+        if (n & 1)
+            power *= base;
+        base *= base;
+    }
+    return (double)(exponent >= 0 ? value * power : value / power);
+}
+
+double LabPro_decimal_to_double(uint64_t significand, int exponent) {
+    if (significand == 0)
+        return 0.0;
+    
+    if (significand <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        // Both operands are exact, so the one rounding step gives the correctly rounded result.
+        if (exponent >= 0)
+            return (double)significand * LabPro_exact_powers_of_ten[exponent];
+        return (double)significand / LabPro_exact_powers_of_ten[-exponent];
+    }
+    return LabPro_scale_by_power_of_ten(significand, exponent);
+}
+
+const char* LabPro_parse_number(const char* string, const char* end, double* value) {
+    const char* p = string;
+    while (p < end && *p == ' ')
+        ++p;
+    
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    
+    uint64_t significand = 0;
+    int num_digits = 0; // Significant digits kept in significand
+    int exponent = 0;
+    bool any_digits = false;
+    
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        any_digits = true;
+        if (num_digits < 19) {
+            significand = significand * 10 + (*p - '0');
+            if (significand != 0)
+                ++num_digits;
+        }
+        else
+            ++exponent; // Too many digits to keep; just track the magnitude.
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            any_digits = true;
+            if (num_digits < 19) {
+                significand = significand * 10 + (*p - '0');
+                if (significand != 0)
+                    ++num_digits;
+                --exponent;
+            }
+        }
+    }
+    if (!any_digits)
+        return NULL;
+    
+    // Only consume the exponent if it is well-formed, like strtod().
+    if (p < end && (*p == 'E' || *p == 'e')) {
+        const char* q = p + 1;
+        bool negative_exponent = false;
+        if (q < end && (*q == '+' || *q == '-')) {
+            negative_exponent = (*q == '-');
+            ++q;
+        }
+        if (q < end && *q >= '0' && *q <= '9') {
+            int written_exponent = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; ++q) {
+                if (written_exponent < 10000)
+                    written_exponent = written_exponent * 10 + (*q - '0');
+            }
+            exponent += negative_exponent ? -written_exponent : written_exponent;
+            p = q;
+        }
+    }
+    
+    double result = LabPro_decimal_to_double(significand, exponent);
+    *value = negative ? -result : result;
+    return p;
+}
+
+int LabPro_list_length(const char* string, size_t length) {
+    const char* end = string + length;
+    if (length == 0 || string[0] != '{')
+        return -1;
+    
+    const char* close = memchr(string, '}', length);
+    if (close == NULL)
+        return -1;
+    end = close;
+    
+    // An empty list has no elements, rather than one empty element.
+    const char* p = string + 1;
+    while (p < end && *p == ' ')
+        ++p;
+    if (p == end)
+        return 0;
+    
+    return 1 + (int)LabPro_count_byte(p, end - p, ',');
+}
+
+/* Shared by the double and float versions: set up *p and *end for the
+ * elements of the list, or return LABPRO_ERR_BAD_LIST.
+ */
+static int LabPro_list_bounds(const char* string, size_t length, const char** p, const char** end) {
+    if (length == 0 || string[0] != '{')
+        return LABPRO_ERR_BAD_LIST;
+    
+    *p = string + 1;
+    *end = string + length;
+    return LABPRO_OK;
+}
+
+/* Decode the element at *p and step past the ',' or '}' after it.
+ * Returns 1 if there is another element, 0 after the last one, or a
+ * negated LabPro_Errors value.
+ */
+static int LabPro_list_next(const char** p, const char* end, double* value) {
+    const char* next = LabPro_parse_number(*p, end, value);
+    if (next == NULL)
+        return -LABPRO_ERR_BAD_LIST;
+    
+    while (next < end && *next == ' ')
+        ++next;
+    if (next == end)
+        return -LABPRO_ERR_BAD_LIST; // No closing '}'
+    
+    *p = next + 1;
+    if (*next == ',')
+        return 1;
+    if (*next == '}')
+        return 0;
+    return -LABPRO_ERR_BAD_LIST;
+}
+
+static bool LabPro_list_is_empty(const char* p, const char* end) {
+    while (p < end && *p == ' ')
+        ++p;
+    return p < end && *p == '}';
+}
+
+int LabPro_parse_list_doubles(const char* string, size_t length, double* values, int max_values, int* num_values) {
+    *num_values = 0;
+    
+    const char* p;
+    const char* end;
+    int status = LabPro_list_bounds(string, length, &p, &end);
+    if (status != LABPRO_OK)
+        return status;
+    if (LabPro_list_is_empty(p, end))
+        return LABPRO_OK;
+    
+    LabPro_Fixed_Decoder decoder = LabPro_fixed_decoder();
+    while (true) {
+        if (decoder != NULL) {
+            while (p < end && *p == ' ')
+                ++p;
+            
+            const char* next;
+            size_t decoded = decoder(p, end, values + *num_values, max_values - *num_values, &next);
+            if (decoded > 0) {
+                *num_values += (int)decoded;
+                p = next;
+                if (p[-1] == '}')
+                    return LABPRO_OK;
+            }
+        }
+        
+        double value;
+        int more = LabPro_list_next(&p, end, &value);
+        if (more < 0)
+            return -more;
+        if (*num_values >= max_values)
+            return LABPRO_ERR_LIST_TOO_LONG;
+        
+        values[(*num_values)++] = value;
+        if (!more)
+            return LABPRO_OK;
+    }
+}
+
+int LabPro_parse_list_floats(const char* string, size_t length, float* values, int max_values, int* num_values) {
+    *num_values = 0;
+    
+    const char* p;
+    const char* end;
+    int status = LabPro_list_bounds(string, length, &p, &end);
+    if (status != LABPRO_OK)
+        return status;
+    if (LabPro_list_is_empty(p, end))
+        return LABPRO_OK;
+    
+    // Decode through a small buffer of doubles so the vectorized decoder can be used.
+    LabPro_Fixed_Decoder decoder = LabPro_fixed_decoder();
+    double buffer[256];
+    while (true) {
+        if (decoder != NULL) {
+            while (p < end && *p == ' ')
+                ++p;
+            
+            size_t space = max_values - *num_values;
+            if (space > 256)
+                space = 256;
+            const char* next;
+            size_t decoded = decoder(p, end, buffer, space, &next);
+            if (decoded > 0) {
+                for (size_t i = 0; i < decoded; ++i)
+                    values[*num_values + i] = (float)buffer[i];
+                *num_values += (int)decoded;
+                p = next;
+                if (p[-1] == '}')
+                    return LABPRO_OK;
+                continue;
+            }
+        }
+        
+        double value;
+        int more = LabPro_list_next(&p, end, &value);
+        if (more < 0)
+            return -more;
+        if (*num_values >= max_values)
+            return LABPRO_ERR_LIST_TOO_LONG;
+        
+        values[(*num_values)++] = (float)value;
+        if (!more)
+            return LABPRO_OK;
+    }
+}
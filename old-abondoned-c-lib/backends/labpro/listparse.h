@@ -0,0 +1,125 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-ListParse Numeric list decoding
+ * 
+ * Decodes TI OS-style lists of numbers, like the "{+1.23450E+00,...}"
+ * responses to status and channel data requests, straight into arrays of
+ * doubles or floats. Nothing is allocated, and the input is only read once.
+ * 
+ * Numbers are decoded without strtod(), which is slow and depends on the
+ * C locale's decimal separator. The result is correctly rounded whenever the
+ * significand has at most 15 digits and the decimal exponent is within 22,
+ * which covers everything the LabPro sends; other numbers may be off by
+ * an ulp or so.
+ * 
+ * Long runs of elements in the LabPro's own "+1.23450E+00" format are decoded
+ * with SSE4.2 or AVX2 when the CPU has them (see \ref LabPro-CPU), and
+ * everything else falls back to the scalar decoder element by element.
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief Decodes a run of fixed-format elements.
+ * 
+ * Starts at the first element of a run and stops at the first element that
+ * isn't in the LabPro's fixed format, after the closing '}', or when
+ * max_values elements have been decoded.
+ * 
+ * \param string Start of the first element
+ * \param end End of the input
+ * \param values Array to decode into
+ * \param max_values Size of values
+ * \param next Set to the character after the delimiter of the last decoded element
+ * \return Number of elements decoded
+ * 
+ * \ingroup LabPro-ListParse
+ */
+typedef size_t (*LabPro_Fixed_Decoder)(const char* string, const char* end, double* values, size_t max_values, const char** next);
+
+/** \brief The vectorized decoder for the current SIMD level, or NULL if there is none.
+ * \ingroup LabPro-ListParse
+ */
+LabPro_Fixed_Decoder LabPro_fixed_decoder();
+
+/** \brief Count how many times c occurs in string, using SIMD if available.
+ * \ingroup LabPro-ListParse
+ */
+size_t LabPro_count_byte(const char* string, size_t length, char c);
+
+/** \brief Nearest double to significand * 10^exponent, with the accuracy described above.
+ * \ingroup LabPro-ListParse
+ */
+double LabPro_decimal_to_double(uint64_t significand, int exponent);
+
+/** \brief Decode one number.
+ * 
+ * Accepts optional leading spaces, an optional sign, digits with an optional
+ * decimal point, and an optional exponent ('E' or 'e', optional sign, digits).
+ * 
+ * \param string Start of the number
+ * \param end End of the input; the number must end before this.
+ * \param value Set to the decoded number
+ * \return Pointer to the first character after the number, or NULL if there
+ *         are no digits at string.
+ * 
+ * \ingroup LabPro-ListParse
+ */
+const char* LabPro_parse_number(const char* string, const char* end, double* value);
+
+/** \brief Count the elements of a list without decoding them.
+ * 
+ * \param string The list, starting with '{'
+ * \param length Number of bytes in string
+ * \return The number of elements, or -1 if string does not start with '{'
+ *         or has no closing '}'.
+ * 
+ * \ingroup LabPro-ListParse
+ */
+int LabPro_list_length(const char* string, size_t length);
+
+/** \brief Decode a list of numbers into an array of doubles.
+ * 
+ * The closing '}' may be followed by anything, e.g. the LabPro's trailing CR.
+ * 
+ * \param string The list, starting with '{'
+ * \param length Number of bytes in string; it need not be NULL-terminated.
+ * \param values Array to decode into
+ * \param max_values Size of values
+ * \param num_values Set to the number of elements decoded, even on error
+ * \return LABPRO_OK, LABPRO_ERR_BAD_LIST if the list is malformed or an element
+ *         is not a number, or LABPRO_ERR_LIST_TOO_LONG if there are more than
+ *         max_values elements.
+ * 
+ * \ingroup LabPro-ListParse
+ */
+int LabPro_parse_list_doubles(const char* string, size_t length, double* values, int max_values, int* num_values);
+
+/** \brief Same as LabPro_parse_list_doubles(), but decodes into floats.
+ * \ingroup LabPro-ListParse
+ */
+int LabPro_parse_list_floats(const char* string, size_t length, float* values, int max_values, int* num_values);
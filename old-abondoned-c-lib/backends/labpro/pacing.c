@@ -0,0 +1,77 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/pacing.h"
+#include "backends/labpro/labpro-internal.h"
+
+void LabPro_pacer_init(LabPro_Pacer* pacer, unsigned int floor_usec) {
+    if (floor_usec > LABPRO_PACING_MAX_DELAY)
+        floor_usec = LABPRO_PACING_MAX_DELAY;
+    
+    pacer->floor_usec = floor_usec;
+    pacer->delay_usec = floor_usec;
+    pacer->last_packet_usec = 0;
+    pacer->total_wait_usec = 0;
+    pacer->num_waits = 0;
+    pacer->num_backoffs = 0;
+}
+
+void LabPro_pacer_wait(LabPro_Pacer* pacer) {
+    unsigned long long now = LabPro_time_usec();
+    
+    if (pacer->delay_usec > 0 && pacer->last_packet_usec != 0) {
+        unsigned long long ready = pacer->last_packet_usec + pacer->delay_usec;
+        if (now < ready) {
+            LabPro_sleep_usec((unsigned int)(ready - now));
+            
+            unsigned long long after = LabPro_time_usec();
+            pacer->total_wait_usec += after - now;
+            ++pacer->num_waits;
+            now = after;
+        }
+    }
+    pacer->last_packet_usec = now;
+}
+
+void LabPro_pacer_success(LabPro_Pacer* pacer) {
+    // Come back down gradually so a flaky device doesn't flip-flop between fast and slow.
+    unsigned int decay = pacer->delay_usec / 4;
+    if (decay == 0)
+        decay = pacer->delay_usec;
+    
+    if (pacer->delay_usec - decay < pacer->floor_usec)
+        pacer->delay_usec = pacer->floor_usec;
+    else
+        pacer->delay_usec -= decay;
+}
+
+void LabPro_pacer_error(LabPro_Pacer* pacer) {
+    if (pacer->delay_usec < LABPRO_PACING_ERROR_DELAY)
+        pacer->delay_usec = LABPRO_PACING_ERROR_DELAY;
+    else
+        pacer->delay_usec *= 2;
+    
+    if (pacer->delay_usec > LABPRO_PACING_MAX_DELAY)
+        pacer->delay_usec = LABPRO_PACING_MAX_DELAY;
+    ++pacer->num_backoffs;
+}
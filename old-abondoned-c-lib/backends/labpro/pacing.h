@@ -0,0 +1,89 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Pacing Adaptive pacing of USB packets
+ * 
+ * Older versions of liblabpro slept 50 ms before every 64-byte packet because
+ * that is what made early LabPro firmware behave. Most of the time the LabPro
+ * keeps up just fine, so instead the delay between packets starts at a
+ * configurable floor (zero by default) and only grows when transfers fail.
+ * Every successful transfer lets the delay decay back towards the floor.
+ */
+
+#pragma once
+
+/** \brief The longest the pacer will ever wait between two packets, in microseconds.
+ * \ingroup LabPro-Pacing
+ */
+#define LABPRO_PACING_MAX_DELAY 50000
+
+/** \brief Delay used after the first error when the current delay is zero, in microseconds.
+ * \ingroup LabPro-Pacing
+ */
+#define LABPRO_PACING_ERROR_DELAY 1000
+
+/** \brief Inter-packet delay state and statistics for one LabPro
+ * \ingroup LabPro-Pacing
+ */
+typedef struct {
+    /** \brief The delay never drops below this, in microseconds. */
+    unsigned int floor_usec;
+    
+    /** \brief The current delay between packets, in microseconds. */
+    unsigned int delay_usec;
+    
+    /** \brief When the last packet was sent, from LabPro_time_usec(). */
+    unsigned long long last_packet_usec;
+    
+    /** \brief Total time spent waiting in LabPro_pacer_wait(), in microseconds. */
+    unsigned long long total_wait_usec;
+    
+    /** \brief Number of times LabPro_pacer_wait() actually had to sleep. */
+    unsigned long long num_waits;
+    
+    /** \brief Number of times an error made the delay grow. */
+    unsigned long long num_backoffs;
+} LabPro_Pacer;
+
+/** \brief Reset the pacer with the given delay floor.
+ * \ingroup LabPro-Pacing
+ */
+void LabPro_pacer_init(LabPro_Pacer* pacer, unsigned int floor_usec);
+
+/** \brief Sleep until the current delay has passed since the previous packet.
+ * Call this right before sending a packet. If enough time has already passed,
+ * this returns immediately.
+ * \ingroup LabPro-Pacing
+ */
+void LabPro_pacer_wait(LabPro_Pacer* pacer);
+
+/** \brief Record a successful transfer; the delay decays towards the floor.
+ * \ingroup LabPro-Pacing
+ */
+void LabPro_pacer_success(LabPro_Pacer* pacer);
+
+/** \brief Record a failed transfer; the delay doubles, up to LABPRO_PACING_MAX_DELAY.
+ * \ingroup LabPro-Pacing
+ */
+void LabPro_pacer_error(LabPro_Pacer* pacer);
@@ -0,0 +1,422 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/realtime.h"
+#include "backends/labpro/clocksync.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void LabPro_realtime_default_config(LabPro_Realtime_Config* config) {
+    config->num_channels = 1;
+    config->sample_time = 0.01;
+    config->binary_records_per_packet = 0;
+    config->queue_capacity = LABPRO_REALTIME_DEFAULT_QUEUE;
+    config->stats_window = 0;
+    config->loop = NULL;
+}
+
+/* Frees the stream's buffers. Fine to call on a stream that is only partly set up. */
+static void LabPro_realtime_free(LabPro_Realtime_Stream* stream) {
+    if (stream->config.stats_window > 0) {
+        for (int i = 0; i < stream->config.num_channels; ++i)
+            LabPro_rolling_free(&stream->channel_stats[i]);
+    }
+    LabPro_spsc_free(&stream->queue);
+    free(stream);
+}
+
+/* Wake the consumer if it is blocked in LabPro_realtime_wait(). The fence
+ * pairs with the one there: either the consumer sees the new samples, or
+ * this sees that it is waiting.
+ */
+static void LabPro_realtime_wake(LabPro_Realtime_Stream* stream) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&stream->consumer_waiting, memory_order_relaxed))
+        return;
+    
+    pthread_mutex_lock(&stream->wake_mutex);
+    pthread_cond_broadcast(&stream->wake);
+    pthread_mutex_unlock(&stream->wake_mutex);
+}
+
+/* How many sample times apart two timestamps are; at least one. */
+static unsigned long long LabPro_realtime_steps(double delta, double step) {
+    if (step <= 0 || delta <= 0)
+        return 1;
+    long long steps = llround(delta / step);
+    return steps > 1 ? (unsigned long long)steps : 1;
+}
+
+/* Number the frame from how far its timestamp is from the previous one, and
+ * queue it.
+ */
+static void LabPro_realtime_push(LabPro_Realtime_Stream* stream, unsigned long long steps) {
+    LabPro_Sample* sample = &stream->frame;
+    
+    if (!stream->have_previous)
+        steps = 1; // The first sample is zero however late it is.
+    else if (steps > 1) {
+        atomic_fetch_add_explicit(&stream->gaps, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stream->missing, steps - 1, memory_order_relaxed);
+    }
+    stream->have_previous = true;
+    
+    // One clock reading for everything decoded in a step; it all arrived together.
+    if (stream->step_host_time == 0)
+        stream->step_host_time = LabPro_clock_host_now();
+    sample->host_time = stream->step_host_time;
+    
+    sample->sequence = stream->next_sequence + steps - 1;
+    sample->missing_before = stream->pending_missing + (unsigned int)(steps - 1);
+    stream->next_sequence = sample->sequence + 1;
+    
+    if (stream->config.stats_window > 0) {
+        for (int i = 0; i < sample->num_values; ++i)
+            LabPro_rolling_push(&stream->channel_stats[i], sample->values[i]);
+    }
+    
+    if (LabPro_spsc_push(&stream->queue, sample)) {
+        stream->pending_missing = 0;
+        atomic_fetch_add_explicit(&stream->samples, 1, memory_order_relaxed);
+    }
+    else {
+        // The consumer will see this one as part of the gap before the next sample.
+        stream->pending_missing = sample->missing_before + 1;
+        atomic_fetch_add_explicit(&stream->dropped, 1, memory_order_relaxed);
+    }
+}
+
+static void LabPro_realtime_on_values(void* user_data, int first_index, const double* values, int count) {
+    LabPro_Realtime_Stream* stream = (LabPro_Realtime_Stream*)user_data;
+    
+    // Each list is the channels followed by the time. Anything longer is caught at the end of the list.
+    for (int i = 0; i < count; ++i) {
+        int index = first_index + i;
+        if (index < stream->config.num_channels)
+            stream->frame.values[index] = values[i];
+        else if (index == stream->config.num_channels)
+            stream->frame.time = values[i];
+    }
+}
+
+static void LabPro_realtime_on_list_end(void* user_data, int num_values, int status) {
+    LabPro_Realtime_Stream* stream = (LabPro_Realtime_Stream*)user_data;
+    
+    if (status != LABPRO_OK || num_values != stream->config.num_channels + 1) {
+        atomic_fetch_add_explicit(&stream->bad_frames, 1, memory_order_relaxed);
+        return;
+    }
+    
+    double delta = stream->frame.time - stream->previous_time;
+    stream->previous_time = stream->frame.time;
+    stream->frame.num_values = stream->config.num_channels;
+    LabPro_realtime_push(stream, LabPro_realtime_steps(delta, stream->config.sample_time));
+}
+
+/* Decode the binary records that have arrived. The unit of the time counter
+ * isn't documented, so the sample spacing is taken to be the smallest
+ * difference between consecutive counters seen so far.
+ */
+static int LabPro_realtime_read_binary(LabPro_Realtime_Stream* stream) {
+    int num_channels = stream->config.num_channels;
+    uint16_t raw[LABPRO_REALTIME_BATCH * LABPRO_REALTIME_MAX_CHANNELS];
+    uint32_t counters[LABPRO_REALTIME_BATCH];
+    size_t num_records;
+    
+    int status = LabPro_read_binary_records(stream->labpro, num_channels, raw, counters, LABPRO_REALTIME_BATCH, &num_records);
+    if (status == LABPRO_ERR_BAD_BINARY) {
+        atomic_fetch_add_explicit(&stream->bad_frames, 1, memory_order_relaxed);
+        status = LABPRO_OK;
+    }
+    
+    for (size_t i = 0; i < num_records; ++i) {
+        // Unsigned subtraction copes with the counter wrapping around.
+        double delta = (double)(uint32_t)(counters[i] - stream->previous_counter);
+        if (stream->have_previous && delta > 0 && (stream->counter_step == 0 || delta < stream->counter_step))
+            stream->counter_step = delta;
+        stream->previous_counter = counters[i];
+        
+        stream->frame.time = counters[i];
+        stream->frame.num_values = num_channels;
+        for (int j = 0; j < num_channels; ++j)
+            stream->frame.values[j] = raw[i * num_channels + j];
+        LabPro_realtime_push(stream, LabPro_realtime_steps(delta, stream->counter_step));
+    }
+    return status;
+}
+
+/* Read and queue whatever the LabPro has sent, waiting up to labpro->timeout
+ * for it. Returns LABPRO_OK if there may be more, LIBUSB_ERROR_TIMEOUT if
+ * nothing arrived, or the error that ends the stream.
+ */
+static int LabPro_realtime_step(LabPro_Realtime_Stream* stream) {
+    LabPro* labpro = stream->labpro;
+    size_t waiting = LabPro_ring_available(&labpro->rx);
+    if (waiting > atomic_load_explicit(&stream->rx_high_water, memory_order_relaxed))
+        atomic_store_explicit(&stream->rx_high_water, waiting, memory_order_relaxed);
+    
+    stream->step_host_time = 0;
+    int status;
+    if (stream->config.binary_records_per_packet > 0)
+        status = LabPro_realtime_read_binary(stream);
+    else
+        status = LabPro_read_parsed(labpro, &stream->parser);
+    
+    LabPro_realtime_wake(stream);
+    
+    // Bad lists were already counted.
+    if (status == LABPRO_OK || status == LIBUSB_ERROR_TIMEOUT || status == LABPRO_ERR_BAD_LIST)
+        return status == LIBUSB_ERROR_TIMEOUT ? status : LABPRO_OK;
+    if (status == LABPRO_ERR_OVERRUN) {
+        atomic_fetch_add_explicit(&stream->overruns, 1, memory_order_relaxed);
+        return LABPRO_OK;
+    }
+    
+    printf("[liblabpro ERR] Realtime stream stopped: error %d\n", status);
+    return status;
+}
+
+static void LabPro_realtime_finish(LabPro_Realtime_Stream* stream, int error) {
+    atomic_store_explicit(&stream->error, error, memory_order_relaxed);
+    atomic_store_explicit(&stream->running, false, memory_order_release);
+    
+    // Let a blocked consumer find out.
+    pthread_mutex_lock(&stream->wake_mutex);
+    pthread_cond_broadcast(&stream->wake);
+    pthread_mutex_unlock(&stream->wake_mutex);
+}
+
+static void* LabPro_realtime_thread(void* data) {
+    LabPro_Realtime_Stream* stream = (LabPro_Realtime_Stream*)data;
+    int error = LABPRO_OK;
+    
+    // Timeouts just mean it's time to check for stop again.
+    while (!atomic_load_explicit(&stream->stop, memory_order_acquire)) {
+        int status = LabPro_realtime_step(stream);
+        if (status != LABPRO_OK && status != LIBUSB_ERROR_TIMEOUT) {
+            error = status;
+            break;
+        }
+    }
+    
+    LabPro_realtime_finish(stream, error);
+    return NULL;
+}
+
+/* Called by the event loop with the LabPro's timeout at zero, so this only
+ * takes what has already arrived.
+ */
+static int LabPro_realtime_service(void* data) {
+    LabPro_Realtime_Stream* stream = (LabPro_Realtime_Stream*)data;
+    int status;
+    while ((status = LabPro_realtime_step(stream)) == LABPRO_OK)
+        ;
+    if (status == LIBUSB_ERROR_TIMEOUT)
+        return LABPRO_OK;
+    
+    LabPro_realtime_finish(stream, status);
+    return status;
+}
+
+int LabPro_realtime_start(LabPro* labpro, const LabPro_Realtime_Config* config, LabPro_Realtime_Stream** stream) {
+    *stream = NULL;
+    if (!labpro->is_open)
+        return LABPRO_ERR_NOT_OPEN;
+    if (labpro->is_collecting_data)
+        return LABPRO_ERR_BUSY_COLLECT;
+    
+    LabPro_Realtime_Stream* new_stream = calloc(1, sizeof(LabPro_Realtime_Stream));
+    if (new_stream == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    new_stream->labpro = labpro;
+    new_stream->config = *config;
+    if (new_stream->config.num_channels < 1)
+        new_stream->config.num_channels = 1;
+    if (new_stream->config.num_channels > LABPRO_REALTIME_MAX_CHANNELS)
+        new_stream->config.num_channels = LABPRO_REALTIME_MAX_CHANNELS;
+    if (new_stream->config.binary_records_per_packet > 0 && new_stream->config.num_channels > LABPRO_BINARY_MAX_CHANNELS)
+        new_stream->config.num_channels = LABPRO_BINARY_MAX_CHANNELS;
+    
+    if (LabPro_spsc_init(&new_stream->queue, sizeof(LabPro_Sample), config->queue_capacity) != LABPRO_OK) {
+        free(new_stream);
+        return LABPRO_ERR_NO_MEM;
+    }
+    if (config->stats_window > 0) {
+        for (int i = 0; i < new_stream->config.num_channels; ++i) {
+            if (LabPro_rolling_init(&new_stream->channel_stats[i], config->stats_window) != LABPRO_OK) {
+                LabPro_realtime_free(new_stream);
+                return LABPRO_ERR_NO_MEM;
+            }
+        }
+    }
+    LabPro_stream_parser_init(&new_stream->parser, LabPro_realtime_on_values, LabPro_realtime_on_list_end, new_stream);
+    atomic_init(&new_stream->stop, false);
+    atomic_init(&new_stream->running, true);
+    atomic_init(&new_stream->consumer_waiting, false);
+    
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&new_stream->wake, &condattr);
+    pthread_condattr_destroy(&condattr);
+    pthread_mutex_init(&new_stream->wake_mutex, NULL);
+    
+    int retval = LABPRO_OK;
+    int transferred;
+    if (config->binary_records_per_packet > 0)
+        retval = LabPro_set_binary_mode(labpro, config->binary_records_per_packet);
+    
+    if (retval == LABPRO_OK) {
+        char command[64];
+        // {3,samptime,numpoints,trigtype,trigchan,trigthresh,prestore,extclock,rectime}: the
+        // sequence numbers are worked out from the time column, so ask for it explicitly.
+        snprintf(command, sizeof(command), "s{%d,%g,-1,0,0,0,0,0,1}", LABPRO_DATACOLLECT_SETUP, config->sample_time);
+        new_stream->start_host_time = LabPro_clock_host_now();
+        retval = LabPro_send_raw(labpro, command, &transferred);
+    }
+    
+    if (retval == LABPRO_OK) {
+        // The thread has to notice LabPro_realtime_stop() quickly, and the loop mustn't wait at all.
+        new_stream->saved_timeout = labpro->timeout;
+        labpro->timeout = config->loop != NULL ? 0 : LABPRO_REALTIME_POLL_MS;
+        labpro->is_collecting_data = true;
+        
+        if (config->loop != NULL)
+            retval = LabPro_event_loop_add(config->loop, labpro, LabPro_realtime_service, new_stream);
+        else if (pthread_create(&new_stream->thread, NULL, LabPro_realtime_thread, new_stream) != 0)
+            retval = LABPRO_ERR_NO_MEM;
+        
+        if (retval != LABPRO_OK) {
+            labpro->timeout = new_stream->saved_timeout;
+            labpro->is_collecting_data = false;
+        }
+    }
+    
+    if (retval != LABPRO_OK) {
+        pthread_cond_destroy(&new_stream->wake);
+        pthread_mutex_destroy(&new_stream->wake_mutex);
+        LabPro_realtime_free(new_stream);
+        return retval;
+    }
+    
+    *stream = new_stream;
+    return LABPRO_OK;
+}
+
+size_t LabPro_realtime_poll(LabPro_Realtime_Stream* stream, LabPro_Sample* samples, size_t max_samples) {
+    return LabPro_spsc_pop(&stream->queue, samples, max_samples);
+}
+
+int LabPro_realtime_wait(LabPro_Realtime_Stream* stream, LabPro_Sample* samples, size_t max_samples, unsigned int timeout_ms, size_t* num_samples) {
+    *num_samples = LabPro_spsc_pop(&stream->queue, samples, max_samples);
+    if (*num_samples > 0)
+        return LABPRO_OK;
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+    
+    int retval = LABPRO_OK;
+    pthread_mutex_lock(&stream->wake_mutex);
+    atomic_store_explicit(&stream->consumer_waiting, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    
+    while ((*num_samples = LabPro_spsc_pop(&stream->queue, samples, max_samples)) == 0) {
+        if (!atomic_load_explicit(&stream->running, memory_order_acquire)) {
+            // The thread may have pushed its last samples just before stopping.
+            *num_samples = LabPro_spsc_pop(&stream->queue, samples, max_samples);
+            if (*num_samples == 0)
+                retval = LABPRO_ERR_STREAM_STOPPED;
+            break;
+        }
+        if (pthread_cond_timedwait(&stream->wake, &stream->wake_mutex, &deadline) == ETIMEDOUT) {
+            *num_samples = LabPro_spsc_pop(&stream->queue, samples, max_samples);
+            if (*num_samples == 0)
+                retval = LIBUSB_ERROR_TIMEOUT;
+            break;
+        }
+    }
+    
+    atomic_store_explicit(&stream->consumer_waiting, false, memory_order_relaxed);
+    pthread_mutex_unlock(&stream->wake_mutex);
+    return retval;
+}
+
+void LabPro_realtime_stats(LabPro_Realtime_Stream* stream, LabPro_Realtime_Stats* stats) {
+    stats->samples = atomic_load_explicit(&stream->samples, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&stream->dropped, memory_order_relaxed);
+    stats->gaps = atomic_load_explicit(&stream->gaps, memory_order_relaxed);
+    stats->missing = atomic_load_explicit(&stream->missing, memory_order_relaxed);
+    stats->bad_frames = atomic_load_explicit(&stream->bad_frames, memory_order_relaxed);
+    stats->overruns = atomic_load_explicit(&stream->overruns, memory_order_relaxed);
+    stats->queue_high_water = atomic_load_explicit(&stream->queue.high_water, memory_order_relaxed);
+    stats->rx_high_water = atomic_load_explicit(&stream->rx_high_water, memory_order_relaxed);
+    stats->error = atomic_load_explicit(&stream->error, memory_order_relaxed);
+}
+
+int LabPro_realtime_channel_stats(LabPro_Realtime_Stream* stream, int index, LabPro_Rolling_Snapshot* snapshot) {
+    if (stream->config.stats_window == 0 || index < 0 || index >= stream->config.num_channels)
+        return LABPRO_ERR_BAD_CHANNEL;
+    
+    LabPro_rolling_snapshot(&stream->channel_stats[index], snapshot);
+    return LABPRO_OK;
+}
+
+int LabPro_realtime_stop(LabPro_Realtime_Stream* stream) {
+    LabPro* labpro = stream->labpro;
+    
+    if (stream->config.loop != NULL)
+        LabPro_event_loop_remove(stream->config.loop, labpro);
+    else {
+        atomic_store_explicit(&stream->stop, true, memory_order_release);
+        pthread_join(stream->thread, NULL);
+    }
+    
+    labpro->timeout = stream->saved_timeout;
+    labpro->is_collecting_data = false;
+    
+    int retval = atomic_load_explicit(&stream->error, memory_order_relaxed);
+    if (retval != LIBUSB_ERROR_NO_DEVICE) {
+        char command[16];
+        int transferred;
+        snprintf(command, sizeof(command), "s{%d,0}", LABPRO_SYS_SETUP);
+        int status = LabPro_send_raw(labpro, command, &transferred);
+        if (retval == LABPRO_OK)
+            retval = status;
+    }
+    
+    pthread_cond_destroy(&stream->wake);
+    pthread_mutex_destroy(&stream->wake_mutex);
+    LabPro_realtime_free(stream);
+    return retval;
+}
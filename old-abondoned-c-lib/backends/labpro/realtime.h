@@ -0,0 +1,296 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Realtime Realtime streaming
+ * 
+ * Runs a realtime collection (command 3 with -1 points) on a thread of its
+ * own. That thread does all the USB I/O, decodes each sample as it arrives,
+ * ASCII or binary, and pushes it into a \ref LabPro-SPSC queue. Whoever
+ * consumes the samples only ever touches the queue, so a control loop
+ * polling it with LabPro_realtime_poll() never waits on USB, and a slow
+ * consumer only costs samples, never a stalled device.
+ * 
+ * Every sample carries a sequence number worked out from its timestamp, so
+ * samples the LabPro never delivered show up as a jump in the sequence, as
+ * do samples thrown away because the queue was full. Both are counted in
+ * LabPro_Realtime_Stats.
+ * 
+ * Streams from many LabPros can instead share one \ref LabPro-Event-Loop
+ * thread, by setting LabPro_Realtime_Config.loop; everything else works the
+ * same.
+ * 
+ * The channels have to be set up with command 1 before the stream is started.
+ * While the stream runs, its thread owns the LabPro: don't send commands to
+ * it or read from it until LabPro_realtime_stop() has returned.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include "backends/labpro/eventloop.h"
+#include "backends/labpro/rolling.h"
+#include "backends/labpro/spsc.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** \brief Most channels a realtime stream can carry: four analog and two sonic.
+ * \ingroup LabPro-Realtime
+ */
+#define LABPRO_REALTIME_MAX_CHANNELS 6
+
+/** \brief Queue size used unless LabPro_Realtime_Config.queue_capacity says otherwise.
+ * \ingroup LabPro-Realtime
+ */
+#define LABPRO_REALTIME_DEFAULT_QUEUE 4096
+
+/** \brief How long the I/O thread waits for data before checking whether it should stop, in milliseconds.
+ * \ingroup LabPro-Realtime
+ */
+#define LABPRO_REALTIME_POLL_MS 20
+
+/** \brief Records the I/O thread decodes at once in binary mode.
+ * \ingroup LabPro-Realtime
+ */
+#define LABPRO_REALTIME_BATCH 64
+
+/** \brief One realtime sample
+ * \ingroup LabPro-Realtime
+ */
+typedef struct {
+    /** \brief Position of the sample in the collection, starting at zero. */
+    unsigned long long sequence;
+    
+    /** \brief How many samples are missing right before this one, whether
+     * the LabPro never sent them or the queue was full. Zero normally.
+     */
+    unsigned int missing_before;
+    
+    int num_values;
+    
+    /** \brief Seconds since the collection started. In binary mode this is
+     * the LabPro's 32-bit time counter instead.
+     */
+    double time;
+    
+    /** \brief LabPro_time_usec() in seconds when the sample was
+     * decoded, for \ref LabPro-Clock-Sync. Samples decoded together share it.
+     */
+    double host_time;
+    
+    /** \brief One value per active channel, lowest channel first. In binary
+     * mode these are raw ADC readings; see LabPro_binary_volts_scale().
+     */
+    double values[LABPRO_REALTIME_MAX_CHANNELS];
+} LabPro_Sample;
+
+/** \brief How to run a realtime stream
+ * \ingroup LabPro-Realtime
+ */
+typedef struct {
+    /** \brief Number of channels set up with command 1. */
+    int num_channels;
+    
+    /** \brief Seconds between samples. */
+    double sample_time;
+    
+    /** \brief 0 to receive ASCII data, or 1 to 4 to receive binary data with
+     * that many records per packet (see LabPro_set_binary_mode()).
+     */
+    int binary_records_per_packet;
+    
+    /** \brief Samples the queue can hold before new ones are thrown away. */
+    size_t queue_capacity;
+    
+    /** \brief Keep \ref LabPro-Rolling statistics over this many samples
+     * for each channel, or 0 not to. They see every sample the LabPro
+     * delivers, including those thrown away because the queue was full.
+     */
+    size_t stats_window;
+    
+    /** \brief Loop to service the stream on, or NULL to give the stream a
+     * thread of its own. The loop must have been started with the context
+     * the LabPro was listed with, and outlive the stream.
+     */
+    LabPro_Event_Loop* loop;
+} LabPro_Realtime_Config;
+
+/** \brief Counters kept by a realtime stream
+ * \ingroup LabPro-Realtime
+ */
+typedef struct {
+    /** \brief Samples put into the queue. */
+    unsigned long long samples;
+    
+    /** \brief Samples thrown away because the queue was full. */
+    unsigned long long dropped;
+    
+    /** \brief Number of jumps in the LabPro's timestamps. */
+    unsigned long long gaps;
+    
+    /** \brief Samples the LabPro never delivered, summed over all gaps. */
+    unsigned long long missing;
+    
+    /** \brief Lists or records that couldn't be decoded. */
+    unsigned long long bad_frames;
+    
+    /** \brief Times the LabPro's receive buffer overran, losing data that
+     * had arrived. Counted rather than printed, so as not to slow down the
+     * I/O thread when it is already behind.
+     */
+    unsigned long long overruns;
+    
+    /** \brief Most samples that have been waiting in the queue at once. */
+    size_t queue_high_water;
+    
+    /** \brief Most bytes that have been waiting in the LabPro's receive buffer at once. */
+    size_t rx_high_water;
+    
+    /** \brief The error that stopped the I/O thread, or LABPRO_OK while it is running. */
+    int error;
+} LabPro_Realtime_Stats;
+
+/** \brief A running realtime collection
+ * \ingroup LabPro-Realtime
+ */
+typedef struct {
+    LabPro* labpro;
+    LabPro_Realtime_Config config;
+    LabPro_SPSC_Queue queue;
+    /** \brief Only used if the stream isn't serviced by config.loop. */
+    pthread_t thread;
+    
+    /** \brief LabPro_time_usec() in seconds right before the
+     * collection was started. The LabPro's clock can't have started earlier.
+     */
+    double start_host_time;
+    
+    /** \brief labpro->timeout before the stream shortened it. */
+    unsigned int saved_timeout;
+    
+    /** \brief Set by LabPro_realtime_stop() to tell the thread to finish. */
+    atomic_bool stop;
+    
+    /** \brief Cleared by the thread when it exits, on its own or when told to. */
+    atomic_bool running;
+    
+    /** \brief Set by a consumer blocked in LabPro_realtime_wait(). */
+    atomic_bool consumer_waiting;
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake;
+    
+    _Atomic unsigned long long samples;
+    _Atomic unsigned long long dropped;
+    _Atomic unsigned long long gaps;
+    _Atomic unsigned long long missing;
+    _Atomic unsigned long long bad_frames;
+    _Atomic unsigned long long overruns;
+    _Atomic size_t rx_high_water;
+    _Atomic int error;
+    
+    /** \brief Per-channel statistics, if LabPro_Realtime_Config.stats_window is set. */
+    LabPro_Rolling_Stats channel_stats[LABPRO_REALTIME_MAX_CHANNELS];
+    
+    /* Only touched by the I/O thread. */
+    LabPro_Stream_Parser parser;
+    LabPro_Sample frame;
+    bool have_previous;
+    double previous_time;
+    uint32_t previous_counter;
+    double counter_step;
+    unsigned long long next_sequence;
+    unsigned int pending_missing;
+    double step_host_time;
+} LabPro_Realtime_Stream;
+
+/** \brief Fill in defaults: one channel, 10 ms samples, ASCII, LABPRO_REALTIME_DEFAULT_QUEUE, no statistics, own thread.
+ * \ingroup LabPro-Realtime
+ */
+void LabPro_realtime_default_config(LabPro_Realtime_Config* config);
+
+/** \brief Start a realtime collection and the thread that reads it, or register it with config->loop.
+ * 
+ * \param labpro The LabPro, with its channels already set up
+ * \param config How to run the stream; copied.
+ * \param stream Set to the new stream, or NULL on error
+ * \return LABPRO_OK, LABPRO_ERR_NOT_OPEN, LABPRO_ERR_BUSY_COLLECT if the
+ *         LabPro is already collecting data, LABPRO_ERR_NO_MEM, or one of the
+ *         \ref LabPro_USB_Errors errorcodes from sending the commands.
+ * 
+ * \ingroup LabPro-Realtime
+ */
+int LabPro_realtime_start(LabPro* labpro, const LabPro_Realtime_Config* config, LabPro_Realtime_Stream** stream);
+
+/** \brief Take the samples that are waiting, without blocking. Consumer thread only.
+ * \return Number of samples copied to samples, up to max_samples.
+ * \ingroup LabPro-Realtime
+ */
+size_t LabPro_realtime_poll(LabPro_Realtime_Stream* stream, LabPro_Sample* samples, size_t max_samples);
+
+/** \brief Wait until samples are waiting, then take them. Consumer thread only.
+ * 
+ * \param stream The stream
+ * \param samples Receives the samples
+ * \param max_samples Room in samples
+ * \param timeout_ms How long to wait at most
+ * \param num_samples Set to the number of samples copied
+ * \return LABPRO_OK, LIBUSB_ERROR_TIMEOUT if nothing arrived in time, or
+ *         LABPRO_ERR_STREAM_STOPPED once the I/O thread has stopped and
+ *         every sample it produced has been taken.
+ * 
+ * \ingroup LabPro-Realtime
+ */
+int LabPro_realtime_wait(LabPro_Realtime_Stream* stream, LabPro_Sample* samples, size_t max_samples, unsigned int timeout_ms, size_t* num_samples);
+
+/** \brief Get a snapshot of the stream's counters. Any thread.
+ * \ingroup LabPro-Realtime
+ */
+void LabPro_realtime_stats(LabPro_Realtime_Stream* stream, LabPro_Realtime_Stats* stats);
+
+/** \brief Get the rolling statistics of one channel. Any thread.
+ * 
+ * In binary mode they are of the raw ADC readings, like the samples.
+ * 
+ * \param stream The stream
+ * \param index Position of the channel in LabPro_Sample.values
+ * \param snapshot Filled in
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_CHANNEL if there is no such channel
+ *         or the stream keeps no statistics.
+ * 
+ * \ingroup LabPro-Realtime
+ */
+int LabPro_realtime_channel_stats(LabPro_Realtime_Stream* stream, int index, LabPro_Rolling_Snapshot* snapshot);
+
+/** \brief Stop the I/O thread (or take the stream off its loop) and the collection, and free the stream.
+ * 
+ * Samples still in the queue are lost. The LabPro is told to stop sampling
+ * with command 6, but anything it sent before that stays in its receive
+ * buffer; a reset is the simplest way to start over.
+ * 
+ * \return The error that stopped the thread early, if any, otherwise the
+ *         result of sending the stop command.
+ * 
+ * \ingroup LabPro-Realtime
+ */
+int LabPro_realtime_stop(LabPro_Realtime_Stream* stream);
@@ -0,0 +1,175 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/ringbuffer.h"
+#include "backends/labpro/labpro-internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+int LabPro_ring_init(LabPro_Ring* ring, size_t capacity, enum LabPro_Overflow_Policy policy) {
+    size_t real_capacity = LABPRO_PACKET_SIZE;
+    while (real_capacity < capacity)
+        real_capacity *= 2;
+    
+    ring->data = malloc(real_capacity);
+    if (ring->data == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    ring->capacity = real_capacity;
+    ring->policy = policy;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overflows, 0);
+    atomic_init(&ring->bytes_dropped, 0);
+    return LABPRO_OK;
+}
+
+void LabPro_ring_free(LabPro_Ring* ring) {
+    free(ring->data);
+    ring->data = NULL;
+    ring->capacity = 0;
+}
+
+size_t LabPro_ring_write(LabPro_Ring* ring, const unsigned char* data, size_t length) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t space = ring->capacity - (head - tail);
+    
+    if (length > space) {
+        atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+        
+        if (ring->policy == LABPRO_OVERFLOW_DROP_NEWEST) {
+            atomic_fetch_add_explicit(&ring->bytes_dropped, length - space, memory_order_relaxed);
+            length = space;
+        }
+        else {
+            if (length > ring->capacity) {
+                // Only the newest bytes of this write can survive anyway.
+                atomic_fetch_add_explicit(&ring->bytes_dropped, length - ring->capacity, memory_order_relaxed);
+                data += length - ring->capacity;
+                length = ring->capacity;
+            }
+            
+            // The reader may be consuming at the same time, so only move the tail forward.
+            size_t new_tail = head + length - ring->capacity;
+            while (new_tail > tail) {
+                if (atomic_compare_exchange_weak_explicit(&ring->tail, &tail, new_tail, memory_order_acq_rel, memory_order_acquire)) {
+                    atomic_fetch_add_explicit(&ring->bytes_dropped, new_tail - tail, memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+    }
+    
+    size_t offset = head & (ring->capacity - 1);
+    size_t first = ring->capacity - offset;
+    if (first > length)
+        first = length;
+    
+    memcpy(ring->data + offset, data, first);
+    if (length > first)
+        memcpy(ring->data, data + first, length - first);
+    
+    atomic_store_explicit(&ring->head, head + length, memory_order_release);
+    return length;
+}
+
+size_t LabPro_ring_available(LabPro_Ring* ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+size_t LabPro_ring_total_written(LabPro_Ring* ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+void LabPro_ring_peek(LabPro_Ring* ring, LabPro_Ring_View* view) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t used = head - tail;
+    size_t offset = tail & (ring->capacity - 1);
+    size_t first = ring->capacity - offset;
+    if (first > used)
+        first = used;
+    
+    view->first = ring->data + offset;
+    view->first_length = first;
+    view->second = ring->data;
+    view->second_length = used - first;
+    view->start = tail;
+}
+
+bool LabPro_ring_consume(LabPro_Ring* ring, const LabPro_Ring_View* view, size_t length) {
+    size_t expected = view->start;
+    size_t new_tail = view->start + length;
+    
+    if (atomic_compare_exchange_strong_explicit(&ring->tail, &expected, new_tail, memory_order_acq_rel, memory_order_acquire))
+        return true;
+    
+    // The writer dropped old bytes under us. Make sure we still end up past this view.
+    while (expected < new_tail) {
+        if (atomic_compare_exchange_weak_explicit(&ring->tail, &expected, new_tail, memory_order_acq_rel, memory_order_acquire))
+            break;
+    }
+    return false;
+}
+
+size_t LabPro_ring_view_length(const LabPro_Ring_View* view) {
+    return view->first_length + view->second_length;
+}
+
+long LabPro_ring_view_find(const LabPro_Ring_View* view, size_t from, unsigned char byte) {
+    const unsigned char* found;
+    
+    if (from < view->first_length) {
+        found = memchr(view->first + from, byte, view->first_length - from);
+        if (found != NULL)
+            return (long)(found - view->first);
+        from = view->first_length;
+    }
+    
+    size_t second_from = from - view->first_length;
+    if (second_from < view->second_length) {
+        found = memchr(view->second + second_from, byte, view->second_length - second_from);
+        if (found != NULL)
+            return (long)(view->first_length + (found - view->second));
+    }
+    return -1;
+}
+
+void LabPro_ring_view_truncate(LabPro_Ring_View* view, size_t length) {
+    if (length <= view->first_length) {
+        view->first_length = length;
+        view->second_length = 0;
+    }
+    else if (length < view->first_length + view->second_length)
+        view->second_length = length - view->first_length;
+}
+
+void LabPro_ring_view_copy(const LabPro_Ring_View* view, unsigned char* dest) {
+    if (view->first_length > 0)
+        memcpy(dest, view->first, view->first_length);
+    if (view->second_length > 0)
+        memcpy(dest + view->first_length, view->second, view->second_length);
+}
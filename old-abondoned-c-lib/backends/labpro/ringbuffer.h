@@ -0,0 +1,175 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Ring Receive ring buffer
+ * 
+ * Fixed-size byte ring that the IN transfer callbacks write into and readers
+ * look into without copying. It is allocated once when the LabPro is opened
+ * and reused for the life of the device, so long captures don't keep growing
+ * and shrinking heap blocks.
+ * 
+ * The ring is safe for exactly one writer thread and one reader thread. The
+ * positions are free-running byte counters; only the low bits index the buffer,
+ * which is why the capacity is always a power of two.
+ */
+
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Receive buffer size used for every LabPro unless changed with LabPro_set_rx_buffer().
+ * Big enough for a full command 5 data dump of one channel in ASCII.
+ * \ingroup LabPro-Ring
+ */
+#define LABPRO_RING_DEFAULT_CAPACITY (256 * 1024)
+
+/** \brief What happens when data arrives and the ring is full
+ * \ingroup LabPro-Ring
+ */
+enum LabPro_Overflow_Policy {
+    /** \brief Keep what is already in the ring and throw away the part of the write that doesn't fit. */
+    LABPRO_OVERFLOW_DROP_NEWEST,
+    /** \brief Throw away the oldest unread bytes to make room.
+     * If the reader was holding a view of those bytes, LabPro_ring_consume()
+     * will report that they were overwritten.
+     */
+    LABPRO_OVERFLOW_DROP_OLDEST
+};
+
+/** \brief A byte ring with a single writer and a single reader
+ * \ingroup LabPro-Ring
+ */
+typedef struct {
+    unsigned char* data;
+    
+    /** \brief Size of data in bytes. Always a power of two. */
+    size_t capacity;
+    
+    /** \brief Total number of bytes ever written. Only the writer advances this. */
+    _Atomic size_t head;
+    
+    /** \brief Total number of bytes ever consumed or dropped. */
+    _Atomic size_t tail;
+    
+    enum LabPro_Overflow_Policy policy;
+    
+    /** \brief Number of writes that did not fit. */
+    _Atomic unsigned long long overflows;
+    
+    /** \brief Number of bytes lost to overflows, either new or old depending on the policy. */
+    _Atomic unsigned long long bytes_dropped;
+} LabPro_Ring;
+
+/** \brief A zero-copy look at bytes in a LabPro_Ring
+ * Because the ring wraps around, the bytes may be split into two pieces. If
+ * they are not, second_length is zero.
+ * \ingroup LabPro-Ring
+ */
+typedef struct {
+    const unsigned char* first;
+    size_t first_length;
+    const unsigned char* second;
+    size_t second_length;
+    
+    /** \brief Ring position of the first byte, used by LabPro_ring_consume(). */
+    size_t start;
+} LabPro_Ring_View;
+
+/** \brief Allocate the ring's storage.
+ * 
+ * \param ring The ring to set up
+ * \param capacity Minimum capacity in bytes; rounded up to a power of two
+ * \param policy What to do when the ring is full
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-Ring
+ */
+int LabPro_ring_init(LabPro_Ring* ring, size_t capacity, enum LabPro_Overflow_Policy policy);
+
+/** \brief Free the ring's storage.
+ * \ingroup LabPro-Ring
+ */
+void LabPro_ring_free(LabPro_Ring* ring);
+
+/** \brief Append bytes to the ring. Writer side only.
+ * 
+ * \return How many bytes were stored. Less than length only with LABPRO_OVERFLOW_DROP_NEWEST.
+ * 
+ * \ingroup LabPro-Ring
+ */
+size_t LabPro_ring_write(LabPro_Ring* ring, const unsigned char* data, size_t length);
+
+/** \brief Number of unread bytes in the ring.
+ * \ingroup LabPro-Ring
+ */
+size_t LabPro_ring_available(LabPro_Ring* ring);
+
+/** \brief Total number of bytes ever written to the ring.
+ * Handy for waiting until something new has arrived.
+ * \ingroup LabPro-Ring
+ */
+size_t LabPro_ring_total_written(LabPro_Ring* ring);
+
+/** \brief Get a view of every unread byte. Reader side only.
+ * The view stays valid until it is consumed (or, with
+ * LABPRO_OVERFLOW_DROP_OLDEST, until the writer overwrites it).
+ * \ingroup LabPro-Ring
+ */
+void LabPro_ring_peek(LabPro_Ring* ring, LabPro_Ring_View* view);
+
+/** \brief Release the first length bytes of a view back to the writer. Reader side only.
+ * 
+ * \return true if the bytes were still intact, false if the writer had
+ *         already overwritten some of them.
+ * 
+ * \ingroup LabPro-Ring
+ */
+bool LabPro_ring_consume(LabPro_Ring* ring, const LabPro_Ring_View* view, size_t length);
+
+/** \brief Total number of bytes in a view.
+ * \ingroup LabPro-Ring
+ */
+size_t LabPro_ring_view_length(const LabPro_Ring_View* view);
+
+/** \brief Find a byte in a view.
+ * 
+ * \param view The view to search
+ * \param from Offset into the view to start searching at
+ * \param byte The byte to look for
+ * \return Offset of the byte into the view, or -1 if it wasn't found.
+ * 
+ * \ingroup LabPro-Ring
+ */
+long LabPro_ring_view_find(const LabPro_Ring_View* view, size_t from, unsigned char byte);
+
+/** \brief Shorten a view to its first length bytes.
+ * \ingroup LabPro-Ring
+ */
+void LabPro_ring_view_truncate(LabPro_Ring_View* view, size_t length);
+
+/** \brief Copy the contents of a view into a flat buffer of at least LabPro_ring_view_length() bytes.
+ * \ingroup LabPro-Ring
+ */
+void LabPro_ring_view_copy(const LabPro_Ring_View* view, unsigned char* dest);
@@ -0,0 +1,156 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/rolling.h"
+#include <math.h>
+#include <stdlib.h>
+
+int LabPro_rolling_init(LabPro_Rolling_Stats* stats, size_t window) {
+    if (window < 1)
+        window = 1;
+    
+    stats->window = window;
+    stats->values = calloc(window, sizeof(double));
+    stats->min_queue = malloc(window * sizeof(unsigned long long));
+    stats->max_queue = malloc(window * sizeof(unsigned long long));
+    if (stats->values == NULL || stats->min_queue == NULL || stats->max_queue == NULL) {
+        LabPro_rolling_free(stats);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    stats->min_head = stats->min_size = 0;
+    stats->max_head = stats->max_size = 0;
+    stats->total = 0;
+    stats->mean = 0;
+    stats->m2 = 0;
+    stats->round_mean = 0;
+    stats->round_m2 = 0;
+    
+    atomic_init(&stats->sequence, 0);
+    atomic_init(&stats->published_count, 0);
+    atomic_init(&stats->published_total, 0);
+    atomic_init(&stats->published_mean, 0);
+    atomic_init(&stats->published_variance, 0);
+    atomic_init(&stats->published_rms, 0);
+    atomic_init(&stats->published_min, NAN);
+    atomic_init(&stats->published_max, NAN);
+    return LABPRO_OK;
+}
+
+void LabPro_rolling_free(LabPro_Rolling_Stats* stats) {
+    free(stats->values);
+    free(stats->min_queue);
+    free(stats->max_queue);
+    stats->values = NULL;
+    stats->min_queue = NULL;
+    stats->max_queue = NULL;
+}
+
+/* Keeps the sample numbers whose values could still be the window's min
+ * (or max, with the comparison the other way round), oldest first. Each
+ * one's value is worse than the ones after it, so the front is the answer.
+ */
+static void LabPro_rolling_queue_push(const LabPro_Rolling_Stats* stats, unsigned long long* queue, size_t* head, size_t* size, unsigned long long index, int sign) {
+    size_t window = stats->window;
+    if (*size > 0 && queue[*head] + window <= index) {
+        *head = (*head + 1) % window;
+        --*size;
+    }
+    
+    double value = stats->values[index % window];
+    while (*size > 0) {
+        unsigned long long back = queue[(*head + *size - 1) % window];
+        if (sign * (stats->values[back % window] - value) < 0)
+            break;
+        --*size;
+    }
+    queue[(*head + *size) % window] = index;
+    ++*size;
+}
+
+void LabPro_rolling_push(LabPro_Rolling_Stats* stats, double value) {
+    size_t window = stats->window;
+    unsigned long long index = stats->total++;
+    size_t slot = index % window;
+    double old = stats->values[slot];
+    stats->values[slot] = value;
+    
+    unsigned long long count = stats->total < window ? stats->total : window;
+    
+    // Plain Welford's method over the slot + 1 samples pushed since the round began.
+    double delta = value - stats->round_mean;
+    stats->round_mean += delta / (slot + 1);
+    stats->round_m2 += delta * (value - stats->round_mean);
+    
+    if (index < window || slot == window - 1) {
+        // The round so far is the whole window: at the start, and once per
+        // window, when it has replaced every value the sliding figures saw.
+        stats->mean = stats->round_mean;
+        stats->m2 = stats->round_m2;
+        if (slot == window - 1) {
+            stats->round_mean = 0;
+            stats->round_m2 = 0;
+        }
+    }
+    else {
+        double old_mean = stats->mean;
+        stats->mean += (value - old) / window;
+        stats->m2 += (value - old) * (value - stats->mean + old - old_mean);
+        if (stats->m2 < 0)
+            stats->m2 = 0;
+    }
+    
+    LabPro_rolling_queue_push(stats, stats->min_queue, &stats->min_head, &stats->min_size, index, 1);
+    LabPro_rolling_queue_push(stats, stats->max_queue, &stats->max_head, &stats->max_size, index, -1);
+    
+    double variance = count > 1 ? stats->m2 / (count - 1) : 0;
+    double mean_square = stats->mean * stats->mean + stats->m2 / count;
+    
+    unsigned int sequence = atomic_load_explicit(&stats->sequence, memory_order_relaxed);
+    atomic_store_explicit(&stats->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&stats->published_count, count, memory_order_relaxed);
+    atomic_store_explicit(&stats->published_total, stats->total, memory_order_relaxed);
+    atomic_store_explicit(&stats->published_mean, stats->mean, memory_order_relaxed);
+    atomic_store_explicit(&stats->published_variance, variance, memory_order_relaxed);
+    atomic_store_explicit(&stats->published_rms, sqrt(mean_square), memory_order_relaxed);
+    atomic_store_explicit(&stats->published_min, stats->values[stats->min_queue[stats->min_head] % window], memory_order_relaxed);
+    atomic_store_explicit(&stats->published_max, stats->values[stats->max_queue[stats->max_head] % window], memory_order_relaxed);
+    atomic_store_explicit(&stats->sequence, sequence + 2, memory_order_release);
+}
+
+void LabPro_rolling_snapshot(LabPro_Rolling_Stats* stats, LabPro_Rolling_Snapshot* snapshot) {
+    unsigned int before, after;
+    do {
+        before = atomic_load_explicit(&stats->sequence, memory_order_acquire);
+        snapshot->count = atomic_load_explicit(&stats->published_count, memory_order_relaxed);
+        snapshot->total = atomic_load_explicit(&stats->published_total, memory_order_relaxed);
+        snapshot->mean = atomic_load_explicit(&stats->published_mean, memory_order_relaxed);
+        snapshot->variance = atomic_load_explicit(&stats->published_variance, memory_order_relaxed);
+        snapshot->rms = atomic_load_explicit(&stats->published_rms, memory_order_relaxed);
+        snapshot->min = atomic_load_explicit(&stats->published_min, memory_order_relaxed);
+        snapshot->max = atomic_load_explicit(&stats->published_max, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&stats->sequence, memory_order_relaxed);
+    } while (before != after || (before & 1));
+}
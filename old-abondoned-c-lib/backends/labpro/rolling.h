@@ -0,0 +1,122 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Rolling Rolling statistics
+ * 
+ * Mean, variance, RMS, min and max of the last few samples of a channel,
+ * kept up to date as samples arrive with a constant amount of work per
+ * sample, however long the window or the collection.
+ * 
+ * The mean and variance are updated with the sliding form of Welford's
+ * method. So that rounding errors can't build up, the plain form also runs
+ * over the samples since the last time the window was full of new ones, and
+ * once every window length of samples, when those samples are the window,
+ * its figures replace the sliding ones. Neither ever loops over the window.
+ * The min and max come from monotonic queues of the samples that could still
+ * become the min or max, which take amortized constant work per sample.
+ * 
+ * One thread pushes samples; any number of threads can take snapshots at the
+ * same time without locks. A snapshot that overlaps a push is simply taken
+ * again, so readers never see half-updated figures and never hold up the
+ * thread pushing, such as a realtime stream's I/O thread.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+/** \brief The figures for the current window
+ * \ingroup LabPro-Rolling
+ */
+typedef struct {
+    /** \brief Samples in the window: the window length, or fewer at the start. */
+    unsigned long long count;
+    
+    /** \brief Samples pushed since the start. */
+    unsigned long long total;
+    
+    double mean;
+    
+    /** \brief Sample variance, dividing by count - 1. Zero for fewer than two samples. */
+    double variance;
+    
+    /** \brief Root mean square of the values themselves, not of their deviations from the mean. */
+    double rms;
+    
+    double min;
+    double max;
+} LabPro_Rolling_Snapshot;
+
+/** \brief Rolling statistics for one channel
+ * \ingroup LabPro-Rolling
+ */
+typedef struct {
+    size_t window;
+    
+    /* Only touched by the thread pushing samples. */
+    double* values;
+    unsigned long long* min_queue;
+    unsigned long long* max_queue;
+    size_t min_head, min_size;
+    size_t max_head, max_size;
+    unsigned long long total;
+    double mean;
+    double m2;
+    
+    /* Welford's method over the samples pushed since the window was last made up of new ones only. */
+    double round_mean;
+    double round_m2;
+    
+    /* The last snapshot, guarded by a sequence number that is odd while it is being written. */
+    _Atomic unsigned int sequence;
+    _Atomic unsigned long long published_count;
+    _Atomic unsigned long long published_total;
+    _Atomic double published_mean;
+    _Atomic double published_variance;
+    _Atomic double published_rms;
+    _Atomic double published_min;
+    _Atomic double published_max;
+} LabPro_Rolling_Stats;
+
+/** \brief Set up statistics over the last window samples.
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * \ingroup LabPro-Rolling
+ */
+int LabPro_rolling_init(LabPro_Rolling_Stats* stats, size_t window);
+
+/** \brief Free the statistics' buffers.
+ * \ingroup LabPro-Rolling
+ */
+void LabPro_rolling_free(LabPro_Rolling_Stats* stats);
+
+/** \brief Add a sample. Only one thread at a time may push.
+ * \ingroup LabPro-Rolling
+ */
+void LabPro_rolling_push(LabPro_Rolling_Stats* stats, double value);
+
+/** \brief Get the figures as of the last push. Any thread.
+ * \ingroup LabPro-Rolling
+ */
+void LabPro_rolling_snapshot(LabPro_Rolling_Stats* stats, LabPro_Rolling_Snapshot* snapshot);
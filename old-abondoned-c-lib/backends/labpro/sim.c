@@ -0,0 +1,567 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/sim.h"
+#include "backends/labpro/labpro-internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Channel numbers in the same order as LabPro_Sim.channel_ops
+static const int LabPro_sim_channels[6] = {
+    LABPRO_CHAN_ANALOG_1,
+    LABPRO_CHAN_ANALOG_2,
+    LABPRO_CHAN_ANALOG_3,
+    LABPRO_CHAN_ANALOG_4,
+    LABPRO_CHAN_SONIC_1,
+    LABPRO_CHAN_SONIC_2
+};
+
+void LabPro_sim_default_config(LabPro_Sim_Config* config) {
+    config->response_latency_usec = 0;
+    config->jitter_usec = 0;
+    config->error_rate = 0;
+    config->time_scale = 1.0;
+    config->signal_frequency = 0.5;
+    config->seed = 1;
+}
+
+/* Small xorshift generator so runs are repeatable for a given seed. */
+static unsigned int LabPro_sim_random(LabPro_Sim* sim) {
+    unsigned int x = sim->rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rng_state = x;
+    return x;
+}
+
+static double LabPro_sim_random_unit(LabPro_Sim* sim) {
+    return (LabPro_sim_random(sim) >> 8) / (double)(1 << 24);
+}
+
+static int LabPro_sim_channel_index(int channel) {
+    for (int i = 0; i < 6; ++i) {
+        if (LabPro_sim_channels[i] == channel)
+            return i;
+    }
+    return -1;
+}
+
+/* Simulated time in seconds for the given host time. */
+static double LabPro_sim_seconds(LabPro_Sim* sim, unsigned long long now) {
+    if (sim->config.time_scale <= 0)
+        return sim->samples_sent * sim->sample_time;
+    return (now - sim->collect_start_usec) / (1e6 * sim->config.time_scale);
+}
+
+static unsigned long long LabPro_sim_scaled_usec(LabPro_Sim* sim, double seconds) {
+    if (sim->config.time_scale <= 0)
+        return 0;
+    return (unsigned long long)(seconds * sim->config.time_scale * 1e6);
+}
+
+/* The synthetic signal: a sine wave per channel, offset so channels are told apart. */
+static double LabPro_sim_value(LabPro_Sim* sim, int index, double t) {
+    double phase = 2 * M_PI * sim->config.signal_frequency * t + index;
+    double noise = (LabPro_sim_random_unit(sim) - 0.5) * 0.002;
+    
+    if (index >= 4) // Motion detector: a cart going back and forth between 0.5 m and 1.5 m
+        return 1.0 + 0.5 * sin(phase) + noise;
+    return 2.5 + (1.0 + 0.25 * index) * sin(phase) + noise;
+}
+
+/* Queue a response, split into zero-padded 64-byte packets like the LabPro does. */
+static void LabPro_sim_queue_response(LabPro_Sim* sim, const char* response, int length, unsigned long long now) {
+    unsigned long long due = now + sim->config.response_latency_usec;
+    
+    for (int offset = 0; offset < length; offset += LABPRO_PACKET_SIZE) {
+        if (sim->queue_count == LABPRO_SIM_QUEUE_PACKETS) {
+            // A real LabPro would overwrite its buffer too when nobody reads it.
+            printf("[liblabpro WARN] Simulated LabPro output queue is full; dropping data.\n");
+            return;
+        }
+        
+        if (sim->config.jitter_usec > 0)
+            due += LabPro_sim_random(sim) % sim->config.jitter_usec;
+        if (due < sim->last_due_usec)
+            due = sim->last_due_usec; // Packets never overtake each other.
+        sim->last_due_usec = due;
+        
+        LabPro_Sim_Packet* packet = &sim->queue[(sim->queue_first + sim->queue_count) % LABPRO_SIM_QUEUE_PACKETS];
+        int chunk = length - offset < LABPRO_PACKET_SIZE ? length - offset : LABPRO_PACKET_SIZE;
+        memset(packet->data, 0, LABPRO_PACKET_SIZE);
+        memcpy(packet->data, response + offset, chunk);
+        packet->due_usec = due;
+        ++sim->queue_count;
+    }
+}
+
+/* Append a number in the LabPro's sm.dddddEsee format. */
+static int LabPro_sim_format(char* out, int space, double value, bool first) {
+    return snprintf(out, space, "%s%+.5E", first ? "{ " : ",", value);
+}
+
+static void LabPro_sim_queue_list(LabPro_Sim* sim, const double* values, int count, unsigned long long now) {
+    int capacity = 16 * count + 8;
+    char* response = malloc(capacity);
+    if (response == NULL)
+        return;
+    
+    int length = 0;
+    for (int i = 0; i < count; ++i)
+        length += LabPro_sim_format(response + length, capacity - length, values[i], i == 0);
+    if (count == 0)
+        length += snprintf(response + length, capacity - length, "{");
+    length += snprintf(response + length, capacity - length, " }\r");
+    
+    LabPro_sim_queue_response(sim, response, length, now);
+    free(response);
+}
+
+/* Encode a value as the left-justified 12-bit ADC reading a real LabPro
+ * would send in binary mode, using the channel's nominal voltage range.
+ */
+static void LabPro_sim_put_raw(LabPro_Sim* sim, int index, double value, unsigned char* out) {
+    float offset, scale;
+    if (!LabPro_binary_volts_scale(sim->channel_ops[index], LABPRO_ADC_BITS, &offset, &scale))
+        LabPro_binary_volts_scale(LABPRO_CHANOP_VOLTAGE_ZERO_TO_FIVE, LABPRO_ADC_BITS, &offset, &scale);
+    
+    long raw = lround((value - offset) / scale);
+    if (raw < 0)
+        raw = 0;
+    if (raw >= 1 << LABPRO_ADC_BITS)
+        raw = (1 << LABPRO_ADC_BITS) - 1;
+    raw <<= 16 - LABPRO_ADC_BITS;
+    out[0] = (unsigned char)(raw >> 8);
+    out[1] = (unsigned char)raw;
+}
+
+static int LabPro_sim_active_channels(LabPro_Sim* sim, int* indices) {
+    int count = 0;
+    for (int i = 0; i < 6; ++i) {
+        if (sim->channel_ops[i] != 0)
+            indices[count++] = i;
+    }
+    return count;
+}
+
+static void LabPro_sim_reset(LabPro_Sim* sim) {
+    sim->errorcode = 0;
+    memset(sim->channel_ops, 0, sizeof(sim->channel_ops));
+    sim->sample_time = 0.5;
+    sim->num_points = 0;
+    sim->realtime = false;
+    sim->fastmode = false;
+    sim->collecting = false;
+    sim->data_waiting = false;
+    sim->samples_sent = 0;
+    sim->data_channel = 0;
+    sim->data_begin = 0;
+    sim->data_end = 0;
+    sim->data_step = 1;
+    sim->next_get = 0;
+    sim->binary_records_per_packet = 0;
+    sim->binary_packet_records = 0;
+}
+
+static enum LabPro_System_Status LabPro_sim_system_status(LabPro_Sim* sim, unsigned long long now) {
+    if (sim->collecting && !sim->realtime && now >= sim->collect_end_usec) {
+        sim->collecting = false;
+        sim->data_waiting = true;
+    }
+    if (sim->collecting)
+        return LABPRO_SYSSTATUS_BUSY;
+    if (sim->data_waiting)
+        return LABPRO_SYSSTATUS_DONE;
+    return LABPRO_SYSSTATUS_IDLE;
+}
+
+static void LabPro_sim_queue_status(LabPro_Sim* sim, unsigned long long now) {
+    double status[17] = {0};
+    
+    status[0] = 6.01120; // Firmware 6.01.12.0, same as the example in the technical manual
+    status[1] = sim->errorcode;
+    status[2] = LABPRO_BATTERY_OK;
+    status[3] = 8888;
+    status[4] = sim->sample_time;
+    status[9] = sim->num_points;
+    status[12] = sim->sound_enabled ? 1 : 0;
+    status[13] = LabPro_sim_system_status(sim, now);
+    status[14] = 1;
+    status[15] = sim->num_points > 0 ? sim->num_points : 0;
+    
+    LabPro_sim_queue_list(sim, status, 17, now);
+}
+
+/* Answer a "g": the next block of non-realtime data. Each get moves on to the
+ * next active channel and finally the time column, like the real LabPro.
+ */
+static void LabPro_sim_queue_get(LabPro_Sim* sim, unsigned long long now) {
+    if (sim->realtime || LabPro_sim_system_status(sim, now) != LABPRO_SYSSTATUS_DONE)
+        return;
+    
+    int indices[6];
+    int num_active = LabPro_sim_active_channels(sim, indices);
+    int index; // Channel index, or -1 for the time column
+    
+    if (sim->data_channel == -1)
+        index = -1;
+    else if (sim->data_channel > 0)
+        index = LabPro_sim_channel_index(sim->data_channel);
+    else {
+        index = sim->next_get < num_active ? indices[sim->next_get] : -1;
+        sim->next_get = (sim->next_get + 1) % (num_active + 1);
+    }
+    
+    int begin = sim->data_begin > 0 ? sim->data_begin : 1;
+    int end = sim->data_end > 0 && sim->data_end < sim->num_points ? sim->data_end : sim->num_points;
+    int step = sim->data_step > 0 ? sim->data_step : 1;
+    int count = end >= begin ? (end - begin) / step + 1 : 0;
+    
+    if (sim->binary_records_per_packet > 0) {
+        // Binary mode only returns channel data; the host works the times out itself.
+        if (index < 0)
+            return;
+        
+        unsigned char* response = malloc(count > 0 ? 2 * count : 1);
+        if (response == NULL)
+            return;
+        for (int i = 0; i < count; ++i)
+            LabPro_sim_put_raw(sim, index, LabPro_sim_value(sim, index, (begin - 1 + i * step) * sim->sample_time), response + 2 * i);
+        LabPro_sim_queue_response(sim, (const char*)response, 2 * count, now);
+        free(response);
+        return;
+    }
+    
+    double* values = malloc((count > 0 ? count : 1) * sizeof(double));
+    if (values == NULL)
+        return;
+    for (int i = 0; i < count; ++i) {
+        double t = (begin - 1 + i * step) * sim->sample_time;
+        values[i] = index < 0 ? t : LabPro_sim_value(sim, index, t);
+    }
+    LabPro_sim_queue_list(sim, values, count, now);
+    free(values);
+}
+
+/* Generate every realtime sample that is due by now. */
+static void LabPro_sim_generate_realtime(LabPro_Sim* sim, unsigned long long now) {
+    int indices[6];
+    int num_active = LabPro_sim_active_channels(sim, indices);
+    double values[7];
+    
+    while (sim->collecting && sim->realtime) {
+        double t = sim->samples_sent * sim->sample_time;
+        unsigned long long due = sim->collect_start_usec + LabPro_sim_scaled_usec(sim, t);
+        
+        if (due > now)
+            break;
+        // As fast as possible still has to wait for the reader to make room.
+        if (sim->config.time_scale <= 0 && sim->queue_count >= LABPRO_SIM_QUEUE_PACKETS / 2)
+            break;
+        
+        if (sim->binary_records_per_packet > 0) {
+            unsigned char* record = sim->binary_packet + sim->binary_packet_records * LABPRO_BINARY_RECORD_SIZE;
+            memset(record, 0, LABPRO_BINARY_RECORD_SIZE);
+            for (int i = 0; i < num_active && i < LABPRO_BINARY_MAX_CHANNELS; ++i)
+                LabPro_sim_put_raw(sim, indices[i], LabPro_sim_value(sim, indices[i], t), record + 2 * i);
+            
+            uint32_t counter = (uint32_t)llround(t * 1e6);
+            unsigned char* time = record + 2 * (num_active < LABPRO_BINARY_MAX_CHANNELS ? num_active : LABPRO_BINARY_MAX_CHANNELS);
+            time[0] = (unsigned char)(counter >> 24);
+            time[1] = (unsigned char)(counter >> 16);
+            time[2] = (unsigned char)(counter >> 8);
+            time[3] = (unsigned char)counter;
+            
+            // The packet only goes out once it holds X records.
+            if (++sim->binary_packet_records == sim->binary_records_per_packet) {
+                LabPro_sim_queue_response(sim, (const char*)sim->binary_packet, sim->binary_packet_records * LABPRO_BINARY_RECORD_SIZE, due > sim->last_due_usec ? due : now);
+                sim->binary_packet_records = 0;
+            }
+        }
+        else {
+            for (int i = 0; i < num_active; ++i)
+                values[i] = LabPro_sim_value(sim, indices[i], t);
+            values[num_active] = t;
+            LabPro_sim_queue_list(sim, values, sim->record_time ? num_active + 1 : num_active, due > sim->last_due_usec ? due : now);
+        }
+        ++sim->samples_sent;
+    }
+}
+
+static void LabPro_sim_execute(LabPro_Sim* sim, char* line, unsigned long long now) {
+    if (line[0] == 's')
+        ++line;
+    if (line[0] == '\0')
+        return; // The LabPro ignores a bare "s", which is used to wake it up.
+    
+    // Anything at all sent during FastMode sampling ends it, and the samples are lost.
+    if (sim->fastmode && LabPro_sim_system_status(sim, now) == LABPRO_SYSSTATUS_BUSY) {
+        sim->errorcode = 2; // FastMode abort
+        sim->collecting = false;
+        sim->num_points = 0;
+    }
+    
+    if (line[0] == 'g') {
+        LabPro_sim_queue_get(sim, now);
+        return;
+    }
+    
+    if (line[0] != '{')
+        return;
+    
+    double args[16];
+    int argc = 0;
+    char* cursor = line + 1;
+    while (argc < 16) {
+        char* end;
+        args[argc] = strtod(cursor, &end);
+        if (end == cursor)
+            break;
+        ++argc;
+        while (*end == ' ')
+            ++end;
+        if (*end != ',')
+            break;
+        cursor = end + 1;
+    }
+    if (argc == 0)
+        return;
+    
+    int channel;
+    int index;
+    switch ((int)args[0]) {
+        case LABPRO_RESET:
+            LabPro_sim_reset(sim);
+            break;
+        
+        case LABPRO_CHANNEL_SETUP:
+            channel = argc > 1 ? (int)args[1] : 0;
+            if (channel == 0)
+                memset(sim->channel_ops, 0, sizeof(sim->channel_ops));
+            else if ((index = LabPro_sim_channel_index(channel)) >= 0)
+                sim->channel_ops[index] = argc > 2 ? (int)args[2] : 1;
+            break;
+        
+        case LABPRO_DATACOLLECT_SETUP: {
+            int indices[6];
+            if (LabPro_sim_active_channels(sim, indices) == 0) {
+                sim->errorcode = 31; // Command 3 was sent prior to performing any channel setups.
+                break;
+            }
+            bool fastmode = argc > 10 && (int)args[10] == 1;
+            if (fastmode) {
+                // One analog channel, 20 to 200 µs between samples, at most 12000 points, no manual trigger.
+                int num_active = LabPro_sim_active_channels(sim, indices);
+                int points = argc > 2 ? (int)args[2] : 0;
+                int trigger = argc > 3 ? (int)args[3] : 0;
+                if (num_active != 1 || indices[0] > 3 || argc < 2 || args[1] < 0.00002 || args[1] > 0.0002
+                        || points < 1 || points > 12000 || trigger == 1 || trigger == 6) {
+                    sim->errorcode = 1; // Invalid FastMode setup
+                    break;
+                }
+            }
+            if (argc > 1 && args[1] > 0)
+                sim->sample_time = args[1];
+            sim->num_points = argc > 2 ? (int)args[2] : 100;
+            sim->realtime = sim->num_points < 0;
+            sim->fastmode = fastmode;
+            sim->record_time = argc > 8 && (int)args[8] != 0;
+            sim->collecting = true;
+            sim->data_waiting = false;
+            sim->samples_sent = 0;
+            sim->next_get = 0;
+            sim->binary_packet_records = 0;
+            sim->data_begin = 0;
+            sim->data_end = 0;
+            sim->collect_start_usec = now;
+            sim->collect_end_usec = now + (sim->realtime ? 0 : LabPro_sim_scaled_usec(sim, sim->num_points * sim->sample_time));
+            break;
+        }
+        
+        case LABPRO_CONVERSION_EQN_SETUP:
+            // Only {4,0,-1,X} matters here; calibration equations don't change the synthetic data.
+            if (argc > 2 && (int)args[1] == 0 && (int)args[2] == -1) {
+                int records = argc > 3 ? (int)args[3] : 1;
+                sim->binary_records_per_packet = records >= 1 && records <= LABPRO_BINARY_MAX_RECORDS_PER_PACKET ? records : 1;
+                sim->binary_packet_records = 0;
+            }
+            break;
+        
+        case LABPRO_DATA_CTL:
+            sim->data_channel = argc > 1 ? (int)args[1] : 0;
+            sim->data_begin = argc > 3 ? (int)args[3] : 0;
+            sim->data_end = argc > 4 ? (int)args[4] : 0;
+            if (argc > 5)
+                sim->data_step = (int)args[5];
+            break;
+        
+        case LABPRO_SYS_SETUP:
+            if (argc > 1 && ((int)args[1] == 0 || (int)args[1] == 2)) {
+                // Abort sampling; whatever was collected so far can still be fetched.
+                if (sim->collecting && !sim->realtime) {
+                    sim->num_points = (int)(LabPro_sim_seconds(sim, now) / sim->sample_time);
+                    sim->data_waiting = true;
+                }
+                sim->collecting = false;
+            }
+            else if (argc > 1 && (int)args[1] == 3)
+                sim->sound_enabled = false;
+            else if (argc > 1 && (int)args[1] == 4)
+                sim->sound_enabled = true;
+            break;
+        
+        case LABPRO_SYS_STATUS:
+            LabPro_sim_queue_status(sim, now);
+            break;
+        
+        case LABPRO_REQUEST_CHAN_DATA: {
+            channel = argc > 1 ? (int)args[1] : LABPRO_CHAN_ANALOG_1;
+            index = LabPro_sim_channel_index(channel);
+            double value = index >= 0 ? LabPro_sim_value(sim, index, now / 1e6) : 0;
+            LabPro_sim_queue_list(sim, &value, 1, now);
+            break;
+        }
+        
+        default:
+            // Everything else (sound, LEDs, digital output...) has no response.
+            break;
+    }
+}
+
+LabPro_Sim* LabPro_sim_create(const LabPro_Sim_Config* config, LabPro_Packet_Callback on_packet, void* on_packet_data) {
+    LabPro_Sim* sim = calloc(1, sizeof(LabPro_Sim));
+    if (sim == NULL)
+        return NULL;
+    
+    sim->config = *config;
+    sim->on_packet = on_packet;
+    sim->on_packet_data = on_packet_data;
+    sim->connected = true;
+    sim->rng_state = config->seed != 0 ? config->seed : 1;
+    sim->sound_enabled = true;
+    LabPro_sim_reset(sim);
+    return sim;
+}
+
+void LabPro_sim_disconnect(LabPro_Sim* sim) {
+    sim->connected = false;
+}
+
+static int LabPro_sim_write(void* transport_data, const unsigned char* data, int length, unsigned int timeout, int* transferred) {
+    LabPro_Sim* sim = (LabPro_Sim*)transport_data;
+    (void)timeout;
+    *transferred = 0;
+    
+    if (!sim->connected)
+        return LIBUSB_ERROR_NO_DEVICE;
+    if (length > LABPRO_PACKET_SIZE)
+        return LIBUSB_ERROR_INVALID_PARAM;
+    if (sim->config.error_rate > 0 && LabPro_sim_random_unit(sim) < sim->config.error_rate)
+        return LIBUSB_ERROR_IO;
+    
+    unsigned long long now = LabPro_time_usec();
+    for (int i = 0; i < length; ++i) {
+        if (data[i] == '\r') {
+            sim->command[sim->command_length] = '\0';
+            LabPro_sim_execute(sim, sim->command, now);
+            sim->command_length = 0;
+        }
+        else if (sim->command_length < (int)sizeof(sim->command) - 1)
+            sim->command[sim->command_length++] = (char)data[i];
+    }
+    
+    *transferred = length;
+    return LIBUSB_SUCCESS;
+}
+
+static int LabPro_sim_handle_events(void* transport_data, unsigned int timeout_ms) {
+    LabPro_Sim* sim = (LabPro_Sim*)transport_data;
+    unsigned long long now = LabPro_time_usec();
+    unsigned long long deadline = now + (unsigned long long)timeout_ms * 1000;
+    
+    while (sim->connected) {
+        LabPro_sim_generate_realtime(sim, now);
+        
+        int delivered = 0;
+        while (sim->queue_count > 0 && sim->queue[sim->queue_first].due_usec <= now) {
+            LabPro_Sim_Packet* packet = &sim->queue[sim->queue_first];
+            
+            if (sim->config.error_rate > 0 && LabPro_sim_random_unit(sim) < sim->config.error_rate) {
+                // Pretend the transfer failed and libusb tried again a little later.
+                ++sim->in_errors;
+                packet->due_usec = now + 1000 + (sim->config.jitter_usec > 0 ? LabPro_sim_random(sim) % sim->config.jitter_usec : 0);
+                break;
+            }
+            
+            sim->queue_first = (sim->queue_first + 1) % LABPRO_SIM_QUEUE_PACKETS;
+            --sim->queue_count;
+            if (sim->on_packet != NULL)
+                sim->on_packet(sim->on_packet_data, packet->data, LABPRO_PACKET_SIZE);
+            ++delivered;
+        }
+        if (delivered > 0 || now >= deadline)
+            return LIBUSB_SUCCESS;
+        
+        // Sleep until the next packet or realtime sample is due, but no longer than asked.
+        unsigned long long wake = deadline;
+        if (sim->queue_count > 0 && sim->queue[sim->queue_first].due_usec < wake)
+            wake = sim->queue[sim->queue_first].due_usec;
+        if (sim->collecting && sim->realtime) {
+            unsigned long long next_sample = sim->collect_start_usec + LabPro_sim_scaled_usec(sim, sim->samples_sent * sim->sample_time);
+            if (next_sample < wake)
+                wake = next_sample;
+        }
+        if (wake > now)
+            LabPro_sleep_usec((unsigned int)(wake - now));
+        now = LabPro_time_usec();
+    }
+    return LIBUSB_ERROR_NO_DEVICE;
+}
+
+static int LabPro_sim_status(void* transport_data) {
+    return ((LabPro_Sim*)transport_data)->connected ? LIBUSB_SUCCESS : LIBUSB_ERROR_NO_DEVICE;
+}
+
+static unsigned long long LabPro_sim_in_errors(void* transport_data) {
+    return ((LabPro_Sim*)transport_data)->in_errors;
+}
+
+static void LabPro_sim_close(void* transport_data) {
+    free(transport_data);
+}
+
+const LabPro_Transport LabPro_sim_transport = {
+    "simulated",
+    LabPro_sim_write,
+    LabPro_sim_handle_events,
+    LabPro_sim_status,
+    LabPro_sim_in_errors,
+    LabPro_sim_close
+};
@@ -0,0 +1,168 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Sim Simulated LabPro
+ * 
+ * An in-process LabPro that sits below the transport layer, so that
+ * LabPro_list_labpros(), LabPro_send_raw(), LabPro_read_raw() and everything
+ * built on them can be run without a device attached. It understands the
+ * commands in LabPro_Commands that matter for data collection (reset, channel
+ * setup, data collection setup, data control, system setup, status, and
+ * single-point requests), replies with the same ASCII formatting and 64-byte
+ * zero-padded packets as a real LabPro, and generates synthetic samples for
+ * realtime, non-realtime and FastMode collections, in ASCII or in the binary
+ * format from \ref LabPro-Binary. Its binary time counter counts microseconds.
+ * Like a real LabPro, it aborts a FastMode collection when any command
+ * arrives before the collection has finished.
+ * 
+ * Timing can be scaled so that collections run faster than any real LabPro,
+ * and packets can be delayed and failed on purpose to exercise the error paths.
+ */
+
+#pragma once
+#include "backends/labpro/async.h"
+#include "backends/labpro/transport.h"
+#include <stdbool.h>
+
+/** \brief Number of 64-byte packets the simulated LabPro can have waiting to be read.
+ * \ingroup LabPro-Sim
+ */
+#define LABPRO_SIM_QUEUE_PACKETS 1024
+
+/** \brief Knobs for a simulated LabPro
+ * \ingroup LabPro-Sim
+ */
+typedef struct {
+    /** \brief Time between a command and the first packet of its response, in microseconds. */
+    unsigned int response_latency_usec;
+    
+    /** \brief Up to this many extra microseconds are added at random to every packet. */
+    unsigned int jitter_usec;
+    
+    /** \brief Probability (0 to 1) that any given transfer fails.
+     * Failed OUT transfers return LIBUSB_ERROR_IO. Failed IN transfers are counted
+     * as errors and the packet arrives later, as if libusb had retried it.
+     */
+    double error_rate;
+    
+    /** \brief How fast simulated time runs compared to the collection settings.
+     * 1.0 collects at the commanded sample rate, 0.01 runs a hundred times faster,
+     * and 0 produces realtime samples as fast as they can be read.
+     */
+    double time_scale;
+    
+    /** \brief Frequency of the synthetic signal on every channel, in Hz of simulated time. */
+    double signal_frequency;
+    
+    /** \brief Seed for the jitter, noise and error injection. */
+    unsigned int seed;
+} LabPro_Sim_Config;
+
+/** \brief A packet waiting to be delivered by the simulated LabPro
+ * \ingroup LabPro-Sim
+ */
+typedef struct {
+    unsigned long long due_usec;
+    unsigned char data[LABPRO_PACKET_SIZE];
+} LabPro_Sim_Packet;
+
+/** \brief State of a simulated LabPro
+ * \ingroup LabPro-Sim
+ */
+typedef struct {
+    LabPro_Sim_Config config;
+    LabPro_Packet_Callback on_packet;
+    void* on_packet_data;
+    
+    /** \brief Cleared by LabPro_sim_disconnect() to act like the cable was pulled. */
+    bool connected;
+    unsigned int rng_state;
+    unsigned long long in_errors;
+    
+    /** \brief Partial command line received so far. */
+    char command[256];
+    int command_length;
+    
+    LabPro_Sim_Packet queue[LABPRO_SIM_QUEUE_PACKETS];
+    int queue_first;
+    int queue_count;
+    unsigned long long last_due_usec;
+    
+    int errorcode;
+    bool sound_enabled;
+    /** \brief Operation from command 1 for channels 1-4, 11 and 12 (indices 0-5). Zero is off. */
+    int channel_ops[6];
+    
+    double sample_time;
+    int num_points;
+    bool realtime;
+    /** \brief Whether the current collection was set up with FastMode. */
+    bool fastmode;
+    /** \brief rectime from command 3: whether ASCII realtime samples end with their time. */
+    bool record_time;
+    bool collecting;
+    bool data_waiting;
+    unsigned long long collect_start_usec;
+    unsigned long long collect_end_usec;
+    unsigned long long samples_sent;
+    
+    /** \brief Channel requested by command 5, or 0 to step through the active channels on each get. */
+    int data_channel;
+    int data_begin;
+    int data_end;
+    int data_step;
+    int next_get;
+    
+    /** \brief Realtime records per packet after {4,0,-1,X}, or 0 for ASCII data. */
+    int binary_records_per_packet;
+    /** \brief Realtime packet being filled with binary records. */
+    unsigned char binary_packet[LABPRO_PACKET_SIZE];
+    int binary_packet_records;
+} LabPro_Sim;
+
+/** \brief Reasonable defaults: real-time speed, no latency, no jitter, no errors.
+ * \ingroup LabPro-Sim
+ */
+void LabPro_sim_default_config(LabPro_Sim_Config* config);
+
+/** \brief Create a simulated LabPro.
+ * 
+ * \param config Knobs for the simulation
+ * \param on_packet Called with every packet the simulated LabPro sends
+ * \param on_packet_data Passed to on_packet
+ * \return The new simulated LabPro, or NULL if out of memory. Freed by the transport's close operation.
+ * 
+ * \ingroup LabPro-Sim
+ */
+LabPro_Sim* LabPro_sim_create(const LabPro_Sim_Config* config, LabPro_Packet_Callback on_packet, void* on_packet_data);
+
+/** \brief Make the simulated LabPro act as if it had been unplugged.
+ * \ingroup LabPro-Sim
+ */
+void LabPro_sim_disconnect(LabPro_Sim* sim);
+
+/** \brief The simulated transport. transport_data is a LabPro_Sim.
+ * \ingroup LabPro-Sim
+ */
+extern const LabPro_Transport LabPro_sim_transport;
@@ -0,0 +1,126 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/sonic.h"
+#include "backends/labpro/cpu.h"
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LABPRO_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Samples corrected at once by LabPro_sonic_compensate_samples().
+#define LABPRO_SONIC_BATCH 64
+
+/* out = distance * sqrt((temperature + offset) * scale), where offset takes
+ * the temperature to an absolute scale and scale divides by the reference
+ * temperature on that scale. The square root is exact in every path, so
+ * they all give the same bits.
+ */
+static void LabPro_sonic_kernel_scalar(const double* distances, const double* temperatures, size_t count, double offset, double scale, double* out) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = distances[i] * sqrt((temperatures[i] + offset) * scale);
+}
+
+#ifdef LABPRO_HAVE_X86_SIMD
+
+__attribute__((target("sse4.2")))
+static void LabPro_sonic_kernel_sse42(const double* distances, const double* temperatures, size_t count, double offset, double scale, double* out) {
+    __m128d voffset = _mm_set1_pd(offset);
+    __m128d vscale = _mm_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d factor = _mm_sqrt_pd(_mm_mul_pd(_mm_add_pd(_mm_loadu_pd(temperatures + i), voffset), vscale));
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(distances + i), factor));
+    }
+    LabPro_sonic_kernel_scalar(distances + i, temperatures + i, count - i, offset, scale, out + i);
+}
+
+__attribute__((target("avx2")))
+static void LabPro_sonic_kernel_avx2(const double* distances, const double* temperatures, size_t count, double offset, double scale, double* out) {
+    __m256d voffset = _mm256_set1_pd(offset);
+    __m256d vscale = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d factor = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_loadu_pd(temperatures + i), voffset), vscale));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(distances + i), factor));
+    }
+    LabPro_sonic_kernel_scalar(distances + i, temperatures + i, count - i, offset, scale, out + i);
+}
+
+#endif // LABPRO_HAVE_X86_SIMD
+
+void LabPro_sonic_compensate(const double* distances, const double* temperatures, size_t count, bool fahrenheit, double reference_temp, double* out) {
+    double reference_kelvin = reference_temp + 273.15;
+    double offset = fahrenheit ? 459.67 : 273.15;
+    double scale = fahrenheit ? (5.0 / 9.0) / reference_kelvin : 1 / reference_kelvin;
+
+#ifdef LABPRO_HAVE_X86_SIMD
+    switch (LabPro_simd_level()) {
+        case LABPRO_SIMD_AVX2:
+            LabPro_sonic_kernel_avx2(distances, temperatures, count, offset, scale, out);
+            return;
+        case LABPRO_SIMD_SSE42:
+            LabPro_sonic_kernel_sse42(distances, temperatures, count, offset, scale, out);
+            return;
+        default:
+            break;
+    }
+#endif
+    LabPro_sonic_kernel_scalar(distances, temperatures, count, offset, scale, out);
+}
+
+int LabPro_sonic_compensate_samples(const LabPro_Sonic_Compensation* compensation, LabPro_Sample* samples, size_t count) {
+    int first = compensation->distance_index;
+    int end = first + compensation->num_values;
+    int temperature = compensation->temperature_index;
+    if (first < 0 || compensation->num_values < 1 || temperature < 0)
+        return LABPRO_ERR_BAD_CHANNEL;
+    if (temperature >= first && temperature < end)
+        return LABPRO_ERR_BAD_CHANNEL;
+    
+    for (size_t i = 0; i < count; ++i) {
+        if (end > samples[i].num_values || temperature >= samples[i].num_values)
+            return LABPRO_ERR_BAD_CHANNEL;
+    }
+    
+    // The values are spread out over the samples, so they are gathered into
+    // arrays for the kernel a batch at a time and put back afterwards.
+    double temperatures[LABPRO_SONIC_BATCH];
+    double values[LABPRO_SONIC_BATCH];
+    for (size_t start = 0; start < count; start += LABPRO_SONIC_BATCH) {
+        size_t n = count - start < LABPRO_SONIC_BATCH ? count - start : LABPRO_SONIC_BATCH;
+        for (size_t i = 0; i < n; ++i)
+            temperatures[i] = samples[start + i].values[temperature];
+        
+        for (int index = first; index < end; ++index) {
+            for (size_t i = 0; i < n; ++i)
+                values[i] = samples[start + i].values[index];
+            LabPro_sonic_compensate(values, temperatures, n, compensation->fahrenheit, compensation->reference_temp, values);
+            for (size_t i = 0; i < n; ++i)
+                samples[start + i].values[index] = values[i];
+        }
+    }
+    return LABPRO_OK;
+}
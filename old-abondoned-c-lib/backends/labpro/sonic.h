@@ -0,0 +1,104 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Sonic Sonic temperature compensation
+ * 
+ * Corrects motion detector distances for the temperature of the air on the
+ * host. The LabPro works distances out from the echo time with the speed of
+ * sound at LABPRO_SONIC_REFERENCE_TEMP, and the speed of sound goes with the
+ * square root of the absolute temperature, so a distance measured in air at
+ * T degrees Celsius is really
+ * 
+ *     distance * sqrt((T + 273.15) / (LABPRO_SONIC_REFERENCE_TEMP + 273.15))
+ * 
+ * The temperature comes from a probe on an analog channel of the same
+ * collection, sample by sample, so the correction follows the air as it
+ * warms up or cools down over a long run. That leaves the LabPro in its
+ * plain distance mode, without LabPro_Data_Session.use_sonic_temp_compensation.
+ * The correction doesn't depend on the distance units, and applies to
+ * velocities and accelerations the same way.
+ * 
+ * The arrays are corrected with vector code as chosen by \ref LabPro-CPU;
+ * the results are the same on every path.
+ */
+
+#pragma once
+#include "backends/labpro/realtime.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Temperature the LabPro's distances are worked out for, in degrees Celsius.
+ * The LabPro assumes 343 m/s, the speed of sound at this temperature.
+ * \ingroup LabPro-Sonic
+ */
+#define LABPRO_SONIC_REFERENCE_TEMP 20.0
+
+/** \brief Where to find the values in realtime samples
+ * \ingroup LabPro-Sonic
+ */
+typedef struct {
+    /** \brief Position of the distance in LabPro_Sample.values. */
+    int distance_index;
+    
+    /** \brief Values from distance_index on to correct: 1 for just the
+     * distance, more if the LabPro sends velocity and acceleration after it.
+     */
+    int num_values;
+    
+    /** \brief Position of the temperature in LabPro_Sample.values. */
+    int temperature_index;
+    
+    /** \brief Whether the temperature is in degrees Fahrenheit rather than Celsius. */
+    bool fahrenheit;
+    
+    /** \brief Temperature the distances were worked out for, in degrees
+     * Celsius. Normally LABPRO_SONIC_REFERENCE_TEMP.
+     */
+    double reference_temp;
+} LabPro_Sonic_Compensation;
+
+/** \brief Correct an array of distances.
+ * 
+ * \param distances count distances, or velocities or accelerations
+ * \param temperatures The temperature at each of them
+ * \param count Number of values
+ * \param fahrenheit Whether the temperatures are in degrees Fahrenheit rather than Celsius
+ * \param reference_temp As for LabPro_Sonic_Compensation.reference_temp
+ * \param out Receives the corrected values; may be the same array as distances.
+ * 
+ * Values whose temperature is below absolute zero, e.g. because the probe is
+ * unplugged, come out as NAN.
+ * 
+ * \ingroup LabPro-Sonic
+ */
+void LabPro_sonic_compensate(const double* distances, const double* temperatures, size_t count, bool fahrenheit, double reference_temp, double* out);
+
+/** \brief Correct realtime samples in place, e.g. right after LabPro_realtime_poll().
+ * 
+ * \return LABPRO_OK, or LABPRO_ERR_BAD_CHANNEL if the indices in compensation
+ *         don't fit in the samples. Nothing is changed then.
+ * 
+ * \ingroup LabPro-Sonic
+ */
+int LabPro_sonic_compensate_samples(const LabPro_Sonic_Compensation* compensation, LabPro_Sample* samples, size_t count);
@@ -0,0 +1,105 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/spsc.h"
+#include "backends/labpro/labpro-internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+int LabPro_spsc_init(LabPro_SPSC_Queue* queue, size_t element_size, size_t capacity) {
+    size_t real_capacity = 1;
+    while (real_capacity < capacity)
+        real_capacity *= 2;
+    
+    queue->data = malloc(real_capacity * element_size);
+    if (queue->data == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    queue->element_size = element_size;
+    queue->capacity = real_capacity;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->high_water, 0);
+    queue->cached_tail = 0;
+    queue->cached_head = 0;
+    return LABPRO_OK;
+}
+
+void LabPro_spsc_free(LabPro_SPSC_Queue* queue) {
+    free(queue->data);
+    queue->data = NULL;
+    queue->capacity = 0;
+}
+
+bool LabPro_spsc_push(LabPro_SPSC_Queue* queue, const void* element) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    
+    if (head - queue->cached_tail == queue->capacity) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head - queue->cached_tail == queue->capacity)
+            return false;
+    }
+    
+    memcpy(queue->data + (head & (queue->capacity - 1)) * queue->element_size, element, queue->element_size);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    
+    // cached_tail is stale, so this overestimates; only look at the real tail when it matters.
+    size_t depth = head + 1 - queue->cached_tail;
+    if (depth > atomic_load_explicit(&queue->high_water, memory_order_relaxed)) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        depth = head + 1 - queue->cached_tail;
+        if (depth > atomic_load_explicit(&queue->high_water, memory_order_relaxed))
+            atomic_store_explicit(&queue->high_water, depth, memory_order_relaxed);
+    }
+    return true;
+}
+
+size_t LabPro_spsc_pop(LabPro_SPSC_Queue* queue, void* elements, size_t max_elements) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    
+    if (queue->cached_head - tail < max_elements)
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    
+    size_t count = queue->cached_head - tail;
+    if (count > max_elements)
+        count = max_elements;
+    if (count == 0)
+        return 0;
+    
+    // Copy in at most two pieces, since the elements may wrap around.
+    size_t start = tail & (queue->capacity - 1);
+    size_t first = queue->capacity - start;
+    if (first > count)
+        first = count;
+    memcpy(elements, queue->data + start * queue->element_size, first * queue->element_size);
+    memcpy((unsigned char*)elements + first * queue->element_size, queue->data, (count - first) * queue->element_size);
+    
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+    return count;
+}
+
+size_t LabPro_spsc_size(LabPro_SPSC_Queue* queue) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return head - tail;
+}
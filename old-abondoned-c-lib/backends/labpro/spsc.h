@@ -0,0 +1,103 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-SPSC Single-producer single-consumer queue
+ * 
+ * A bounded, lock-free queue of fixed-size elements for handing data from
+ * one thread to exactly one other. Neither side ever blocks or takes a lock:
+ * a push into a full queue fails and a pop from an empty one returns nothing.
+ * The producer's and consumer's positions live on separate cache lines, and
+ * each side keeps a private copy of the other's position so it only has to
+ * touch the shared one when the copy says the queue is full or empty.
+ */
+
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Assumed size of a cache line, used to keep the two sides of a queue apart.
+ * \ingroup LabPro-SPSC
+ */
+#define LABPRO_CACHE_LINE 64
+
+/** \brief A bounded queue with one producer thread and one consumer thread
+ * \ingroup LabPro-SPSC
+ */
+typedef struct {
+    unsigned char* data;
+    size_t element_size;
+    
+    /** \brief Number of elements that fit. Always a power of two. */
+    size_t capacity;
+    
+    /** \brief Total number of elements ever pushed. Only the producer advances this. */
+    _Alignas(LABPRO_CACHE_LINE) _Atomic size_t head;
+    
+    /** \brief The producer's last look at tail. */
+    size_t cached_tail;
+    
+    /** \brief Most elements that have been waiting at once, as seen by the producer. */
+    _Atomic size_t high_water;
+    
+    /** \brief Total number of elements ever popped. Only the consumer advances this. */
+    _Alignas(LABPRO_CACHE_LINE) _Atomic size_t tail;
+    
+    /** \brief The consumer's last look at head. */
+    size_t cached_head;
+} LabPro_SPSC_Queue;
+
+/** \brief Allocate a queue's storage.
+ * 
+ * \param queue The queue to set up
+ * \param element_size Size of each element in bytes
+ * \param capacity Minimum number of elements; rounded up to a power of two
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-SPSC
+ */
+int LabPro_spsc_init(LabPro_SPSC_Queue* queue, size_t element_size, size_t capacity);
+
+/** \brief Free a queue's storage. Neither thread may be using it any more.
+ * \ingroup LabPro-SPSC
+ */
+void LabPro_spsc_free(LabPro_SPSC_Queue* queue);
+
+/** \brief Add an element. Producer only.
+ * \return false if the queue is full, in which case nothing was added.
+ * \ingroup LabPro-SPSC
+ */
+bool LabPro_spsc_push(LabPro_SPSC_Queue* queue, const void* element);
+
+/** \brief Take up to max_elements elements, oldest first. Consumer only.
+ * \return Number of elements copied to elements; zero if the queue is empty.
+ * \ingroup LabPro-SPSC
+ */
+size_t LabPro_spsc_pop(LabPro_SPSC_Queue* queue, void* elements, size_t max_elements);
+
+/** \brief Number of elements waiting. Exact only when called by the producer or the consumer
+ * while the other side is idle; otherwise a snapshot.
+ * \ingroup LabPro-SPSC
+ */
+size_t LabPro_spsc_size(LabPro_SPSC_Queue* queue);
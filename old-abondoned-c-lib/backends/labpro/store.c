@@ -0,0 +1,272 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/store.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int LabPro_store_channel_index(enum LabPro_Channels channel) {
+    switch (channel) {
+        case LABPRO_CHAN_ANALOG_1:
+        case LABPRO_CHAN_ANALOG_2:
+        case LABPRO_CHAN_ANALOG_3:
+        case LABPRO_CHAN_ANALOG_4:
+            return channel - LABPRO_CHAN_ANALOG_1;
+        case LABPRO_CHAN_SONIC_1:
+        case LABPRO_CHAN_SONIC_2:
+            return 4 + channel - LABPRO_CHAN_SONIC_1;
+        case LABPRO_CHAN_DIGITAL_1:
+        case LABPRO_CHAN_DIGITAL_2:
+            return 6 + channel - LABPRO_CHAN_DIGITAL_1;
+        default:
+            return -1;
+    }
+}
+
+static const LabPro_Store_Channel* LabPro_store_find(const LabPro_Store* store, enum LabPro_Channels channel) {
+    int index = LabPro_store_channel_index(channel);
+    return index >= 0 ? &store->channels[index] : NULL;
+}
+
+/* Make sure there are chunks for at least count points in the time and value columns. */
+static int LabPro_store_reserve(LabPro_Store_Channel* column_set, size_t count) {
+    size_t needed = (count + LABPRO_STORE_CHUNK_POINTS - 1) / LABPRO_STORE_CHUNK_POINTS;
+    
+    if (needed > column_set->chunk_table_size) {
+        size_t new_size = column_set->chunk_table_size > 0 ? column_set->chunk_table_size : 16;
+        while (new_size < needed)
+            new_size *= 2;
+        
+        // Only the tables of chunk pointers move; the points stay where they are.
+        for (int column = 0; column < LABPRO_STORE_NUM_COLUMNS; ++column) {
+            double** table = realloc(column_set->chunks[column], new_size * sizeof(double*));
+            if (table == NULL)
+                return LABPRO_ERR_NO_MEM;
+            memset(table + column_set->chunk_table_size, 0, (new_size - column_set->chunk_table_size) * sizeof(double*));
+            column_set->chunks[column] = table;
+        }
+        column_set->chunk_table_size = new_size;
+    }
+    
+    while (column_set->num_chunks < needed) {
+        size_t chunk = column_set->num_chunks;
+        if (column_set->chunks[LABPRO_STORE_TIME][chunk] == NULL)
+            column_set->chunks[LABPRO_STORE_TIME][chunk] = malloc(LABPRO_STORE_CHUNK_POINTS * sizeof(double));
+        if (column_set->chunks[LABPRO_STORE_VALUE][chunk] == NULL)
+            column_set->chunks[LABPRO_STORE_VALUE][chunk] = malloc(LABPRO_STORE_CHUNK_POINTS * sizeof(double));
+        if (column_set->chunks[LABPRO_STORE_TIME][chunk] == NULL || column_set->chunks[LABPRO_STORE_VALUE][chunk] == NULL)
+            return LABPRO_ERR_NO_MEM;
+        ++column_set->num_chunks;
+    }
+    return LABPRO_OK;
+}
+
+/* Copy count points into a column from first onwards, with stride between source values. */
+static void LabPro_store_put(LabPro_Store_Channel* column_set, int column, size_t first, const double* source, size_t stride, size_t count) {
+    size_t done = 0;
+    while (done < count) {
+        size_t index = first + done;
+        size_t offset = index % LABPRO_STORE_CHUNK_POINTS;
+        size_t run = LABPRO_STORE_CHUNK_POINTS - offset;
+        if (run > count - done)
+            run = count - done;
+        
+        double* chunk = column_set->chunks[column][index / LABPRO_STORE_CHUNK_POINTS] + offset;
+        if (stride == 1) {
+            memcpy(chunk, source + done, run * sizeof(double));
+        }
+        else {
+            for (size_t i = 0; i < run; ++i)
+                chunk[i] = source[(done + i) * stride];
+        }
+        done += run;
+    }
+}
+
+void LabPro_store_init(LabPro_Store* store) {
+    memset(store, 0, sizeof(LabPro_Store));
+    
+    static const enum LabPro_Channels channel_numbers[LABPRO_STORE_MAX_CHANNELS] = {
+        LABPRO_CHAN_ANALOG_1, LABPRO_CHAN_ANALOG_2, LABPRO_CHAN_ANALOG_3, LABPRO_CHAN_ANALOG_4,
+        LABPRO_CHAN_SONIC_1, LABPRO_CHAN_SONIC_2, LABPRO_CHAN_DIGITAL_1, LABPRO_CHAN_DIGITAL_2
+    };
+    for (int i = 0; i < LABPRO_STORE_MAX_CHANNELS; ++i)
+        store->channels[i].channel_number = channel_numbers[i];
+}
+
+void LabPro_store_free(LabPro_Store* store) {
+    for (int i = 0; i < LABPRO_STORE_MAX_CHANNELS; ++i) {
+        LabPro_Store_Channel* column_set = &store->channels[i];
+        for (int column = 0; column < LABPRO_STORE_NUM_COLUMNS; ++column) {
+            if (column_set->chunks[column] == NULL)
+                continue;
+            for (size_t chunk = 0; chunk < column_set->chunk_table_size; ++chunk)
+                free(column_set->chunks[column][chunk]);
+            free(column_set->chunks[column]);
+        }
+    }
+    LabPro_store_init(store);
+}
+
+void LabPro_store_clear(LabPro_Store* store) {
+    for (int i = 0; i < LABPRO_STORE_MAX_CHANNELS; ++i) {
+        LabPro_Store_Channel* column_set = &store->channels[i];
+        column_set->count = 0;
+        
+        // Derived chunks go, so that points nobody writes read as zero again.
+        for (int column = LABPRO_STORE_DERIVED_1; column < LABPRO_STORE_NUM_COLUMNS; ++column) {
+            for (size_t chunk = 0; chunk < column_set->chunk_table_size; ++chunk) {
+                free(column_set->chunks[column][chunk]);
+                column_set->chunks[column][chunk] = NULL;
+            }
+        }
+    }
+}
+
+int LabPro_store_append(LabPro_Store* store, enum LabPro_Channels channel, const double* times, const double* values, size_t count) {
+    int index = LabPro_store_channel_index(channel);
+    if (index < 0)
+        return LABPRO_ERR_BAD_CHANNEL;
+    
+    LabPro_Store_Channel* column_set = &store->channels[index];
+    int retval = LabPro_store_reserve(column_set, column_set->count + count);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    LabPro_store_put(column_set, LABPRO_STORE_TIME, column_set->count, times, 1, count);
+    LabPro_store_put(column_set, LABPRO_STORE_VALUE, column_set->count, values, 1, count);
+    column_set->count += count;
+    return LABPRO_OK;
+}
+
+int LabPro_store_append_interleaved(LabPro_Store* store, const enum LabPro_Channels* channels, int num_channels, const double* times, const double* values, size_t count) {
+    // Reserve everything first so that an error leaves every channel as it was.
+    for (int i = 0; i < num_channels; ++i) {
+        int index = LabPro_store_channel_index(channels[i]);
+        if (index < 0)
+            return LABPRO_ERR_BAD_CHANNEL;
+        
+        LabPro_Store_Channel* column_set = &store->channels[index];
+        int retval = LabPro_store_reserve(column_set, column_set->count + count);
+        if (retval != LABPRO_OK)
+            return retval;
+    }
+    
+    for (int i = 0; i < num_channels; ++i) {
+        LabPro_Store_Channel* column_set = &store->channels[LabPro_store_channel_index(channels[i])];
+        LabPro_store_put(column_set, LABPRO_STORE_TIME, column_set->count, times, 1, count);
+        LabPro_store_put(column_set, LABPRO_STORE_VALUE, column_set->count, values + i, num_channels, count);
+        column_set->count += count;
+    }
+    return LABPRO_OK;
+}
+
+int LabPro_store_set_derived(LabPro_Store* store, enum LabPro_Channels channel, enum LabPro_Store_Column column, size_t first, const double* values, size_t count) {
+    int index = LabPro_store_channel_index(channel);
+    if (index < 0 || column < LABPRO_STORE_DERIVED_1 || column >= LABPRO_STORE_NUM_COLUMNS)
+        return LABPRO_ERR_BAD_CHANNEL;
+    
+    LabPro_Store_Channel* column_set = &store->channels[index];
+    if (first > column_set->count || count > column_set->count - first)
+        return LABPRO_ERR_BAD_CHANNEL;
+    if (count == 0)
+        return LABPRO_OK;
+    
+    size_t last_chunk = (first + count - 1) / LABPRO_STORE_CHUNK_POINTS;
+    for (size_t chunk = first / LABPRO_STORE_CHUNK_POINTS; chunk <= last_chunk; ++chunk) {
+        if (column_set->chunks[column][chunk] == NULL) {
+            column_set->chunks[column][chunk] = calloc(LABPRO_STORE_CHUNK_POINTS, sizeof(double));
+            if (column_set->chunks[column][chunk] == NULL)
+                return LABPRO_ERR_NO_MEM;
+        }
+    }
+    
+    LabPro_store_put(column_set, column, first, values, 1, count);
+    return LABPRO_OK;
+}
+
+size_t LabPro_store_count(const LabPro_Store* store, enum LabPro_Channels channel) {
+    const LabPro_Store_Channel* column_set = LabPro_store_find(store, channel);
+    return column_set != NULL ? column_set->count : 0;
+}
+
+size_t LabPro_store_span(const LabPro_Store* store, enum LabPro_Channels channel, enum LabPro_Store_Column column, size_t index, const double** data) {
+    *data = NULL;
+    const LabPro_Store_Channel* column_set = LabPro_store_find(store, channel);
+    if (column_set == NULL || column < 0 || column >= LABPRO_STORE_NUM_COLUMNS || index >= column_set->count)
+        return 0;
+    
+    const double* chunk = column_set->chunks[column][index / LABPRO_STORE_CHUNK_POINTS];
+    if (chunk == NULL)
+        return 0;
+    
+    size_t offset = index % LABPRO_STORE_CHUNK_POINTS;
+    size_t run = LABPRO_STORE_CHUNK_POINTS - offset;
+    if (run > column_set->count - index)
+        run = column_set->count - index;
+    *data = chunk + offset;
+    return run;
+}
+
+size_t LabPro_store_read(const LabPro_Store* store, enum LabPro_Channels channel, enum LabPro_Store_Column column, size_t first, size_t count, double* out) {
+    const LabPro_Store_Channel* column_set = LabPro_store_find(store, channel);
+    if (column_set == NULL || column < 0 || column >= LABPRO_STORE_NUM_COLUMNS || first >= column_set->count)
+        return 0;
+    if (count > column_set->count - first)
+        count = column_set->count - first;
+    
+    size_t done = 0;
+    while (done < count) {
+        size_t index = first + done;
+        size_t offset = index % LABPRO_STORE_CHUNK_POINTS;
+        size_t run = LABPRO_STORE_CHUNK_POINTS - offset;
+        if (run > count - done)
+            run = count - done;
+        
+        const double* chunk = column_set->chunks[column][index / LABPRO_STORE_CHUNK_POINTS];
+        if (chunk != NULL)
+            memcpy(out + done, chunk + offset, run * sizeof(double));
+        else
+            memset(out + done, 0, run * sizeof(double));
+        done += run;
+    }
+    return count;
+}
+
+size_t LabPro_store_find_time(const LabPro_Store* store, enum LabPro_Channels channel, double time) {
+    const LabPro_Store_Channel* column_set = LabPro_store_find(store, channel);
+    if (column_set == NULL)
+        return 0;
+    
+    double* const* chunks = column_set->chunks[LABPRO_STORE_TIME];
+    size_t low = 0;
+    size_t high = column_set->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (chunks[middle / LABPRO_STORE_CHUNK_POINTS][middle % LABPRO_STORE_CHUNK_POINTS] < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
@@ -0,0 +1,209 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Store Sample store
+ * 
+ * Keeps collected data per channel, one column per quantity: the times, the
+ * values, and up to LABPRO_STORE_MAX_DERIVED derived quantities such as
+ * velocity and acceleration. Each column is stored as plain arrays of doubles,
+ * so a scan over one channel's values touches nothing but those values.
+ * 
+ * Columns grow in chunks of LABPRO_STORE_CHUNK_POINTS points. Appending never
+ * moves data that is already stored, so pointers returned by
+ * LabPro_store_span() stay valid until the store is cleared or freed. A
+ * derived column only takes memory once something is written to it.
+ * 
+ * To go through a range of points without copying, take spans:
+ * 
+ *     for (size_t i = first; i < last; ) {
+ *         const double* values;
+ *         size_t n = LabPro_store_span(store, channel, LABPRO_STORE_VALUE, i, &values);
+ *         if (n > last - i)
+ *             n = last - i;
+ *         // use values[0] to values[n - 1]
+ *         i += n;
+ *     }
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <stddef.h>
+
+/** \brief Points in each chunk of a column. A chunk of doubles is 32 KiB.
+ * \ingroup LabPro-Store
+ */
+#define LABPRO_STORE_CHUNK_POINTS 4096
+
+/** \brief Derived columns each channel can have.
+ * \ingroup LabPro-Store
+ */
+#define LABPRO_STORE_MAX_DERIVED 2
+
+/** \brief Channels a store can hold: four analog, two sonic and two digital.
+ * \ingroup LabPro-Store
+ */
+#define LABPRO_STORE_MAX_CHANNELS 8
+
+/** \brief Columns of a channel
+ * \ingroup LabPro-Store
+ */
+enum LabPro_Store_Column {
+    /** \brief Seconds since the collection started. */
+    LABPRO_STORE_TIME,
+    /** \brief The measured values. */
+    LABPRO_STORE_VALUE,
+    /** \brief First derived quantity, e.g. velocity. */
+    LABPRO_STORE_DERIVED_1,
+    /** \brief Second derived quantity, e.g. acceleration. */
+    LABPRO_STORE_DERIVED_2,
+    
+    LABPRO_STORE_NUM_COLUMNS
+};
+
+/** \brief The points of one channel
+ * \ingroup LabPro-Store
+ */
+typedef struct {
+    enum LabPro_Channels channel_number;
+    
+    /** \brief Number of points stored. */
+    size_t count;
+    
+    /** \brief Chunks of each column; chunks[column][i] holds points
+     * i * LABPRO_STORE_CHUNK_POINTS onwards. Derived chunks may be NULL.
+     */
+    double** chunks[LABPRO_STORE_NUM_COLUMNS];
+    
+    /** \brief Number of chunks allocated for the time and value columns. */
+    size_t num_chunks;
+    
+    /** \brief Room in the chunk tables. */
+    size_t chunk_table_size;
+} LabPro_Store_Channel;
+
+/** \brief Collected data of every channel
+ * \ingroup LabPro-Store
+ */
+typedef struct {
+    LabPro_Store_Channel channels[LABPRO_STORE_MAX_CHANNELS];
+} LabPro_Store;
+
+/** \brief Set up an empty store.
+ * \ingroup LabPro-Store
+ */
+void LabPro_store_init(LabPro_Store* store);
+
+/** \brief Free everything in a store.
+ * \ingroup LabPro-Store
+ */
+void LabPro_store_free(LabPro_Store* store);
+
+/** \brief Forget all points but keep the memory for the next collection.
+ * \ingroup LabPro-Store
+ */
+void LabPro_store_clear(LabPro_Store* store);
+
+/** \brief Append points to a channel.
+ * 
+ * \param store The store
+ * \param channel LABPRO_CHAN_ANALOG_1 to LABPRO_CHAN_DIGITAL_2
+ * \param times count times
+ * \param values count values
+ * \param count Number of points
+ * \return LABPRO_OK, LABPRO_ERR_NO_MEM, or LABPRO_ERR_BAD_CHANNEL if the
+ *         channel can't be stored. Nothing is appended on error.
+ * 
+ * \ingroup LabPro-Store
+ */
+int LabPro_store_append(LabPro_Store* store, enum LabPro_Channels channel, const double* times, const double* values, size_t count);
+
+/** \brief Append points that are interleaved by channel, as a realtime
+ * collection or a binary record buffer delivers them.
+ * 
+ * \param store The store
+ * \param channels The channel of each column of values
+ * \param num_channels Number of channels
+ * \param times count times, shared by all channels
+ * \param values count rows of num_channels values
+ * \param count Number of rows
+ * \return Same as LabPro_store_append(). Nothing is appended on error.
+ * 
+ * \ingroup LabPro-Store
+ */
+int LabPro_store_append_interleaved(LabPro_Store* store, const enum LabPro_Channels* channels, int num_channels, const double* times, const double* values, size_t count);
+
+/** \brief Write part of a derived column.
+ * 
+ * Points that haven't been written read as zero.
+ * 
+ * \param store The store
+ * \param channel The channel
+ * \param column LABPRO_STORE_DERIVED_1 or LABPRO_STORE_DERIVED_2
+ * \param first Index of the first point to write
+ * \param values The derived values
+ * \param count Number of values. first + count may not go past the channel's
+ *        number of points.
+ * \return LABPRO_OK, LABPRO_ERR_NO_MEM, or LABPRO_ERR_BAD_CHANNEL if the
+ *         channel has no such points or the column isn't a derived one.
+ * 
+ * \ingroup LabPro-Store
+ */
+int LabPro_store_set_derived(LabPro_Store* store, enum LabPro_Channels channel, enum LabPro_Store_Column column, size_t first, const double* values, size_t count);
+
+/** \brief Number of points stored for a channel.
+ * \ingroup LabPro-Store
+ */
+size_t LabPro_store_count(const LabPro_Store* store, enum LabPro_Channels channel);
+
+/** \brief Get the longest contiguous run of a column starting at a point.
+ * 
+ * \param store The store
+ * \param channel The channel
+ * \param column The column
+ * \param index First point of the run
+ * \param data Set to the run, or NULL if there is none
+ * \return Number of points in the run, which ends at the end of a chunk or
+ *         at the last point. Zero if the channel has no such point, or if the
+ *         column is a derived one that was never written there; use
+ *         LabPro_store_read() to get zeros for those instead.
+ * 
+ * \ingroup LabPro-Store
+ */
+size_t LabPro_store_span(const LabPro_Store* store, enum LabPro_Channels channel, enum LabPro_Store_Column column, size_t index, const double** data);
+
+/** \brief Copy a range of a column.
+ * \return Number of points copied, which is less than count if the channel has fewer points.
+ * \ingroup LabPro-Store
+ */
+size_t LabPro_store_read(const LabPro_Store* store, enum LabPro_Channels channel, enum LabPro_Store_Column column, size_t first, size_t count, double* out);
+
+/** \brief Find the first point taken at or after a time.
+ * 
+ * Times are assumed to increase, as they do within one collection.
+ * 
+ * \return The point's index, or the number of points if all are earlier.
+ * 
+ * \ingroup LabPro-Store
+ */
+size_t LabPro_store_find_time(const LabPro_Store* store, enum LabPro_Channels channel, double time);
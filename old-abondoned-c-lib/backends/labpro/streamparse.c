@@ -0,0 +1,240 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/streamparse.h"
+#include "backends/labpro/labpro-internal.h"
+#include <string.h>
+
+void LabPro_stream_parser_init(LabPro_Stream_Parser* parser, LabPro_Values_Callback on_values, LabPro_List_End_Callback on_list_end, void* user_data) {
+    parser->on_values = on_values;
+    parser->on_list_end = on_list_end;
+    parser->user_data = user_data;
+    parser->num_lists = 0;
+    parser->last_status = LABPRO_OK;
+    LabPro_stream_parser_reset(parser);
+}
+
+void LabPro_stream_parser_reset(LabPro_Stream_Parser* parser) {
+    parser->state = LABPRO_STREAM_BEFORE_LIST;
+    parser->token_length = 0;
+    parser->num_values = 0;
+    parser->status = LABPRO_OK;
+    parser->batch_length = 0;
+}
+
+static void LabPro_stream_flush(LabPro_Stream_Parser* parser) {
+    if (parser->batch_length == 0)
+        return;
+    
+    if (parser->on_values != NULL)
+        parser->on_values(parser->user_data, parser->num_values - parser->batch_length, parser->batch, parser->batch_length);
+    parser->batch_length = 0;
+}
+
+static void LabPro_stream_emit(LabPro_Stream_Parser* parser, double value) {
+    if (parser->batch_length == LABPRO_STREAM_BATCH)
+        LabPro_stream_flush(parser);
+    
+    parser->batch[parser->batch_length++] = value;
+    ++parser->num_values;
+}
+
+static void LabPro_stream_fail(LabPro_Stream_Parser* parser) {
+    parser->status = LABPRO_ERR_BAD_LIST;
+    parser->state = LABPRO_STREAM_AFTER_LIST;
+    parser->token_length = 0;
+}
+
+/* Decode one complete element, which runs up to but not including its
+ * delimiter. Spaces around the number are fine.
+ */
+static void LabPro_stream_element(LabPro_Stream_Parser* parser, const char* element, const char* end) {
+    double value;
+    const char* p = LabPro_parse_number(element, end, &value);
+    if (p == NULL) {
+        LabPro_stream_fail(parser);
+        return;
+    }
+    while (p < end && *p == ' ')
+        ++p;
+    if (p != end) {
+        LabPro_stream_fail(parser);
+        return;
+    }
+    LabPro_stream_emit(parser, value);
+}
+
+/* Decode the element from element to delimiter and act on the delimiter.
+ * Returns false if the list has ended, either at a '}' or on an error.
+ */
+static bool LabPro_stream_finish_element(LabPro_Stream_Parser* parser, const char* element, const char* delimiter, char delimiter_char) {
+    // "{}" is an empty list rather than one bad element.
+    bool empty = (delimiter_char == '}' && parser->num_values == 0);
+    for (const char* q = element; empty && q < delimiter; ++q)
+        empty = (*q == ' ');
+    
+    if (!empty) {
+        LabPro_stream_element(parser, element, delimiter);
+        if (parser->state != LABPRO_STREAM_IN_LIST)
+            return false;
+    }
+    if (delimiter_char == '}') {
+        parser->state = LABPRO_STREAM_AFTER_LIST;
+        return false;
+    }
+    return true;
+}
+
+/* Handle the part of a fragment that is inside a list. Returns how many
+ * bytes were used; the list has ended if parser->state has changed.
+ */
+static size_t LabPro_stream_in_list(LabPro_Stream_Parser* parser, const char* data, size_t length) {
+    const char* p = data;
+    const char* end = data + length;
+    
+    // Finish the element left over from the last fragment first.
+    if (parser->token_length > 0) {
+        const char* delimiter = p;
+        while (delimiter < end && *delimiter != ',' && *delimiter != '}' && *delimiter != '\r')
+            ++delimiter;
+        
+        size_t piece = delimiter - p;
+        if (parser->token_length + piece > LABPRO_STREAM_MAX_TOKEN) {
+            LabPro_stream_fail(parser);
+            return 0;
+        }
+        memcpy(parser->token + parser->token_length, p, piece);
+        parser->token_length += (int)piece;
+        if (delimiter == end)
+            return length;
+        if (*delimiter == '\r') {
+            // The response ended in the middle of the list. Leave the CR to end it.
+            LabPro_stream_fail(parser);
+            return delimiter - data;
+        }
+        
+        int token_length = parser->token_length;
+        parser->token_length = 0;
+        if (!LabPro_stream_finish_element(parser, parser->token, parser->token + token_length, *delimiter))
+            return delimiter + 1 - data;
+        p = delimiter + 1;
+    }
+    
+    LabPro_Fixed_Decoder decoder = LabPro_fixed_decoder();
+    while (p < end) {
+        // Runs of fixed-format numbers go straight into the batch.
+        if (decoder != NULL) {
+            if (parser->batch_length == LABPRO_STREAM_BATCH)
+                LabPro_stream_flush(parser);
+            
+            const char* next;
+            size_t decoded = decoder(p, end, parser->batch + parser->batch_length, LABPRO_STREAM_BATCH - parser->batch_length, &next);
+            if (decoded > 0) {
+                parser->batch_length += (int)decoded;
+                parser->num_values += (int)decoded;
+                p = next;
+                if (p[-1] == '}') {
+                    parser->state = LABPRO_STREAM_AFTER_LIST;
+                    return p - data;
+                }
+                continue;
+            }
+        }
+        
+        const char* delimiter = p;
+        while (delimiter < end && *delimiter != ',' && *delimiter != '}' && *delimiter != '\r')
+            ++delimiter;
+        
+        if (delimiter == end) {
+            // Cut off by the end of the fragment; keep it for next time.
+            if (end - p > LABPRO_STREAM_MAX_TOKEN) {
+                LabPro_stream_fail(parser);
+                return length;
+            }
+            memcpy(parser->token, p, end - p);
+            parser->token_length = (int)(end - p);
+            return length;
+        }
+        if (*delimiter == '\r') {
+            LabPro_stream_fail(parser);
+            return delimiter - data;
+        }
+        
+        if (!LabPro_stream_finish_element(parser, p, delimiter, *delimiter))
+            return delimiter + 1 - data;
+        p = delimiter + 1;
+    }
+    return length;
+}
+
+size_t LabPro_stream_parser_feed(LabPro_Stream_Parser* parser, const char* data, size_t length, bool* list_ended) {
+    *list_ended = false;
+    size_t used = 0;
+    
+    while (used < length) {
+        switch (parser->state) {
+            case LABPRO_STREAM_BEFORE_LIST: {
+                // Skip padding and whitespace up to the '{'.
+                const char* open = memchr(data + used, '{', length - used);
+                const char* cr = memchr(data + used, '\r', length - used);
+                if (cr != NULL && (open == NULL || cr < open)) {
+                    // A response that isn't a list at all.
+                    parser->status = LABPRO_ERR_BAD_LIST;
+                    used = cr - data;
+                    parser->state = LABPRO_STREAM_AFTER_LIST;
+                    break;
+                }
+                if (open == NULL)
+                    return length;
+                used = open + 1 - data;
+                parser->state = LABPRO_STREAM_IN_LIST;
+                break;
+            }
+            
+            case LABPRO_STREAM_IN_LIST:
+                used += LabPro_stream_in_list(parser, data + used, length - used);
+                break;
+            
+            case LABPRO_STREAM_AFTER_LIST: {
+                const char* cr = memchr(data + used, '\r', length - used);
+                if (cr == NULL) {
+                    LabPro_stream_flush(parser);
+                    return length;
+                }
+                
+                LabPro_stream_flush(parser);
+                ++parser->num_lists;
+                parser->last_status = parser->status;
+                if (parser->on_list_end != NULL)
+                    parser->on_list_end(parser->user_data, parser->num_values, parser->status);
+                LabPro_stream_parser_reset(parser);
+                *list_ended = true;
+                return cr + 1 - data;
+            }
+        }
+    }
+    
+    // Hand over what this fragment produced instead of waiting for the batch to fill up.
+    LabPro_stream_flush(parser);
+    return length;
+}
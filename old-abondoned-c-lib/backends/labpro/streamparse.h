@@ -0,0 +1,150 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-StreamParse Streaming list decoder
+ * 
+ * A push parser for numeric lists that decodes them while they are still
+ * arriving. Feed it fragments of any size, such as single 64-byte packets,
+ * and it hands decoded numbers to a callback in small batches as soon as each
+ * fragment has been processed. A number split across two fragments is carried
+ * over in a small buffer, so the memory used never depends on how long the
+ * list is.
+ * 
+ * Lists are expected in the form the LabPro sends them, "{a,b,c}" followed by
+ * a CR. Each list ends with a call to the list-end callback, after which the
+ * parser waits for the next '{'.
+ */
+
+#pragma once
+#include "backends/labpro/listparse.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Longest element the parser can carry across fragments.
+ * Anything longer is not a number the LabPro would send.
+ * \ingroup LabPro-StreamParse
+ */
+#define LABPRO_STREAM_MAX_TOKEN 32
+
+/** \brief How many decoded numbers are collected before the values callback is called.
+ * \ingroup LabPro-StreamParse
+ */
+#define LABPRO_STREAM_BATCH 64
+
+/** \brief Receives decoded numbers.
+ * 
+ * \param user_data As passed to LabPro_stream_parser_init()
+ * \param first_index Position in the list of values[0]
+ * \param values The numbers
+ * \param count How many numbers there are
+ * 
+ * \ingroup LabPro-StreamParse
+ */
+typedef void (*LabPro_Values_Callback)(void* user_data, int first_index, const double* values, int count);
+
+/** \brief Called when a list ends, after its last values have been delivered.
+ * 
+ * \param user_data As passed to LabPro_stream_parser_init()
+ * \param num_values Number of values in the list
+ * \param status LABPRO_OK, or LABPRO_ERR_BAD_LIST if the list was malformed.
+ *        Values before the error have still been delivered.
+ * 
+ * \ingroup LabPro-StreamParse
+ */
+typedef void (*LabPro_List_End_Callback)(void* user_data, int num_values, int status);
+
+/** \brief Where the parser is in the input
+ * \ingroup LabPro-StreamParse
+ */
+enum LabPro_Stream_State {
+    /** \brief Waiting for a '{'. */
+    LABPRO_STREAM_BEFORE_LIST,
+    
+    /** \brief Between the '{' and the '}'. */
+    LABPRO_STREAM_IN_LIST,
+    
+    /** \brief After the '}' or an error, waiting for the CR that ends the response. */
+    LABPRO_STREAM_AFTER_LIST
+};
+
+/** \brief State of a streaming list decoder
+ * \ingroup LabPro-StreamParse
+ */
+typedef struct {
+    enum LabPro_Stream_State state;
+    
+    /** \brief Start of an element that was cut off at the end of the last fragment. */
+    char token[LABPRO_STREAM_MAX_TOKEN];
+    int token_length;
+    
+    /** \brief Numbers in the current list so far, including those still in batch. */
+    int num_values;
+    
+    /** \brief LABPRO_OK, or LABPRO_ERR_BAD_LIST once the current list has gone wrong. */
+    int status;
+    
+    double batch[LABPRO_STREAM_BATCH];
+    int batch_length;
+    
+    LabPro_Values_Callback on_values;
+    LabPro_List_End_Callback on_list_end;
+    void* user_data;
+    
+    /** \brief Total number of lists that have ended. */
+    unsigned long long num_lists;
+    
+    /** \brief Status of the list that ended most recently. */
+    int last_status;
+} LabPro_Stream_Parser;
+
+/** \brief Set up a parser.
+ * 
+ * \param parser Parser to set up
+ * \param on_values Receives decoded numbers; may be NULL.
+ * \param on_list_end Called at the end of each list; may be NULL.
+ * \param user_data Passed to the callbacks
+ * 
+ * \ingroup LabPro-StreamParse
+ */
+void LabPro_stream_parser_init(LabPro_Stream_Parser* parser, LabPro_Values_Callback on_values, LabPro_List_End_Callback on_list_end, void* user_data);
+
+/** \brief Throw away any partial list and wait for a new '{'.
+ * \ingroup LabPro-StreamParse
+ */
+void LabPro_stream_parser_reset(LabPro_Stream_Parser* parser);
+
+/** \brief Decode the next fragment of input.
+ * 
+ * Stops right after the CR that ends a list, so the caller can tell where one
+ * response ends and leave the rest for later.
+ * 
+ * \param parser The parser
+ * \param data Next bytes of input
+ * \param length Number of bytes
+ * \param list_ended Set to true if a list ended in this fragment
+ * \return Number of bytes used, which is less than length only if a list ended.
+ * 
+ * \ingroup LabPro-StreamParse
+ */
+size_t LabPro_stream_parser_feed(LabPro_Stream_Parser* parser, const char* data, size_t length, bool* list_ended);
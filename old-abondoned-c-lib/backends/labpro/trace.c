@@ -0,0 +1,325 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/trace.h"
+#include "backends/labpro/labpro-internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NDEBUG
+#define DEBUG
+#endif
+
+static const unsigned char LabPro_trace_magic[4] = {'L', 'P', 'T', 'R'};
+
+int LabPro_trace_writer_open(LabPro_Trace_Writer* writer, const char* path) {
+    memset(writer, 0, sizeof(LabPro_Trace_Writer));
+    
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        printf("[liblabpro ERR] Unable to create trace file %s.\n", path);
+        return LABPRO_ERR_TRACE_IO;
+    }
+    
+    unsigned char header[LABPRO_TRACE_HEADER_SIZE] = {0};
+    memcpy(header, LabPro_trace_magic, 4);
+    header[4] = LABPRO_TRACE_VERSION;
+    if (fwrite(header, 1, LABPRO_TRACE_HEADER_SIZE, writer->file) != LABPRO_TRACE_HEADER_SIZE) {
+        fclose(writer->file);
+        writer->file = NULL;
+        return LABPRO_ERR_TRACE_IO;
+    }
+    
+    writer->last_usec = LabPro_time_usec();
+    return LABPRO_OK;
+}
+
+void LabPro_trace_writer_record(LabPro_Trace_Writer* writer, unsigned char endpoint, const unsigned char* data, int length) {
+    if (writer->file == NULL || writer->failed || length < 0 || length > LABPRO_PACKET_SIZE)
+        return;
+    
+    // A packet stamped on another thread just before the previous one was
+    // recorded would otherwise make the delta wrap around.
+    unsigned long long now = LabPro_time_usec();
+    unsigned long long delta = 0;
+    if (now > writer->last_usec) {
+        delta = now - writer->last_usec;
+        writer->last_usec = now;
+    }
+    if (delta > 0xFFFFFFFFULL)
+        delta = 0xFFFFFFFFULL;
+    
+    unsigned char record[LABPRO_TRACE_RECORD_HEADER_SIZE + LABPRO_PACKET_SIZE];
+    record[0] = delta & 0xFF;
+    record[1] = (delta >> 8) & 0xFF;
+    record[2] = (delta >> 16) & 0xFF;
+    record[3] = (delta >> 24) & 0xFF;
+    record[4] = endpoint;
+    record[5] = (unsigned char)length;
+    if (length > 0)
+        memcpy(record + LABPRO_TRACE_RECORD_HEADER_SIZE, data, length);
+    
+    size_t size = LABPRO_TRACE_RECORD_HEADER_SIZE + length;
+    if (fwrite(record, 1, size, writer->file) != size) {
+        printf("[liblabpro ERR] Unable to write to trace file; recording stopped.\n");
+        writer->failed = true;
+        return;
+    }
+    ++writer->num_records;
+    writer->num_bytes += length;
+}
+
+int LabPro_trace_writer_close(LabPro_Trace_Writer* writer) {
+    if (writer->file == NULL)
+        return LABPRO_OK;
+    
+    if (fclose(writer->file) != 0)
+        writer->failed = true;
+    writer->file = NULL;
+
+#ifdef DEBUG
+    printf("[liblabpro DBG] Trace closed after %llu packets (%llu bytes).\n", writer->num_records, writer->num_bytes);
+#endif
+    return writer->failed ? LABPRO_ERR_TRACE_IO : LABPRO_OK;
+}
+
+/* Read the whole file into memory. Traces are small next to what the
+ * receive ring holds, and this keeps replay free of file I/O.
+ */
+static int LabPro_trace_load_file(const char* path, unsigned char** data, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("[liblabpro ERR] Unable to open trace file %s.\n", path);
+        return LABPRO_ERR_TRACE_IO;
+    }
+    
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return LABPRO_ERR_TRACE_IO;
+    }
+    long file_size = ftell(file);
+    if (file_size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return LABPRO_ERR_TRACE_IO;
+    }
+    
+    *data = malloc(file_size > 0 ? file_size : 1);
+    if (*data == NULL) {
+        fclose(file);
+        return LABPRO_ERR_NO_MEM;
+    }
+    if (fread(*data, 1, file_size, file) != (size_t)file_size) {
+        free(*data);
+        fclose(file);
+        return LABPRO_ERR_TRACE_IO;
+    }
+    fclose(file);
+    
+    *size = (size_t)file_size;
+    return LABPRO_OK;
+}
+
+int LabPro_trace_replay_create(
+    const LabPro_Replay_Config* config,
+    LabPro_Packet_Callback on_packet,
+    void* on_packet_data,
+    LabPro_Trace_Replay** replay
+) {
+    *replay = NULL;
+    
+    unsigned char* data;
+    size_t size;
+    int status = LabPro_trace_load_file(config->path, &data, &size);
+    if (status != LABPRO_OK)
+        return status;
+    
+    if (size < LABPRO_TRACE_HEADER_SIZE || memcmp(data, LabPro_trace_magic, 4) != 0 || data[4] != LABPRO_TRACE_VERSION) {
+        printf("[liblabpro ERR] %s is not a version %d LabPro trace.\n", config->path, LABPRO_TRACE_VERSION);
+        free(data);
+        return LABPRO_ERR_BAD_TRACE;
+    }
+    
+    // First pass: validate and count the records.
+    size_t num_records = 0;
+    size_t offset = LABPRO_TRACE_HEADER_SIZE;
+    while (offset < size) {
+        if (size - offset < LABPRO_TRACE_RECORD_HEADER_SIZE || data[offset + 5] > LABPRO_PACKET_SIZE
+            || size - offset - LABPRO_TRACE_RECORD_HEADER_SIZE < data[offset + 5]) {
+            printf("[liblabpro ERR] Trace %s is truncated or corrupt at byte %zu.\n", config->path, offset);
+            free(data);
+            return LABPRO_ERR_BAD_TRACE;
+        }
+        offset += LABPRO_TRACE_RECORD_HEADER_SIZE + data[offset + 5];
+        ++num_records;
+    }
+    
+    LabPro_Trace_Replay* new_replay = calloc(1, sizeof(LabPro_Trace_Replay));
+    if (new_replay == NULL) {
+        free(data);
+        return LABPRO_ERR_NO_MEM;
+    }
+    new_replay->records = malloc((num_records > 0 ? num_records : 1) * sizeof(LabPro_Trace_Record));
+    if (new_replay->records == NULL) {
+        free(new_replay);
+        free(data);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    // Second pass: turn the deltas into offsets from the start of the trace.
+    unsigned long long time_usec = 0;
+    offset = LABPRO_TRACE_HEADER_SIZE;
+    for (size_t i = 0; i < num_records; ++i) {
+        const unsigned char* header = data + offset;
+        time_usec += (unsigned long long)header[0]
+            | ((unsigned long long)header[1] << 8)
+            | ((unsigned long long)header[2] << 16)
+            | ((unsigned long long)header[3] << 24);
+        
+        new_replay->records[i].time_usec = time_usec;
+        new_replay->records[i].endpoint = header[4];
+        new_replay->records[i].length = header[5];
+        new_replay->records[i].data = header + LABPRO_TRACE_RECORD_HEADER_SIZE;
+        offset += LABPRO_TRACE_RECORD_HEADER_SIZE + header[5];
+    }
+    
+    new_replay->file_data = data;
+    new_replay->num_records = num_records;
+    new_replay->time_scale = config->time_scale > 0 ? config->time_scale : 0;
+    new_replay->anchor_host_usec = LabPro_time_usec();
+    new_replay->on_packet = on_packet;
+    new_replay->on_packet_data = on_packet_data;
+
+#ifdef DEBUG
+    printf("[liblabpro DBG] Loaded trace %s: %zu packets over %llu ms.\n", config->path, num_records, time_usec / 1000);
+#endif
+    *replay = new_replay;
+    return LABPRO_OK;
+}
+
+static bool LabPro_trace_is_in(const LabPro_Trace_Record* record) {
+    return (record->endpoint & LIBUSB_ENDPOINT_IN) == LIBUSB_ENDPOINT_IN;
+}
+
+static unsigned long long LabPro_trace_due_usec(LabPro_Trace_Replay* replay, const LabPro_Trace_Record* record) {
+    return replay->anchor_host_usec + (unsigned long long)((record->time_usec - replay->anchor_trace_usec) * replay->time_scale);
+}
+
+// Deliver the IN records at the front of the trace that are due. Returns how many were delivered.
+static int LabPro_trace_deliver_due(LabPro_Trace_Replay* replay, unsigned long long now) {
+    int delivered = 0;
+    while (replay->next < replay->num_records) {
+        const LabPro_Trace_Record* record = &replay->records[replay->next];
+        if (!LabPro_trace_is_in(record) || LabPro_trace_due_usec(replay, record) > now)
+            break;
+        
+        ++replay->next;
+        if (replay->on_packet != NULL)
+            replay->on_packet(replay->on_packet_data, record->data, record->length);
+        ++delivered;
+    }
+    return delivered;
+}
+
+static int LabPro_trace_replay_write(void* transport_data, const unsigned char* data, int length, unsigned int timeout, int* transferred) {
+    LabPro_Trace_Replay* replay = (LabPro_Trace_Replay*)transport_data;
+    (void)timeout;
+    *transferred = 0;
+    
+    /* Anything the LabPro sent before this command was recorded has already
+     * arrived as far as the host is concerned.
+     */
+    while (replay->next < replay->num_records && LabPro_trace_is_in(&replay->records[replay->next])) {
+        const LabPro_Trace_Record* record = &replay->records[replay->next++];
+        if (replay->on_packet != NULL)
+            replay->on_packet(replay->on_packet_data, record->data, record->length);
+    }
+    if (replay->next >= replay->num_records)
+        return LIBUSB_ERROR_NO_DEVICE;
+    
+    const LabPro_Trace_Record* record = &replay->records[replay->next++];
+    if (record->length != length || memcmp(record->data, data, length) != 0) {
+        ++replay->mismatches;
+        printf("[liblabpro WARN] Write does not match packet %zu of the trace; replaying the trace anyway.\n", replay->next - 1);
+    }
+    
+    replay->anchor_trace_usec = record->time_usec;
+    replay->anchor_host_usec = LabPro_time_usec();
+    *transferred = length;
+    return LIBUSB_SUCCESS;
+}
+
+static int LabPro_trace_replay_handle_events(void* transport_data, unsigned int timeout_ms) {
+    LabPro_Trace_Replay* replay = (LabPro_Trace_Replay*)transport_data;
+    unsigned long long now = LabPro_time_usec();
+    unsigned long long deadline = now + (unsigned long long)timeout_ms * 1000;
+    
+    while (true) {
+        if (LabPro_trace_deliver_due(replay, now) > 0 || now >= deadline)
+            return LIBUSB_SUCCESS;
+        
+        // Sleep until the next IN packet is due, or the whole timeout if the trace is waiting on a write.
+        unsigned long long wake = deadline;
+        if (replay->next < replay->num_records && LabPro_trace_is_in(&replay->records[replay->next])) {
+            unsigned long long due = LabPro_trace_due_usec(replay, &replay->records[replay->next]);
+            if (due < wake)
+                wake = due;
+        }
+        if (wake > now)
+            LabPro_sleep_usec((unsigned int)(wake - now));
+        now = LabPro_time_usec();
+    }
+}
+
+static int LabPro_trace_replay_status(void* transport_data) {
+    LabPro_Trace_Replay* replay = (LabPro_Trace_Replay*)transport_data;
+    
+    if (replay->time_scale == 0
+        && (replay->next >= replay->num_records || !LabPro_trace_is_in(&replay->records[replay->next])))
+        return LIBUSB_ERROR_TIMEOUT;
+    return LIBUSB_SUCCESS;
+}
+
+static unsigned long long LabPro_trace_replay_in_errors(void* transport_data) {
+    (void)transport_data;
+    // Failed transfers are not recorded, so a replay never has any.
+    return 0;
+}
+
+static void LabPro_trace_replay_close(void* transport_data) {
+    LabPro_Trace_Replay* replay = (LabPro_Trace_Replay*)transport_data;
+    
+    if (replay->mismatches > 0)
+        printf("[liblabpro WARN] %llu writes did not match the trace.\n", replay->mismatches);
+    free(replay->records);
+    free(replay->file_data);
+    free(replay);
+}
+
+const LabPro_Transport LabPro_replay_transport = {
+    "replay",
+    LabPro_trace_replay_write,
+    LabPro_trace_replay_handle_events,
+    LabPro_trace_replay_status,
+    LabPro_trace_replay_in_errors,
+    LabPro_trace_replay_close
+};
@@ -0,0 +1,191 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Trace USB trace recording and replay
+ * 
+ * A trace is a compact binary log of every bulk packet exchanged with a
+ * LabPro. Recording happens at the packet boundary, below the receive ring and
+ * the parsers, so replaying a trace through LabPro_read_raw() and everything
+ * built on it reproduces a session bit-for-bit on a machine without a LabPro.
+ * 
+ * File format (all integers little-endian):
+ * 
+ *     header:  "LPTR" (4 bytes), version (1 byte), 3 reserved zero bytes
+ *     record:  delta_usec (4 bytes), endpoint (1 byte), length (1 byte), payload (length bytes)
+ * 
+ * delta_usec is the time since the previous record (or the start of the trace)
+ * and saturates at 0xFFFFFFFF. endpoint is the USB endpoint address, so bit 7
+ * (LIBUSB_ENDPOINT_IN) tells IN packets from OUT packets.
+ */
+
+#pragma once
+#include "backends/labpro/async.h"
+#include "backends/labpro/transport.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/** \brief Trace format version written by this library.
+ * \ingroup LabPro-Trace
+ */
+#define LABPRO_TRACE_VERSION 1
+
+/** \brief Size of the trace file header, in bytes.
+ * \ingroup LabPro-Trace
+ */
+#define LABPRO_TRACE_HEADER_SIZE 8
+
+/** \brief Size of a record header, in bytes.
+ * \ingroup LabPro-Trace
+ */
+#define LABPRO_TRACE_RECORD_HEADER_SIZE 6
+
+/** \brief Longest trace file path LabPro_replay_add() accepts, including the NULL byte.
+ * \ingroup LabPro-Trace
+ */
+#define LABPRO_TRACE_MAX_PATH 1024
+
+/** \brief An open trace being recorded. Not thread-safe on its own; a
+ * LabPro's trace is guarded by its trace_mutex.
+ * \ingroup LabPro-Trace
+ */
+typedef struct {
+    FILE* file;
+    
+    /** \brief Time of the previous record, from LabPro_time_usec(). */
+    unsigned long long last_usec;
+    
+    unsigned long long num_records;
+    unsigned long long num_bytes;
+    
+    /** \brief Set after a write to the file fails; nothing more is recorded. */
+    bool failed;
+} LabPro_Trace_Writer;
+
+/** \brief One packet of a loaded trace
+ * \ingroup LabPro-Trace
+ */
+typedef struct {
+    /** \brief Time since the start of the trace, in microseconds. */
+    unsigned long long time_usec;
+    unsigned char endpoint;
+    unsigned char length;
+    const unsigned char* data;
+} LabPro_Trace_Record;
+
+/** \brief Which trace to replay, and how fast
+ * \ingroup LabPro-Trace
+ */
+typedef struct {
+    char path[LABPRO_TRACE_MAX_PATH];
+    
+    /** \brief 1.0 replays at the recorded pace, 0.5 twice as fast,
+     * and 0 delivers every packet as soon as it is asked for.
+     */
+    double time_scale;
+} LabPro_Replay_Config;
+
+/** \brief State of a trace being replayed
+ * \ingroup LabPro-Trace
+ */
+typedef struct {
+    /** \brief The whole trace file; records point into it. */
+    unsigned char* file_data;
+    LabPro_Trace_Record* records;
+    size_t num_records;
+    
+    /** \brief Index of the next record that has not been delivered or matched. */
+    size_t next;
+    
+    double time_scale;
+    
+    /** \brief The last OUT record matched, and when the host actually wrote it.
+     * IN packets are paced relative to this, so time the host spends between
+     * commands does not pile up as lag.
+     */
+    unsigned long long anchor_trace_usec;
+    unsigned long long anchor_host_usec;
+    
+    LabPro_Packet_Callback on_packet;
+    void* on_packet_data;
+    
+    /** \brief Writes that did not match the recorded OUT packet. */
+    unsigned long long mismatches;
+} LabPro_Trace_Replay;
+
+/** \brief Create a trace file and write its header.
+ * 
+ * \param writer Writer to initialize
+ * \param path File to create; overwritten if it exists.
+ * \return LABPRO_OK or LABPRO_ERR_TRACE_IO
+ * 
+ * \ingroup LabPro-Trace
+ */
+int LabPro_trace_writer_open(LabPro_Trace_Writer* writer, const char* path);
+
+/** \brief Append one packet to the trace.
+ * 
+ * \param writer An open writer
+ * \param endpoint Endpoint address the packet went through
+ * \param data Packet contents
+ * \param length Number of bytes (at most LABPRO_PACKET_SIZE)
+ * 
+ * \ingroup LabPro-Trace
+ */
+void LabPro_trace_writer_record(LabPro_Trace_Writer* writer, unsigned char endpoint, const unsigned char* data, int length);
+
+/** \brief Flush and close the trace file.
+ * \return LABPRO_OK, or LABPRO_ERR_TRACE_IO if any part of the trace could not be written.
+ * \ingroup LabPro-Trace
+ */
+int LabPro_trace_writer_close(LabPro_Trace_Writer* writer);
+
+/** \brief Load a trace for replay.
+ * 
+ * \param config Trace file and replay speed
+ * \param on_packet Called with every IN packet in the trace
+ * \param on_packet_data Passed to on_packet
+ * \param replay Set to the new replay, or NULL on error. Freed by the transport's close operation.
+ * \return LABPRO_OK, LABPRO_ERR_NO_MEM, LABPRO_ERR_TRACE_IO, or LABPRO_ERR_BAD_TRACE
+ * 
+ * \ingroup LabPro-Trace
+ */
+int LabPro_trace_replay_create(
+    const LabPro_Replay_Config* config,
+    LabPro_Packet_Callback on_packet,
+    void* on_packet_data,
+    LabPro_Trace_Replay** replay
+);
+
+/** \brief The replay transport. transport_data is a LabPro_Trace_Replay.
+ * 
+ * Each write is matched against the next OUT record (mismatches are counted and
+ * logged, but replay continues). The IN records up to the following OUT record
+ * are then delivered at their recorded offsets from the write. Once those run
+ * out, the recorded read must have timed out: a paced replay just waits, and a
+ * replay with time_scale 0 reports LIBUSB_ERROR_TIMEOUT from status() right
+ * away. Writing past the end of the trace returns LIBUSB_ERROR_NO_DEVICE.
+ * 
+ * \ingroup LabPro-Trace
+ */
+extern const LabPro_Transport LabPro_replay_transport;
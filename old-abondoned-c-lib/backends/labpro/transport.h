@@ -0,0 +1,66 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Transport Transport layer
+ * 
+ * Everything above this layer (LabPro_send_raw(), LabPro_read_raw(), the
+ * receive ring, pacing) only talks to the device through these operations.
+ * The real USB transport is the asynchronous libusb engine; other transports
+ * such as the simulated LabPro plug in here so the rest of the library can
+ * be exercised without hardware.
+ * 
+ * Transports deliver incoming packets through the LabPro_Packet_Callback
+ * they were created with, and only from inside handle_events.
+ */
+
+#pragma once
+#include "backends/labpro/async.h"
+
+/** \brief Operations a transport has to provide
+ * \ingroup LabPro-Transport
+ */
+typedef struct {
+    /** \brief Short name for log messages. */
+    const char* name;
+    
+    /** \brief Send up to LABPRO_PACKET_SIZE bytes. Same contract as LabPro_async_write(). */
+    int (*write)(void* transport_data, const unsigned char* data, int length, unsigned int timeout, int* transferred);
+    
+    /** \brief Make progress for up to timeout_ms milliseconds. Same contract as LabPro_async_handle_events(). */
+    int (*handle_events)(void* transport_data, unsigned int timeout_ms);
+    
+    /** \brief LIBUSB_SUCCESS while more IN data can arrive, otherwise LIBUSB_ERROR_NO_DEVICE or LIBUSB_ERROR_IO. */
+    int (*status)(void* transport_data);
+    
+    /** \brief Total number of failed IN transfers so far. */
+    unsigned long long (*in_errors)(void* transport_data);
+    
+    /** \brief Stop all transfers and release the device. */
+    void (*close)(void* transport_data);
+} LabPro_Transport;
+
+/** \brief The libusb transport. transport_data is a started LabPro_Async_Engine.
+ * \ingroup LabPro-Transport
+ */
+extern const LabPro_Transport LabPro_async_transport;
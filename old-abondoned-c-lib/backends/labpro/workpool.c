@@ -0,0 +1,340 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "backends/labpro/workpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+/* The pool and queue of the worker running on this thread, if any, so that
+ * jobs submitted by jobs go to that worker's own queue.
+ */
+static _Thread_local LabPro_Work_Pool* LabPro_work_current_pool = NULL;
+static _Thread_local int LabPro_work_current_index = -1;
+
+/* Make room for one more job. The queue's mutex must be held. */
+static int LabPro_work_queue_reserve(LabPro_Work_Queue* queue) {
+    if (queue->count < queue->capacity)
+        return LABPRO_OK;
+    
+    size_t capacity = queue->capacity > 0 ? queue->capacity * 2 : 16;
+    LabPro_Work_Job* jobs = malloc(capacity * sizeof(LabPro_Work_Job));
+    if (jobs == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    // Straighten the ring out while copying.
+    for (size_t i = 0; i < queue->count; ++i)
+        jobs[i] = queue->jobs[(queue->first + i) % queue->capacity];
+    free(queue->jobs);
+    queue->jobs = jobs;
+    queue->first = 0;
+    queue->capacity = capacity;
+    return LABPRO_OK;
+}
+
+/* Take the newest job, as the queue's own worker. */
+static bool LabPro_work_queue_pop(LabPro_Work_Queue* queue, LabPro_Work_Job* job) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->mutex);
+        return false;
+    }
+    --queue->count;
+    *job = queue->jobs[(queue->first + queue->count) % queue->capacity];
+    pthread_mutex_unlock(&queue->mutex);
+    return true;
+}
+
+/* Take the oldest job, as another worker. */
+static bool LabPro_work_queue_steal(LabPro_Work_Queue* queue, LabPro_Work_Job* job) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->mutex);
+        return false;
+    }
+    *job = queue->jobs[queue->first];
+    queue->first = (queue->first + 1) % queue->capacity;
+    --queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return true;
+}
+
+/* Find a job for worker index: its own newest, or else another's oldest. */
+static bool LabPro_work_take(LabPro_Work_Pool* pool, int index, LabPro_Work_Job* job) {
+    LabPro_Work_Queue* own = &pool->queues[index];
+    if (LabPro_work_queue_pop(own, job)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return true;
+    }
+    
+    for (int i = 1; i < pool->num_workers; ++i) {
+        int victim = (index + i) % pool->num_workers;
+        if (LabPro_work_queue_steal(&pool->queues[victim], job)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            atomic_fetch_add_explicit(&own->stolen, 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    if (pool->num_workers > 1)
+        atomic_fetch_add_explicit(&pool->failed_steals, 1, memory_order_relaxed);
+    return false;
+}
+
+/* Hand the job's result on, along with any later ones of its lane that are
+ * already waiting. Only one worker delivers a lane's jobs at a time; the
+ * others just leave theirs for it.
+ */
+static void LabPro_work_finish(const LabPro_Work_Job* job) {
+    LabPro_Work_Lane* lane = job->lane;
+    
+    pthread_mutex_lock(&lane->mutex);
+    size_t slot = job->sequence % lane->window;
+    lane->finished[slot] = *job;
+    lane->is_finished[slot] = true;
+    if (lane->delivering) {
+        pthread_mutex_unlock(&lane->mutex);
+        return;
+    }
+    
+    lane->delivering = true;
+    for (;;) {
+        slot = lane->next_delivery % lane->window;
+        if (!lane->is_finished[slot])
+            break;
+        LabPro_Work_Job next = lane->finished[slot];
+        lane->is_finished[slot] = false;
+        pthread_mutex_unlock(&lane->mutex);
+        
+        if (next.deliver != NULL)
+            next.deliver(next.data);
+        
+        // Only counted once delivered, so the slot isn't reused and a drain waits for the callback.
+        pthread_mutex_lock(&lane->mutex);
+        ++lane->next_delivery;
+        pthread_cond_broadcast(&lane->delivered);
+    }
+    lane->delivering = false;
+    pthread_mutex_unlock(&lane->mutex);
+}
+
+static void* LabPro_work_thread(void* data) {
+    LabPro_Work_Queue* queue = (LabPro_Work_Queue*)data;
+    LabPro_Work_Pool* pool = queue->pool;
+    int index = (int)(queue - pool->queues);
+    LabPro_work_current_pool = pool;
+    LabPro_work_current_index = index;
+    
+    for (;;) {
+        LabPro_Work_Job job;
+        if (LabPro_work_take(pool, index, &job)) {
+            job.process(job.data);
+            atomic_fetch_add_explicit(&queue->executed, 1, memory_order_relaxed);
+            LabPro_work_finish(&job);
+            continue;
+        }
+        
+        // Nothing anywhere. Counting ourselves idle before looking at queued
+        // again means a submitter either sees us idle or we see its job.
+        pthread_mutex_lock(&pool->idle_mutex);
+        atomic_fetch_add(&pool->idle, 1);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stop))
+            pthread_cond_wait(&pool->wake, &pool->idle_mutex);
+        atomic_fetch_sub(&pool->idle, 1);
+        bool finished = atomic_load(&pool->stop) && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->idle_mutex);
+        if (finished)
+            break;
+    }
+    return NULL;
+}
+
+/* Free a pool whose threads have all been joined, or never started. */
+static void LabPro_work_pool_free(LabPro_Work_Pool* pool) {
+    for (int i = 0; i < LABPRO_WORK_POOL_MAX_WORKERS; ++i) {
+        pthread_mutex_destroy(&pool->queues[i].mutex);
+        free(pool->queues[i].jobs);
+    }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->idle_mutex);
+    free(pool);
+}
+
+/* Tell the first num_started workers to finish what's queued, and wait for them. */
+static void LabPro_work_pool_join(LabPro_Work_Pool* pool, int num_started) {
+    pthread_mutex_lock(&pool->idle_mutex);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->idle_mutex);
+    
+    for (int i = 0; i < num_started; ++i)
+        pthread_join(pool->threads[i], NULL);
+}
+
+int LabPro_work_pool_start(int num_workers, LabPro_Work_Pool** pool) {
+    *pool = NULL;
+    if (num_workers <= 0) {
+        num_workers = LABPRO_WORK_POOL_DEFAULT_WORKERS;
+#ifdef __unix__
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores > 0)
+            num_workers = (int)(cores < LABPRO_WORK_POOL_MAX_WORKERS ? cores : LABPRO_WORK_POOL_MAX_WORKERS);
+#endif
+    }
+    if (num_workers > LABPRO_WORK_POOL_MAX_WORKERS)
+        num_workers = LABPRO_WORK_POOL_MAX_WORKERS;
+    
+    LabPro_Work_Pool* new_pool = calloc(1, sizeof(LabPro_Work_Pool));
+    if (new_pool == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    new_pool->num_workers = num_workers;
+    for (int i = 0; i < LABPRO_WORK_POOL_MAX_WORKERS; ++i) {
+        new_pool->queues[i].pool = new_pool;
+        pthread_mutex_init(&new_pool->queues[i].mutex, NULL);
+        atomic_init(&new_pool->queues[i].executed, 0);
+        atomic_init(&new_pool->queues[i].stolen, 0);
+        atomic_init(&new_pool->queues[i].high_water, 0);
+    }
+    atomic_init(&new_pool->queued, 0);
+    atomic_init(&new_pool->idle, 0);
+    atomic_init(&new_pool->stop, false);
+    atomic_init(&new_pool->next_home, 0);
+    atomic_init(&new_pool->failed_steals, 0);
+    pthread_mutex_init(&new_pool->idle_mutex, NULL);
+    pthread_cond_init(&new_pool->wake, NULL);
+    
+    for (int i = 0; i < num_workers; ++i) {
+        if (pthread_create(&new_pool->threads[i], NULL, LabPro_work_thread, &new_pool->queues[i]) != 0) {
+            printf("[liblabpro ERR] Unable to start work pool thread %d.\n", i);
+            LabPro_work_pool_join(new_pool, i);
+            LabPro_work_pool_free(new_pool);
+            return LABPRO_ERR_NO_MEM;
+        }
+    }
+    
+    *pool = new_pool;
+    return LABPRO_OK;
+}
+
+void LabPro_work_pool_stop(LabPro_Work_Pool* pool) {
+    LabPro_work_pool_join(pool, pool->num_workers);
+    LabPro_work_pool_free(pool);
+}
+
+void LabPro_work_pool_stats(LabPro_Work_Pool* pool, LabPro_Work_Pool_Stats* stats) {
+    memset(stats, 0, sizeof(LabPro_Work_Pool_Stats));
+    stats->workers = pool->num_workers;
+    stats->queued = atomic_load_explicit(&pool->queued, memory_order_relaxed);
+    stats->failed_steals = atomic_load_explicit(&pool->failed_steals, memory_order_relaxed);
+    
+    for (int i = 0; i < pool->num_workers; ++i) {
+        LabPro_Work_Queue* queue = &pool->queues[i];
+        size_t high_water = atomic_load_explicit(&queue->high_water, memory_order_relaxed);
+        if (high_water > stats->queue_high_water)
+            stats->queue_high_water = high_water;
+        stats->executed += atomic_load_explicit(&queue->executed, memory_order_relaxed);
+        stats->stolen += atomic_load_explicit(&queue->stolen, memory_order_relaxed);
+    }
+}
+
+int LabPro_work_lane_init(LabPro_Work_Pool* pool, LabPro_Work_Lane* lane, size_t window) {
+    lane->pool = pool;
+    lane->home = atomic_fetch_add(&pool->next_home, 1) % pool->num_workers;
+    lane->window = window > 0 ? window : LABPRO_WORK_LANE_DEFAULT_WINDOW;
+    lane->next_sequence = 0;
+    lane->next_delivery = 0;
+    lane->delivering = false;
+    
+    lane->finished = malloc(lane->window * sizeof(LabPro_Work_Job));
+    lane->is_finished = calloc(lane->window, sizeof(bool));
+    if (lane->finished == NULL || lane->is_finished == NULL) {
+        free(lane->finished);
+        free(lane->is_finished);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    pthread_mutex_init(&lane->mutex, NULL);
+    pthread_cond_init(&lane->delivered, NULL);
+    return LABPRO_OK;
+}
+
+int LabPro_work_submit(LabPro_Work_Lane* lane, LabPro_Work_Function process, LabPro_Work_Function deliver, void* data) {
+    LabPro_Work_Pool* pool = lane->pool;
+    int target = LabPro_work_current_pool == pool ? LabPro_work_current_index : lane->home;
+    LabPro_Work_Queue* queue = &pool->queues[target];
+    
+    // The sequence number is only taken once the job is sure to be queued;
+    // a number that never came back would hold up the lane for good.
+    pthread_mutex_lock(&lane->mutex);
+    if (lane->next_sequence - lane->next_delivery >= lane->window) {
+        pthread_mutex_unlock(&lane->mutex);
+        return LABPRO_ERR_BUSY;
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    if (LabPro_work_queue_reserve(queue) != LABPRO_OK) {
+        pthread_mutex_unlock(&queue->mutex);
+        pthread_mutex_unlock(&lane->mutex);
+        return LABPRO_ERR_NO_MEM;
+    }
+    
+    LabPro_Work_Job* job = &queue->jobs[(queue->first + queue->count) % queue->capacity];
+    job->process = process;
+    job->deliver = deliver;
+    job->data = data;
+    job->lane = lane;
+    job->sequence = lane->next_sequence++;
+    
+    // Counted before it can be taken, so that the count never goes below zero.
+    atomic_fetch_add(&pool->queued, 1);
+    ++queue->count;
+    if (queue->count > atomic_load_explicit(&queue->high_water, memory_order_relaxed))
+        atomic_store_explicit(&queue->high_water, queue->count, memory_order_relaxed);
+    pthread_mutex_unlock(&queue->mutex);
+    pthread_mutex_unlock(&lane->mutex);
+    
+    if (atomic_load(&pool->idle) > 0) {
+        pthread_mutex_lock(&pool->idle_mutex);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->idle_mutex);
+    }
+    return LABPRO_OK;
+}
+
+void LabPro_work_lane_drain(LabPro_Work_Lane* lane) {
+    pthread_mutex_lock(&lane->mutex);
+    while (lane->next_delivery != lane->next_sequence)
+        pthread_cond_wait(&lane->delivered, &lane->mutex);
+    pthread_mutex_unlock(&lane->mutex);
+}
+
+void LabPro_work_lane_free(LabPro_Work_Lane* lane) {
+    LabPro_work_lane_drain(lane);
+    pthread_cond_destroy(&lane->delivered);
+    pthread_mutex_destroy(&lane->mutex);
+    free(lane->finished);
+    free(lane->is_finished);
+}
@@ -0,0 +1,242 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * \defgroup LabPro-Work-Pool Work-stealing pool
+ * 
+ * Worker threads for the host-side processing of many LabPros' data:
+ * calibration, derivatives, sonic compensation and the like, done on chunks
+ * of samples as they come out of realtime streams, so that it neither runs
+ * on the thread servicing USB nor is limited to one core.
+ * 
+ * Each worker keeps a queue of its own. It takes its newest job first, which
+ * is likely still in its cache, and when it runs out it steals the oldest
+ * job from another worker's queue. Jobs submitted from outside the pool go
+ * to the queue of their lane's worker, so a device's chunks tend to stay on
+ * one core while there is enough to do, and spread out when there isn't.
+ * 
+ * Jobs are submitted to a LabPro_Work_Lane, normally one per device. The
+ * jobs of a lane are processed in any order and at the same time, on any
+ * worker, but are delivered strictly in the order they were submitted, one
+ * at a time: a job's process function does the work, and its deliver
+ * function hands the result on, e.g. appends it to the device's output.
+ * 
+ * LabPro_work_pool_stats() reports how deep the queues are and how much
+ * stealing is going on.
+ */
+
+#pragma once
+#include "backends/labpro/labpro-internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** \brief Most workers a pool can have.
+ * \ingroup LabPro-Work-Pool
+ */
+#define LABPRO_WORK_POOL_MAX_WORKERS 64
+
+/** \brief Workers a pool gets when the number of cores can't be found out.
+ * \ingroup LabPro-Work-Pool
+ */
+#define LABPRO_WORK_POOL_DEFAULT_WORKERS 4
+
+/** \brief Jobs a lane can have submitted but not delivered unless LabPro_work_lane_init() is told otherwise.
+ * \ingroup LabPro-Work-Pool
+ */
+#define LABPRO_WORK_LANE_DEFAULT_WINDOW 64
+
+/** \brief Does a job's work or delivers its result. Gets the job's data.
+ * \ingroup LabPro-Work-Pool
+ */
+typedef void (*LabPro_Work_Function)(void* data);
+
+struct LabPro_Work_Lane;
+struct LabPro_Work_Pool;
+
+/** \brief A submitted job
+ * \ingroup LabPro-Work-Pool
+ */
+typedef struct {
+    LabPro_Work_Function process;
+    
+    /** \brief Called after process, in submission order within the lane; may be NULL. */
+    LabPro_Work_Function deliver;
+    void* data;
+    struct LabPro_Work_Lane* lane;
+    unsigned long long sequence;
+} LabPro_Work_Job;
+
+/** \brief One worker's queue of jobs. The worker works at the back, thieves take from the front.
+ * \ingroup LabPro-Work-Pool
+ */
+typedef struct {
+    struct LabPro_Work_Pool* pool;
+    pthread_mutex_t mutex;
+    LabPro_Work_Job* jobs;
+    size_t first;
+    size_t count;
+    size_t capacity;
+    
+    /** \brief Jobs this worker has run. */
+    _Atomic unsigned long long executed;
+    
+    /** \brief Of those, jobs taken from another worker's queue. */
+    _Atomic unsigned long long stolen;
+    
+    /** \brief Most jobs that have been waiting in this queue at once. */
+    _Atomic size_t high_water;
+} LabPro_Work_Queue;
+
+/** \brief Counters kept by a pool
+ * \ingroup LabPro-Work-Pool
+ */
+typedef struct {
+    int workers;
+    
+    /** \brief Jobs waiting in all the queues right now. */
+    size_t queued;
+    
+    /** \brief Most jobs that have waited in any one queue at once. */
+    size_t queue_high_water;
+    
+    /** \brief Jobs run so far. */
+    unsigned long long executed;
+    
+    /** \brief Jobs run by a worker other than the one whose queue they were in. */
+    unsigned long long stolen;
+    
+    /** \brief Times a worker with nothing to do went through the others' queues and found nothing either. */
+    unsigned long long failed_steals;
+} LabPro_Work_Pool_Stats;
+
+/** \brief The pool and its threads
+ * \ingroup LabPro-Work-Pool
+ */
+typedef struct LabPro_Work_Pool {
+    int num_workers;
+    pthread_t threads[LABPRO_WORK_POOL_MAX_WORKERS];
+    LabPro_Work_Queue queues[LABPRO_WORK_POOL_MAX_WORKERS];
+    
+    /** \brief Jobs waiting in all the queues. */
+    _Atomic size_t queued;
+    
+    /** \brief Workers asleep, or about to be, for lack of jobs. */
+    _Atomic int idle;
+    
+    /** \brief Set by LabPro_work_pool_stop() to tell the workers to finish. */
+    atomic_bool stop;
+    
+    /** \brief Lets idle workers sleep until a job is submitted. */
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t wake;
+    
+    /** \brief Lanes get their home worker in turn. */
+    _Atomic int next_home;
+    
+    _Atomic unsigned long long failed_steals;
+} LabPro_Work_Pool;
+
+/** \brief Jobs whose results are delivered in order, normally one device's
+ * \ingroup LabPro-Work-Pool
+ */
+typedef struct LabPro_Work_Lane {
+    LabPro_Work_Pool* pool;
+    
+    /** \brief The worker whose queue the lane's jobs go to. */
+    int home;
+    
+    /** \brief Guards everything below. */
+    pthread_mutex_t mutex;
+    
+    /** \brief Signalled whenever jobs have been delivered. */
+    pthread_cond_t delivered;
+    
+    /** \brief Processed jobs waiting for their turn to be delivered, by sequence modulo window. */
+    LabPro_Work_Job* finished;
+    bool* is_finished;
+    size_t window;
+    
+    unsigned long long next_sequence;
+    unsigned long long next_delivery;
+    
+    /** \brief Whether some worker is delivering this lane's jobs right now. */
+    bool delivering;
+} LabPro_Work_Lane;
+
+/** \brief Start a pool.
+ * 
+ * \param num_workers Threads to run, or 0 for one per core. At most LABPRO_WORK_POOL_MAX_WORKERS.
+ * \param pool Receives the pool
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-Work-Pool
+ */
+int LabPro_work_pool_start(int num_workers, LabPro_Work_Pool** pool);
+
+/** \brief Run every job still queued, then stop the threads and free the pool.
+ * \ingroup LabPro-Work-Pool
+ */
+void LabPro_work_pool_stop(LabPro_Work_Pool* pool);
+
+/** \brief Get the pool's counters. Any thread.
+ * \ingroup LabPro-Work-Pool
+ */
+void LabPro_work_pool_stats(LabPro_Work_Pool* pool, LabPro_Work_Pool_Stats* stats);
+
+/** \brief Set up a lane.
+ * 
+ * \param pool The pool to run the lane's jobs on
+ * \param lane The lane to set up
+ * \param window Jobs that can be submitted but not yet delivered, or 0 for
+ *        LABPRO_WORK_LANE_DEFAULT_WINDOW.
+ * \return LABPRO_OK or LABPRO_ERR_NO_MEM
+ * 
+ * \ingroup LabPro-Work-Pool
+ */
+int LabPro_work_lane_init(LabPro_Work_Pool* pool, LabPro_Work_Lane* lane, size_t window);
+
+/** \brief Submit a job. Any thread, including the pool's own.
+ * 
+ * \param lane The lane whose order the job is delivered in
+ * \param process Does the work; called on some worker
+ * \param deliver Called on some worker once process has returned and every
+ *        earlier job of the lane has been delivered, or NULL.
+ * \param data Passed to both
+ * \return LABPRO_OK, LABPRO_ERR_BUSY if the lane already has window jobs
+ *         that haven't been delivered, or LABPRO_ERR_NO_MEM.
+ * 
+ * \ingroup LabPro-Work-Pool
+ */
+int LabPro_work_submit(LabPro_Work_Lane* lane, LabPro_Work_Function process, LabPro_Work_Function deliver, void* data);
+
+/** \brief Wait until every job submitted to the lane has been delivered. Not from the pool's own threads.
+ * \ingroup LabPro-Work-Pool
+ */
+void LabPro_work_lane_drain(LabPro_Work_Lane* lane);
+
+/** \brief Wait for the lane's jobs, then free it.
+ * \ingroup LabPro-Work-Pool
+ */
+void LabPro_work_lane_free(LabPro_Work_Lane* lane);
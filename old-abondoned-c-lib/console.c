@@ -82,6 +82,8 @@ void print_help() {
     printf("::     !help: Show this information.\n");
     printf("::     !mary-had-a-little-lamb: Make the selected LabPro play \"Mary Had a Little Lamb.\"\n");
     printf("::     !test-list-parser <list>: Test liblabpro's TI-OS style list parser.\n");
+    printf("::     !trace <file>: Record every USB packet to and from the selected LabPro to a trace file.\n");
+    printf("::     !stop-trace: Stop recording and close the trace file.\n");
     printf("::   Any input not starting with an exclamation point will be sent to the first connected\n");
     printf("::   LabPro device found. A carriage-return (CR) character is appended to the input, but\n");
     printf("::   no error checking is performed, so be careful!\n");
@@ -108,13 +110,25 @@ int test_list_parser(int argc, char** argv) {
         previous_length = strlen(argv[i]) + 1;
     }
     
+    // Decode as numbers first, since LabPro_parse_list() splits the string in place.
+    int num_values = LabPro_list_length(combined_list, strlen(combined_list));
+    if (num_values > 0) {
+        double* values = malloc(num_values * sizeof(double));
+        if (values != NULL) {
+            int status = LabPro_parse_list_doubles(combined_list, strlen(combined_list), values, num_values, &num_values);
+            printf(":: Numeric status: %d\n", status);
+            for (int i = 0; i < num_values; ++i)
+                printf(":: Value %d: %g\n", i, values[i]);
+            free(values);
+        }
+    }
+    
     int argc_list;
     char** argv_list;
     int status = LabPro_parse_list(combined_list, &argc_list, &argv_list);
     printf(":: Status: %d\n", status);
     for (int i = 0; i < argc_list; ++i) {
         printf(":: Element %d: %s\n", i, argv_list[i]);
-        free(argv_list[i]);
     }
     if (argc_list > 0)
         free(argv_list);
@@ -128,14 +142,22 @@ int main(int argc, char** argv) {
     printf("--------------------------------------------\n");
     
     int fake_shell = false;
-    LabPro* selected_labpro;
+    int sim_shell = false;
+    char* replay_path = NULL;
+    LabPro* selected_labpro = NULL;
     if (argc > 1)
     {
         if (strcmp(argv[1], "--fake") == 0)
             fake_shell = true;
+        else if (strcmp(argv[1], "--sim") == 0)
+            sim_shell = true;
+        else if (strcmp(argv[1], "--replay") == 0 && argc > 2)
+            replay_path = argv[2];
         else if (strcmp(argv[1], "--help") == 0) {
             printf("For help, start the shell and enter \"!help\" (without quotes) and hit enter.\n");
             printf("Run labpro-console with the \"--fake\" flag to enter a fake shell without a LabPro connected.\n");
+            printf("Run labpro-console with the \"--sim\" flag to talk to a simulated LabPro instead.\n");
+            printf("Run labpro-console with \"--replay <file>\" to replay a trace recorded with !trace.\n");
             return 0;
         }
         else {
@@ -149,11 +171,23 @@ int main(int argc, char** argv) {
         LabPro_Context ctx;
         LabPro_init(&ctx);
         
+        if (sim_shell) {
+            printf(":: Adding a simulated LabPro device.\n");
+            LabPro_Sim_Config sim_config;
+            LabPro_sim_default_config(&sim_config);
+            LabPro_sim_add(&ctx, &sim_config);
+        }
+        if (replay_path != NULL) {
+            printf(":: Replaying trace %s at the recorded pace.\n", replay_path);
+            LabPro_replay_add(&ctx, replay_path, 1.0);
+        }
+        
         printf(":: Searching for connected LabPro devices...\n");
         LabPro_List list = LabPro_list_labpros(&ctx);
         
         if (list.num == 0) {
             printf(":: No LabPro devices found; aborting.\n");
+            LabPro_free_list(&list);
             LabPro_exit(&ctx);
             return(0);
         }
@@ -167,6 +201,7 @@ int main(int argc, char** argv) {
                 free(list.labpros[i]);
             }
         }
+        LabPro_free_list(&list);
     }
     else
         printf(":: Starting a fake shell.\n");
@@ -205,6 +240,30 @@ int main(int argc, char** argv) {
                 }
                 else if (strcmp(argv_cmd[0], "test-list-parser") == 0)
                     test_list_parser(argc_cmd, argv_cmd);
+                else if (strcmp(argv_cmd[0], "trace") == 0) {
+                    if (argc_cmd < 2)
+                        printf(":: Usage: !trace <file>\n");
+                    else if (!fake_shell && selected_labpro == NULL)
+                        printf(":: No LabPro is selected.\n");
+                    else if (!fake_shell) {
+                        int trace_status = LabPro_start_trace(selected_labpro, argv_cmd[1]);
+                        if (trace_status != 0)
+                            printf(":: Warning: LabPro_start_trace returned error %d.\n", trace_status);
+                        else
+                            printf(":: Recording trace to %s.\n", argv_cmd[1]);
+                    }
+                    else
+                        printf(":: This command would record a trace of the selected LabPro to %s.\n", argv_cmd[1]);
+                }
+                else if (strcmp(argv_cmd[0], "stop-trace") == 0) {
+                    if (!fake_shell && selected_labpro == NULL)
+                        printf(":: No LabPro is selected.\n");
+                    else if (!fake_shell) {
+                        int trace_status = LabPro_stop_trace(selected_labpro);
+                        if (trace_status != 0)
+                            printf(":: Warning: LabPro_stop_trace returned error %d.\n", trace_status);
+                    }
+                }
                 else
                     printf(":: No command found by the name \"%s\". Try \"!help\".\n", argv_cmd[0]);
                 
@@ -26,6 +26,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -44,13 +46,69 @@ void LabPro_sleep(unsigned int milliseconds) {
 #endif
 #ifdef __unix__
     struct timespec spec;
-    spec.tv_sec = 0;
-    spec.tv_nsec = milliseconds * 1000000;
+    spec.tv_sec = milliseconds / 1000;
+    spec.tv_nsec = (milliseconds % 1000) * 1000000;
     nanosleep(&spec, NULL);
 #endif
 }
 
+void LabPro_sleep_usec(unsigned int microseconds) {
+#ifdef WIN32
+    Sleep((microseconds + 999) / 1000);
+#endif
+#ifdef __unix__
+    struct timespec spec;
+    spec.tv_sec = microseconds / 1000000;
+    spec.tv_nsec = (microseconds % 1000000) * 1000;
+    nanosleep(&spec, NULL);
+#endif
+}
+
+unsigned long long LabPro_time_usec() {
+#ifdef WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000
+        + (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#endif
+#ifdef __unix__
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return (unsigned long long)spec.tv_sec * 1000000 + spec.tv_nsec / 1000;
+#endif
+}
+
+/* Completion callback for the IN transfers. Appends the packet to the
+ * LabPro's receive ring so LabPro_read_raw() can pick it up later.
+ */
+static void LabPro_receive_packet(void* user_data, const unsigned char* packet, int length) {
+    LabPro* labpro = (LabPro*)user_data;
+    
+    pthread_mutex_lock(&labpro->trace_mutex);
+    if (labpro->trace != NULL)
+        LabPro_trace_writer_record(labpro->trace, labpro->in_endpt_addr | LIBUSB_ENDPOINT_IN, packet, length);
+    pthread_mutex_unlock(&labpro->trace_mutex);
+    
+    // The rest of the packet after the CR is just padding, unless the packet is binary data.
+    if (labpro->framing == LABPRO_FRAMING_CR && !atomic_load_explicit(&labpro->rx_whole_packets, memory_order_relaxed)) {
+        const unsigned char* cr = memchr(packet, '\r', length);
+        if (cr != NULL)
+            length = (int)(cr - packet) + 1;
+    }
+    
+    // A full ring counts what it drops; readers report the overrun. Printing
+    // here would only slow down the thread that has to catch up.
+    LabPro_ring_write(&labpro->rx, packet, length);
+    if (length < LABPRO_PACKET_SIZE)
+        atomic_store(&labpro->rx_response_end, LabPro_ring_total_written(&labpro->rx));
+}
+
 int LabPro_init(LabPro_Context *context) {
+    (*context).sim_configs = NULL;
+    (*context).num_sim_devices = 0;
+    (*context).replay_configs = NULL;
+    (*context).num_replays = 0;
     int errorcode = libusb_init(&(*context).usb_link);
     if (errorcode != LIBUSB_SUCCESS) {
         printf("[liblabpro FATAL] Error initializing liblabpro: %s\n", libusb_strerror(errorcode));
@@ -65,139 +123,434 @@ int LabPro_init(LabPro_Context *context) {
 
 void LabPro_exit(LabPro_Context* context) {
     libusb_exit((*context).usb_link);
+    free((*context).sim_configs);
+    free((*context).replay_configs);
+    (*context).sim_configs = NULL;
+    (*context).replay_configs = NULL;
 }
 
-LabPro_List LabPro_list_labpros(LabPro_Context* context) {
-    libusb_device** usb_list;
-    LabPro_List lp_list;
-    ssize_t cnt;
+int LabPro_sim_add(LabPro_Context* context, const LabPro_Sim_Config* config) {
+    LabPro_Sim_Config* configs = realloc((*context).sim_configs, ((*context).num_sim_devices + 1) * sizeof(LabPro_Sim_Config));
+    if (configs == NULL)
+        return LABPRO_ERR_NO_MEM;
+    (*context).sim_configs = configs;
+    
+    (*context).sim_configs[(*context).num_sim_devices] = *config;
+    ++(*context).num_sim_devices;
+    return LABPRO_OK;
+}
+
+int LabPro_replay_add(LabPro_Context* context, const char* path, double time_scale) {
+    if (strlen(path) >= LABPRO_TRACE_MAX_PATH)
+        return LABPRO_ERR_NO_MEM;
     
-    cnt = libusb_get_device_list((*context).usb_link, &usb_list);
-    if (cnt <= 0 ) {
-        lp_list.num = 0;
+    LabPro_Replay_Config* configs = realloc((*context).replay_configs, ((*context).num_replays + 1) * sizeof(LabPro_Replay_Config));
+    if (configs == NULL)
+        return LABPRO_ERR_NO_MEM;
+    (*context).replay_configs = configs;
+    
+    strcpy((*context).replay_configs[(*context).num_replays].path, path);
+    (*context).replay_configs[(*context).num_replays].time_scale = time_scale;
+    ++(*context).num_replays;
+    return LABPRO_OK;
+}
+
+/* Allocate a LabPro with the state that doesn't depend on the transport. */
+static LabPro* LabPro_new_labpro() {
+    LabPro *labpro = (LabPro*)calloc(1, sizeof(LabPro));
+    if (labpro == NULL)
+        return NULL;
+    
+    labpro->timeout = 5000; // This is what freelab uses
+    LabPro_pacer_init(&labpro->pacer, 0);
+    LabPro_journal_init(&labpro->journal);
+    if (LabPro_ring_init(&labpro->rx, LABPRO_RING_DEFAULT_CAPACITY, LABPRO_OVERFLOW_DROP_NEWEST) != LABPRO_OK) {
+        free(labpro);
+        return NULL;
     }
-    else {
-        lp_list.num = 0;
-        struct libusb_device_descriptor desc;
+    pthread_mutex_init(&labpro->trace_mutex, NULL);
+    return labpro;
+}
+
+/* Add an opened LabPro to the list, growing it as needed. If there's no
+ * memory for it, the LabPro is closed and freed instead.
+ */
+static void LabPro_list_append(LabPro_List* list, LabPro* labpro) {
+    if (list->num == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+        LabPro** labpros = realloc(list->labpros, capacity * sizeof(LabPro*));
+        if (labpros == NULL) {
+            printf("[liblabpro ERR] Unable to allocate memory for LabPro %d.\n", list->num);
+            LabPro_close_labpro(labpro);
+            free(labpro);
+            return;
+        }
+        list->labpros = labpros;
+        list->capacity = capacity;
+    }
+    list->labpros[list->num] = labpro;
+    ++list->num;
+}
+
+/* Open and claim a LabPro found on the bus, and find its endpoints.
+ * Returns NULL if that fails; the reason has been printed.
+ */
+static libusb_device_handle* LabPro_claim_usb(libusb_device* device, int index, unsigned char* in_endpt, unsigned char* out_endpt) {
+    // Attempt to open the device
+    libusb_device_handle *dev_handle = NULL;
+    int open_err;
+    if ((open_err = libusb_open(device, &dev_handle)) != LIBUSB_SUCCESS) {
+        printf("[liblabpro ERR] Unable to open libusb device: %s\n", libusb_strerror(open_err));
+        return NULL;
+    }
+    
+    // Detach kernel driver if necessary
+    if (libusb_kernel_driver_active(dev_handle, 0) == 1) {
+        int detach_error = libusb_detach_kernel_driver(dev_handle, 0);
+        if (detach_error != 0) {
+            printf("[liblabpro ERR] Unable to detach kernel driver from interface 0 of LabPro %d: %s\n", index, libusb_strerror(detach_error));
+            libusb_close(dev_handle);
+            return NULL;
+        }
+        else {
+            printf("[liblabpro MSG] Successfully detached kernel driver.\n");
+        }
+    }
+    
+    /* I don't think that LabPros have more than one USB configuration.
+     * freelab doesn't manually set the configuration probably because the
+     * kernel sometimes chooses a configuration automatically.
+     */
+    int config_setting_err = libusb_set_configuration(dev_handle, 1);
+    if (config_setting_err != 0) {
+        printf("[liblabpro ERR] Unable to set configuration to 1 on LabPro %d: %s\n", index, libusb_strerror(config_setting_err));
+        libusb_close(dev_handle);
+        return NULL;
+    }
+    
+    // Claim the interface in order to be able to write to endpoints.
+    int interface_claim_error;
+    if ((interface_claim_error = libusb_claim_interface(dev_handle, 0)) != 0) {
+        printf("[liblabpro ERR] Unable to claim interface 0 of LabPro %d: %s\n", index, libusb_strerror(interface_claim_error));
+        libusb_close(dev_handle);
+        return NULL;
+    }
+    
+    // Find endpoints
+    struct libusb_config_descriptor* config;
+    int config_desc_err;
+    if ((config_desc_err = libusb_get_config_descriptor(device, 0, &config)) != 0) {
+        printf("[liblabpro ERR] Unable to get descriptor of first configuration of LabPro %d: %s\n", index, libusb_strerror(config_desc_err));
+        libusb_close(dev_handle);
+        return NULL;
+    }
+    struct libusb_endpoint_descriptor ep_desc;
+    unsigned char in_addr = 0;
+    unsigned char out_addr = 0;
+    bool in_endpt_found = false;
+    bool out_endpt_found = false;
+    for (uint8_t i = 0; i < config->interface[0].altsetting[0].bNumEndpoints; ++i) {
+        ep_desc = config->interface[0].altsetting[0].endpoint[i];
+#ifdef DEBUG
+        printf("[liblabpro DBG] EP Address: %x, Endpoint attributes: %x\n", (unsigned int)ep_desc.bEndpointAddress, (unsigned int)ep_desc.bmAttributes);
+#endif
+        // Make sure we're dealing with only bulk endpoints.
+        if ((ep_desc.bmAttributes & 0b00000011) != LIBUSB_TRANSFER_TYPE_BULK)
+        {
+            printf("[liblabpro ERR] LabPro %d had unexpected non-bulk endpoint (Endpoint attributes: %x).\n", index, (unsigned int)ep_desc.bmAttributes);
+            continue;
+        }
         
-        for (ssize_t i = 0; i < cnt && lp_list.num < 5; ++i) { // We won't support more than 5 connected LabPros at once, that would be ridiculous
-            libusb_get_device_descriptor(usb_list[i], &desc);
-            if (desc.idVendor == 0x08f7 && desc.idProduct == 1) {
-                // Attempt to open the device
-                libusb_device_handle *dev_handle = NULL;
-                int open_err;
-                if ((open_err = libusb_open(usb_list[i], &dev_handle)) != LIBUSB_SUCCESS) {
-                    printf("[liblabpro ERR] Unable to open libusb device: %s\n", libusb_strerror(open_err));
-                }
-                else {
-                    // Detach kernel driver if necessary
-                    if (libusb_kernel_driver_active(dev_handle, 0) == 1) {
-                        int detach_error = libusb_detach_kernel_driver(dev_handle, 0);
-                        if (detach_error != 0) {
-                            printf("[liblabpro ERR] Unable to detach kernel driver from interface 0 of LabPro %d: %s\n", lp_list.num, libusb_strerror(detach_error));
-                            libusb_close(dev_handle);
-                            continue;
-                        }
-                        else {
-                            printf("[liblabpro MSG] Successfully detached kernel driver.\n");
-                        }
-                    }
-                    
-                    /* I don't think that LabPros have more than one USB configuration.
-                     * freelab doesn't manually set the configuration probably because the
-                     * kernel sometimes chooses a configuration automatically.
-                     */
-                    int config_setting_err = libusb_set_configuration(dev_handle, 1);
-                    if (config_setting_err != 0) {
-                        printf("[liblabpro ERR] Unable to set configuration to 1 on LabPro %d: %s\n", lp_list.num, libusb_strerror(config_setting_err));
-                        libusb_close(dev_handle);
-                        continue;
-                    }
-                    
-                    // Claim the interface in order to be able to write to endpoints.
-                    int interface_claim_error;
-                    if ((interface_claim_error = libusb_claim_interface(dev_handle, 0)) != 0) {
-                        printf("[liblabpro ERR] Unable to claim interface 0 of LabPro %d: %s\n", lp_list.num, libusb_strerror(interface_claim_error));
-                        libusb_close(dev_handle);
-                        continue;
-                    }
-                    
-                    // Find endpoints
-                    struct libusb_config_descriptor* config;
-                    int config_desc_err;
-                    if ((config_desc_err = libusb_get_config_descriptor(usb_list[i], 0, &config)) != 0) {
-                        printf("[liblabpro ERR] Unable to get descriptor of first configuration of LabPro %d: %s\n", lp_list.num, libusb_strerror(config_desc_err));
-                        libusb_close(dev_handle);
-                        continue;
-                    }
-                    struct libusb_endpoint_descriptor ep_desc;
-                    unsigned char in_addr;
-                    unsigned char out_addr;
-                    bool in_endpt_found = false;
-                    bool out_endpt_found = false;
-                    for (uint8_t i = 0; i < config->interface[0].altsetting[0].bNumEndpoints; ++i) {
-                        ep_desc = config->interface[0].altsetting[0].endpoint[i];
+        /* I'm not sure whether this would fail on big-endian machines or not. The libusb docs
+         * are not clear about whether the descriptor values get converted to big-endian on
+         * big-endian systems, but I do not think they do.
+         * Additionally, the docs talk about "bits 0:3 and 4:6" but don't specify whether bit 0
+         * is the LSB or MSB. Based on freelab, I have to assume the former.
+         */
+        if ((ep_desc.bEndpointAddress & 0b10000000) == LIBUSB_ENDPOINT_IN) {
+            in_addr = ep_desc.bEndpointAddress;
+            in_endpt_found = true;
 #ifdef DEBUG
-                        printf("[liblabpro DBG] EP Address: %x, Endpoint attributes: %x\n", (unsigned int)ep_desc.bEndpointAddress, (unsigned int)ep_desc.bmAttributes);
+            printf("[liblabpro DBG] Using endpoint %x as bulk in endpoint.\n", (unsigned int)in_addr);
 #endif
-                        // Make sure we're dealing with only bulk endpoints.
-                        if ((ep_desc.bmAttributes & 0b00000011) != LIBUSB_TRANSFER_TYPE_BULK)
-                        {
-                            printf("[liblabpro ERR] LabPro %d had unexpected non-bulk endpoint (Endpoint attributes: %x).\n", lp_list.num, (unsigned int)ep_desc.bmAttributes);
-                            continue;
-                        }
-                        
-                        /* I'm not sure whether this would fail on big-endian machines or not. The libusb docs
-                         * are not clear about whether the descriptor values get converted to big-endian on
-                         * big-endian systems, but I do not think they do.
-                         * Additionally, the docs talk about "bits 0:3 and 4:6" but don't specify whether bit 0
-                         * is the LSB or MSB. Based on freelab, I have to assume the former.
-                         */
-                        if ((ep_desc.bEndpointAddress & 0b10000000) == LIBUSB_ENDPOINT_IN) {
-                            in_addr = ep_desc.bEndpointAddress;
-                            in_endpt_found = true;
+        }
+        else {
+            out_addr = ep_desc.bEndpointAddress;
+            out_endpt_found = true;
 #ifdef DEBUG
-                            printf("[liblabpro DBG] Using endpoint %x as bulk in endpoint.\n", (unsigned int)in_addr);
+            printf("[liblabpro DBG] Using endpoint %x as bulk out endpoint.\n", (unsigned int)out_addr);
 #endif
-                        }
-                        else {
-                            out_addr = ep_desc.bEndpointAddress;
-                            out_endpt_found = true;
+        }
+    }
+    libusb_free_config_descriptor(config);
+    
+    if (!in_endpt_found || !out_endpt_found) {
+        printf("[liblabpro ERR] Bulk endpoints not found for LabPro %d.\n", index);
+        libusb_release_interface(dev_handle, 0);
+        libusb_close(dev_handle);
+        return NULL;
+    }
+    
+    *in_endpt = in_addr;
+    *out_endpt = out_addr;
+    return dev_handle;
+}
+
+/* Start the transfers of a claimed LabPro. If that fails, the device is
+ * released and closed, and the LabPro left as it was.
+ */
+static int LabPro_attach_usb(LabPro* labpro, LabPro_Context* context, libusb_device_handle* dev_handle, unsigned char in_addr, unsigned char out_addr, int index) {
+    labpro->device_handle = dev_handle;
+    labpro->in_endpt_addr = in_addr;
+    labpro->out_endpt_addr = out_addr;
+    labpro->usb_link = (*context).usb_link;
+    
+    LabPro_Async_Engine* engine;
+    int engine_err = LabPro_async_start(
+        &engine,
+        labpro->usb_link,
+        dev_handle,
+        in_addr,
+        out_addr,
+        LABPRO_ASYNC_DEFAULT_IN_TRANSFERS,
+        LabPro_receive_packet,
+        labpro
+    );
+    if (engine_err != LIBUSB_SUCCESS) {
+        printf("[liblabpro ERR] Unable to start transfers for LabPro %d: %s\n", index, libusb_strerror(engine_err));
+        libusb_release_interface(dev_handle, 0);
+        libusb_close(dev_handle);
+        return engine_err;
+    }
+    labpro->transport = &LabPro_async_transport;
+    labpro->transport_data = engine;
+    labpro->is_open = true;
+    return LIBUSB_SUCCESS;
+}
+
+LabPro* LabPro_open_usb(LabPro_Context* context, libusb_device* device, int index) {
+    unsigned char in_addr = 0, out_addr = 0;
+    libusb_device_handle* dev_handle = LabPro_claim_usb(device, index, &in_addr, &out_addr);
+    if (dev_handle == NULL)
+        return NULL;
+    
+    LabPro *labpro = LabPro_new_labpro();
+    if (labpro == NULL) {
+        printf("[liblabpro ERR] Unable to allocate memory for LabPro %d.\n", index);
+        libusb_release_interface(dev_handle, 0);
+        libusb_close(dev_handle);
+        return NULL;
+    }
+    
+    if (LabPro_attach_usb(labpro, context, dev_handle, in_addr, out_addr, index) != LIBUSB_SUCCESS) {
+        LabPro_ring_free(&labpro->rx);
+        free(labpro);
+        return NULL;
+    }
+    return labpro;
+}
+
+int LabPro_reopen_usb(LabPro* labpro, LabPro_Context* context, libusb_device* device, int index) {
+    if (labpro->is_open)
+        return LABPRO_ERR_BUSY;
+    
+    unsigned char in_addr = 0, out_addr = 0;
+    libusb_device_handle* dev_handle = LabPro_claim_usb(device, index, &in_addr, &out_addr);
+    if (dev_handle == NULL)
+        return LIBUSB_ERROR_IO;
+    
+    // Whatever was left from before the LabPro was unplugged is of no use now.
+    LabPro_Ring_View view;
+    LabPro_ring_peek(&labpro->rx, &view);
+    LabPro_ring_consume(&labpro->rx, &view, LabPro_ring_view_length(&view));
+    
+    int status = LabPro_attach_usb(labpro, context, dev_handle, in_addr, out_addr, index);
+    if (status != LIBUSB_SUCCESS)
+        return status;
+    labpro->unplugged = false;
+    labpro->is_collecting_data = false;
+    labpro->is_busy = false;
+    return LabPro_replay_journal(labpro);
+}
+
+int LabPro_replay_journal(LabPro* labpro) {
+    int transferred;
+    int retval = LABPRO_OK;
+    
+    labpro->replaying_journal = true;
+    for (size_t i = 0; i < labpro->journal.num_entries && retval == LABPRO_OK; ++i)
+        retval = LabPro_send_raw(labpro, labpro->journal.entries[i].command, &transferred);
+    
+    if (retval == LABPRO_OK && labpro->resume_collection && labpro->collecting_when_lost && labpro->journal.collection != NULL) {
+        retval = LabPro_send_raw(labpro, labpro->journal.collection, &transferred);
+        if (retval == LABPRO_OK)
+            labpro->is_collecting_data = true;
+    }
+    labpro->collecting_when_lost = false;
+    labpro->replaying_journal = false;
+    return retval;
+}
+
+void LabPro_detach(LabPro* labpro) {
+    if (!labpro->is_open)
+        return;
+    
+    labpro->transport->close(labpro->transport_data);
+    labpro->is_open = false;
+    labpro->is_collecting_data = false;
+}
+
+/* Set up the simulated LabPro described by the context's sim_configs[which]. */
+static LabPro* LabPro_open_sim(LabPro_Context* context, int which, int index) {
+    LabPro *labpro = LabPro_new_labpro();
+    if (labpro == NULL) {
+        printf("[liblabpro ERR] Unable to allocate memory for simulated LabPro %d.\n", index);
+        return NULL;
+    }
+    
+    labpro->transport_data = LabPro_sim_create(&(*context).sim_configs[which], LabPro_receive_packet, labpro);
+    if (labpro->transport_data == NULL) {
+        printf("[liblabpro ERR] Unable to allocate memory for simulated LabPro %d.\n", index);
+        LabPro_ring_free(&labpro->rx);
+        free(labpro);
+        return NULL;
+    }
+    labpro->transport = &LabPro_sim_transport;
+    labpro->is_open = true;
+    return labpro;
+}
+
+/* Set up a LabPro replaying the context's replay_configs[which]. */
+static LabPro* LabPro_open_replay(LabPro_Context* context, int which, int index) {
+    LabPro *labpro = LabPro_new_labpro();
+    if (labpro == NULL) {
+        printf("[liblabpro ERR] Unable to allocate memory for replayed LabPro %d.\n", index);
+        return NULL;
+    }
+    
+    LabPro_Trace_Replay* replay;
+    if (LabPro_trace_replay_create(&(*context).replay_configs[which], LabPro_receive_packet, labpro, &replay) != LABPRO_OK) {
+        LabPro_ring_free(&labpro->rx);
+        free(labpro);
+        return NULL;
+    }
+    labpro->transport = &LabPro_replay_transport;
+    labpro->transport_data = replay;
+    labpro->is_open = true;
+    return labpro;
+}
+
+/* The LabPros LabPro_list_labpros() sets up: the LabPros found on the bus,
+ * then the simulated ones, then the replays. Each thread takes the next one
+ * until there are none left.
+ */
+typedef struct {
+    LabPro_Context* context;
+    libusb_device** usb_devices;
+    int num_usb;
+    int num_jobs;
+    LabPro** opened;
+    _Atomic int next_job;
+} LabPro_Open_Batch;
+
+static void LabPro_open_one(LabPro_Open_Batch* batch, int job) {
+    LabPro_Context* context = batch->context;
+    unsigned long long started = LabPro_time_usec();
+    LabPro* labpro;
+    
+    if (job < batch->num_usb)
+        labpro = LabPro_open_usb(context, batch->usb_devices[job], job);
+    else if (job < batch->num_usb + (*context).num_sim_devices)
+        labpro = LabPro_open_sim(context, job - batch->num_usb, job);
+    else
+        labpro = LabPro_open_replay(context, job - batch->num_usb - (*context).num_sim_devices, job);
+    
+    if (labpro != NULL) {
+        labpro->open_usec = LabPro_time_usec() - started;
 #ifdef DEBUG
-                            printf("[liblabpro DBG] Using endpoint %x as bulk out endpoint.\n", (unsigned int)out_addr);
+        printf("[liblabpro DBG] Opened LabPro %d in %llu us.\n", job, labpro->open_usec);
 #endif
-                        }
-                    }
-                    libusb_free_config_descriptor(config);
-                    
-                    if (!in_endpt_found || !out_endpt_found) {
-                        printf("[liblabpro ERR] Bulk endpoints not found for LabPro %d.\n", lp_list.num);
-                        libusb_release_interface(dev_handle, 0);
-                        libusb_close(dev_handle);
-                        continue;
-                    }
-                    
-                    
-                    LabPro *labpro = (LabPro*)malloc(sizeof(LabPro));
-                    labpro->device_handle = dev_handle;
-                    labpro->is_open = true;
-                    labpro->in_endpt_addr = in_addr;
-                    labpro->out_endpt_addr = out_addr;
-                    labpro->timeout = 5000; // This is what freelab uses
-                    lp_list.labpros[lp_list.num] = labpro;
-                    ++lp_list.num;
-                }
-            }
+    }
+    batch->opened[job] = labpro;
+}
+
+static void* LabPro_open_worker(void* data) {
+    LabPro_Open_Batch* batch = (LabPro_Open_Batch*)data;
+    int job;
+    while ((job = atomic_fetch_add_explicit(&batch->next_job, 1, memory_order_relaxed)) < batch->num_jobs)
+        LabPro_open_one(batch, job);
+    return NULL;
+}
+
+LabPro_List LabPro_list_labpros(LabPro_Context* context) {
+    libusb_device** usb_list;
+    LabPro_List lp_list = {0, 0, NULL};
+    LabPro_Open_Batch batch;
+    batch.context = context;
+    batch.usb_devices = NULL;
+    batch.num_usb = 0;
+    
+    ssize_t cnt = libusb_get_device_list((*context).usb_link, &usb_list);
+    if (cnt > 0) {
+        batch.usb_devices = malloc(cnt * sizeof(libusb_device*));
+        if (batch.usb_devices == NULL)
+            printf("[liblabpro ERR] Unable to allocate memory for the list of USB devices.\n");
+        
+        struct libusb_device_descriptor desc;
+        for (ssize_t i = 0; i < cnt && batch.usb_devices != NULL; ++i) {
+            libusb_get_device_descriptor(usb_list[i], &desc);
+            if (desc.idVendor == 0x08f7 && desc.idProduct == 1)
+                batch.usb_devices[batch.num_usb++] = usb_list[i];
         }
     }
-    libusb_free_device_list(usb_list, 1);
+    
+    batch.num_jobs = batch.num_usb + (*context).num_sim_devices + (*context).num_replays;
+    batch.opened = calloc(batch.num_jobs > 0 ? batch.num_jobs : 1, sizeof(LabPro*));
+    if (batch.opened == NULL) {
+        printf("[liblabpro ERR] Unable to allocate memory for the list of LabPros.\n");
+        batch.num_jobs = 0;
+    }
+    atomic_init(&batch.next_job, 0);
+    
+    // Opening a LabPro is mostly waiting for control transfers, so open them side by side.
+    pthread_t threads[LABPRO_LIST_MAX_THREADS];
+    int num_threads = 0;
+    while (num_threads + 1 < LABPRO_LIST_MAX_THREADS && num_threads + 1 < batch.num_jobs) {
+        if (pthread_create(&threads[num_threads], NULL, LabPro_open_worker, &batch) != 0)
+            break;
+        ++num_threads;
+    }
+    LabPro_open_worker(&batch);
+    for (int i = 0; i < num_threads; ++i)
+        pthread_join(threads[i], NULL);
+    
+    for (int i = 0; i < batch.num_jobs; ++i) {
+        if (batch.opened[i] != NULL)
+            LabPro_list_append(&lp_list, batch.opened[i]);
+    }
+    
+    free(batch.opened);
+    free(batch.usb_devices);
+    if (cnt >= 0)
+        libusb_free_device_list(usb_list, 1);
     return lp_list;
 }
 
+void LabPro_free_list(LabPro_List* list) {
+    free(list->labpros);
+    list->labpros = NULL;
+    list->num = 0;
+    list->capacity = 0;
+}
+
 void LabPro_close_labpro(LabPro* labpro) {
-    libusb_release_interface(labpro->device_handle, 0);
-    libusb_close(labpro->device_handle);
-    labpro->is_open = false;
+    LabPro_stop_trace(labpro);
+    LabPro_detach(labpro);
+    labpro->transport_data = NULL;
+    
+    LabPro_ring_free(&labpro->rx);
+    LabPro_journal_free(&labpro->journal);
+    pthread_mutex_destroy(&labpro->trace_mutex);
 }
 
 int LabPro_reset(LabPro* labpro, bool force) {
@@ -214,6 +567,9 @@ int LabPro_reset(LabPro* labpro, bool force) {
     snprintf((char*)cmd_str, 6, "s{%d}\r", LABPRO_RESET);
     int transferred;
     
+    // The reset also puts data back into ASCII.
+    labpro->binary_records_per_packet = 0;
+    atomic_store_explicit(&labpro->rx_whole_packets, false, memory_order_relaxed);
     
     return LabPro_send_raw(labpro, (char*)cmd_str, &transferred);
 }
@@ -260,114 +616,407 @@ int LabPro_send_raw(LabPro* labpro, char* command, int* length_transferred) {
         ++numpackets;
     
     for (int i = 1; i <= numpackets; ++i) {
-        LabPro_sleep(50);
+        LabPro_pacer_wait(&labpro->pacer);
         
         if (i == numpackets && len % 64 != 0)
             numbytes = len % 64;
         else
             numbytes = 64;
         
-        status = libusb_bulk_transfer(
-            labpro->device_handle,
-            labpro->out_endpt_addr,
+        status = labpro->transport->write(
+            labpro->transport_data,
             (unsigned char*)real_command + (64 * (i - 1)),
             numbytes,
-            &transferred,
-            labpro->timeout
+            labpro->timeout,
+            &transferred
         );
         *length_transferred += transferred;
         
         if (status == LIBUSB_ERROR_NO_DEVICE) {
             LabPro_handle_device_disconnect(labpro);
+            free(real_command);
             return LIBUSB_ERROR_NO_DEVICE;
         }
         
         if (status != LIBUSB_SUCCESS) {
             ++numerrors;
+            LabPro_pacer_error(&labpro->pacer);
             printf("[liblabpro ERR] Error writing to USB: %s\n", libusb_strerror(status));
             printf("[liblabpro WARN] There have been %d errors for this write function so far.\n", numerrors);
             --i;
             
             if (numerrors > 5) {
                 printf("[liblabpro ERR] LabPro_send_raw: Error limit reached; aborting.");
+                free(real_command);
                 return status;
             }
         }
+        else {
+            LabPro_pacer_success(&labpro->pacer);
+            pthread_mutex_lock(&labpro->trace_mutex);
+            if (labpro->trace != NULL)
+                LabPro_trace_writer_record(labpro->trace, labpro->out_endpt_addr & ~LIBUSB_ENDPOINT_IN, (unsigned char*)real_command + (64 * (i - 1)), transferred);
+            pthread_mutex_unlock(&labpro->trace_mutex);
+        }
     }
     
     free(real_command);
+    
+    if (!labpro->replaying_journal && LabPro_journal_record(&labpro->journal, command) != LABPRO_OK)
+        printf("[liblabpro WARN] Out of memory; the command won't be sent again if the LabPro is unplugged.\n");
     return LABPRO_OK;
 }
 
-int LabPro_read_raw(LabPro* labpro, char** string, int* length) {
-    *length = 0;
+/* Handle events until more than old_written bytes have ever been received, or
+ * timeout milliseconds pass. Returns LIBUSB_ERROR_TIMEOUT if nothing arrived.
+ */
+static int LabPro_wait_for_rx(LabPro* labpro, size_t old_written, unsigned int timeout) {
+    unsigned long long deadline = LabPro_time_usec() + (unsigned long long)timeout * 1000;
+    unsigned long long in_errors = labpro->transport->in_errors(labpro->transport_data);
+    
+    while (LabPro_ring_total_written(&labpro->rx) == old_written) {
+        // Failed IN transfers are resubmitted by the transport, but slow down the next command.
+        if (labpro->transport->in_errors(labpro->transport_data) != in_errors) {
+            LabPro_pacer_error(&labpro->pacer);
+            in_errors = labpro->transport->in_errors(labpro->transport_data);
+        }
+        
+        int status = labpro->transport->status(labpro->transport_data);
+        if (status != LIBUSB_SUCCESS)
+            return status;
+        
+        unsigned long long now = LabPro_time_usec();
+        if (now >= deadline)
+            return LIBUSB_ERROR_TIMEOUT;
+        
+        unsigned int remaining_ms = (unsigned int)((deadline - now + 999) / 1000);
+        status = labpro->transport->handle_events(labpro->transport_data, remaining_ms);
+        if (status != LIBUSB_SUCCESS && status != LIBUSB_ERROR_TIMEOUT)
+            return status;
+    }
+    return LIBUSB_SUCCESS;
+}
+
+/* Length of the first complete response in the view, or zero if there
+ * isn't one yet.
+ */
+static size_t LabPro_rx_response_length(LabPro* labpro, const LabPro_Ring_View* view) {
+    size_t length = LabPro_ring_view_length(view);
+    
+    if (labpro->framing == LABPRO_FRAMING_RAW) {
+        // Positions are free-running, so an end before the view wraps around to a huge offset.
+        size_t end = atomic_load(&labpro->rx_response_end) - view->start;
+        return end <= length ? end : 0;
+    }
+    
+    // Don't search the same bytes over and over while a long response trickles in.
+    size_t from = 0;
+    if (labpro->rx_scan_pos > view->start)
+        from = labpro->rx_scan_pos - view->start;
+    
+    long cr = LabPro_ring_view_find(view, from, '\r');
+    if (cr < 0) {
+        labpro->rx_scan_pos = view->start + length;
+        return 0;
+    }
+    return (size_t)cr + 1;
+}
+
+/* How much of what follows the first length bytes of a response is padding
+ * to be dropped with it: the rest of the packet the response ends in, when
+ * packets are kept whole. Responses start on a packet boundary, as every
+ * read consumes whole packets then. available is how much has been received
+ * after the response.
+ */
+static size_t LabPro_rx_padding(LabPro* labpro, size_t length, size_t available) {
+    if (!atomic_load_explicit(&labpro->rx_whole_packets, memory_order_relaxed))
+        return 0;
+    
+    size_t padding = (LABPRO_PACKET_SIZE - length % LABPRO_PACKET_SIZE) % LABPRO_PACKET_SIZE;
+    return padding < available ? padding : available;
+}
+
+int LabPro_read_view(LabPro* labpro, LabPro_Ring_View* view) {
     if (!labpro->is_open)
         return LABPRO_ERR_NOT_OPEN;
     
     int retval = LABPRO_OK;
-    int status; // The status code libusb_bulk_transfer returns
-    int transferred; // Number of bytes transferred. This should always be either 0 or 64
-    int numpackets = 1; // Number of packets we need the buffer to be able to store.
-    int numerrors = 0; // Number of times libusb has returned an error
-    unsigned char* data = calloc(64, sizeof(char)); // The data buffer
-    if (data == NULL)
-        return LABPRO_ERR_NO_MEM;
+    int status;
+    size_t response_length;
     
-    do {
-        LabPro_sleep(50);
-        status = libusb_bulk_transfer(
-            labpro->device_handle,
-            labpro->in_endpt_addr,
-            data + (64 * (numpackets - 1)), // Write into the proper offset
-            64,
-            &transferred,
-            labpro->timeout
-        );
+    LabPro_ring_peek(&labpro->rx, view);
+    while ((response_length = LabPro_rx_response_length(labpro, view)) == 0) {
+        status = LabPro_wait_for_rx(labpro, view->start + LabPro_ring_view_length(view), labpro->timeout);
+        LabPro_ring_peek(&labpro->rx, view);
+        
+        if (status == LIBUSB_ERROR_TIMEOUT) { // Nothing more is coming, so return what we have
+            response_length = LabPro_ring_view_length(view);
+            break;
+        }
         
         if (status == LIBUSB_ERROR_NO_DEVICE) {
             LabPro_handle_device_disconnect(labpro);
-            memset(data + (64 * (numpackets - 1)), 0, 64); // NULL-terminate the string since we allocated this memory and didn't fill it.
+            response_length = LabPro_ring_view_length(view);
             retval = LIBUSB_ERROR_NO_DEVICE;
             break;
         }
         
-        if (status != LIBUSB_SUCCESS && status != LIBUSB_ERROR_TIMEOUT) {
-            ++numerrors; // We do not need to check transferred because the transfer is atomic in this case. https://sourceforge.net/p/libusb/mailman/message/36289834/
-            printf("[liblabpro ERR] Error reading from USB: %s\n", libusb_strerror(status));
-            printf("[liblabpro WARN] There have been %d errors for this read function call so far.\n", numerrors);
-            
-            if (numerrors > 5) {
-                printf("[liblabpro ERR] LabPro_read_raw: error limit reached; aborting.\n");
-                memset(data + (64 * (numpackets - 1)), 0, 64); // NULL-terminate the string since we allocated this memory and didn't fill it.
-                retval = status;
-                break;
-            }
-            continue;
+        if (status != LIBUSB_SUCCESS) {
+            printf("[liblabpro ERR] LabPro_read_view: Error reading from USB: %s\n", libusb_strerror(status));
+            response_length = LabPro_ring_view_length(view);
+            retval = status;
+            break;
+        }
+    }
+    
+    // Anything after this response stays in the ring for the next call.
+    labpro->rx_padding = LabPro_rx_padding(labpro, response_length, LabPro_ring_view_length(view) - response_length);
+    LabPro_ring_view_truncate(view, response_length);
+    return retval;
+}
+
+int LabPro_release_view(LabPro* labpro, const LabPro_Ring_View* view) {
+    size_t padding = labpro->rx_padding;
+    labpro->rx_padding = 0;
+    if (!LabPro_ring_consume(&labpro->rx, view, LabPro_ring_view_length(view) + padding))
+        return LABPRO_ERR_OVERRUN;
+    return LABPRO_OK;
+}
+
+int LabPro_read_parsed(LabPro* labpro, LabPro_Stream_Parser* parser) {
+    if (!labpro->is_open)
+        return LABPRO_ERR_NOT_OPEN;
+    
+    int retval = LABPRO_OK;
+    size_t response_length = 0;
+    while (true) {
+        LabPro_Ring_View view;
+        LabPro_ring_peek(&labpro->rx, &view);
+        
+        // Decode whatever has arrived so far, then go back to waiting for more.
+        bool list_ended = false;
+        size_t used = LabPro_stream_parser_feed(parser, (const char*)view.first, view.first_length, &list_ended);
+        if (!list_ended && view.second_length > 0) {
+            size_t used_second = LabPro_stream_parser_feed(parser, (const char*)view.second, view.second_length, &list_ended);
+            used += used_second;
         }
-        else if (status == LIBUSB_ERROR_TIMEOUT) { // There is no more data to read; so we can return
-            memset(data + (64 * (numpackets - 1)), 0, 64); // NULL-terminate the string since we allocated this memory and didn't fill it.
+        response_length += used;
+        if (list_ended)
+            used += LabPro_rx_padding(labpro, response_length, LabPro_ring_view_length(&view) - used);
+        
+        // The response may already have been overwritten while it was being decoded.
+        if (!LabPro_ring_consume(&labpro->rx, &view, used) && retval == LABPRO_OK)
+            retval = LABPRO_ERR_OVERRUN;
+        if (list_ended)
             break;
+        
+        int status = LabPro_wait_for_rx(labpro, view.start + LabPro_ring_view_length(&view), labpro->timeout);
+        if (status == LIBUSB_ERROR_NO_DEVICE) {
+            LabPro_handle_device_disconnect(labpro);
+            return LIBUSB_ERROR_NO_DEVICE;
+        }
+        if (status != LIBUSB_SUCCESS) {
+            if (status != LIBUSB_ERROR_TIMEOUT)
+                printf("[liblabpro ERR] LabPro_read_parsed: Error reading from USB: %s\n", libusb_strerror(status));
+            return status;
         }
+    }
+    
+    return retval != LABPRO_OK ? retval : parser->last_status;
+}
+
+int LabPro_set_binary_mode(LabPro* labpro, int records_per_packet) {
+    if (records_per_packet < 1)
+        records_per_packet = 1;
+    if (records_per_packet > LABPRO_BINARY_MAX_RECORDS_PER_PACKET)
+        records_per_packet = LABPRO_BINARY_MAX_RECORDS_PER_PACKET;
+    
+    char command[32];
+    snprintf(command, sizeof(command), "s{%d,0,-1,%d}", LABPRO_CONVERSION_EQN_SETUP, records_per_packet);
+    int transferred;
+    int retval = LabPro_send_raw(labpro, command, &transferred);
+    if (retval != LABPRO_OK)
+        return retval;
+    
+    labpro->binary_records_per_packet = records_per_packet;
+    atomic_store_explicit(&labpro->rx_whole_packets, true, memory_order_relaxed);
+    return LABPRO_OK;
+}
+
+/* Wait for more data after a read stopped at the end of view, with the
+ * error handling every binary read needs.
+ */
+static int LabPro_wait_for_binary(LabPro* labpro, const LabPro_Ring_View* view, const char* function) {
+    int status = LabPro_wait_for_rx(labpro, view->start + LabPro_ring_view_length(view), labpro->timeout);
+    if (status == LIBUSB_ERROR_NO_DEVICE)
+        LabPro_handle_device_disconnect(labpro);
+    else if (status != LIBUSB_SUCCESS && status != LIBUSB_ERROR_TIMEOUT)
+        printf("[liblabpro ERR] %s: Error reading from USB: %s\n", function, libusb_strerror(status));
+    return status;
+}
+
+/* Decode up to max_samples samples from the start of the view. A sample can
+ * be split by the end of the ring's storage, so it may have to be put back
+ * together first.
+ */
+static size_t LabPro_rx_decode_samples(const LabPro_Ring_View* view, uint16_t* samples, size_t max_samples) {
+    size_t count = LabPro_ring_view_length(view) / 2;
+    if (count > max_samples)
+        count = max_samples;
+    
+    size_t done = view->first_length / 2;
+    if (done > count)
+        done = count;
+    LabPro_binary_decode_samples(view->first, done, LABPRO_ADC_BITS, samples);
+    if (done == count)
+        return count;
+    
+    const unsigned char* second = view->second;
+    if (view->first_length % 2 == 1) {
+        unsigned char pair[2] = {view->first[view->first_length - 1], second[0]};
+        LabPro_binary_decode_samples(pair, 1, LABPRO_ADC_BITS, samples + done);
+        ++done;
+        ++second;
+    }
+    LabPro_binary_decode_samples(second, count - done, LABPRO_ADC_BITS, samples + done);
+    return count;
+}
+
+int LabPro_read_binary(LabPro* labpro, uint16_t* samples, size_t num_samples, size_t* num_read) {
+    *num_read = 0;
+    if (!labpro->is_open)
+        return LABPRO_ERR_NOT_OPEN;
+    
+    int retval = LABPRO_OK;
+    size_t response_length = 2 * num_samples;
+    // The last packet is padded to the full 64 bytes.
+    size_t padded_length = (response_length + LABPRO_PACKET_SIZE - 1) / LABPRO_PACKET_SIZE * LABPRO_PACKET_SIZE;
+    size_t received = 0;
+    
+    while (true) {
+        LabPro_Ring_View view;
+        LabPro_ring_peek(&labpro->rx, &view);
         
-        // This only gets executed on successful reads
-        *length += transferred;
-        ++numpackets;
+        size_t decoded = LabPro_rx_decode_samples(&view, samples + *num_read, num_samples - *num_read);
+        *num_read += decoded;
+        size_t used = 2 * decoded;
+        if (*num_read == num_samples) {
+            // The padding arrived in the same packet as the last sample.
+            size_t padding = padded_length - received - used;
+            if (used + padding > LabPro_ring_view_length(&view))
+                padding = LabPro_ring_view_length(&view) - used;
+            used += padding;
+        }
+        received += used;
         
-        unsigned char* previous_data = data;
-        data = realloc(data, 64 * numpackets); // Allocate memory for the next read.
-        if (data == NULL) {
-            data = previous_data;
-            retval = LABPRO_ERR_NO_MEM;
+        if (!LabPro_ring_consume(&labpro->rx, &view, used) && retval == LABPRO_OK)
+            retval = LABPRO_ERR_OVERRUN;
+        if (*num_read == num_samples)
             break;
+        
+        int status = LabPro_wait_for_binary(labpro, &view, "LabPro_read_binary");
+        if (status != LIBUSB_SUCCESS)
+            return status;
+    }
+    
+    return retval;
+}
+
+int LabPro_read_binary_records(LabPro* labpro, int num_channels, uint16_t* samples, uint32_t* times, size_t max_records, size_t* num_records) {
+    *num_records = 0;
+    if (!labpro->is_open)
+        return LABPRO_ERR_NOT_OPEN;
+    if (num_channels < 1 || num_channels > LABPRO_BINARY_MAX_CHANNELS)
+        return LABPRO_ERR_BAD_BINARY;
+    
+    int records_per_packet = labpro->binary_records_per_packet > 0 ? labpro->binary_records_per_packet : 1;
+    if (max_records < (size_t)records_per_packet)
+        return LABPRO_ERR_LIST_TOO_LONG;
+    size_t max_packets = max_records / records_per_packet;
+    
+    LabPro_Ring_View view;
+    LabPro_ring_peek(&labpro->rx, &view);
+    while (LabPro_ring_view_length(&view) < LABPRO_PACKET_SIZE) {
+        int status = LabPro_wait_for_binary(labpro, &view, "LabPro_read_binary_records");
+        if (status != LIBUSB_SUCCESS)
+            return status;
+        LabPro_ring_peek(&labpro->rx, &view);
+    }
+    
+    size_t num_packets = LabPro_ring_view_length(&view) / LABPRO_PACKET_SIZE;
+    if (num_packets > max_packets)
+        num_packets = max_packets;
+    
+    int retval = LABPRO_OK;
+    for (size_t i = 0; i < num_packets; ++i) {
+        size_t offset = i * LABPRO_PACKET_SIZE;
+        const unsigned char* packet;
+        unsigned char joined[LABPRO_PACKET_SIZE];
+        
+        if (offset + LABPRO_PACKET_SIZE <= view.first_length)
+            packet = view.first + offset;
+        else if (offset >= view.first_length)
+            packet = view.second + (offset - view.first_length);
+        else {
+            // Split by the end of the ring's storage.
+            size_t head = view.first_length - offset;
+            memcpy(joined, view.first + offset, head);
+            memcpy(joined + head, view.second, LABPRO_PACKET_SIZE - head);
+            packet = joined;
         }
         
-    } while (transferred == 64 && status == LIBUSB_SUCCESS);
+        // The last packet before collection stops may not be full.
+        int present = LabPro_binary_packet_records(packet, records_per_packet);
+        size_t index = *num_records;
+        int status = LabPro_binary_decode_records(packet, 1, present, num_channels, LABPRO_ADC_BITS,
+            samples + index * num_channels, times != NULL ? times + index : NULL);
+        if (status != LABPRO_OK && retval == LABPRO_OK)
+            retval = status;
+        *num_records += present;
+    }
+    
+    if (!LabPro_ring_consume(&labpro->rx, &view, num_packets * LABPRO_PACKET_SIZE) && retval == LABPRO_OK)
+        retval = LABPRO_ERR_OVERRUN;
+    return retval;
+}
+
+int LabPro_read_raw(LabPro* labpro, char** string, int* length) {
+    *length = 0;
+    
+    LabPro_Ring_View view;
+    int retval = LabPro_read_view(labpro, &view);
+    if (retval == LABPRO_ERR_NOT_OPEN)
+        return retval;
+    
+    size_t response_length = LabPro_ring_view_length(&view);
+    unsigned char* data = malloc(response_length + 1);
+    if (data == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    LabPro_ring_view_copy(&view, data);
+    data[response_length] = '\0'; // NULL-terminate so the string functions can be used on the result
+    *length = (int)response_length;
+    
+    if (LabPro_release_view(labpro, &view) != LABPRO_OK && retval == LABPRO_OK)
+        retval = LABPRO_ERR_OVERRUN;
     
     *string = (char*)data;
     
     return retval;
 }
 
+int LabPro_set_rx_buffer(LabPro* labpro, size_t capacity, enum LabPro_Overflow_Policy policy) {
+    LabPro_Ring new_rx;
+    if (LabPro_ring_init(&new_rx, capacity, policy) != LABPRO_OK)
+        return LABPRO_ERR_NO_MEM;
+    
+    LabPro_ring_free(&labpro->rx);
+    labpro->rx = new_rx;
+    labpro->rx_scan_pos = 0;
+    labpro->rx_response_end = 0;
+    return LABPRO_OK;
+}
+
 int LabPro_trim_response(char* string) {
     char* cr = strstr(string, "\r");
     if (cr == NULL)
@@ -380,47 +1029,30 @@ int LabPro_trim_response(char* string) {
 int LabPro_parse_list(char* string, int* argc_list, char ***argv_list)
 {
     *argc_list = 0;
-    if (string[0] != '{' || strstr(string, "}") == NULL)
+    *argv_list = NULL;
+    if (string[0] != '{')
+        return LABPRO_ERR_BAD_LIST;
+    
+    char* end = strchr(string, '}');
+    if (end == NULL)
         return LABPRO_ERR_BAD_LIST;
     
-    string = strstr(string, "{") + 1;
-    *argv_list = malloc(1 * sizeof(char*));
+    // Count the elements first so argv only needs one allocation.
+    int count = 1 + (int)LabPro_count_byte(string + 1, end - string - 1, ',');
+    
+    *argv_list = malloc(count * sizeof(char*));
     if (*argv_list == NULL)
         return LABPRO_ERR_NO_MEM;
     
-    int element_length;
-    bool return_after_copy = false;
-    for (int i = 0; true; ++i) {
-        if (strstr(string, ",") != NULL) {
-            element_length = (uintptr_t)strstr(string, ",") - (uintptr_t)string;
-        }
-        else {
-            if (strstr(string, "}") == NULL)
-                return LABPRO_ERR_BAD_LIST;
-            
-            element_length = (uintptr_t)strstr(string, "}") - (uintptr_t)string;
-            return_after_copy = true;
-        }
-        
-        (*argv_list)[i] = calloc((element_length + 1), sizeof(char));
-        if ((*argv_list)[i] == NULL)
-            return LABPRO_ERR_NO_MEM;
-        
-        memcpy((*argv_list)[i], string, element_length);
-        
-        if (return_after_copy) {
-            *argc_list = i + 1;
-            return LABPRO_OK;
-        }
-        
-        char** argv_new = realloc(*argv_list, (i * sizeof(char*)) + (2 * sizeof(char*)));
-        if (argv_new == NULL)
-            return LABPRO_ERR_NO_MEM;
-        else
-            *argv_list = argv_new;
-        
-        string = strstr(string, ",") + 1;
+    // Split in place: each element is terminated by overwriting the ',' or '}' after it.
+    char* element = string + 1;
+    for (int i = 0; i < count; ++i) {
+        char* delimiter = (i == count - 1) ? end : memchr(element, ',', end - element);
+        *delimiter = '\0';
+        (*argv_list)[i] = element;
+        element = delimiter + 1;
     }
+    *argc_list = count;
     return LABPRO_OK;
 }
 
@@ -444,7 +1076,52 @@ int LabPro_query_status(LabPro* labpro) {
 }
 
 
+void LabPro_set_pacing_floor(LabPro* labpro, unsigned int floor_usec) {
+    if (floor_usec > LABPRO_PACING_MAX_DELAY)
+        floor_usec = LABPRO_PACING_MAX_DELAY;
+    
+    labpro->pacer.floor_usec = floor_usec;
+    if (labpro->pacer.delay_usec < floor_usec)
+        labpro->pacer.delay_usec = floor_usec;
+}
+
+int LabPro_start_trace(LabPro* labpro, const char* path) {
+    LabPro_stop_trace(labpro);
+    
+    LabPro_Trace_Writer* trace = malloc(sizeof(LabPro_Trace_Writer));
+    if (trace == NULL)
+        return LABPRO_ERR_NO_MEM;
+    
+    int status = LabPro_trace_writer_open(trace, path);
+    if (status != LABPRO_OK) {
+        free(trace);
+        return status;
+    }
+    
+    // Taking the mutex waits for a packet being recorded on another thread.
+    pthread_mutex_lock(&labpro->trace_mutex);
+    labpro->trace = trace;
+    pthread_mutex_unlock(&labpro->trace_mutex);
+    return LABPRO_OK;
+}
+
+int LabPro_stop_trace(LabPro* labpro) {
+    pthread_mutex_lock(&labpro->trace_mutex);
+    LabPro_Trace_Writer* trace = labpro->trace;
+    labpro->trace = NULL;
+    pthread_mutex_unlock(&labpro->trace_mutex);
+    
+    if (trace == NULL)
+        return LABPRO_OK;
+    
+    int status = LabPro_trace_writer_close(trace);
+    free(trace);
+    return status;
+}
+
 void LabPro_handle_device_disconnect(LabPro* labpro) {
-    printf("[liblabpro WARN] LabPro_handle_device_disconnect(): stub\n");
-    return;
+    // Every read and write fails until the LabPro is closed or comes back, so only say so once.
+    if (!labpro->unplugged)
+        printf("[liblabpro WARN] The LabPro has been unplugged.\n");
+    labpro->unplugged = true;
 }
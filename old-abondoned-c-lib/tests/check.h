@@ -0,0 +1,66 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/** \file
+ * Checks shared by the test programs in this directory.
+ * 
+ * Each test is a program of its own that prints every failed check and
+ * exits with the number of failures, so zero means it passed. Build one
+ * from the library's directory together with core.c and the .c files of
+ * backends/labpro, with -I. -Ibackends/labpro, and link it with libusb-1.0,
+ * pthreads and libm.
+ * 
+ * None of them needs a LabPro; the ones that talk to one use simulated
+ * LabPros (see \ref LabPro-Sim), and every input is fixed, so they give the
+ * same result every run.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+static int check_failures = 0;
+
+/** \brief Count and print a failed check, without stopping the test. */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++check_failures; \
+        } \
+    } while (0)
+
+/** \brief Print the result and give the exit status for main() to return. */
+static inline int check_report(const char* test) {
+    if (check_failures == 0)
+        printf("%s: passed\n", test);
+    else
+        printf("%s: %d checks failed\n", test, check_failures);
+    return check_failures;
+}
+
+/** \brief Pseudo-random numbers from a fixed seed, the same on every platform, unlike rand(). */
+static inline uint32_t check_random(uint64_t* state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*state >> 33);
+}
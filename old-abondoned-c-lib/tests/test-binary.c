@@ -0,0 +1,141 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* The binary decoders on hand-made packets, and LabPro_read_binary_records()
+ * on a simulated LabPro collecting in binary realtime mode, including the
+ * arguments it has to refuse.
+ */
+
+#include "backends/labpro/labpro-internal.h"
+#include "tests/check.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Put a record of two 12-bit readings and a time counter into slot of a packet. */
+static void put_record(unsigned char* packet, int slot, uint16_t first, uint16_t second, uint32_t counter) {
+    unsigned char* record = packet + slot * LABPRO_BINARY_RECORD_SIZE;
+    record[0] = (unsigned char)(first >> 4);
+    record[1] = (unsigned char)(first << 4);
+    record[2] = (unsigned char)(second >> 4);
+    record[3] = (unsigned char)(second << 4);
+    record[4] = (unsigned char)(counter >> 24);
+    record[5] = (unsigned char)(counter >> 16);
+    record[6] = (unsigned char)(counter >> 8);
+    record[7] = (unsigned char)counter;
+}
+
+int main() {
+    // Left-justified words, for a LabPro and for a CBL2.
+    const unsigned char words[] = {0xFF, 0xF0, 0x00, 0x00, 0x80, 0x00, 0x12, 0x30};
+    uint16_t samples[4 * 4 * LABPRO_BINARY_MAX_CHANNELS];
+    LabPro_binary_decode_samples(words, 4, LABPRO_ADC_BITS, samples);
+    CHECK(samples[0] == 4095 && samples[1] == 0 && samples[2] == 2048 && samples[3] == 0x123);
+    LabPro_binary_decode_samples(words, 4, LABPRO_CBL2_ADC_BITS, samples);
+    CHECK(samples[0] == 1023 && samples[1] == 0 && samples[2] == 512 && samples[3] == 0x48);
+    
+    // Three records in a packet that has room for four; the record in the
+    // first slot has the time counter of zero that starts a collection.
+    unsigned char packets[2 * LABPRO_PACKET_SIZE];
+    memset(packets, 0, sizeof(packets));
+    put_record(packets, 0, 0, 0, 0);
+    put_record(packets, 1, 4095, 1, 1000);
+    put_record(packets, 2, 2048, 2, 2000);
+    put_record(packets + LABPRO_PACKET_SIZE, 0, 0, 0, 0);
+    CHECK(LabPro_binary_packet_records(packets, 4) == 3);
+    CHECK(LabPro_binary_packet_records(packets, 2) == 2);
+    CHECK(LabPro_binary_packet_records(packets + LABPRO_PACKET_SIZE, 4) == 1);
+    
+    uint32_t times[8];
+    CHECK(LabPro_binary_decode_records(packets, 1, 3, 2, LABPRO_ADC_BITS, samples, times) == LABPRO_OK);
+    CHECK(samples[2] == 4095 && samples[3] == 1 && samples[4] == 2048 && samples[5] == 2);
+    CHECK(times[0] == 0 && times[1] == 1000 && times[2] == 2000);
+    
+    // Claiming more channels than the records have turns time bytes into
+    // readings and leaves nonzero bytes where padding should be.
+    CHECK(LabPro_binary_decode_records(packets, 1, 3, 1, LABPRO_ADC_BITS, samples, NULL) == LABPRO_ERR_BAD_BINARY);
+    packets[LABPRO_PACKET_SIZE - 1] = 1;
+    CHECK(LabPro_binary_decode_records(packets, 1, 3, 2, LABPRO_ADC_BITS, samples, NULL) == LABPRO_ERR_BAD_BINARY);
+    
+    float offset;
+    float scale;
+    float volts[2];
+    CHECK(LabPro_binary_volts_scale(LABPRO_CHANOP_VOLTAGE10V, LABPRO_ADC_BITS, &offset, &scale));
+    const uint16_t readings[] = {0, 99, 2048, 99};
+    LabPro_binary_to_volts(readings, 2, 2, offset, scale, volts);
+    CHECK(volts[0] == -10.0f && volts[1] == 0.0f);
+    CHECK(LabPro_binary_volts_scale(LABPRO_CHANOP_VOLTAGE_ZERO_TO_FIVE, LABPRO_ADC_BITS, &offset, &scale));
+    CHECK(offset == 0.0f && scale == 5.0f / 4096);
+    
+    // Realtime records from a simulated LabPro, three to a packet.
+    LabPro_Context context;
+    LabPro_init(&context);
+    LabPro_Sim_Config config;
+    LabPro_sim_default_config(&config);
+    config.time_scale = 0;
+    LabPro_sim_add(&context, &config);
+    LabPro_List list = LabPro_list_labpros(&context);
+    CHECK(list.num == 1);
+    if (list.num != 1)
+        return check_report("test-binary");
+    LabPro* labpro = list.labpros[0];
+    labpro->timeout = 500;
+    
+    int transferred;
+    CHECK(LabPro_send_raw(labpro, "s{1,1,2}", &transferred) == LABPRO_OK);
+    CHECK(LabPro_send_raw(labpro, "s{1,2,14}", &transferred) == LABPRO_OK);
+    CHECK(LabPro_set_binary_mode(labpro, 3) == LABPRO_OK);
+    
+    // Refused before anything is waited for.
+    size_t num_records = 99;
+    CHECK(LabPro_read_binary_records(labpro, 0, samples, times, 8, &num_records) == LABPRO_ERR_BAD_BINARY);
+    CHECK(num_records == 0);
+    CHECK(LabPro_read_binary_records(labpro, LABPRO_BINARY_MAX_CHANNELS + 1, samples, times, 8, &num_records) == LABPRO_ERR_BAD_BINARY);
+    CHECK(LabPro_read_binary_records(labpro, 2, samples, times, 2, &num_records) == LABPRO_ERR_LIST_TOO_LONG);
+    
+    CHECK(LabPro_send_raw(labpro, "s{3,0.001,-1,0,0,0,0,0,0}", &transferred) == LABPRO_OK);
+    size_t total = 0;
+    int bad_times = 0;
+    uint32_t last = 0;
+    while (total < 300) {
+        // Room for two and a bit packets, so only two are taken at a time.
+        int status = LabPro_read_binary_records(labpro, 2, samples, times, 8, &num_records);
+        CHECK(status == LABPRO_OK);
+        if (status != LABPRO_OK)
+            break;
+        CHECK(num_records > 0 && num_records <= 6 && num_records % 3 == 0);
+        for (size_t i = 0; i < num_records; ++i) {
+            if (total + i > 0 && times[i] != last + 1000)
+                ++bad_times;
+            last = times[i];
+        }
+        total += num_records;
+    }
+    CHECK(bad_times == 0);
+    
+    LabPro_close_labpro(labpro);
+    free(labpro);
+    LabPro_free_list(&list);
+    LabPro_exit(&context);
+    return check_report("test-binary");
+}
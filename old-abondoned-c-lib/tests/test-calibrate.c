@@ -0,0 +1,122 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* Every conversion equation against values worked out by hand from the
+ * Command 4 table of the LabPro Technical Manual, and the vector paths of
+ * the polynomial against the plain C one.
+ */
+
+#include "backends/labpro/calibrate.h"
+#include "tests/check.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int equation_type;
+    float k0;
+    float k1;
+    float k2;
+    double input;
+    double expected;
+} Calibration_Case;
+
+/* The coefficients are floats in a calibration page, hence the tolerance. */
+static const Calibration_Case cases[] = {
+    // The Vernier barometer, in atmospheres.
+    {LABPRO_EQN_POLYNOMIAL, 8.729f, 8.271f, 0, 2, 25.271},
+    {LABPRO_EQN_POLYNOMIAL, 1, 2, 3, 2, 17},
+    {LABPRO_EQN_MIXED_POLYNOMIAL, 1, 2, 3, 2, 6.5},
+    {LABPRO_EQN_POWER, 2, 3, 0, 2, 16},
+    {LABPRO_EQN_MODIFIED_POWER, 2, 3, 0, 2, 18},
+    // e^2
+    {LABPRO_EQN_LOGARITHMIC, 1, 2, 0, 7.38905609893065, 5},
+    {LABPRO_EQN_MODIFIED_LOGARITHMIC, 1, 2, 0, 7.38905609893065, -3},
+    // k1 = ln 2, so this is 2 * 2^3; then ln 4, so 3 * 4^(1/2).
+    {LABPRO_EQN_EXPONENTIAL, 2, 0.6931471805599453f, 0, 3, 16},
+    {LABPRO_EQN_MODIFIED_EXPONENTIAL, 3, 1.3862943611198906f, 0, 2, 6},
+    {LABPRO_EQN_GEOMETRIC, 2, 0.5f, 0, 4, 32},
+    {LABPRO_EQN_MODIFIED_GEOMETRIC, 2, 8, 0, 4, 32},
+    // ln(0.5 * 2e^2) = 2
+    {LABPRO_EQN_RECIPROCAL_LOG, 0.5f, 0.25f, 0.5f, 14.7781121978613, 1},
+    // The Vernier stainless steel temperature probe at 20 kilohms, about 25 degrees Celsius.
+    {LABPRO_EQN_STEINHART_HART, 1.02119e-3f, 2.22468e-4f, 1.33342e-7f, 20, 298.1587983540042}
+};
+
+int main() {
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const Calibration_Case* c = &cases[i];
+        LabPro_Sensor_Calibration_Page page = {c->k0, c->k1, c->k2, ""};
+        double output = NAN;
+        CHECK(LabPro_calibrate(c->equation_type, &page, &c->input, &output, 1) == LABPRO_OK);
+        if (!(fabs(output - c->expected) <= 1e-6 * fabs(c->expected))) {
+            printf("equation type %d gave %.17g, not %.17g\n", c->equation_type, output, c->expected);
+            ++check_failures;
+        }
+    }
+    
+    // The vector kernels give the same bits as plain C, at every length, in place too.
+    size_t count = 1027;
+    double* inputs = malloc(count * sizeof(double));
+    double* plain = malloc(count * sizeof(double));
+    double* vector = malloc(count * sizeof(double));
+    uint64_t state = 16;
+    for (size_t i = 0; i < count; ++i)
+        inputs[i] = (check_random(&state) % 4096) * (10.0 / 4096) - 5;
+    
+    enum LabPro_SIMD_Level detected = LabPro_simd_detect();
+    LabPro_Sensor_Calibration_Page pages[] = {{1.5f, -2.25f, 0, ""}, {1.5f, -2.25f, 0.1f, ""}};
+    for (size_t p = 0; p < sizeof(pages) / sizeof(pages[0]); ++p) {
+        for (size_t length = 0; length <= 19; ++length) {
+            LabPro_set_simd_level(LABPRO_SIMD_NONE);
+            LabPro_calibrate(LABPRO_EQN_POLYNOMIAL, &pages[p], inputs, plain, count - length);
+            for (int level = LABPRO_SIMD_SSE42; level <= (int)detected; ++level) {
+                LabPro_set_simd_level((enum LabPro_SIMD_Level)level);
+                memcpy(vector, inputs, count * sizeof(double));
+                LabPro_calibrate(LABPRO_EQN_POLYNOMIAL, &pages[p], vector, vector, count - length);
+                CHECK(memcmp(plain, vector, (count - length) * sizeof(double)) == 0);
+            }
+        }
+    }
+    LabPro_set_simd_level(detected);
+    
+    // Unknown equations, and sensors whose active page doesn't exist.
+    CHECK(LabPro_calibrate(0, &pages[0], inputs, plain, 1) == LABPRO_ERR_BAD_EQUATION);
+    CHECK(LabPro_calibrate(13, &pages[0], inputs, plain, 1) == LABPRO_ERR_BAD_EQUATION);
+    LabPro_Analog_Sensor sensor;
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.equation_type = LABPRO_EQN_POLYNOMIAL;
+    sensor.calibrations[1] = pages[1];
+    sensor.active_cal_idx = 1;
+    CHECK(LabPro_calibrate_sensor(&sensor, inputs, vector, count) == LABPRO_OK);
+    LabPro_calibrate(LABPRO_EQN_POLYNOMIAL, &pages[1], inputs, plain, count);
+    CHECK(memcmp(plain, vector, count * sizeof(double)) == 0);
+    sensor.active_cal_idx = 3;
+    CHECK(LabPro_calibrate_sensor(&sensor, inputs, vector, 1) == LABPRO_ERR_BAD_EQUATION);
+    
+    free(inputs);
+    free(plain);
+    free(vector);
+    return check_report("test-calibrate");
+}
@@ -0,0 +1,133 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* What the capture writer puts in a file, the reader gets back exactly, both
+ * while the file is still being written and after it is closed, and a
+ * damaged chunk is caught by its checksum without losing the others.
+ */
+
+#include "backends/labpro/capture.h"
+#include "tests/check.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK_POINTS 1000
+#define FIRST_POINTS 2500
+#define MORE_POINTS 700
+
+/* Check every point of the file against what was appended: FIRST_POINTS
+ * points, then MORE_POINTS more starting over from zero.
+ */
+static void check_points(LabPro_Capture_Reader* reader) {
+    unsigned long long point = 0;
+    int mismatches = 0;
+    for (uint32_t c = 0; c < reader->num_chunks; ++c) {
+        LabPro_Capture_Chunk chunk;
+        CHECK(LabPro_capture_chunk(reader, c, &chunk) == LABPRO_OK);
+        for (uint32_t i = 0; i < chunk.num_points; ++i, ++point) {
+            double k = point < FIRST_POINTS ? point : point - FIRST_POINTS;
+            if (chunk.times[i] != k * 0.01 || chunk.values[0][i] != 2 * k || chunk.values[1][i] != -k / 3)
+                ++mismatches;
+        }
+    }
+    CHECK(point == reader->num_points);
+    CHECK(mismatches == 0);
+}
+
+int main() {
+    char path[] = "/tmp/labpro-test-capture-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return check_report("test-capture");
+    close(fd);
+    
+    LabPro_Data_Session session;
+    memset(&session, 0, sizeof(session));
+    session.channel = LABPRO_CHAN_ANALOG_1;
+    session.analog_op = LABPRO_CHANOP_VOLTAGE10V;
+    LabPro_Analog_Sensor sensor;
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.id = 2;
+    strcpy(sensor.name_long, "Voltage");
+    sensor.calibrations[0].k1 = 1.5f;
+    strcpy(sensor.calibrations[0].units, "V");
+    
+    LabPro_Capture_Channel channels[2];
+    LabPro_capture_describe_channel(&channels[0], &session, &sensor);
+    session.channel = LABPRO_CHAN_SONIC_1;
+    LabPro_capture_describe_channel(&channels[1], &session, NULL);
+    
+    double times[FIRST_POINTS];
+    double values[2 * FIRST_POINTS];
+    for (int i = 0; i < FIRST_POINTS; ++i) {
+        times[i] = i * 0.01;
+        values[2 * i] = 2.0 * i;
+        values[2 * i + 1] = -i / 3.0;
+    }
+    
+    LabPro_Capture_Writer writer;
+    CHECK(LabPro_capture_create(&writer, path, channels, 2, 0.01, CHUNK_POINTS, false) == LABPRO_OK);
+    CHECK(LabPro_capture_append(&writer, times, values, FIRST_POINTS) == LABPRO_OK);
+    
+    // Only the full chunks are in the file yet.
+    LabPro_Capture_Reader reader;
+    CHECK(LabPro_capture_open(&reader, path) == LABPRO_OK);
+    CHECK(reader.num_chunks == FIRST_POINTS / CHUNK_POINTS);
+    CHECK(reader.num_points == FIRST_POINTS / CHUNK_POINTS * CHUNK_POINTS);
+    CHECK(strcmp(reader.header->channels[0].name_long, "Voltage") == 0);
+    CHECK(reader.header->channels[0].k1 == 1.5f);
+    CHECK(strcmp(reader.header->channels[0].units, "V") == 0);
+    check_points(&reader);
+    
+    CHECK(LabPro_capture_flush(&writer) == LABPRO_OK);
+    CHECK(LabPro_capture_append(&writer, times, values, MORE_POINTS) == LABPRO_OK);
+    CHECK(LabPro_capture_close(&writer) == LABPRO_OK);
+    
+    CHECK(LabPro_capture_refresh(&reader) == LABPRO_OK);
+    CHECK(reader.num_chunks == 4);
+    CHECK(reader.num_points == FIRST_POINTS + MORE_POINTS);
+    check_points(&reader);
+    uint64_t chunk_size = reader.header->chunk_size;
+    LabPro_capture_close_reader(&reader);
+    
+    // Damage a value in the third chunk.
+    FILE* file = fopen(path, "r+b");
+    CHECK(file != NULL);
+    if (file != NULL) {
+        fseek(file, LABPRO_CAPTURE_HEADER_SIZE + 2 * chunk_size + sizeof(LabPro_Capture_Chunk_Header) + 100, SEEK_SET);
+        fputc(0x55, file);
+        fclose(file);
+    }
+    CHECK(LabPro_capture_open(&reader, path) == LABPRO_OK);
+    LabPro_Capture_Chunk chunk;
+    CHECK(LabPro_capture_chunk(&reader, 0, &chunk) == LABPRO_OK);
+    CHECK(LabPro_capture_chunk(&reader, 2, &chunk) == LABPRO_ERR_BAD_CAPTURE);
+    CHECK(LabPro_capture_chunk(&reader, 3, &chunk) == LABPRO_OK);
+    CHECK(LabPro_capture_chunk(&reader, reader.num_chunks, &chunk) == LABPRO_ERR_BAD_CAPTURE);
+    LabPro_capture_close_reader(&reader);
+    
+    unlink(path);
+    return check_report("test-capture");
+}
@@ -0,0 +1,152 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* The clock fit on made-up observations of a LabPro that runs fast and has
+ * random delays, and the merge of two simulated LabPros' realtime streams
+ * into one stream in time order.
+ */
+
+#include "backends/labpro/clocksync.h"
+#include "tests/check.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* A LabPro started at host time 100 s whose crystal runs 50 ppm fast. */
+#define TRUE_OFFSET 100.0
+#define TRUE_RATE (1 + 50e-6)
+
+/* The least delay a sample can have between being taken and being decoded. */
+#define MIN_DELAY 0.0005
+
+static double true_host_time(double device_time) {
+    return TRUE_OFFSET + TRUE_RATE * device_time;
+}
+
+/* Count and check merged samples: each stream's in order, all of them in time order. */
+static void check_merged(const LabPro_Synced_Sample* samples, size_t count, double* last_time, unsigned long long* per_source, unsigned long long* next_sequence) {
+    for (size_t i = 0; i < count; ++i) {
+        CHECK(samples[i].time >= *last_time);
+        CHECK(samples[i].source == 0 || samples[i].source == 1);
+        if (samples[i].source != 0 && samples[i].source != 1)
+            continue;
+        CHECK(samples[i].sample.sequence >= next_sequence[samples[i].source]);
+        next_sequence[samples[i].source] = samples[i].sample.sequence + 1;
+        *last_time = samples[i].time;
+        ++per_source[samples[i].source];
+    }
+}
+
+int main() {
+    // No points yet: device time zero is when the start command went out.
+    LabPro_Clock clock;
+    LabPro_clock_init(&clock, TRUE_OFFSET - 0.001);
+    CHECK(LabPro_clock_to_host(&clock, 0) == TRUE_OFFSET - 0.001);
+    CHECK(LabPro_clock_to_host(&clock, 2) == TRUE_OFFSET - 0.001 + 2);
+    
+    // Ten minutes of samples every 10 ms, each decoded at least MIN_DELAY
+    // late and often much later. The fit finds the drift, and lines up
+    // within a little of MIN_DELAY, never earlier than the start.
+    uint64_t state = 24;
+    for (int k = 0; k < 60000; ++k) {
+        double device_time = k * 0.01;
+        // Exponentially distributed; check_random() gives 31 bits.
+        double delay = MIN_DELAY - 0.002 * log((check_random(&state) + 1.0) / 2147483648.0);
+        LabPro_clock_observe(&clock, device_time, true_host_time(device_time) + delay);
+    }
+    CHECK(fabs(clock.rate - TRUE_RATE) < 1e-6);
+    CHECK(clock.offset >= clock.start_host_time);
+    CHECK(fabs(LabPro_clock_to_host(&clock, 600) - (true_host_time(600) + MIN_DELAY)) < 2e-4);
+    CHECK(clock.num_points <= LABPRO_CLOCK_MAX_POINTS);
+    
+    // The line passes under every point it kept.
+    int above = 0;
+    for (size_t i = 0; i < clock.num_points; ++i) {
+        const LabPro_Clock_Point* point = &clock.points[(clock.first_point + i) % LABPRO_CLOCK_MAX_POINTS];
+        above += LabPro_clock_to_host(&clock, point->device_time) > point->host_time + 1e-9;
+    }
+    CHECK(above == 0);
+    
+    // A rate no crystal could have is held to LABPRO_CLOCK_MAX_DRIFT.
+    LabPro_clock_init(&clock, 0);
+    for (int k = 0; k < 100; ++k)
+        LabPro_clock_observe(&clock, k, 1.5 * k);
+    CHECK(clock.rate <= 1 + LABPRO_CLOCK_MAX_DRIFT + 1e-12);
+    
+    // Two simulated LabPros sampling at different rates, merged.
+    LabPro_Context context;
+    LabPro_init(&context);
+    LabPro_Sim_Config config;
+    LabPro_sim_default_config(&config);
+    config.time_scale = 1;
+    config.jitter_usec = 300;
+    LabPro_sim_add(&context, &config);
+    LabPro_sim_add(&context, &config);
+    LabPro_List list = LabPro_list_labpros(&context);
+    CHECK(list.num == 2);
+    if (list.num != 2)
+        return check_report("test-clocksync");
+    
+    LabPro_Realtime_Stream* streams[2];
+    int transferred;
+    for (int i = 0; i < 2; ++i) {
+        CHECK(LabPro_send_raw(list.labpros[i], "s{1,1,2}", &transferred) == LABPRO_OK);
+        LabPro_Realtime_Config realtime;
+        LabPro_realtime_default_config(&realtime);
+        realtime.sample_time = i == 0 ? 0.005 : 0.008;
+        CHECK(LabPro_realtime_start(list.labpros[i], &realtime, &streams[i]) == LABPRO_OK);
+        LabPro_sleep(30);
+    }
+    
+    LabPro_Sync sync;
+    CHECK(LabPro_sync_init(&sync, streams, 2, 0, -1) == LABPRO_OK);
+    LabPro_Synced_Sample samples[256];
+    double last_time = -INFINITY;
+    unsigned long long per_source[2] = {0, 0};
+    unsigned long long next_sequence[2] = {0, 0};
+    double start = LabPro_clock_host_now();
+    while (LabPro_clock_host_now() - start < 1.5) {
+        size_t count = LabPro_sync_poll(&sync, samples, 256);
+        check_merged(samples, count, &last_time, per_source, next_sequence);
+        LabPro_sleep(5);
+    }
+    size_t count;
+    while ((count = LabPro_sync_flush(&sync, samples, 256)) > 0)
+        check_merged(samples, count, &last_time, per_source, next_sequence);
+    
+    // About 1.5 s of each, minus what was still on its way.
+    CHECK(per_source[0] > 200 && per_source[1] > 120);
+    for (int i = 0; i < 2; ++i) {
+        CHECK(sync.sources[i].clock.offset >= streams[i]->start_host_time);
+        CHECK(LabPro_realtime_stop(streams[i]) == LABPRO_OK);
+    }
+    LabPro_sync_free(&sync);
+    
+    for (int i = 0; i < 2; ++i) {
+        LabPro_close_labpro(list.labpros[i]);
+        free(list.labpros[i]);
+    }
+    LabPro_free_list(&list);
+    LabPro_exit(&context);
+    return check_report("test-clocksync");
+}
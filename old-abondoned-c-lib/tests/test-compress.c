@@ -0,0 +1,122 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* Every codec of the sample compression gives back exactly the values it
+ * was given, bit for bit, and a block that is cut short is refused rather
+ * than decoded into garbage.
+ */
+
+#include "backends/labpro/labpro-internal.h"
+#include "tests/check.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compress and decompress a block, and return its codec. */
+static int round_trip(const double* values, size_t count, double offset, double quantum) {
+    unsigned char* block = malloc(LabPro_compress_bound(count));
+    double* decoded = malloc((count > 0 ? count : 1) * sizeof(double));
+    size_t length = LabPro_compress_block(values, count, offset, quantum, block);
+    CHECK(length <= LabPro_compress_bound(count));
+    
+    size_t block_count;
+    CHECK(LabPro_compress_block_count(block, length, &block_count) == LABPRO_OK && block_count == count);
+    
+    // A block may be followed by anything, such as the next one.
+    unsigned char* padded = calloc(length + 16, 1);
+    memcpy(padded, block, length);
+    size_t decoded_count;
+    size_t used;
+    CHECK(LabPro_decompress_block(padded, length + 16, decoded, count, &decoded_count, &used) == LABPRO_OK);
+    CHECK(decoded_count == count && used == length);
+    CHECK(count == 0 || memcmp(decoded, values, count * sizeof(double)) == 0);
+    
+    for (size_t cut = 0; cut < length; cut += length / 11 + 1)
+        CHECK(LabPro_decompress_block(block, cut, decoded, count, &decoded_count, &used) == LABPRO_ERR_BAD_BLOCK);
+    if (count > 1)
+        CHECK(LabPro_decompress_block(block, length, decoded, count - 1, &decoded_count, &used) == LABPRO_ERR_LIST_TOO_LONG);
+    
+    int codec = block[0];
+    free(block);
+    free(padded);
+    free(decoded);
+    return codec;
+}
+
+int main() {
+    size_t count = LABPRO_COMPRESS_MAX_BLOCK;
+    double* values = malloc(count * sizeof(double));
+    uint64_t state = 2018;
+    
+    // A slowly wandering analog channel, in steps of the ADC's resolution.
+    double offset = -10;
+    double quantum = 20.0 / 4096;
+    int raw = 2048;
+    for (size_t i = 0; i < count; ++i) {
+        raw += (int)(check_random(&state) % 3) - 1;
+        values[i] = offset + quantum * raw;
+    }
+    CHECK(round_trip(values, count, offset, quantum) != LABPRO_CODEC_XOR);
+    
+    // An evenly spaced time column.
+    for (size_t i = 0; i < count; ++i)
+        values[i] = i * 0.01;
+    CHECK(round_trip(values, count, 0, 0.01) == LABPRO_CODEC_DELTA2);
+    
+    // One value off the grid sends the whole block to the XOR codec.
+    values[7] = 0.0700000001;
+    CHECK(round_trip(values, count, 0, 0.01) == LABPRO_CODEC_XOR);
+    
+    // Smooth values without a quantum, and the awkward doubles.
+    for (size_t i = 0; i < count; ++i)
+        values[i] = 20 + sin(i * 0.001);
+    values[100] = -0.0;
+    values[101] = INFINITY;
+    values[102] = 5e-324;
+    values[103] = NAN;
+    CHECK(round_trip(values, count, 0, 0) == LABPRO_CODEC_XOR);
+    
+    // Constant, alternating between far apart values, and random.
+    for (size_t i = 0; i < count; ++i)
+        values[i] = 21.5;
+    round_trip(values, count, 0, 0);
+    round_trip(values, count, 0, 0.5);
+    for (size_t i = 0; i < count; ++i)
+        values[i] = (i % 2) * 1e6;
+    round_trip(values, count, 0, 1);
+    for (size_t i = 0; i < count; ++i)
+        values[i] = check_random(&state) / 4294967296.0;
+    round_trip(values, count, 0, 0.5);
+    
+    // The smallest blocks.
+    round_trip(values, 1, 0, 0);
+    round_trip(values, 2, 0, 0.5);
+    round_trip(values, 0, 0, 0);
+    
+    const unsigned char garbage[] = {0xFF, 0x01};
+    size_t block_count;
+    CHECK(LabPro_compress_block_count(garbage, sizeof(garbage), &block_count) == LABPRO_ERR_BAD_BLOCK);
+    
+    free(values);
+    return check_report("test-compress");
+}
@@ -0,0 +1,148 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* The plotting summary: the buckets of a few samples worked out by hand,
+ * and for a long noisy collection, columns and picked points checked
+ * against the samples themselves.
+ */
+
+#include "backends/labpro/decimate.h"
+#include "tests/check.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define NUM_SAMPLES 300007
+#define SAMPLE_TIME 0.001
+#define PIXELS 500
+
+/* Whether a bucket summarizes exactly the samples from first to last, inclusive. */
+static bool summarizes(const LabPro_Decimate_Bucket* bucket, const double* times, const double* values, size_t first, size_t last) {
+    double min = INFINITY;
+    double max = -INFINITY;
+    for (size_t i = first; i <= last; ++i) {
+        min = fmin(min, values[i]);
+        max = fmax(max, values[i]);
+    }
+    return bucket->count == last - first + 1
+        && bucket->first_time == times[first] && bucket->first_value == values[first]
+        && bucket->last_time == times[last] && bucket->last_value == values[last]
+        && bucket->min == min && bucket->max == max;
+}
+
+/* Index of the sample taken at a time. */
+static size_t sample_at(double time) {
+    return (size_t)llround(time / SAMPLE_TIME);
+}
+
+int main() {
+    double* times = malloc(NUM_SAMPLES * sizeof(double));
+    double* values = malloc(NUM_SAMPLES * sizeof(double));
+    LabPro_Decimate_Bucket* columns = malloc(PIXELS * sizeof(LabPro_Decimate_Bucket));
+    LabPro_Plot_Point* points = malloc(PIXELS * sizeof(LabPro_Plot_Point));
+    
+    // 40 samples fill two buckets of the finest level and leave 8 in the open one.
+    LabPro_Decimator decimator;
+    LabPro_decimate_init(&decimator);
+    for (size_t i = 0; i < 40; ++i) {
+        times[i] = i;
+        values[i] = i == 20 ? -5 : (double)(i % 7);
+    }
+    CHECK(LabPro_decimate_append(&decimator, times, values, 40) == LABPRO_OK);
+    CHECK(decimator.num_samples == 40);
+    CHECK(decimator.num_buckets[0] == 2 && decimator.num_buckets[1] == 0);
+    CHECK(decimator.open_parts[0] == 8);
+    if (decimator.num_buckets[0] == 2) {
+        const LabPro_Decimate_Bucket* second = &decimator.buckets[0][1];
+        CHECK(summarizes(second, times, values, 16, 31));
+        // The 6 at sample 20 was replaced by the -5, so the max is the 6 at 27.
+        CHECK(second->min_time == 20 && second->max_time == 27);
+        CHECK(second->sum_time == (16 + 31) * 8);
+    }
+    LabPro_decimate_free(&decimator);
+    
+    // A long collection, added in uneven pieces.
+    uint64_t state = 19;
+    for (size_t i = 0; i < NUM_SAMPLES; ++i) {
+        times[i] = i * SAMPLE_TIME;
+        values[i] = sin(i * 0.0003) + (check_random(&state) % 1000) * 1e-4;
+    }
+    LabPro_decimate_init(&decimator);
+    for (size_t added = 0; added < NUM_SAMPLES; ) {
+        size_t count = 1 + check_random(&state) % 5000;
+        if (count > NUM_SAMPLES - added)
+            count = NUM_SAMPLES - added;
+        CHECK(LabPro_decimate_append(&decimator, times + added, values + added, count) == LABPRO_OK);
+        added += count;
+    }
+    CHECK(decimator.num_samples == NUM_SAMPLES);
+    
+    // Whole and partial views, and one past the last sample. The columns are
+    // runs of samples, in order, that cover the whole range.
+    const double ranges[][2] = {{0, NUM_SAMPLES * SAMPLE_TIME}, {12.3456, 45.6}, {100, 100.25}, {299, 310}};
+    for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+        double start = ranges[r][0];
+        double end = ranges[r][1];
+        size_t num_columns = LabPro_decimate_minmax(&decimator, start, end, PIXELS, columns);
+        CHECK(num_columns > 0 && num_columns <= PIXELS);
+        
+        int wrong = 0;
+        for (size_t c = 0; c < num_columns; ++c) {
+            size_t first = sample_at(columns[c].first_time);
+            size_t last = sample_at(columns[c].last_time);
+            wrong += !summarizes(&columns[c], times, values, first, last);
+            if (c > 0)
+                wrong += first != sample_at(columns[c - 1].last_time) + 1;
+        }
+        CHECK(wrong == 0);
+        CHECK(columns[0].first_time <= fmax(start, 0));
+        CHECK(columns[num_columns - 1].last_time >= fmin(end, times[NUM_SAMPLES - 1]));
+        
+        // Picked points are samples, in order, starting and ending where the columns do.
+        size_t num_points = LabPro_decimate_lttb(&decimator, start, end, PIXELS, points);
+        CHECK(num_points == num_columns);
+        wrong = 0;
+        for (size_t p = 0; p < num_points; ++p) {
+            size_t index = sample_at(points[p].time);
+            wrong += index >= NUM_SAMPLES || times[index] != points[p].time || values[index] != points[p].value;
+            if (p > 0)
+                wrong += points[p].time <= points[p - 1].time;
+        }
+        CHECK(wrong == 0);
+        CHECK(points[0].time == columns[0].first_time);
+        CHECK(points[num_points - 1].time == columns[num_columns - 1].last_time);
+    }
+    
+    // The whole collection in one column, and a view before it started.
+    CHECK(LabPro_decimate_minmax(&decimator, -1, 1e6, 1, columns) == 1);
+    CHECK(columns[0].count == NUM_SAMPLES);
+    CHECK(LabPro_decimate_minmax(&decimator, -5, -1, PIXELS, columns) == 0);
+    CHECK(LabPro_decimate_lttb(&decimator, -5, -1, PIXELS, points) == 0);
+    LabPro_decimate_free(&decimator);
+    
+    free(times);
+    free(values);
+    free(columns);
+    free(points);
+    return check_report("test-decimate");
+}
@@ -0,0 +1,130 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* Derivatives of a parabola, which every window fits exactly, the central
+ * difference of a window of 3, the vector code against the scalar code, and
+ * the streaming filter against the whole-array function.
+ */
+
+#include "backends/labpro/derivative.h"
+#include "backends/labpro/cpu.h"
+#include "tests/check.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_POINTS 1001
+
+/* Run the points through a filter, collecting its output in point order. Returns the number of points it gave. */
+static size_t stream(int window, const double* times, const double* values, size_t count, double* first, double* second) {
+    LabPro_Deriv_Filter filter;
+    LabPro_deriv_init(&filter, window);
+    size_t emitted = 0;
+    for (size_t i = 0; i < count; ++i)
+        emitted += LabPro_deriv_push(&filter, times[i], values[i], first + emitted, second + emitted);
+    return emitted + LabPro_deriv_finish(&filter, first + emitted, second + emitted);
+}
+
+static double max_difference(const double* a, const double* b, size_t count) {
+    double largest = 0;
+    for (size_t i = 0; i < count; ++i)
+        largest = fmax(largest, isnan(a[i] - b[i]) ? INFINITY : fabs(a[i] - b[i]));
+    return largest;
+}
+
+int main() {
+    double* times = malloc(NUM_POINTS * sizeof(double));
+    double* values = malloc(NUM_POINTS * sizeof(double));
+    double* first = malloc(NUM_POINTS * sizeof(double));
+    double* second = malloc(NUM_POINTS * sizeof(double));
+    double* stream_first = malloc(NUM_POINTS * sizeof(double));
+    double* stream_second = malloc(NUM_POINTS * sizeof(double));
+    double* vector_first = malloc(NUM_POINTS * sizeof(double));
+    double* vector_second = malloc(NUM_POINTS * sizeof(double));
+    
+    LabPro_Deriv_Filter filter;
+    CHECK(LabPro_deriv_init(&filter, 1) == 3);
+    CHECK(LabPro_deriv_init(&filter, 8) == 9);
+    CHECK(LabPro_deriv_init(&filter, 100) == LABPRO_DERIV_MAX_WINDOW);
+    
+    // A window of 3 on evenly spaced points is the central difference.
+    const double squares_times[] = {0, 0.5, 1, 1.5, 2};
+    const double squares[] = {0, 1, 4, 9, 16};
+    LabPro_derivatives(squares_times, squares, 5, 3, first, second);
+    CHECK(fabs(first[1] - 4) < 1e-12 && fabs(first[2] - 8) < 1e-12 && fabs(first[3] - 12) < 1e-12);
+    CHECK(fabs(second[2] - 8) < 1e-12);
+    
+    // y = 1 - 2t + 3t², evenly and unevenly spaced: y' = 6t - 2 and y'' = 6
+    // everywhere, ends included, for every window.
+    uint64_t state = 17;
+    enum LabPro_SIMD_Level detected = LabPro_simd_detect();
+    for (int uneven = 0; uneven <= 1; ++uneven) {
+        for (size_t i = 0; i < NUM_POINTS; ++i) {
+            times[i] = i * 0.01 + (uneven ? (check_random(&state) % 1000) * 4e-6 : 0);
+            values[i] = 1 - 2 * times[i] + 3 * times[i] * times[i];
+        }
+        for (int window = 3; window <= LABPRO_DERIV_MAX_WINDOW; window += 4) {
+            LabPro_set_simd_level(LABPRO_SIMD_NONE);
+            LabPro_derivatives(times, values, NUM_POINTS, window, first, second);
+            int wrong = 0;
+            for (size_t i = 0; i < NUM_POINTS; ++i)
+                wrong += fabs(first[i] - (6 * times[i] - 2)) > 1e-8 || fabs(second[i] - 6) > 1e-5;
+            CHECK(wrong == 0);
+            
+            for (int level = LABPRO_SIMD_SSE42; level <= (int)detected; ++level) {
+                LabPro_set_simd_level((enum LabPro_SIMD_Level)level);
+                LabPro_derivatives(times, values, NUM_POINTS, window, vector_first, vector_second);
+                CHECK(memcmp(first, vector_first, NUM_POINTS * sizeof(double)) == 0);
+                CHECK(memcmp(second, vector_second, NUM_POINTS * sizeof(double)) == 0);
+            }
+            LabPro_set_simd_level(detected);
+            
+            // The same fits one sample at a time.
+            CHECK(stream(window, times, values, NUM_POINTS, stream_first, stream_second) == NUM_POINTS);
+            CHECK(max_difference(first, stream_first, NUM_POINTS) < 1e-9);
+            CHECK(max_difference(second, stream_second, NUM_POINTS) < 1e-6);
+        }
+    }
+    
+    // Fewer points than the window: one point has no slope, two have no curvature.
+    for (size_t count = 0; count < 5; ++count) {
+        LabPro_derivatives(times, values, count, 7, first, second);
+        CHECK(stream(7, times, values, count, stream_first, stream_second) == count);
+        CHECK(memcmp(first, stream_first, count * sizeof(double)) == 0);
+    }
+    LabPro_derivatives(times, values, 1, 7, first, second);
+    CHECK(isnan(first[0]) && isnan(second[0]));
+    LabPro_derivatives(times, values, 2, 7, first, second);
+    CHECK(!isnan(first[0]) && second[0] == 0);
+    
+    free(times);
+    free(values);
+    free(first);
+    free(second);
+    free(stream_first);
+    free(stream_second);
+    free(vector_first);
+    free(vector_second);
+    return check_report("test-derivative");
+}
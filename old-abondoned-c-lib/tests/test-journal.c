@@ -0,0 +1,158 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* A LabPro that comes back after being unplugged is sent its journal
+ * (LabPro_reopen_usb()). That must bring its setup back without starting
+ * the collection that was running, unless the application asked for that.
+ * 
+ * The LabPro coming back is played by a second, fresh simulated LabPro that
+ * is handed the first one's journal, as LabPro_reopen_usb() does with the
+ * new device.
+ */
+
+#include "backends/labpro/labpro-internal.h"
+#include "tests/check.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Ask for the system status, as in {7}'s reply. */
+static int system_status(LabPro* labpro) {
+    int transferred;
+    if (LabPro_send_raw(labpro, "s{7}", &transferred) != LABPRO_OK)
+        return -1;
+    
+    char* response;
+    int length;
+    int status = LabPro_read_raw(labpro, &response, &length);
+    double values[17];
+    int num_values = 0;
+    if (status == LABPRO_OK)
+        status = LabPro_parse_list_doubles(response, length, values, 17, &num_values);
+    free(response);
+    return status == LABPRO_OK && num_values > 13 ? (int)values[13] : -1;
+}
+
+/* Whether the journal holds exactly these commands, oldest first. */
+static bool journal_is(const LabPro_Journal* journal, const char* const* commands, size_t num_commands) {
+    if (journal->num_entries != num_commands)
+        return false;
+    for (size_t i = 0; i < num_commands; ++i) {
+        if (strcmp(journal->entries[i].command, commands[i]) != 0)
+            return false;
+    }
+    return true;
+}
+
+int main() {
+    LabPro_Context context;
+    LabPro_init(&context);
+    
+    LabPro_Sim_Config config;
+    LabPro_sim_default_config(&config);
+    config.time_scale = 0.001;
+    LabPro_sim_add(&context, &config);
+    LabPro_sim_add(&context, &config);
+    
+    LabPro_List list = LabPro_list_labpros(&context);
+    CHECK(list.num == 2);
+    if (list.num != 2)
+        return check_report("test-journal");
+    LabPro* before = list.labpros[0];
+    LabPro* after = list.labpros[1];
+    before->timeout = 200;
+    after->timeout = 200;
+    
+    // Set up two channels and start a realtime collection, as the realtime streams do.
+    int transferred;
+    CHECK(LabPro_send_raw(before, "s{1,1,1}", &transferred) == LABPRO_OK);
+    CHECK(LabPro_send_raw(before, "s{1,2,1}", &transferred) == LABPRO_OK);
+    CHECK(LabPro_send_raw(before, "s{7}", &transferred) == LABPRO_OK);
+    CHECK(LabPro_send_raw(before, "s{3,0.01,-1,0,0,0,0,0,1}", &transferred) == LABPRO_OK);
+    CHECK(LabPro_send_raw(before, "s{1,1,14}", &transferred) == LABPRO_OK);
+    
+    // The channel setups are kept, the later one of channel 1 in place of the
+    // earlier; the query and the collection are not.
+    CHECK(before->journal.num_entries == 2);
+    for (size_t i = 0; i < before->journal.num_entries; ++i)
+        CHECK(before->journal.entries[i].number == LABPRO_CHANNEL_SETUP);
+    if (before->journal.num_entries == 2) {
+        CHECK(strcmp(before->journal.entries[0].command, "s{1,2,1}") == 0);
+        CHECK(strcmp(before->journal.entries[1].command, "s{1,1,14}") == 0);
+    }
+    CHECK(before->journal.collection != NULL && strcmp(before->journal.collection, "s{3,0.01,-1,0,0,0,0,0,1}") == 0);
+    
+    // The LabPro comes back.
+    LabPro_journal_free(&after->journal);
+    after->journal = before->journal;
+    LabPro_journal_init(&before->journal);
+    CHECK(LabPro_replay_journal(after) == LABPRO_OK);
+    CHECK(after->journal.num_entries == 2);
+    
+    // Nothing arrives unasked, and the LabPro isn't collecting.
+    LabPro_sleep(20);
+    char* response;
+    int length;
+    LabPro_read_raw(after, &response, &length);
+    CHECK(length == 0);
+    free(response);
+    CHECK(system_status(after) == LABPRO_SYSSTATUS_IDLE);
+    CHECK(!after->is_collecting_data);
+    
+    // Asked to, the LabPro picks up a stored collection that was running when it was lost.
+    CHECK(LabPro_journal_record(&after->journal, "s{3,0.01,100,0,0,0,0,0,0}\r") == LABPRO_OK);
+    after->resume_collection = true;
+    after->collecting_when_lost = true;
+    CHECK(LabPro_replay_journal(after) == LABPRO_OK);
+    CHECK(after->is_collecting_data);
+    CHECK(!after->collecting_when_lost);
+    CHECK(system_status(after) != LABPRO_SYSSTATUS_IDLE);
+    CHECK(LabPro_send_raw(after, "s{6,0}", &transferred) == LABPRO_OK);
+    after->is_collecting_data = false;
+    
+    // Command 5 only picks what the next Get returns.
+    LabPro_Journal journal;
+    LabPro_journal_init(&journal);
+    CHECK(LabPro_journal_record(&journal, "s{1,1,1}\r") == LABPRO_OK);
+    CHECK(LabPro_journal_record(&journal, "s{5,1,0,1,100}\r") == LABPRO_OK);
+    const char* const after_data_ctl[] = {"s{1,1,1}"};
+    CHECK(journal_is(&journal, after_data_ctl, 1));
+    
+    // Command 6 is kept per setting, so stopping a realtime stream doesn't
+    // lose its filter, and the stop itself isn't kept.
+    CHECK(LabPro_journal_record(&journal, "s{6,5,3}\r") == LABPRO_OK);
+    CHECK(LabPro_journal_record(&journal, "s{6,6,1}\r") == LABPRO_OK);
+    CHECK(LabPro_journal_record(&journal, "s{6,0}\r") == LABPRO_OK);
+    CHECK(LabPro_journal_record(&journal, "s{6,2}\r") == LABPRO_OK);
+    CHECK(LabPro_journal_record(&journal, "s{6,5,4}\r") == LABPRO_OK);
+    const char* const after_sys_setup[] = {"s{1,1,1}", "s{6,6,1}", "s{6,5,4}"};
+    CHECK(journal_is(&journal, after_sys_setup, 3));
+    LabPro_journal_free(&journal);
+    
+    LabPro_close_labpro(before);
+    LabPro_close_labpro(after);
+    free(before);
+    free(after);
+    LabPro_free_list(&list);
+    LabPro_exit(&context);
+    return check_report("test-journal");
+}
@@ -0,0 +1,243 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* The list decoders: the console's !test-list-parser path, the streaming
+ * decoder against the whole-list one on a simulated LabPro's data, and the
+ * vectorized decoders at every SIMD level the CPU has against the scalar
+ * one, with the streaming decoder fed in fragments of every awkward size.
+ */
+
+#include "backends/labpro/labpro-internal.h"
+#include "backends/labpro/streamparse.h"
+#include "tests/check.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ELEMENTS 20000
+
+/* Elements as the LabPro sends them, "+1.23450E+00", with now and then one
+ * in a free format that the vectorized decoders have to hand back.
+ */
+static size_t make_list(char* list, double* expected, uint64_t seed) {
+    uint64_t state = seed;
+    char* position = list;
+    *position++ = '{';
+    for (int i = 0; i < NUM_ELEMENTS; ++i) {
+        char* element = position;
+        if (i % 501 == 250)
+            position += sprintf(position, " %d.%d ", (int)(check_random(&state) % 2000) - 1000, (int)(check_random(&state) % 100));
+        else {
+            int significand = (int)(check_random(&state) % 1000000);
+            int exponent = (int)(check_random(&state) % 31) - 15;
+            position += sprintf(position, "%c%d.%05dE%c%02d", check_random(&state) % 2 ? '+' : '-',
+                significand / 100000, significand % 100000, exponent < 0 ? '-' : '+', abs(exponent));
+        }
+        expected[i] = strtod(element, NULL);
+        *position++ = ',';
+    }
+    position[-1] = '}';
+    *position++ = '\r';
+    return (size_t)(position - list);
+}
+
+/* The same parsing the console does for !test-list-parser. */
+static void check_console_path() {
+    char list[] = "{ +1.00000E+00,-2.50000E-01, 3 ,+6.01120E+00}";
+    double values[4];
+    int num_values;
+    
+    CHECK(LabPro_list_length(list, strlen(list)) == 4);
+    CHECK(LabPro_parse_list_doubles(list, strlen(list), values, 4, &num_values) == LABPRO_OK);
+    CHECK(num_values == 4);
+    CHECK(values[0] == 1.0 && values[1] == -0.25 && values[2] == 3.0 && values[3] == 6.0112);
+    
+    int argc_list;
+    char** argv_list;
+    CHECK(LabPro_parse_list(list, &argc_list, &argv_list) == LABPRO_OK);
+    CHECK(argc_list == 4);
+    if (argc_list == 4) {
+        CHECK(strcmp(argv_list[1], "-2.50000E-01") == 0);
+        CHECK(strcmp(argv_list[2], " 3 ") == 0);
+    }
+    if (argc_list > 0)
+        free(argv_list);
+    
+    const char* empty = "{}\r";
+    CHECK(LabPro_list_length(empty, strlen(empty)) == 0);
+    CHECK(LabPro_parse_list_doubles(empty, strlen(empty), values, 4, &num_values) == LABPRO_OK && num_values == 0);
+    
+    const char* bad = "{+1.00000E+00,-2.50000E-01,+x.00000E+00,+1.00000E+00}";
+    CHECK(LabPro_parse_list_doubles(bad, strlen(bad), values, 4, &num_values) == LABPRO_ERR_BAD_LIST);
+    const char* too_long = "{1,2,3,4,5}";
+    CHECK(LabPro_parse_list_doubles(too_long, strlen(too_long), values, 4, &num_values) == LABPRO_ERR_LIST_TOO_LONG);
+}
+
+typedef struct {
+    double* values;
+    int num_values;
+    int num_lists;
+    int status;
+} Stream_Result;
+
+static void on_values(void* user_data, int first_index, const double* values, int count) {
+    Stream_Result* result = user_data;
+    for (int i = 0; i < count; ++i) {
+        if (first_index + i < NUM_ELEMENTS)
+            result->values[first_index + i] = values[i];
+    }
+    result->num_values += count;
+}
+
+static void on_list_end(void* user_data, int num_values, int status) {
+    Stream_Result* result = user_data;
+    (void)num_values;
+    ++result->num_lists;
+    result->status = status;
+}
+
+static void check_level(enum LabPro_SIMD_Level level, const char* list, size_t length, const double* expected, const double* scalar) {
+    double* values = malloc(NUM_ELEMENTS * sizeof(double));
+    float* floats = malloc(NUM_ELEMENTS * sizeof(float));
+    int num_values;
+    
+    CHECK(LabPro_set_simd_level(level) == level);
+    CHECK(LabPro_list_length(list, length) == NUM_ELEMENTS);
+    CHECK(LabPro_count_byte(list, length, ',') == NUM_ELEMENTS - 1);
+    
+    CHECK(LabPro_parse_list_doubles(list, length, values, NUM_ELEMENTS, &num_values) == LABPRO_OK);
+    CHECK(num_values == NUM_ELEMENTS);
+    CHECK(memcmp(values, scalar, NUM_ELEMENTS * sizeof(double)) == 0);
+    CHECK(memcmp(values, expected, NUM_ELEMENTS * sizeof(double)) == 0);
+    
+    CHECK(LabPro_parse_list_floats(list, length, floats, NUM_ELEMENTS, &num_values) == LABPRO_OK);
+    int float_mismatches = 0;
+    for (int i = 0; i < num_values; ++i) {
+        if (floats[i] != (float)expected[i])
+            ++float_mismatches;
+    }
+    CHECK(float_mismatches == 0);
+    
+    CHECK(LabPro_parse_list_doubles(list, length, values, NUM_ELEMENTS - 1, &num_values) == LABPRO_ERR_LIST_TOO_LONG);
+    
+    // Fragments that split numbers everywhere, from single bytes up to more than a packet.
+    static const size_t fragment_sizes[] = {1, 7, 13, 63, 64, 65, 1000};
+    for (size_t f = 0; f < sizeof(fragment_sizes) / sizeof(fragment_sizes[0]); ++f) {
+        Stream_Result result = {values, 0, 0, -1};
+        memset(values, 0, NUM_ELEMENTS * sizeof(double));
+        LabPro_Stream_Parser parser;
+        LabPro_stream_parser_init(&parser, on_values, on_list_end, &result);
+        
+        size_t offset = 0;
+        bool list_ended = false;
+        while (offset < length && !list_ended) {
+            size_t fragment = length - offset < fragment_sizes[f] ? length - offset : fragment_sizes[f];
+            offset += LabPro_stream_parser_feed(&parser, list + offset, fragment, &list_ended);
+        }
+        CHECK(list_ended && offset == length);
+        CHECK(result.num_lists == 1 && result.status == LABPRO_OK);
+        CHECK(result.num_values == NUM_ELEMENTS);
+        CHECK(memcmp(values, scalar, NUM_ELEMENTS * sizeof(double)) == 0);
+    }
+    
+    free(values);
+    free(floats);
+}
+
+/* The same non-realtime collection from two simulated LabPros with the same
+ * seed, one decoded packet by packet as it arrives, the other read whole and
+ * then decoded.
+ */
+static void check_sim_collection() {
+    LabPro_Context context;
+    LabPro_init(&context);
+    LabPro_Sim_Config config;
+    LabPro_sim_default_config(&config);
+    config.time_scale = 0;
+    LabPro_sim_add(&context, &config);
+    LabPro_sim_add(&context, &config);
+    
+    LabPro_List list = LabPro_list_labpros(&context);
+    CHECK(list.num == 2);
+    if (list.num != 2)
+        return;
+    
+    for (int i = 0; i < 2; ++i) {
+        int transferred;
+        list.labpros[i]->timeout = 500;
+        CHECK(LabPro_send_raw(list.labpros[i], "s{1,1,1}", &transferred) == LABPRO_OK);
+        CHECK(LabPro_send_raw(list.labpros[i], "s{3,0.001,2000}", &transferred) == LABPRO_OK);
+        CHECK(LabPro_send_raw(list.labpros[i], "g", &transferred) == LABPRO_OK);
+    }
+    
+    double* streamed = calloc(NUM_ELEMENTS, sizeof(double));
+    Stream_Result result = {streamed, 0, 0, -1};
+    LabPro_Stream_Parser parser;
+    LabPro_stream_parser_init(&parser, on_values, on_list_end, &result);
+    CHECK(LabPro_read_parsed(list.labpros[0], &parser) == LABPRO_OK);
+    CHECK(result.num_lists == 1 && result.num_values == 2000);
+    
+    double* whole = malloc(NUM_ELEMENTS * sizeof(double));
+    char* response;
+    int length;
+    int num_values = 0;
+    CHECK(LabPro_read_raw(list.labpros[1], &response, &length) == LABPRO_OK);
+    CHECK(LabPro_parse_list_doubles(response, length, whole, NUM_ELEMENTS, &num_values) == LABPRO_OK);
+    CHECK(num_values == 2000);
+    CHECK(memcmp(streamed, whole, 2000 * sizeof(double)) == 0);
+    free(response);
+    
+    free(streamed);
+    free(whole);
+    for (int i = 0; i < 2; ++i) {
+        LabPro_close_labpro(list.labpros[i]);
+        free(list.labpros[i]);
+    }
+    LabPro_free_list(&list);
+    LabPro_exit(&context);
+}
+
+int main() {
+    check_console_path();
+    check_sim_collection();
+    
+    char* list = malloc(NUM_ELEMENTS * 16 + 16);
+    double* expected = malloc(NUM_ELEMENTS * sizeof(double));
+    double* scalar = malloc(NUM_ELEMENTS * sizeof(double));
+    size_t length = make_list(list, expected, 12345);
+    
+    enum LabPro_SIMD_Level detected = LabPro_simd_detect();
+    int num_values;
+    LabPro_set_simd_level(LABPRO_SIMD_NONE);
+    CHECK(LabPro_parse_list_doubles(list, length, scalar, NUM_ELEMENTS, &num_values) == LABPRO_OK);
+    
+    for (int level = LABPRO_SIMD_NONE; level <= (int)detected; ++level)
+        check_level((enum LabPro_SIMD_Level)level, list, length, expected, scalar);
+    if (detected == LABPRO_SIMD_NONE)
+        printf("test-list-parser: no SIMD on this CPU; only the scalar decoder was checked.\n");
+    
+    LabPro_set_simd_level(detected);
+    free(list);
+    free(expected);
+    free(scalar);
+    return check_report("test-list-parser");
+}
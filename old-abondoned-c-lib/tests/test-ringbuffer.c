@@ -0,0 +1,142 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* The receive ring: views split where it wraps around, both overflow
+ * policies, and a writer thread against a reader thread that must see every
+ * byte once and in order.
+ */
+
+#include "backends/labpro/ringbuffer.h"
+#include "backends/labpro/labpro-internal.h"
+#include "tests/check.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define NUM_BYTES 4000000
+
+/* Byte i of the threaded run. 251 is prime, so the pattern never lines up with the ring. */
+static unsigned char stream_byte(size_t i) {
+    return (unsigned char)(i % 251);
+}
+
+static void* write_stream(void* data) {
+    LabPro_Ring* ring = data;
+    uint64_t state = 7;
+    unsigned char chunk[64];
+    size_t written = 0;
+    while (written < NUM_BYTES) {
+        size_t length = 1 + check_random(&state) % 64;
+        if (length > NUM_BYTES - written)
+            length = NUM_BYTES - written;
+        for (size_t i = 0; i < length; ++i)
+            chunk[i] = stream_byte(written + i);
+        size_t stored = LabPro_ring_write(ring, chunk, length);
+        written += stored;
+        if (stored < length)
+            sched_yield();
+    }
+    return NULL;
+}
+
+int main() {
+    LabPro_Ring ring;
+    LabPro_Ring_View view;
+    unsigned char bytes[128];
+    unsigned char copy[128];
+    for (int i = 0; i < 128; ++i)
+        bytes[i] = (unsigned char)i;
+    
+    // The capacity is rounded up to a power of two.
+    CHECK(LabPro_ring_init(&ring, 100, LABPRO_OVERFLOW_DROP_NEWEST) == LABPRO_OK);
+    CHECK(ring.capacity == 128);
+    LabPro_ring_peek(&ring, &view);
+    CHECK(LabPro_ring_view_length(&view) == 0);
+    
+    // Wrapping around splits a view in two; searching, copying and truncating see one run.
+    CHECK(LabPro_ring_write(&ring, bytes, 100) == 100);
+    LabPro_ring_peek(&ring, &view);
+    CHECK(LabPro_ring_consume(&ring, &view, 90));
+    CHECK(LabPro_ring_write(&ring, bytes, 60) == 60);
+    CHECK(LabPro_ring_available(&ring) == 70);
+    CHECK(LabPro_ring_total_written(&ring) == 160);
+    LabPro_ring_peek(&ring, &view);
+    CHECK(view.first_length == 38 && view.second_length == 32);
+    CHECK(view.first[0] == 90 && view.second[0] == 28);
+    CHECK(LabPro_ring_view_find(&view, 0, 95) == 5);
+    CHECK(LabPro_ring_view_find(&view, 0, 30) == 40);
+    CHECK(LabPro_ring_view_find(&view, 41, 30) == -1);
+    LabPro_ring_view_copy(&view, copy);
+    CHECK(memcmp(copy, bytes + 90, 10) == 0 && memcmp(copy + 10, bytes, 60) == 0);
+    LabPro_ring_view_truncate(&view, 40);
+    CHECK(view.first_length == 38 && view.second_length == 2);
+    CHECK(LabPro_ring_consume(&ring, &view, 40));
+    CHECK(LabPro_ring_available(&ring) == 30);
+    
+    // Dropping the newest keeps what's there and counts what didn't fit.
+    CHECK(LabPro_ring_write(&ring, bytes, 128) == 98);
+    CHECK(LabPro_ring_available(&ring) == 128);
+    CHECK(ring.overflows == 1 && ring.bytes_dropped == 30);
+    LabPro_ring_free(&ring);
+    
+    // Dropping the oldest overwrites them, and a view of them is no longer good.
+    CHECK(LabPro_ring_init(&ring, 64, LABPRO_OVERFLOW_DROP_OLDEST) == LABPRO_OK);
+    CHECK(LabPro_ring_write(&ring, bytes, 50) == 50);
+    LabPro_ring_peek(&ring, &view);
+    CHECK(LabPro_ring_write(&ring, bytes + 50, 30) == 30);
+    CHECK(ring.overflows == 1 && ring.bytes_dropped == 16);
+    CHECK(!LabPro_ring_consume(&ring, &view, 10));
+    LabPro_ring_peek(&ring, &view);
+    CHECK(LabPro_ring_view_length(&view) == 64);
+    LabPro_ring_view_copy(&view, copy);
+    CHECK(memcmp(copy, bytes + 16, 64) == 0);
+    LabPro_ring_free(&ring);
+    
+    // A writer thread against this one as the reader, through a small ring.
+    CHECK(LabPro_ring_init(&ring, 256, LABPRO_OVERFLOW_DROP_NEWEST) == LABPRO_OK);
+    pthread_t writer;
+    CHECK(pthread_create(&writer, NULL, write_stream, &ring) == 0);
+    size_t read = 0;
+    int wrong = 0;
+    while (read < NUM_BYTES) {
+        LabPro_ring_peek(&ring, &view);
+        size_t length = LabPro_ring_view_length(&view);
+        if (length == 0) {
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < view.first_length; ++i)
+            wrong += view.first[i] != stream_byte(read + i);
+        for (size_t i = 0; i < view.second_length; ++i)
+            wrong += view.second[i] != stream_byte(read + view.first_length + i);
+        CHECK(LabPro_ring_consume(&ring, &view, length));
+        read += length;
+    }
+    pthread_join(writer, NULL);
+    CHECK(wrong == 0);
+    CHECK(read == NUM_BYTES && LabPro_ring_available(&ring) == 0);
+    LabPro_ring_free(&ring);
+    
+    return check_report("test-ringbuffer");
+}
@@ -0,0 +1,124 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* Rolling statistics against the same figures worked out from the whole
+ * window every sample, for several window lengths, and after a jump that
+ * leaves the sliding update with far more rounding error than the figures.
+ */
+
+#include "backends/labpro/rolling.h"
+#include "tests/check.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* The figures for the window ending at values[last], worked out directly. */
+static void window_figures(const double* values, size_t last, size_t window, LabPro_Rolling_Snapshot* expected) {
+    size_t first = last + 1 > window ? last + 1 - window : 0;
+    size_t count = last + 1 - first;
+    double sum = 0;
+    double square_sum = 0;
+    expected->min = values[first];
+    expected->max = values[first];
+    for (size_t i = first; i <= last; ++i) {
+        sum += values[i];
+        square_sum += values[i] * values[i];
+        expected->min = fmin(expected->min, values[i]);
+        expected->max = fmax(expected->max, values[i]);
+    }
+    expected->count = count;
+    expected->total = last + 1;
+    expected->mean = sum / count;
+    double m2 = 0;
+    for (size_t i = first; i <= last; ++i)
+        m2 += (values[i] - expected->mean) * (values[i] - expected->mean);
+    expected->variance = count > 1 ? m2 / (count - 1) : 0;
+    expected->rms = sqrt(square_sum / count);
+}
+
+static bool close_to(double value, double expected, double tolerance) {
+    return fabs(value - expected) <= tolerance * fmax(1, fabs(expected));
+}
+
+/* Push values one at a time, comparing every snapshot from sample start on. Returns the number of mismatches. */
+static int run(const double* values, size_t num_values, size_t window, size_t start, double tolerance) {
+    LabPro_Rolling_Stats stats;
+    if (LabPro_rolling_init(&stats, window) != LABPRO_OK)
+        return 1;
+    
+    int mismatches = 0;
+    for (size_t i = 0; i < num_values; ++i) {
+        LabPro_rolling_push(&stats, values[i]);
+        if (i < start)
+            continue;
+        LabPro_Rolling_Snapshot snapshot;
+        LabPro_Rolling_Snapshot expected;
+        LabPro_rolling_snapshot(&stats, &snapshot);
+        window_figures(values, i, window, &expected);
+        bool same = snapshot.count == expected.count && snapshot.total == expected.total
+            && snapshot.min == expected.min && snapshot.max == expected.max
+            && close_to(snapshot.mean, expected.mean, tolerance)
+            && close_to(snapshot.variance, expected.variance, tolerance)
+            && close_to(snapshot.rms, expected.rms, tolerance);
+        if (!same)
+            ++mismatches;
+    }
+    LabPro_rolling_free(&stats);
+    return mismatches;
+}
+
+int main() {
+    enum { NUM_VALUES = 5000 };
+    double* values = malloc(NUM_VALUES * sizeof(double));
+    uint64_t state = 1;
+    
+    // A noisy sine, with ties for the min and max queues.
+    for (size_t i = 0; i < NUM_VALUES; ++i)
+        values[i] = floor(100 * sin(i * 0.05)) + check_random(&state) % 8;
+    const size_t windows[] = {1, 2, 7, 64, 1000};
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); ++w)
+        CHECK(run(values, NUM_VALUES, windows[w], 0, 1e-9) == 0);
+    
+    // Small readings after huge ones. Sliding the huge ones out leaves the
+    // running sums with errors far bigger than the readings' variance; the
+    // figures must be right again within a window of the jump.
+    for (size_t i = 0; i < NUM_VALUES; ++i)
+        values[i] = i < 1000 ? 1e9 + check_random(&state) % 1000 : (check_random(&state) % 1000) * 1e-3;
+    CHECK(run(values, NUM_VALUES, 16, 1000 + 2 * 16, 1e-9) == 0);
+    
+    // Before a window is full, the figures are those of the samples so far.
+    LabPro_Rolling_Stats stats;
+    LabPro_Rolling_Snapshot snapshot;
+    CHECK(LabPro_rolling_init(&stats, 4) == LABPRO_OK);
+    LabPro_rolling_snapshot(&stats, &snapshot);
+    CHECK(snapshot.count == 0 && isnan(snapshot.min) && isnan(snapshot.max));
+    LabPro_rolling_push(&stats, 3);
+    LabPro_rolling_push(&stats, 5);
+    LabPro_rolling_snapshot(&stats, &snapshot);
+    CHECK(snapshot.count == 2 && snapshot.mean == 4 && snapshot.variance == 2);
+    CHECK(snapshot.min == 3 && snapshot.max == 5 && close_to(snapshot.rms, sqrt(17), 1e-15));
+    LabPro_rolling_free(&stats);
+    
+    free(values);
+    return check_report("test-rolling");
+}
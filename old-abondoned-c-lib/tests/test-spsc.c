@@ -0,0 +1,102 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* The single-producer single-consumer queue keeps its elements in order,
+ * refuses them when full, and loses or repeats none of them when the two
+ * sides run on different threads.
+ */
+
+#include "backends/labpro/spsc.h"
+#include "backends/labpro/labpro-internal.h"
+#include "tests/check.h"
+#include <pthread.h>
+#include <sched.h>
+
+#define NUM_ELEMENTS 1000000
+
+static void* produce(void* data) {
+    LabPro_SPSC_Queue* queue = data;
+    for (uint64_t i = 0; i < NUM_ELEMENTS; ++i) {
+        while (!LabPro_spsc_push(queue, &i))
+            sched_yield();
+    }
+    return NULL;
+}
+
+int main() {
+    LabPro_SPSC_Queue queue;
+    uint64_t element;
+    uint64_t batch[64];
+    
+    // The capacity is rounded up to a power of two, and no element fits beyond it.
+    CHECK(LabPro_spsc_init(&queue, sizeof(uint64_t), 100) == LABPRO_OK);
+    CHECK(queue.capacity == 128);
+    CHECK(LabPro_spsc_pop(&queue, batch, 64) == 0);
+    for (element = 0; element < 128; ++element)
+        CHECK(LabPro_spsc_push(&queue, &element));
+    CHECK(!LabPro_spsc_push(&queue, &element));
+    CHECK(LabPro_spsc_size(&queue) == 128);
+    
+    // Oldest first, across the end of the storage.
+    uint64_t expected = 0;
+    for (int round = 0; round < 10; ++round) {
+        size_t popped = LabPro_spsc_pop(&queue, batch, 50);
+        CHECK(popped == 50);
+        for (size_t i = 0; i < popped; ++i)
+            CHECK(batch[i] == expected++);
+        for (int i = 0; i < 50; ++i, ++element)
+            CHECK(LabPro_spsc_push(&queue, &element));
+    }
+    CHECK(LabPro_spsc_size(&queue) == 128);
+    size_t popped;
+    while ((popped = LabPro_spsc_pop(&queue, batch, 64)) > 0) {
+        for (size_t i = 0; i < popped; ++i)
+            CHECK(batch[i] == expected++);
+    }
+    CHECK(expected == element);
+    LabPro_spsc_free(&queue);
+    
+    // A producer thread against this one as the consumer, through a small queue.
+    CHECK(LabPro_spsc_init(&queue, sizeof(uint64_t), 256) == LABPRO_OK);
+    pthread_t producer;
+    CHECK(pthread_create(&producer, NULL, produce, &queue) == 0);
+    expected = 0;
+    int out_of_order = 0;
+    while (expected < NUM_ELEMENTS) {
+        popped = LabPro_spsc_pop(&queue, batch, 64);
+        if (popped == 0)
+            sched_yield();
+        for (size_t i = 0; i < popped; ++i) {
+            if (batch[i] != expected)
+                ++out_of_order;
+            expected = batch[i] + 1;
+        }
+    }
+    pthread_join(producer, NULL);
+    CHECK(out_of_order == 0);
+    CHECK(LabPro_spsc_pop(&queue, batch, 64) == 0);
+    CHECK(queue.high_water <= queue.capacity);
+    LabPro_spsc_free(&queue);
+    
+    return check_report("test-spsc");
+}
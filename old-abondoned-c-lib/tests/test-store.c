@@ -0,0 +1,134 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+
+/* The sample store across chunk boundaries: appending whole and interleaved
+ * points, spans and copies, derived columns, finding times, and refusing
+ * what it can't store without changing anything.
+ */
+
+#include "backends/labpro/store.h"
+#include "tests/check.h"
+#include <stdlib.h>
+
+/* Point i of the test data: taken every millisecond, with a value that tells channel and point apart. */
+static double point_time(size_t i) {
+    return i * 0.001;
+}
+
+static double point_value(int channel, size_t i) {
+    return channel * 1e6 + i;
+}
+
+int main() {
+    enum { NUM_POINTS = 2 * LABPRO_STORE_CHUNK_POINTS + 100 };
+    double* times = malloc(NUM_POINTS * sizeof(double));
+    double* values = malloc(NUM_POINTS * 2 * sizeof(double));
+    double* out = malloc(NUM_POINTS * sizeof(double));
+    for (size_t i = 0; i < NUM_POINTS; ++i) {
+        times[i] = point_time(i);
+        values[2 * i] = point_value(LABPRO_CHAN_ANALOG_1, i);
+        values[2 * i + 1] = point_value(LABPRO_CHAN_SONIC_1, i);
+    }
+    
+    LabPro_Store store;
+    LabPro_store_init(&store);
+    
+    // Interleaved rows, in pieces that end partway into chunks.
+    const enum LabPro_Channels channels[] = {LABPRO_CHAN_ANALOG_1, LABPRO_CHAN_SONIC_1};
+    size_t appended = 0;
+    const size_t pieces[] = {1, 4094, 3, LABPRO_STORE_CHUNK_POINTS, NUM_POINTS};
+    for (size_t p = 0; appended < NUM_POINTS; ++p) {
+        size_t count = pieces[p] < NUM_POINTS - appended ? pieces[p] : NUM_POINTS - appended;
+        CHECK(LabPro_store_append_interleaved(&store, channels, 2, times + appended, values + 2 * appended, count) == LABPRO_OK);
+        appended += count;
+    }
+    CHECK(LabPro_store_count(&store, LABPRO_CHAN_ANALOG_1) == NUM_POINTS);
+    CHECK(LabPro_store_count(&store, LABPRO_CHAN_SONIC_1) == NUM_POINTS);
+    CHECK(LabPro_store_count(&store, LABPRO_CHAN_ANALOG_2) == 0);
+    
+    // Spans end at chunk boundaries and together cover every point.
+    int wrong = 0;
+    size_t num_spans = 0;
+    for (size_t i = 0; i < NUM_POINTS; ) {
+        const double* span;
+        size_t n = LabPro_store_span(&store, LABPRO_CHAN_SONIC_1, LABPRO_STORE_VALUE, i, &span);
+        CHECK(n > 0 && n <= LABPRO_STORE_CHUNK_POINTS);
+        if (n == 0)
+            break;
+        for (size_t j = 0; j < n; ++j)
+            wrong += span[j] != point_value(LABPRO_CHAN_SONIC_1, i + j);
+        i += n;
+        ++num_spans;
+    }
+    CHECK(wrong == 0);
+    CHECK(num_spans == 3);
+    const double* span;
+    CHECK(LabPro_store_span(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_TIME, LABPRO_STORE_CHUNK_POINTS - 2, &span) == 2);
+    CHECK(LabPro_store_span(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_TIME, NUM_POINTS, &span) == 0 && span == NULL);
+    
+    // Copies across a boundary, and up to the last point only.
+    CHECK(LabPro_store_read(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_VALUE, 4000, 200, out) == 200);
+    wrong = 0;
+    for (size_t j = 0; j < 200; ++j)
+        wrong += out[j] != point_value(LABPRO_CHAN_ANALOG_1, 4000 + j);
+    CHECK(wrong == 0);
+    CHECK(LabPro_store_read(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_TIME, NUM_POINTS - 5, 10, out) == 5);
+    CHECK(out[4] == point_time(NUM_POINTS - 1));
+    
+    // A derived column written only in its second chunk reads as zeros elsewhere.
+    const double derived[] = {1.5, 2.5, 3.5};
+    CHECK(LabPro_store_set_derived(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_DERIVED_1, LABPRO_STORE_CHUNK_POINTS - 1, derived, 3) == LABPRO_OK);
+    CHECK(LabPro_store_read(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_DERIVED_1, LABPRO_STORE_CHUNK_POINTS - 2, 5, out) == 5);
+    CHECK(out[0] == 0 && out[1] == 1.5 && out[2] == 2.5 && out[3] == 3.5 && out[4] == 0);
+    CHECK(LabPro_store_span(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_DERIVED_2, 0, &span) == 0);
+    CHECK(LabPro_store_set_derived(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_VALUE, 0, derived, 1) == LABPRO_ERR_BAD_CHANNEL);
+    CHECK(LabPro_store_set_derived(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_DERIVED_2, NUM_POINTS - 1, derived, 2) == LABPRO_ERR_BAD_CHANNEL);
+    
+    // Times are found by bisection.
+    CHECK(LabPro_store_find_time(&store, LABPRO_CHAN_ANALOG_1, -1) == 0);
+    CHECK(LabPro_store_find_time(&store, LABPRO_CHAN_ANALOG_1, point_time(5000)) == 5000);
+    CHECK(LabPro_store_find_time(&store, LABPRO_CHAN_ANALOG_1, point_time(5000) + 0.0005) == 5001);
+    CHECK(LabPro_store_find_time(&store, LABPRO_CHAN_ANALOG_1, 1e9) == NUM_POINTS);
+    
+    // Channels that can't be stored change nothing, not even the good channels of the same call.
+    const enum LabPro_Channels bad_channels[] = {LABPRO_CHAN_ANALOG_1, LABPRO_CHAN_DIGITAL_OUT_1};
+    CHECK(LabPro_store_append_interleaved(&store, bad_channels, 2, times, values, 1) == LABPRO_ERR_BAD_CHANNEL);
+    CHECK(LabPro_store_append(&store, LABPRO_CHAN_ALL, times, values, 1) == LABPRO_ERR_BAD_CHANNEL);
+    CHECK(LabPro_store_count(&store, LABPRO_CHAN_ANALOG_1) == NUM_POINTS);
+    
+    // Clearing keeps the chunks, so appending again reuses them.
+    double* first_chunk = store.channels[0].chunks[LABPRO_STORE_VALUE][0];
+    LabPro_store_clear(&store);
+    CHECK(LabPro_store_count(&store, LABPRO_CHAN_ANALOG_1) == 0);
+    CHECK(LabPro_store_append(&store, LABPRO_CHAN_ANALOG_1, times, values, 10) == LABPRO_OK);
+    CHECK(store.channels[0].chunks[LABPRO_STORE_VALUE][0] == first_chunk);
+    CHECK(LabPro_store_read(&store, LABPRO_CHAN_ANALOG_1, LABPRO_STORE_DERIVED_1, 0, 10, out) == 10);
+    CHECK(out[9] == 0);
+    
+    LabPro_store_free(&store);
+    free(times);
+    free(values);
+    free(out);
+    return check_report("test-store");
+}
@@ -0,0 +1,122 @@
+/* liblabpro, a C library for using Vernier LabPro devices.
+ * Based on the original FreeLab Ruby implementation by Ben Crowell.
+ *
+ * * www.lightandmatter.com/freelab
+ * * liblabpro.sf.net
+ * 
+ * Copyright (C) 2018 Matthew Trescott <matthewtrescott@gmail.com>
+ * 
+ * liblabpro is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * liblabpro is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with liblabpro.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/* The work pool runs every job once and delivers each lane's jobs in the
+ * order they were submitted, whatever order the workers finish them in and
+ * however many workers there are.
+ */
+
+#include "backends/labpro/workpool.h"
+#include "tests/check.h"
+#include <stdlib.h>
+
+#define NUM_LANES 16
+#define JOBS_PER_LANE 200
+
+typedef struct {
+    int lane;
+    int index;
+    unsigned long long result;
+} Job;
+
+typedef struct {
+    int next_index;
+    int out_of_order;
+    int wrong_results;
+} Lane_Record;
+
+static Lane_Record records[NUM_LANES];
+
+/* Jobs take very different times, so later ones often finish first. */
+static void process(void* data) {
+    Job* job = data;
+    unsigned long long result = job->index;
+    int rounds = (job->index * 7919 + job->lane * 104729) % 5000;
+    for (int i = 0; i < rounds; ++i)
+        result = result * 6364136223846793005ULL + 1442695040888963407ULL;
+    for (int i = 0; i < rounds; ++i)
+        result = (result - 1442695040888963407ULL) * 13877824140714322085ULL; // Undoes the above.
+    job->result = result;
+}
+
+/* Deliveries of a lane never overlap, so the records need no lock. */
+static void deliver(void* data) {
+    Job* job = data;
+    Lane_Record* record = &records[job->lane];
+    if (job->index != record->next_index)
+        ++record->out_of_order;
+    if (job->result != (unsigned long long)job->index)
+        ++record->wrong_results;
+    record->next_index = job->index + 1;
+    free(job);
+}
+
+static void run(int num_workers, size_t window) {
+    for (int i = 0; i < NUM_LANES; ++i) {
+        records[i].next_index = 0;
+        records[i].out_of_order = 0;
+        records[i].wrong_results = 0;
+    }
+    
+    LabPro_Work_Pool* pool;
+    CHECK(LabPro_work_pool_start(num_workers, &pool) == LABPRO_OK);
+    LabPro_Work_Lane lanes[NUM_LANES];
+    for (int i = 0; i < NUM_LANES; ++i)
+        CHECK(LabPro_work_lane_init(pool, &lanes[i], window) == LABPRO_OK);
+    
+    for (int index = 0; index < JOBS_PER_LANE; ++index) {
+        for (int lane = 0; lane < NUM_LANES; ++lane) {
+            Job* job = malloc(sizeof(Job));
+            job->lane = lane;
+            job->index = index;
+            int status;
+            while ((status = LabPro_work_submit(&lanes[lane], process, deliver, job)) == LABPRO_ERR_BUSY)
+                LabPro_work_lane_drain(&lanes[lane]);
+            CHECK(status == LABPRO_OK);
+        }
+    }
+    for (int i = 0; i < NUM_LANES; ++i)
+        LabPro_work_lane_free(&lanes[i]);
+    
+    LabPro_Work_Pool_Stats stats;
+    LabPro_work_pool_stats(pool, &stats);
+    CHECK(stats.executed == NUM_LANES * JOBS_PER_LANE);
+    CHECK(stats.queued == 0);
+    CHECK(stats.stolen <= stats.executed);
+    LabPro_work_pool_stop(pool);
+    
+    for (int i = 0; i < NUM_LANES; ++i) {
+        CHECK(records[i].next_index == JOBS_PER_LANE);
+        CHECK(records[i].out_of_order == 0);
+        CHECK(records[i].wrong_results == 0);
+    }
+}
+
+int main() {
+    run(1, 0);
+    run(2, 0);
+    run(4, 0);
+    run(4, 3);
+    run(0, 0);
+    return check_report("test-workpool");
+}